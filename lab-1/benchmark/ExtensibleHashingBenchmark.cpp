@@ -1,9 +1,14 @@
 #include "ehash/ExtensibleHashing.hpp"
+#include "ehash/LinearHashing.hpp"
+#include "AddressBook.pb.h"
 #include "TestMessage.pb.h"
+#include <algorithm>
 #include <benchmark/benchmark.h>
+#include <chrono>
 #include <filesystem>
 #include <memory>
 #include <random>
+#include <sstream>
 
 namespace ehash {
 using namespace ehash::proto;
@@ -18,10 +23,39 @@ std::unique_ptr<TestMessage> createTestMessage(int id) {
     return message;
 }
 
+// Report the table's stats as counters, so that a change in splits, writes or latency shows up next to the time
+void reportTableStats(benchmark::State& state, const TableStats& stats) {
+    state.counters["splits"] = stats.splits;
+    state.counters["doublings"] = stats.directoryDoublings;
+    state.counters["merges"] = stats.merges;
+    state.counters["overflowPages"] = stats.overflowPagesAdded;
+    state.counters["bytesWritten"] = stats.bytesWritten;
+    state.counters["filesOpened"] = stats.filesOpened;
+    state.counters["fillFactor"] = stats.meanFillFactor;
+    state.counters["maxOverflowDepth"] = stats.overflowDepth.empty() ? 0 : stats.overflowDepth.size() - 1;
+    const std::pair<const char*, const LatencyHistogram*> latencies[] = {
+        {"insert", &stats.insertLatency},
+        {"batchInsert", &stats.batchInsertLatency},
+        {"lookup", &stats.lookupLatency},
+        {"remove", &stats.removeLatency},
+    };
+    for (const auto& [name, histogram] : latencies) {
+        if (histogram->count != 0) {
+            state.counters[std::string(name) + "P50Nanos"] = histogram->quantileNanos(0.5);
+            state.counters[std::string(name) + "P99Nanos"] = histogram->quantileNanos(0.99);
+        }
+    }
+}
+
 // Fixture for setting up and tearing down the benchmark environment
 class ExtensibleHashingBenchmark : public benchmark::Fixture {
   protected:
     void SetUp(const ::benchmark::State& state) override {
+        // Multi-threaded benchmarks share one table; the other threads wait for it at the start of the loop
+        if (state.thread_index() != 0) {
+            return;
+        }
+
         // Ensure the benchmark directory is clean
         if (std::filesystem::exists(BENCHMARK_DIR)) {
             std::filesystem::remove_all(BENCHMARK_DIR);
@@ -46,6 +80,15 @@ class ExtensibleHashingBenchmark : public benchmark::Fixture {
     }
 
     void TearDown(const ::benchmark::State& state) override {
+        if (state.thread_index() != 0) {
+            return;
+        }
+
+        // Close the table before its files go away, and start the next run from scratch
+        hashTable.reset();
+        entries.clear();
+        serializedKeys.clear();
+
         // Clean up the benchmark directory after tests
         if (std::filesystem::exists(BENCHMARK_DIR)) {
             std::filesystem::remove_all(BENCHMARK_DIR);
@@ -70,6 +113,7 @@ BENCHMARK_DEFINE_F(ExtensibleHashingBenchmark, AddEntries)(benchmark::State& sta
         }
     }
     state.SetItemsProcessed(static_cast<int64_t>(state.iterations()) * totalEntries);
+    reportTableStats(state, hashTable->stats());
 }
 
 // Register the benchmark with different bucket sizes and entry counts
@@ -79,6 +123,55 @@ BENCHMARK_REGISTER_F(ExtensibleHashingBenchmark, AddEntries)
     ->Args({16384, 10000})  // Bucket size: 16KB, Entries: 10,000
     ->Unit(benchmark::kMillisecond);
 
+// Benchmark: Adding the same entries as one batch
+BENCHMARK_DEFINE_F(ExtensibleHashingBenchmark, AddEntriesBatch)(benchmark::State& state) {
+    for (auto _ : state) {
+        std::vector<std::unique_ptr<TestMessage>> batch;
+        batch.reserve(totalEntries);
+        for (auto& entry : entries) {
+            batch.push_back(createTestMessage(entry->id()));
+        }
+        hashTable->addEntries(std::move(batch));
+    }
+    state.SetItemsProcessed(static_cast<int64_t>(state.iterations()) * totalEntries);
+    reportTableStats(state, hashTable->stats());
+}
+
+BENCHMARK_REGISTER_F(ExtensibleHashingBenchmark, AddEntriesBatch)
+    ->Args({4096, 1000})
+    ->Args({8192, 5000})
+    ->Args({16384, 10000})
+    ->Unit(benchmark::kMillisecond);
+
+// Benchmark: Building a table from a stream of the same entries as length-delimited records, written bucket by
+// bucket at the final depth instead of grown by splits
+BENCHMARK_DEFINE_F(ExtensibleHashingBenchmark, BulkLoad)(benchmark::State& state) {
+    std::ostringstream snapshot;
+    for (const auto& key : serializedKeys) {
+        writeDelimitedRecord(snapshot, key);
+    }
+    hashTable.reset();
+
+    for (auto _ : state) {
+        state.PauseTiming();
+        std::filesystem::remove_all(BENCHMARK_DIR);
+        std::filesystem::create_directory(BENCHMARK_DIR);
+        std::istringstream records(snapshot.str());
+        state.ResumeTiming();
+
+        auto loaded = ExtensibleHashing<TestMessage>::bulkLoad(BENCHMARK_DIR, bucketSize, records);
+        benchmark::DoNotOptimize(loaded->bucketCount());
+    }
+    state.SetItemsProcessed(static_cast<int64_t>(state.iterations()) * totalEntries);
+}
+
+BENCHMARK_REGISTER_F(ExtensibleHashingBenchmark, BulkLoad)
+    ->Args({4096, 1000})
+    ->Args({8192, 5000})
+    ->Args({16384, 10000})
+    ->Args({4096, 20000})   // As GrowTable, which starts from an empty table every time
+    ->Unit(benchmark::kMillisecond);
+
 // Benchmark: Retrieving entries from the hash table
 BENCHMARK_DEFINE_F(ExtensibleHashingBenchmark, RetrieveEntries)(benchmark::State& state) {
     // First, add all entries to the hash table
@@ -94,6 +187,7 @@ BENCHMARK_DEFINE_F(ExtensibleHashingBenchmark, RetrieveEntries)(benchmark::State
         }
     }
     state.SetItemsProcessed(static_cast<int64_t>(state.iterations()) * totalEntries);
+    reportTableStats(state, hashTable->stats());
 }
 
 BENCHMARK_REGISTER_F(ExtensibleHashingBenchmark, RetrieveEntries)
@@ -102,6 +196,134 @@ BENCHMARK_REGISTER_F(ExtensibleHashingBenchmark, RetrieveEntries)
     ->Args({16384, 10000})
     ->Unit(benchmark::kMillisecond);
 
+// Benchmark: Reopening a table and loading every bucket, which parses each bucket's entries into one arena,
+// then dropping them all with the table
+BENCHMARK_DEFINE_F(ExtensibleHashingBenchmark, LoadBuckets)(benchmark::State& state) {
+    for (auto& entry : entries) {
+        hashTable->addEntry(createTestMessage(entry->id()));
+    }
+    hashTable.reset();
+
+    for (auto _ : state) {
+        auto reopened = ExtensibleHashing<TestMessage>::open(BENCHMARK_DIR);
+        for (size_t i = 0; i < totalEntries; ++i) {
+            benchmark::DoNotOptimize(reopened->getEntry(reopened->hashKey(serializedKeys[i])));
+        }
+    }
+    state.SetItemsProcessed(static_cast<int64_t>(state.iterations()) * totalEntries);
+}
+
+BENCHMARK_REGISTER_F(ExtensibleHashingBenchmark, LoadBuckets)
+    ->Args({4096, 1000})
+    ->Args({8192, 5000})
+    ->Args({16384, 10000})
+    ->Unit(benchmark::kMillisecond);
+
+// Benchmark: Reopening a segment-file table and scanning every entry, reading the given number of buckets ahead
+BENCHMARK_DEFINE_F(ExtensibleHashingBenchmark, ScanTable)(benchmark::State& state) {
+    hashTable.reset();
+    std::filesystem::remove_all(BENCHMARK_DIR);
+    std::filesystem::create_directory(BENCHMARK_DIR);
+    Options options;
+    options.storageMode = StorageMode::Segment;
+    hashTable =
+        std::make_unique<ExtensibleHashing<TestMessage>>(BENCHMARK_DIR, bucketSize, initialGlobalDepth, options);
+    for (auto& entry : entries) {
+        hashTable->addEntry(createTestMessage(entry->id()));
+    }
+    hashTable.reset();
+
+    for (auto _ : state) {
+        auto reopened = ExtensibleHashing<TestMessage>::open(BENCHMARK_DIR);
+        auto scan = reopened->scan(state.range(2));
+        while (const auto* bucketEntries = scan.next()) {
+            for (const auto& entry : *bucketEntries) {
+                benchmark::DoNotOptimize(entry->id());
+            }
+        }
+    }
+    state.SetItemsProcessed(static_cast<int64_t>(state.iterations()) * totalEntries);
+}
+
+BENCHMARK_REGISTER_F(ExtensibleHashingBenchmark, ScanTable)
+    ->Args({16384, 20000, 1})
+    ->Args({16384, 20000, 16})
+    ->Unit(benchmark::kMillisecond);
+
+// Benchmark: Reopening a table and looking up one entry in 50, with buckets that parse all records when they
+// load (0) or only the ones used (1)
+BENCHMARK_DEFINE_F(ExtensibleHashingBenchmark, SparseLookupsAfterOpen)(benchmark::State& state) {
+    for (auto& entry : entries) {
+        hashTable->addEntry(createTestMessage(entry->id()));
+    }
+    hashTable.reset();
+
+    Options options;
+    options.lazyEntries = state.range(2) != 0;
+    for (auto _ : state) {
+        auto reopened = ExtensibleHashing<TestMessage>::open(BENCHMARK_DIR, options);
+        for (size_t i = 0; i < totalEntries; i += 50) {
+            benchmark::DoNotOptimize(reopened->get(serializedKeys[i]));
+        }
+    }
+    state.SetItemsProcessed(static_cast<int64_t>(state.iterations()) * (totalEntries / 50));
+}
+
+BENCHMARK_REGISTER_F(ExtensibleHashingBenchmark, SparseLookupsAfterOpen)
+    ->Args({16384, 10000, 0})
+    ->Args({16384, 10000, 1})
+    ->Args({65536, 20000, 0})
+    ->Args({65536, 20000, 1})
+    ->Unit(benchmark::kMillisecond);
+
+// Benchmark: Threads adding their own share of the entries to one table
+BENCHMARK_DEFINE_F(ExtensibleHashingBenchmark, AddEntriesConcurrent)(benchmark::State& state) {
+    int64_t share = state.range(1) / state.threads();
+    int64_t first = state.thread_index() * share;
+    for (auto _ : state) {
+        for (int64_t id = first; id < first + share; ++id) {
+            hashTable->addEntry(createTestMessage(id));
+        }
+    }
+    state.SetItemsProcessed(static_cast<int64_t>(state.iterations()) * share);
+    if (state.thread_index() == 0) {
+        reportTableStats(state, hashTable->stats());
+    }
+}
+
+BENCHMARK_REGISTER_F(ExtensibleHashingBenchmark, AddEntriesConcurrent)
+    ->Args({8192, 20000})
+    ->ThreadRange(1, 8)
+    ->UseRealTime()
+    ->Unit(benchmark::kMillisecond);
+
+// Benchmark: Threads looking up their own share of the entries in one table
+BENCHMARK_DEFINE_F(ExtensibleHashingBenchmark, RetrieveEntriesConcurrent)(benchmark::State& state) {
+    if (state.thread_index() == 0) {
+        for (auto& entry : entries) {
+            hashTable->addEntry(createTestMessage(entry->id()));
+        }
+    }
+
+    int64_t share = state.range(1) / state.threads();
+    int64_t first = state.thread_index() * share;
+    for (auto _ : state) {
+        for (int64_t i = first; i < first + share; ++i) {
+            hashTable->getEntry(hashTable->hashKey(serializedKeys[i]));
+        }
+    }
+    state.SetItemsProcessed(static_cast<int64_t>(state.iterations()) * share);
+    if (state.thread_index() == 0) {
+        reportTableStats(state, hashTable->stats());
+    }
+}
+
+BENCHMARK_REGISTER_F(ExtensibleHashingBenchmark, RetrieveEntriesConcurrent)
+    ->Args({8192, 20000})
+    ->ThreadRange(1, 8)
+    ->UseRealTime()
+    ->Unit(benchmark::kMillisecond);
+
 // Benchmark: Updating entries in the hash table
 BENCHMARK_DEFINE_F(ExtensibleHashingBenchmark, UpdateEntries)(benchmark::State& state) {
     // First, add all entries to the hash table
@@ -118,6 +340,7 @@ BENCHMARK_DEFINE_F(ExtensibleHashingBenchmark, UpdateEntries)(benchmark::State&
         }
     }
     state.SetItemsProcessed(static_cast<int64_t>(state.iterations()) * totalEntries);
+    reportTableStats(state, hashTable->stats());
 }
 
 BENCHMARK_REGISTER_F(ExtensibleHashingBenchmark, UpdateEntries)
@@ -139,6 +362,7 @@ BENCHMARK_DEFINE_F(ExtensibleHashingBenchmark, HandleBucketSplits)(benchmark::St
         }
     }
     state.SetItemsProcessed(static_cast<int64_t>(state.iterations()) * totalEntries);
+    reportTableStats(state, hashTable->stats());
 }
 
 BENCHMARK_REGISTER_F(ExtensibleHashingBenchmark, HandleBucketSplits)
@@ -146,6 +370,185 @@ BENCHMARK_REGISTER_F(ExtensibleHashingBenchmark, HandleBucketSplits)
     ->Args({2048, 5000})    // Bucket size: 2KB, Entries: 5,000
     ->Unit(benchmark::kMillisecond);
 
+// Benchmark: Inserts, lookups, batch updates and removals on a table that records their latencies, exported as
+// percentile counters. Only this benchmark turns latency recording on, so the clock reads it costs stay out of
+// the times of the others
+BENCHMARK_DEFINE_F(ExtensibleHashingBenchmark, OperationLatencies)(benchmark::State& state) {
+    Options options;
+    options.recordLatencies = true;
+    hashTable.reset();
+    std::filesystem::remove_all(BENCHMARK_DIR);
+    std::filesystem::create_directory(BENCHMARK_DIR);
+    hashTable =
+        std::make_unique<ExtensibleHashing<TestMessage>>(BENCHMARK_DIR, bucketSize, initialGlobalDepth, options);
+
+    for (auto _ : state) {
+        for (auto& entry : entries) {
+            hashTable->addEntry(createTestMessage(entry->id()));
+        }
+        for (size_t i = 0; i < totalEntries; ++i) {
+            hashTable->getEntry(hashTable->hashKey(serializedKeys[i]));
+        }
+        std::vector<std::unique_ptr<TestMessage>> batch;
+        batch.reserve(totalEntries);
+        for (auto& entry : entries) {
+            batch.push_back(createTestMessage(entry->id()));
+        }
+        hashTable->addEntries(std::move(batch));
+        for (size_t i = 0; i < totalEntries; ++i) {
+            hashTable->removeEntry(serializedKeys[i]);
+        }
+    }
+    state.SetItemsProcessed(static_cast<int64_t>(state.iterations()) * totalEntries);
+    reportTableStats(state, hashTable->stats());
+}
+
+BENCHMARK_REGISTER_F(ExtensibleHashingBenchmark, OperationLatencies)
+    ->Args({8192, 5000})
+    ->Unit(benchmark::kMillisecond);
+
+// Benchmark: Growing an ExtensibleHashing or a LinearHashing table from two buckets, timing every insert.
+// Extendible hashing splits the full bucket and doubles the directory when it runs out of depth; linear
+// hashing splits the bucket at its split pointer and chains overflow pages until that reaches the full one.
+// maxInsertMicros is the slowest insert of the last run, where the most expensive split landed
+template <typename Table> void GrowTable(benchmark::State& state) {
+    size_t bucketSize = state.range(0);
+    size_t totalEntries = state.range(1);
+
+    double maxInsertMicros = 0;
+    size_t buckets = 0;
+    size_t overflowPages = 0;
+    for (auto _ : state) {
+        state.PauseTiming();
+        std::filesystem::remove_all(BENCHMARK_DIR);
+        std::filesystem::create_directory(BENCHMARK_DIR);
+        auto hashTable = std::make_unique<Table>(BENCHMARK_DIR, bucketSize, 1);
+        state.ResumeTiming();
+
+        maxInsertMicros = 0;
+        for (size_t i = 0; i < totalEntries; ++i) {
+            auto start = std::chrono::steady_clock::now();
+            hashTable->addEntry(createTestMessage(i));
+            std::chrono::duration<double, std::micro> elapsed = std::chrono::steady_clock::now() - start;
+            maxInsertMicros = std::max(maxInsertMicros, elapsed.count());
+        }
+
+        state.PauseTiming();
+        buckets = hashTable->bucketCount();
+        overflowPages = hashTable->overflowStats().overflowPages;
+        hashTable.reset();
+        state.ResumeTiming();
+    }
+    std::filesystem::remove_all(BENCHMARK_DIR);
+
+    state.SetItemsProcessed(static_cast<int64_t>(state.iterations()) * totalEntries);
+    state.counters["maxInsertMicros"] = maxInsertMicros;
+    state.counters["buckets"] = buckets;
+    state.counters["overflowPages"] = overflowPages;
+}
+
+BENCHMARK_TEMPLATE(GrowTable, ExtensibleHashing<TestMessage>)
+    ->Args({4096, 20000})
+    ->Args({8192, 50000})
+    ->Unit(benchmark::kMillisecond);
+BENCHMARK_TEMPLATE(GrowTable, LinearHashing<TestMessage>)
+    ->Args({4096, 20000})
+    ->Args({8192, 50000})
+    ->Unit(benchmark::kMillisecond);
+
+// Benchmark: Looking up every entry of a table grown from two buckets, ExtensibleHashing or LinearHashing
+template <typename Table> void LookupGrownTable(benchmark::State& state) {
+    size_t bucketSize = state.range(0);
+    size_t totalEntries = state.range(1);
+    std::filesystem::remove_all(BENCHMARK_DIR);
+    std::filesystem::create_directory(BENCHMARK_DIR);
+    {
+        Table hashTable(BENCHMARK_DIR, bucketSize, 1);
+        std::vector<std::string> keys;
+        for (size_t i = 0; i < totalEntries; ++i) {
+            auto entry = createTestMessage(i);
+            keys.push_back(entry->SerializeAsString());
+            hashTable.addEntry(std::move(entry));
+        }
+
+        for (auto _ : state) {
+            for (const auto& key : keys) {
+                benchmark::DoNotOptimize(hashTable.get(key));
+            }
+        }
+    }
+    std::filesystem::remove_all(BENCHMARK_DIR);
+    state.SetItemsProcessed(static_cast<int64_t>(state.iterations()) * totalEntries);
+}
+
+BENCHMARK_TEMPLATE(LookupGrownTable, ExtensibleHashing<TestMessage>)
+    ->Args({4096, 20000})
+    ->Unit(benchmark::kMillisecond);
+BENCHMARK_TEMPLATE(LookupGrownTable, LinearHashing<TestMessage>)
+    ->Args({4096, 20000})
+    ->Unit(benchmark::kMillisecond);
+
+// Benchmark: Writing a table of Person entries, whose email domains and phone types repeat, with raw (0) or
+// LZ-compressed (1) pages, then reopening it and loading every bucket. Reports the bytes written per page
+// byte and the time the codec took per page
+void PersonPages(benchmark::State& state) {
+    using PersonTable = ExtensibleHashing<Person, FieldKey<Person, &Person::id>>;
+    Options options;
+    options.pageCompression = state.range(0) == 0 ? PageCompression::None : PageCompression::Lz;
+    size_t totalEntries = state.range(1);
+
+    std::vector<std::unique_ptr<Person>> people;
+    for (size_t i = 0; i < totalEntries; ++i) {
+        auto person = std::make_unique<Person>();
+        person->set_id(i);
+        person->set_name("person " + std::to_string(i));
+        person->set_email("person" + std::to_string(i) + "@example.com");
+        for (int phone = 0; phone < 2; ++phone) {
+            auto* number = person->add_phone();
+            number->set_number("+7 900 " + std::to_string(1000000 + i * 2 + phone));
+            number->set_type(phone == 0 ? Person::MOBILE : Person::WORK);
+        }
+        people.push_back(std::move(person));
+    }
+
+    CompressionStats written;
+    CompressionStats read;
+    BufferPoolStats pool;
+    for (auto _ : state) {
+        state.PauseTiming();
+        std::filesystem::remove_all(BENCHMARK_DIR);
+        std::filesystem::create_directory(BENCHMARK_DIR);
+        state.ResumeTiming();
+
+        {
+            PersonTable hashTable(BENCHMARK_DIR, 4096, 1, options);
+            for (const auto& person : people) {
+                hashTable.addEntry(std::make_unique<Person>(*person));
+            }
+            hashTable.flush();
+            written = hashTable.compressionStats();
+            pool = hashTable.bufferPoolStats();
+        }
+        auto reopened = PersonTable::open(BENCHMARK_DIR, options);
+        for (size_t i = 0; i < totalEntries; ++i) {
+            benchmark::DoNotOptimize(reopened->get(i));
+        }
+        read = reopened->compressionStats();
+    }
+    std::filesystem::remove_all(BENCHMARK_DIR);
+
+    state.SetItemsProcessed(static_cast<int64_t>(state.iterations()) * totalEntries);
+    // Raw pages write every page byte; compressed ones write what the codec stored
+    state.counters["bytesWrittenPerPageByte"] = written.pagesWritten == 0 ? 1.0 : 1.0 / written.ratio();
+    state.counters["pageBytesWritten"] = written.pagesWritten == 0 ? pool.bytesWritten : written.bytesStored;
+    state.counters["compressNanosPerPage"] =
+        written.pagesWritten == 0 ? 0.0 : static_cast<double>(written.compressNanos) / written.pagesWritten;
+    state.counters["decompressNanosPerPage"] =
+        read.pagesRead == 0 ? 0.0 : static_cast<double>(read.decompressNanos) / read.pagesRead;
+}
+
+BENCHMARK(PersonPages)->Args({0, 20000})->Args({1, 20000})->Unit(benchmark::kMillisecond);
+
 // Main function to run the benchmarks
 
 } // namespace ehash
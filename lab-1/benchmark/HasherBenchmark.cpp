@@ -0,0 +1,128 @@
+#include "ehash/ExtensibleHashing.hpp"
+#include "ehash/Hasher.hpp"
+#include "AddressBook.pb.h"
+#include "TestMessage.pb.h"
+#include <algorithm>
+#include <benchmark/benchmark.h>
+#include <filesystem>
+#include <memory>
+
+namespace ehash {
+using namespace ehash::proto;
+
+// Temporary benchmark directory for buckets
+const std::string HASHER_BENCHMARK_DIR = "hasher_benchmark_buckets";
+
+// TestMessages keyed by their whole serialized bytes, with consecutive ids
+struct TestMessageWorkload {
+    using Entry = TestMessage;
+    using KeyExtractor = SerializedKey<TestMessage>;
+
+    static std::unique_ptr<TestMessage> create(int i) {
+        auto message = std::make_unique<TestMessage>();
+        message->set_id(i);
+        return message;
+    }
+};
+
+// Persons keyed by their id, with ids 1024 apart as handed out by a sharded id allocator: every id has the
+// same low ten bits
+struct PersonWorkload {
+    using Entry = Person;
+    using KeyExtractor = FieldKey<Person, &Person::id>;
+
+    static std::unique_ptr<Person> create(int i) {
+        auto person = std::make_unique<Person>();
+        person->set_id(i * 1024);
+        person->set_name("person");
+        return person;
+    }
+};
+
+// Benchmark: Hashing the keys of a workload
+template <typename Workload, typename Hasher> void HashKeys(benchmark::State& state) {
+    typename Workload::KeyExtractor extractKey;
+    std::vector<typename Workload::KeyExtractor::KeyType> keys;
+    for (int i = 0; i < state.range(0); ++i) {
+        keys.push_back(extractKey(*Workload::create(i)));
+    }
+
+    for (auto _ : state) {
+        for (const auto& key : keys) {
+            benchmark::DoNotOptimize(Hasher{}(key));
+        }
+    }
+    state.SetItemsProcessed(static_cast<int64_t>(state.iterations()) * keys.size());
+}
+
+BENCHMARK_TEMPLATE(HashKeys, TestMessageWorkload, StdHasher)->Arg(10000);
+BENCHMARK_TEMPLATE(HashKeys, TestMessageWorkload, WyHasher)->Arg(10000);
+BENCHMARK_TEMPLATE(HashKeys, TestMessageWorkload, Xxh64Hasher)->Arg(10000);
+BENCHMARK_TEMPLATE(HashKeys, PersonWorkload, StdHasher)->Arg(10000);
+BENCHMARK_TEMPLATE(HashKeys, PersonWorkload, WyHasher)->Arg(10000);
+BENCHMARK_TEMPLATE(HashKeys, PersonWorkload, Xxh64Hasher)->Arg(10000);
+
+// Benchmark: Filling a table with a workload, reporting how evenly the entries ended up spread over buckets.
+// A hash that leaves low bits unmixed needs a deeper directory for the same number of buckets, and leaves
+// some buckets nearly empty while others overflow
+template <typename Workload, typename Hasher> void FillTable(benchmark::State& state) {
+    using Table = ExtensibleHashing<typename Workload::Entry, typename Workload::KeyExtractor, Hasher>;
+    size_t bucketSize = state.range(0);
+    size_t totalEntries = state.range(1);
+
+    size_t buckets = 0;
+    size_t globalDepth = 0;
+    OverflowStats overflow;
+    for (auto _ : state) {
+        state.PauseTiming();
+        std::filesystem::remove_all(HASHER_BENCHMARK_DIR);
+        std::filesystem::create_directory(HASHER_BENCHMARK_DIR);
+        auto hashTable = std::make_unique<Table>(HASHER_BENCHMARK_DIR, bucketSize, 1);
+        state.ResumeTiming();
+
+        for (size_t i = 0; i < totalEntries; ++i) {
+            hashTable->addEntry(Workload::create(i));
+        }
+
+        state.PauseTiming();
+        buckets = hashTable->bucketCount();
+        globalDepth = hashTable->getGlobalDepth();
+        overflow = hashTable->overflowStats();
+        hashTable.reset();
+        state.ResumeTiming();
+    }
+    std::filesystem::remove_all(HASHER_BENCHMARK_DIR);
+
+    // Hashes falling into each of as many slots as there are buckets, picked by the low bits like the directory
+    size_t slotBits = 0;
+    while ((size_t{1} << slotBits) < buckets) {
+        slotBits++;
+    }
+    std::vector<size_t> slots(size_t{1} << slotBits);
+    typename Workload::KeyExtractor extractKey;
+    for (size_t i = 0; i < totalEntries; ++i) {
+        slots[Hasher{}(extractKey(*Workload::create(i))) & (slots.size() - 1)]++;
+    }
+    double meanSlot = static_cast<double>(totalEntries) / slots.size();
+
+    state.SetItemsProcessed(static_cast<int64_t>(state.iterations()) * totalEntries);
+    state.counters["buckets"] = buckets;
+    state.counters["globalDepth"] = globalDepth;
+    state.counters["entriesPerBucket"] = static_cast<double>(totalEntries) / buckets;
+    // 1 when every bucket is pointed to by the same number of directory slots
+    state.counters["slotsPerBucket"] = static_cast<double>(size_t{1} << globalDepth) / buckets;
+    state.counters["overflowPages"] = overflow.overflowPages;
+    // Fullest low-bit slot relative to the mean; 1 is a perfectly even spread
+    state.counters["maxSlotLoad"] = *std::max_element(slots.begin(), slots.end()) / meanSlot;
+}
+
+BENCHMARK_TEMPLATE(FillTable, TestMessageWorkload, StdHasher)->Args({4096, 10000})->Unit(benchmark::kMillisecond);
+BENCHMARK_TEMPLATE(FillTable, TestMessageWorkload, WyHasher)->Args({4096, 10000})->Unit(benchmark::kMillisecond);
+BENCHMARK_TEMPLATE(FillTable, TestMessageWorkload, Xxh64Hasher)->Args({4096, 10000})->Unit(benchmark::kMillisecond);
+BENCHMARK_TEMPLATE(FillTable, PersonWorkload, StdHasher)->Args({4096, 10000})->Unit(benchmark::kMillisecond);
+BENCHMARK_TEMPLATE(FillTable, PersonWorkload, WyHasher)->Args({4096, 10000})->Unit(benchmark::kMillisecond);
+BENCHMARK_TEMPLATE(FillTable, PersonWorkload, Xxh64Hasher)->Args({4096, 10000})->Unit(benchmark::kMillisecond);
+
+} // namespace ehash
+
+BENCHMARK_MAIN();
@@ -1,12 +1,25 @@
 #ifndef BUCKET_HPP
 #define BUCKET_HPP
 
+#include "BufferPool.hpp"
+#include "Epoch.hpp"
+#include "Fingerprint.hpp"
+#include "Hasher.hpp"
+#include "KeyExtractor.hpp"
+#include "MemoryBudget.hpp"
+#include "SlottedPage.hpp"
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
 #include <fstream>
+#include <google/protobuf/arena.h>
 #include <google/protobuf/message.h>
 #include <iostream>
 #include <memory>
+#include <mutex>
 #include <stdexcept>
 #include <string>
+#include <string_view>
 #include <sys/statvfs.h>
 #include <vector>
 
@@ -16,13 +29,13 @@ namespace ehash {
 // const size_t DEFAULT_BLOCK_SIZE = 4096;
 
 // Helper function to check if a file exists
-bool fileExists(const std::string &path) {
+inline bool fileExists(const std::string &path) {
     std::ifstream file(path);
     return file.good();
 }
 
 // Helper function to get filesystem block size for a given path
-size_t getBlockSize(const std::string &path) {
+inline size_t getBlockSize(const std::string &path) {
     struct statvfs stat;
     if (statvfs(path.c_str(), &stat) == 0) {
         return stat.f_bsize; // Return block size
@@ -32,7 +45,7 @@ size_t getBlockSize(const std::string &path) {
 }
 
 // Create the file if it doesn't exist, and open it
-void createFileIfNotExists(const std::string &path) {
+inline void createFileIfNotExists(const std::string &path) {
     // std::cout << "createFileIfNotExists" << std::endl;
     if (!fileExists(path)) {
         std::ofstream file(path);
@@ -44,172 +57,841 @@ void createFileIfNotExists(const std::string &path) {
     // std::cout << "File EXISTS" << std::endl;
 }
 
-// Generic Bucket class for storing any Protobuf objects
-template <typename T> class Bucket {
+// Round the requested bucket size up to whole filesystem blocks of the given path
+inline size_t bucketPageSize(const std::string &path, size_t maxSize) {
+    size_t blockSize = getBlockSize(path);
+    return ((maxSize / blockSize) + 1) * blockSize;
+}
+
+// How many buckets have grown overflow pages instead of splitting
+struct OverflowStats {
+    size_t buckets = 0;            // Buckets in the table
+    size_t overflowBuckets = 0;    // Buckets with at least one overflow page
+    size_t overflowPages = 0;      // Overflow pages chained to buckets
+    size_t overflowPagesAdded = 0; // Overflow pages chained since the table was opened
+
+    // Share of the buckets that have overflowed
+    double overflowRate() const { return buckets == 0 ? 0.0 : static_cast<double>(overflowBuckets) / buckets; }
+};
+
+// Generic Bucket class for storing any Protobuf objects. A bucket is stored in a chain of slotted pages: its
+// primary page, followed by overflow pages the table chains to it when splitting cannot make room. Hasher
+// maps a key to the hash entries are placed by (see Hasher.hpp).
+//
+// The entries read from the pages are allocated in one arena per load, so that loading a bucket takes a few
+// large allocations instead of several per message, and dropping the entries frees the arena at once.
+// Entries added later stay on the heap. An arena is shared with the buckets its entries move to when the
+// bucket splits or merges, and freed once all of them have dropped their entries.
+//
+// A lazy bucket copies the records it loads instead of parsing them, and parses each one the first time its
+// entry is used, so that a point lookup parses one record rather than the whole bucket. Keys are compared and
+// hashed in the records if the KeyExtractor can find them there (see HasRecordKeys); otherwise loading parses
+// every record into the same scratch message to hash its key, keeping nothing but the copy
+template <typename T, typename KeyExtractor = SerializedKey<T>, typename Hasher = StdHasher> class Bucket {
     static_assert(std::is_base_of<google::protobuf::Message, T>::value,
                   "T must be a subclass of google::protobuf::Message");
 
-  private:
-    std::string filePath;                    // Path to the file where the bucket is stored
-    size_t blockSize;                        // Filesystem block size (e.g., 4KB)
-    size_t maxBucketSize;                    // Maximum size of the bucket (a multiple of block size)
-    std::vector<std::unique_ptr<T>> entries; // Deserialized objects in memory
-    std::size_t currentSize = 0;             // Current size of the bucket
+  public:
+    using Key = typename KeyExtractor::KeyType;
+
+    // Deletes entries on the heap; entries in an arena are freed with it
+    struct EntryDeleter {
+        EntryDeleter() = default;
+        EntryDeleter(std::default_delete<T>) {} // Entries handed over by callers are heap allocated
 
-    // Internal method to serialize and write to disk
-    void writeToDisk() {
-        std::ofstream outFile(filePath, std::ios::binary | std::ios::trunc);
-        if (!outFile) {
-            throw std::runtime_error("Failed to open file for writing: " + filePath);
+        void operator()(T *entry) const {
+            if (entry->GetArena() == nullptr) {
+                delete entry;
+            }
         }
+    };
 
-        size_t currentSize = 0;
-        for (const auto &entry : entries) {
-            std::string serializedEntry;
-            entry->SerializeToString(&serializedEntry);
-            size_t entrySize = serializedEntry.size();
+    using EntryPtr = std::unique_ptr<T, EntryDeleter>;
+    using ArenaSet = std::vector<std::shared_ptr<google::protobuf::Arena>>;
+
+    // Entry on its way into a bucket, serialized and hashed once by the caller
+    struct PendingEntry {
+        EntryPtr entry;
+        std::string bytes; // Serialized entry
+        size_t hashValue;  // Hash of the entry's key
+    };
 
-            // Check if adding this entry would exceed the bucket's size limit
-            if (currentSize + sizeof(int) + entrySize > maxBucketSize) {
-                throw std::runtime_error("Bucket overflow: adding entry exceeds max bucket size");
+  private:
+    // Copy of the lookup state in atomics, for readers that probe the bucket without its latch
+    struct ProbeTable {
+        explicit ProbeTable(size_t capacity)
+            : capacity(capacity), fingerprintWords(new std::atomic<uint64_t>[(capacity + 7) / 8]()),
+              hashes(new std::atomic<size_t>[capacity]()), entries(new std::atomic<T *>[capacity]()) {}
+
+        size_t capacity;
+        std::unique_ptr<std::atomic<uint64_t>[]> fingerprintWords; // Eight fingerprints per word
+        std::unique_ptr<std::atomic<size_t>[]> hashes;             // Hash of every entry's key
+        std::unique_ptr<std::atomic<T *>[]> entries;
+    };
+
+    // Where the record of an entry is stored
+    struct Location {
+        uint32_t page; // Index in the page chain
+        uint32_t slot; // Slot on that page
+    };
+
+    // Copy of a loaded record whose entry may not have been parsed yet
+    struct RecordSpan {
+        static constexpr uint32_t NONE = UINT32_MAX; // Offset of entries added since the load
+
+        uint32_t offset; // In recordBytes
+        uint32_t size;
+    };
+
+    // Page of the chain
+    struct ChainPage {
+        PageId pageId;
+        size_t freeSpace = 0; // Free bytes on the slotted page, known once the bucket is loaded
+    };
+
+    // Pins one page of the chain at a time, for a series of changes that may touch several of them
+    class PageCursor {
+      private:
+        Bucket &bucket;
+        std::unique_ptr<PageGuard> guard;
+        uint32_t current = 0;
+
+      public:
+        explicit PageCursor(Bucket &bucket) : bucket(bucket) {}
+
+        // The page at index of the chain, pinned until another page is asked for
+        SlottedPage page(uint32_t index) {
+            if (!guard || current != index) {
+                guard.reset();
+                guard = std::make_unique<PageGuard>(*bucket.bufferPool, bucket.chain[index].pageId);
+                current = index;
+            }
+            return SlottedPage(*guard, bucket.maxBucketSize);
+        }
+    };
+
+    KeyExtractor extractKey;                 // Maps an entry to the key it is compared by
+    std::shared_ptr<BufferPool> bufferPool;  // Pool that caches the bucket pages
+    std::shared_ptr<EpochManager> epochs;    // Reclaims entries and probe tables readers may still hold
+    std::shared_ptr<MemoryBudget> budget;    // Charged with the memory the loaded entries take
+    std::vector<ChainPage> chain;            // Primary page, then the overflow pages in the order they were added
+    size_t maxBucketSize;                    // Size of each page of the bucket
+    ArenaSet arenas;                         // Arenas entries may live in; declared first so they outlive them
+    std::vector<EntryPtr> entries;           // Deserialized objects in memory
+    std::vector<Location> locations;         // Page and slot of every entry
+    std::vector<uint8_t> fingerprints;       // Hash fingerprint of every entry, probed before comparing keys
+    bool loaded = false;                     // Entries are read on first access
+    size_t chargedBytes = 0;                 // Resident size last charged to the budget
+
+    // Lazy buckets only. Entries not parsed yet are null; readers holding the latch shared parse them under
+    // parseMutex and publish them through the probe table
+    bool lazy;
+    std::string recordBytes;                        // Records copied at load
+    std::vector<RecordSpan> records;                // Record of every entry
+    google::protobuf::Arena *recordArena = nullptr; // Arena of the load, one of arenas; entries are parsed into it
+    std::mutex parseMutex;
+
+    // Seqlock over the probe table: odd while a writer changes it. Readers that see the same even
+    // version before and after probing have read a consistent bucket
+    std::atomic<uint64_t> version{0};
+    std::atomic<ProbeTable *> probeTable{nullptr}; // Published when the page is loaded
+    std::atomic<size_t> probeCount{0};             // Entries in the probe table
+    size_t changeDepth = 0;                        // Open ChangeScopes
+
+    // Deserialize every record of the page chain. Page i of the chain is parsed from copies[i] if it is given
+    void readPages(const std::vector<const char *> &copies = {}) {
+        ChangeScope change(*this);
+        entries.clear();
+        locations.clear();
+        fingerprints.clear();
+        recordBytes.clear();
+        records.clear();
+
+        // The parsed messages take more than their records, but a first block the size of the pages saves
+        // most of the arena's growth
+        google::protobuf::ArenaOptions options;
+        options.start_block_size = chain.size() * maxBucketSize;
+        auto arena = std::make_shared<google::protobuf::Arena>(options);
+
+        std::vector<size_t> hashes;
+        for (uint32_t page = 0; page < chain.size(); ++page) {
+            if (page < copies.size() && copies[page] != nullptr) {
+                parsePage(page, SlottedPageView(copies[page], maxBucketSize), *arena, hashes);
+                continue;
+            }
+            // Parse straight from the mapped file when possible instead of copying the page into the pool
+            if (const char *mapped = bufferPool->mappedPage(chain[page].pageId)) {
+                parsePage(page, SlottedPageView(mapped, maxBucketSize), *arena, hashes);
+                continue;
             }
+            PageGuard guard(*bufferPool, chain[page].pageId);
+            parsePage(page, SlottedPageView(guard.data(), maxBucketSize), *arena, hashes);
+        }
+        if (!entries.empty()) {
+            recordArena = arena.get();
+            arenas.push_back(std::move(arena));
+        }
+        loaded = true;
+        if (!lazy) {
+            budget->countParses(entries.size());
+        }
 
-            outFile.write(reinterpret_cast<const char *>(&entrySize), sizeof(int)); // Write size of entry
-            outFile.write(serializedEntry.data(), entrySize);                       // Write serialized data
-            currentSize += sizeof(int) + entrySize;                                 // Update current bucket size
+        auto *table = new ProbeTable(std::max<size_t>(entries.size(), 8));
+        for (size_t i = 0; i < entries.size(); ++i) {
+            storeProbeEntry(*table, i, hashes[i], entries[i].get());
         }
+        probeCount.store(entries.size(), std::memory_order_relaxed);
+        probeTable.store(table, std::memory_order_release);
+    }
 
-        // Pad the rest of the bucket to ensure it's a multiple of the block size
-        size_t padding = maxBucketSize - currentSize;
-        std::string paddingData(padding, '\0');
-        outFile.write(paddingData.data(), padding);
-        outFile.close();
+    // Append the records of one page of the chain, parsed into arena or copied if the bucket is lazy, and the
+    // hashes of their keys
+    void parsePage(uint32_t page, const SlottedPageView &view, google::protobuf::Arena &arena,
+                   std::vector<size_t> &hashes) {
+        std::unique_ptr<T> scratch; // Lazy buckets parse records into it only to find keys
+        for (uint32_t slot = 0; slot < view.slotCount(); ++slot) {
+            if (!view.isLive(slot))
+                continue;
+
+            std::string_view record(view.recordData(slot), view.recordSize(slot));
+            if (lazy) {
+                hashes.push_back(hashOfRecord(record, scratch));
+                records.push_back({static_cast<uint32_t>(recordBytes.size()), static_cast<uint32_t>(record.size())});
+                recordBytes.append(record);
+                entries.emplace_back();
+            } else {
+                // Create a new instance of T (a Protobuf Message)
+                EntryPtr entry(google::protobuf::Arena::CreateMessage<T>(&arena));
+                if (!entry->ParseFromArray(record.data(), record.size())) {
+                    throw std::runtime_error("Failed to parse protobuf object");
+                }
+                hashes.push_back(hashOf(extractKey(*entry)));
+                entries.push_back(std::move(entry));
+            }
+            fingerprints.push_back(fingerprintOf(hashes.back()));
+            locations.push_back({page, slot});
+        }
+        chain[page].freeSpace = view.freeSpace();
     }
 
-    // Internal method to read and deserialize from disk
-    void readFromDisk() {
-        std::ifstream inFile(filePath, std::ios::binary);
-        if (!inFile) {
-            throw std::runtime_error("Failed to open file for reading: " + filePath);
+    // Hash of the key of a record, found in the record itself if the extractor can, or else by parsing it into
+    // scratch
+    size_t hashOfRecord(std::string_view record, std::unique_ptr<T> &scratch) {
+        if constexpr (HasRecordKeys<KeyExtractor>::value) {
+            return hashOfRecordKey(extractKey, record);
+        } else {
+            if (!scratch) {
+                scratch = std::make_unique<T>();
+            }
+            if (!scratch->ParseFromArray(record.data(), record.size())) {
+                throw std::runtime_error("Failed to parse protobuf object");
+            }
+            budget->countParses(1);
+            return hashOf(extractKey(*scratch));
         }
+    }
 
-        entries.clear();
-        size_t currentSize = 0;
-        while (currentSize < maxBucketSize && !inFile.eof()) {
-            int entrySize = 0;
-            inFile.read(reinterpret_cast<char *>(&entrySize), sizeof(int));
-            if (inFile.eof())
-                break;
+    std::string_view recordOf(size_t i) const {
+        return std::string_view(recordBytes).substr(records[i].offset, records[i].size);
+    }
 
-            std::string serializedEntry(entrySize, '\0');
-            inFile.read(&serializedEntry[0], entrySize);
-            if (inFile.eof())
-                break;
+    // Entry i, parsed from its record first if the bucket is lazy and nobody has yet. The latch is held
+    T *entryAt(size_t i) {
+        if (!lazy) {
+            return entries[i].get();
+        }
+        ProbeTable *table = probeTable.load(std::memory_order_relaxed);
+        T *entry = table->entries[i].load(std::memory_order_acquire);
+        if (entry != nullptr) {
+            return entry;
+        }
 
-            // Create a new instance of T (a Protobuf Message)
-            std::unique_ptr<T> entry(new T());
-            if (!entry->ParseFromString(serializedEntry)) {
+        std::lock_guard<std::mutex> lock(parseMutex);
+        entry = table->entries[i].load(std::memory_order_relaxed);
+        if (entry == nullptr) {
+            std::string_view record = recordOf(i);
+            entry = google::protobuf::Arena::CreateMessage<T>(recordArena);
+            if (!entry->ParseFromArray(record.data(), record.size())) {
                 throw std::runtime_error("Failed to parse protobuf object");
             }
-            entries.push_back(std::move(entry));
-            currentSize += sizeof(int) + entrySize;
+            budget->countParses(1);
+            entries[i].reset(entry);
+            table->entries[i].store(entry, std::memory_order_release);
         }
+        return entry;
+    }
+
+    // Parse every entry a lazy bucket has not parsed yet
+    void parseAll() {
+        for (size_t i = 0; lazy && i < entries.size(); ++i) {
+            entryAt(i);
+        }
+    }
+
+    // Whether entry i has the given key, compared in its record when possible
+    bool keyMatches(size_t i, const Key &key) {
+        if constexpr (HasRecordKeys<KeyExtractor>::value) {
+            if (lazy && records[i].offset != RecordSpan::NONE) {
+                return extractKey.fromRecord(recordOf(i)) == key;
+            }
+        }
+        return extractKey(*entryAt(i)) == key;
+    }
 
-        inFile.close();
+    // Forget the records of a lazy bucket whose entries have all been dropped or taken
+    void dropRecords() {
+        std::string().swap(recordBytes);
+        std::vector<RecordSpan>().swap(records);
+        recordArena = nullptr;
+    }
+
+    // First page of the chain with room for a record of recordSize bytes, or the chain length if none has
+    uint32_t findRoom(size_t recordSize) const {
+        uint32_t page = 0;
+        while (page < chain.size() && SlottedPageView::requiredSpace(recordSize) > chain[page].freeSpace) {
+            page++;
+        }
+        return page;
+    }
+
+    // Indexes of the overflow pages that hold no live record, in chain order
+    std::vector<uint32_t> emptyOverflowPages() const {
+        std::vector<bool> live(chain.size(), false);
+        for (const auto &location : locations) {
+            live[location.page] = true;
+        }
+        std::vector<uint32_t> empty;
+        for (uint32_t page = 1; page < chain.size(); ++page) {
+            if (!live[page]) {
+                empty.push_back(page);
+            }
+        }
+        return empty;
+    }
+
+    // Bytes of the pages taken by records and slots
+    size_t usedBytes() const {
+        size_t used = 0;
+        for (const auto &page : chain) {
+            used += maxBucketSize - SlottedPageView::HEADER_SIZE - page.freeSpace;
+        }
+        return used;
+    }
+
+    void storeProbeEntry(ProbeTable &table, size_t i, size_t hashValue, T *entry) {
+        storePackedFingerprint(table.fingerprintWords.get(), i, fingerprintOf(hashValue));
+        table.hashes[i].store(hashValue, std::memory_order_relaxed);
+        table.entries[i].store(entry, std::memory_order_release);
+    }
+
+    // Mirror the entry just appended to entries into the probe table, growing it if it is full
+    void appendProbeEntry(size_t hashValue) {
+        ProbeTable *table = probeTable.load(std::memory_order_relaxed);
+        size_t count = probeCount.load(std::memory_order_relaxed);
+        if (count == table->capacity) {
+            auto *grown = new ProbeTable(table->capacity * 2);
+            for (size_t i = 0; i < count; ++i) {
+                storeProbeEntry(*grown, i, table->hashes[i].load(std::memory_order_relaxed),
+                                table->entries[i].load(std::memory_order_relaxed));
+            }
+            probeTable.store(grown, std::memory_order_release);
+            epochs->retire(table);
+            table = grown;
+        }
+        storeProbeEntry(*table, count, hashValue, entries.back().get());
+        probeCount.store(count + 1, std::memory_order_relaxed);
+    }
+
+    // Hand an entry readers may still use to the epochs. An entry in an arena stays until the arena is freed
+    void retireEntry(EntryPtr &entry) {
+        T *object = entry.release();
+        if (object != nullptr && object->GetArena() == nullptr) {
+            epochs->retire(object);
+        }
+    }
+
+    // Drop the bucket's share of its arenas once no reader can use their entries anymore
+    void retireArenas() {
+        if (!arenas.empty()) {
+            epochs->retire(new ArenaSet(std::move(arenas)));
+            arenas.clear();
+        }
+    }
+
+    // Replace entry i, keeping the old object alive for readers that may still use it
+    void replaceEntry(size_t i, EntryPtr entry) {
+        ProbeTable *table = probeTable.load(std::memory_order_relaxed);
+        table->entries[i].store(entry.get(), std::memory_order_release);
+        retireEntry(entries[i]);
+        entries[i] = std::move(entry);
+        if (lazy) {
+            records[i].offset = RecordSpan::NONE; // The record is outdated
+        }
+    }
+
+    // Estimated memory taken by the entries and the state kept to find them
+    size_t residentBytes() const {
+        if (!loaded) {
+            return 0;
+        }
+        // The messages themselves are counted as their fixed part plus their serialized size
+        constexpr size_t perEntry = sizeof(T) + sizeof(EntryPtr) + sizeof(uint32_t) + sizeof(uint8_t);
+        constexpr size_t perProbeSlot = sizeof(size_t) + sizeof(T *) + sizeof(uint8_t);
+        const ProbeTable *table = probeTable.load(std::memory_order_relaxed);
+        return sizeof(*this) + entries.size() * perEntry + (table != nullptr ? table->capacity * perProbeSlot : 0) +
+               usedBytes() + recordBytes.capacity() + records.capacity() * sizeof(RecordSpan);
+    }
+
+    void recharge() {
+        size_t bytes = residentBytes();
+        budget->recharge(chargedBytes, bytes);
+        chargedBytes = bytes;
+    }
+
+    void ensureLoaded() {
+        if (!loaded) {
+            readPages();
+        }
+    }
+
+    // Position of the entry with the given key, or entries.size() if there is none.
+    // Keys are only extracted and compared for entries whose fingerprint matches
+    size_t findIndex(const Key &key, size_t hashValue) {
+        ensureLoaded();
+        return probeFingerprints(fingerprints.data(), fingerprints.size(), fingerprintOf(hashValue),
+                                 [&](size_t i) { return keyMatches(i, key); });
+    }
+
+    void eraseAt(size_t index) {
+        retireEntry(entries[index]);
+        entries.erase(entries.begin() + index);
+        locations.erase(locations.begin() + index);
+        fingerprints.erase(fingerprints.begin() + index);
+        if (lazy) {
+            records.erase(records.begin() + index);
+        }
+
+        ProbeTable *table = probeTable.load(std::memory_order_relaxed);
+        for (size_t i = index; i < entries.size(); ++i) {
+            storeProbeEntry(*table, i, table->hashes[i + 1].load(std::memory_order_relaxed), entries[i].get());
+        }
+        probeCount.store(entries.size(), std::memory_order_relaxed);
     }
 
   public:
-    Bucket(const std::string &path, size_t maxSize) : filePath(path), currentSize(0) {
-        // Create the file if it doesn't exist
-        createFileIfNotExists(path);
+    // Marks the bucket as changing for optimistic readers while alive. Every change to the bucket opens
+    // one; callers open an enclosing scope to make several changes appear at once. The latch is held.
+    // Closing the outermost scope charges the bucket's new size to the memory budget
+    class ChangeScope {
+      private:
+        Bucket &bucket;
+
+      public:
+        explicit ChangeScope(Bucket &bucket) : bucket(bucket) {
+            if (bucket.changeDepth++ == 0) {
+                bucket.version.store(bucket.version.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+                std::atomic_thread_fence(std::memory_order_release);
+            }
+        }
 
-        // Now safely get the block size
-        blockSize = getBlockSize(path);
+        ChangeScope(const ChangeScope &) = delete;
+        ChangeScope &operator=(const ChangeScope &) = delete;
 
-        // Ensure maxBucketSize is a multiple of the block size
-        maxBucketSize = ((maxSize / blockSize) + 1) * blockSize;
-        if (maxBucketSize < blockSize) {
-            throw std::runtime_error("Max bucket size must be at least one block size");
+        ~ChangeScope() {
+            if (--bucket.changeDepth == 0) {
+                bucket.version.store(bucket.version.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+                bucket.recharge();
+            }
+        }
+    };
+
+    // The pages are read on first access, so opening a table touches only the buckets it uses
+    Bucket(std::shared_ptr<BufferPool> pool, std::shared_ptr<EpochManager> epochs,
+           std::shared_ptr<MemoryBudget> budget, PageId pageId, const std::vector<PageId> &overflowPages = {},
+           bool lazy = false)
+        : bufferPool(std::move(pool)), epochs(std::move(epochs)), budget(std::move(budget)),
+          maxBucketSize(bufferPool->pageSize()), lazy(lazy) {
+        chain.push_back({pageId});
+        for (PageId overflowPage : overflowPages) {
+            chain.push_back({overflowPage});
         }
+    }
 
-        readFromDisk(); // Load objects into memory when bucket is initialized
+    Bucket(const Bucket &) = delete;
+    Bucket &operator=(const Bucket &) = delete;
+
+    ~Bucket() {
+        budget->recharge(chargedBytes, 0);
+        delete probeTable.load(std::memory_order_relaxed);
     }
 
-    ~Bucket() = default;
+    // Hash of a key; the table hashes keys the same way to pick the bucket
+    static size_t hashOf(const Key &key) { return Hasher{}(key); }
 
-    // Add a new Protobuf entry to the bucket
-    bool addEntry(std::unique_ptr<T> entry) {
-        // std::cout << "Adding entry to bucket" << std::endl;
+    // Hash of the key extractKey finds in a record, without parsing it. Only for extractors with HasRecordKeys
+    static size_t hashOfRecordKey(const KeyExtractor &extractKey, std::string_view record) {
+        if constexpr (std::is_invocable_r_v<size_t, Hasher, std::string_view>) {
+            return Hasher{}(extractKey.fromRecord(record));
+        } else {
+            return hashOf(Key(extractKey.fromRecord(record)));
+        }
+    }
+
+    // Add a new Protobuf entry whose key hashes to hashValue
+    bool addEntry(std::unique_ptr<T> entry, size_t hashValue) {
         std::string serializedEntry;
         entry->SerializeToString(&serializedEntry);
         size_t entrySize = serializedEntry.size();
 
         // If the entry itself is larger than the maximum bucket size, throw an error
-        if (entrySize > maxBucketSize) {
+        if (SlottedPageView::requiredSpace(entrySize) > maxBucketSize - SlottedPageView::HEADER_SIZE) {
             throw std::runtime_error("Entry size exceeds maximum bucket size");
         }
 
-        if (currentSize + sizeof(int) + entrySize > maxBucketSize) {
+        ensureLoaded();
+        uint32_t target = findRoom(entrySize);
+        if (target == chain.size()) {
             return false; // Bucket full, cannot add more entries
         }
 
+        // Only the new record, its slot and the page header are written
+        ChangeScope change(*this);
+        PageGuard page(*bufferPool, chain[target].pageId);
+        SlottedPage slottedPage(page, maxBucketSize);
+        locations.push_back({target, slottedPage.insert(serializedEntry.data(), entrySize)});
+        fingerprints.push_back(fingerprintOf(hashValue));
         entries.push_back(std::move(entry));
-        currentSize += sizeof(int) + entrySize;
-        writeToDisk(); // Persist to disk after modification
+        if (lazy) {
+            records.push_back({RecordSpan::NONE, 0});
+        }
+        appendProbeEntry(hashValue);
+        chain[target].freeSpace = slottedPage.freeSpace();
         return true;
     }
 
-    bool canAddEntry(std::size_t entrySize) const { return currentSize + sizeof(int) + entrySize <= maxBucketSize; }
+    bool canAddEntry(std::size_t entrySize) {
+        ensureLoaded();
+        return findRoom(entrySize) < chain.size();
+    }
 
-    bool hasKey(const std::string &key) const {
-        for (const auto &entry : entries) {
-            std::string serializedKey;
-            entry->SerializeToString(&serializedKey);
-            if (key == serializedKey) {
-                return true;
+    // Add or replace entries from the front of the batch in order, pinning each page only while consecutive
+    // entries go to it, and stop at the first one that does not fit so that a later entry is never
+    // overwritten by an earlier one with the same key. Returns how many were placed; their entries are moved
+    // out, their bytes are left to the caller
+    size_t addEntries(std::vector<PendingEntry> &batch) {
+        ensureLoaded();
+
+        ChangeScope change(*this);
+        PageCursor cursor(*this);
+        size_t placed = 0;
+        for (; placed < batch.size(); ++placed) {
+            PendingEntry &pending = batch[placed];
+            size_t i = findIndex(extractKey(*pending.entry), pending.hashValue);
+            if (i != entries.size()) {
+                Location location = locations[i];
+                SlottedPage slottedPage = cursor.page(location.page);
+                bool updated = slottedPage.update(location.slot, pending.bytes.data(), pending.bytes.size());
+                if (!updated) {
+                    slottedPage.erase(location.slot);
+                }
+                chain[location.page].freeSpace = slottedPage.freeSpace();
+                if (updated) {
+                    replaceEntry(i, std::move(pending.entry));
+                    continue;
+                }
+                eraseAt(i);
+            }
+
+            uint32_t target = findRoom(pending.bytes.size());
+            if (target == chain.size()) {
+                break;
+            }
+            SlottedPage slottedPage = cursor.page(target);
+            locations.push_back({target, slottedPage.insert(pending.bytes.data(), pending.bytes.size())});
+            chain[target].freeSpace = slottedPage.freeSpace();
+            fingerprints.push_back(fingerprintOf(pending.hashValue));
+            entries.push_back(std::move(pending.entry));
+            if (lazy) {
+                records.push_back({RecordSpan::NONE, 0});
+            }
+            appendProbeEntry(pending.hashValue);
+        }
+        return placed;
+    }
+
+    // Whether the batch is predicted to fit in the free space of the pages. Entries that replace one with the
+    // same key are assumed to take its room; free space split across pages may still leave some out
+    bool hasRoomFor(const std::vector<PendingEntry> &batch) {
+        ensureLoaded();
+        size_t needed = 0;
+        for (const auto &pending : batch) {
+            if (findIndex(extractKey(*pending.entry), pending.hashValue) == entries.size()) {
+                needed += SlottedPageView::requiredSpace(pending.bytes.size());
             }
         }
-        return false;
+        size_t free = 0;
+        for (const auto &page : chain) {
+            free += page.freeSpace;
+        }
+        return needed <= free;
     }
 
-    void updateEntry(std::unique_ptr<T> newEntry) {
-        std::string serializedKey;
-        newEntry->SerializeToString(&serializedKey);
+    bool hasKey(const Key &key) { return findIndex(key, hashOf(key)) != entries.size(); }
 
-        for (auto &entry : entries) {
-            std::string existingKey;
-            entry->SerializeToString(&existingKey);
+    // Entry with the given key, or nullptr
+    T *findEntry(const Key &key, size_t hashValue) {
+        size_t index = findIndex(key, hashValue);
+        return index == entries.size() ? nullptr : entryAt(index);
+    }
+
+    // First entry whose key hashes to hashValue, or nullptr
+    T *findEntryByHash(size_t hashValue) {
+        ensureLoaded();
+        const ProbeTable *table = probeTable.load(std::memory_order_relaxed);
+        size_t index =
+            probeFingerprints(fingerprints.data(), fingerprints.size(), fingerprintOf(hashValue),
+                              [&](size_t i) { return table->hashes[i].load(std::memory_order_relaxed) == hashValue; });
+        return index == entries.size() ? nullptr : entryAt(index);
+    }
+
+    // Replace the entry with the same key in its slot. If the new version does not fit on the page,
+    // the old entry is removed, newEntry is left untouched and false is returned
+    bool updateEntry(std::unique_ptr<T> &newEntry, size_t hashValue) {
+        size_t i = findIndex(extractKey(*newEntry), hashValue);
+        if (i == entries.size()) {
+            return false;
+        }
+
+        std::string serializedEntry;
+        newEntry->SerializeToString(&serializedEntry);
+
+        ChangeScope change(*this);
+        Location location = locations[i];
+        PageGuard page(*bufferPool, chain[location.page].pageId);
+        SlottedPage slottedPage(page, maxBucketSize);
+        if (slottedPage.update(location.slot, serializedEntry.data(), serializedEntry.size())) {
+            replaceEntry(i, std::move(newEntry)); // Replace the existing entry
+        } else {
+            slottedPage.erase(location.slot);
+            eraseAt(i);
+        }
+        chain[location.page].freeSpace = slottedPage.freeSpace();
+        return newEntry == nullptr;
+    }
+
+    // Remove the entry with the given key. Returns false if there is none
+    bool removeEntry(const Key &key, size_t hashValue) {
+        size_t i = findIndex(key, hashValue);
+        if (i == entries.size()) {
+            return false;
+        }
+
+        ChangeScope change(*this);
+        Location location = locations[i];
+        PageGuard page(*bufferPool, chain[location.page].pageId);
+        SlottedPage slottedPage(page, maxBucketSize);
+        slottedPage.erase(location.slot);
+        eraseAt(i);
+        chain[location.page].freeSpace = slottedPage.freeSpace();
+        return true;
+    }
+
+    // Bytes of the pages taken by records and slots
+    size_t usedSpace() {
+        ensureLoaded();
+        return usedBytes();
+    }
+
+    // Whether the key hash of every entry has the same lowest bits as hashValue, so that no split up to that
+    // depth could separate them
+    bool hashesShareBits(size_t hashValue, size_t bits) {
+        ensureLoaded();
+        size_t mask = bits >= 64 ? ~size_t{0} : (size_t{1} << bits) - 1;
+        const ProbeTable *table = probeTable.load(std::memory_order_relaxed);
+        for (size_t i = 0; i < entries.size(); ++i) {
+            if (((table->hashes[i].load(std::memory_order_relaxed) ^ hashValue) & mask) != 0) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    // Chain a newly allocated, empty page to the bucket
+    void addOverflowPage(PageId pageId) {
+        ensureLoaded();
+        chain.push_back({pageId, maxBucketSize - SlottedPageView::HEADER_SIZE});
+    }
 
-            if (existingKey == serializedKey) {
-                entry = std::move(newEntry); // Replace the existing entry
-                return;
+    // Overflow pages without a live record, which the table may give back
+    bool hasEmptyOverflowPage() {
+        ensureLoaded();
+        return chain.size() > 1 && !emptyOverflowPages().empty();
+    }
+
+    // Unchain every overflow page that holds no live record and return their page ids; the caller frees them
+    std::vector<PageId> releaseEmptyOverflowPages() {
+        ensureLoaded();
+        std::vector<uint32_t> empty = emptyOverflowPages();
+        std::vector<PageId> released;
+        for (auto it = empty.rbegin(); it != empty.rend(); ++it) {
+            released.push_back(chain[*it].pageId);
+            chain.erase(chain.begin() + *it);
+            for (auto &location : locations) {
+                if (location.page > *it) {
+                    location.page--;
+                }
             }
         }
+        return released;
     }
 
+    // Pages of the chain after the primary page
+    std::vector<PageId> overflowPages() const {
+        std::vector<PageId> pageIds;
+        for (size_t i = 1; i < chain.size(); ++i) {
+            pageIds.push_back(chain[i].pageId);
+        }
+        return pageIds;
+    }
+
+    size_t overflowPageCount() const { return chain.size() - 1; }
+
     // Retrieve all entries from the bucket
-    const std::vector<std::unique_ptr<T>> &getEntries() const { return entries; }
+    const std::vector<EntryPtr> &getEntries() {
+        ensureLoaded();
+        parseAll();
+        return entries;
+    }
 
-    std::vector<std::unique_ptr<T>> retrieveEntries() { return std::move(entries); }
+    // Take every entry out of the bucket, and in taken the arenas they may live in; the caller must clear() it
+    // before it is used again, and have every bucket the entries go to adopt the arenas
+    std::vector<EntryPtr> retrieveEntries(ArenaSet &taken) {
+        ensureLoaded();
+        parseAll();
+        ChangeScope change(*this);
+        probeCount.store(0, std::memory_order_relaxed);
+        taken = std::move(arenas);
+        arenas.clear();
+        dropRecords();
+        return std::move(entries);
+    }
 
-    // Check if bucket is full
-    bool isFull() const {
-        size_t currentSize = 0;
-        for (const auto &entry : entries) {
-            std::string serializedEntry;
-            entry->SerializeToString(&serializedEntry);
-            currentSize += sizeof(int) + serializedEntry.size();
+    // Share arenas that entries added to the bucket may live in
+    void adoptArenas(const ArenaSet &shared) {
+        for (const auto &arena : shared) {
+            if (std::find(arenas.begin(), arenas.end(), arena) == arenas.end()) {
+                arenas.push_back(arena);
+            }
         }
-        return currentSize >= maxBucketSize;
     }
 
+    // Arenas the bucket's entries may live in
+    size_t arenaCount() const { return arenas.size(); }
+
+    // Primary page of the bucket
+    PageId getPageId() const { return chain.front().pageId; }
+
+    // The page has been read, so lookups no longer modify the bucket
+    bool isLoaded() const { return loaded; }
+
+    // The page has been loaded and optimistic lookups can probe the bucket
+    bool hasProbeTable() const { return probeTable.load(std::memory_order_acquire) != nullptr; }
+
+    // Look up the first entry whose key hashes to hashValue and that match accepts, without the latch.
+    // Returns false if a writer changed the bucket meanwhile, its page has not been loaded yet or a lazy bucket
+    // has not parsed an entry that may match; found is only meaningful when true is returned. The caller keeps
+    // the epoch pinned while it uses the entry
+    template <typename Match> bool findEntryOptimistic(size_t hashValue, Match match, T *&found) const {
+        uint64_t before = version.load(std::memory_order_acquire);
+        const ProbeTable *table = probeTable.load(std::memory_order_acquire);
+        if ((before & 1) != 0 || table == nullptr) {
+            return false;
+        }
+
+        // A count that does not belong to this table is caught by the version check below
+        size_t count = std::min(probeCount.load(std::memory_order_relaxed), table->capacity);
+        found = nullptr;
+        bool unparsed = false; // A lazy bucket has not parsed an entry that may match
+        probePackedFingerprints(table->fingerprintWords.get(), count, fingerprintOf(hashValue), [&](size_t i) {
+            if (table->hashes[i].load(std::memory_order_relaxed) != hashValue) {
+                return false;
+            }
+            T *entry = table->entries[i].load(std::memory_order_acquire);
+            if (entry == nullptr) {
+                unparsed = true;
+                return true;
+            }
+            if (!match(*entry)) {
+                return false;
+            }
+            found = entry;
+            return true;
+        });
+
+        std::atomic_thread_fence(std::memory_order_acquire);
+        return !unparsed && version.load(std::memory_order_relaxed) == before;
+    }
+
+    // Read the page now instead of on first access
+    void load() { ensureLoaded(); }
+
+    // Load the entries from copies of pages of the chain the caller has read itself, in chain order, unless they
+    // are loaded already. Pages without a copy are read as usual
+    void loadFrom(const std::vector<const char *> &pages) {
+        if (!loaded) {
+            readPages(pages);
+        }
+    }
+
+    // Drop the entries from memory; the next access reads them from the page again, which holds every change.
+    // The entries and the probe table are retired, since optimistic readers and PinnedEntry handles may still
+    // use them.
+    // The latch is held exclusively
+    void unload() {
+        if (!loaded) {
+            return;
+        }
+        ChangeScope change(*this);
+        for (auto &entry : entries) {
+            retireEntry(entry);
+        }
+        retireArenas();
+        dropRecords();
+        std::vector<EntryPtr>().swap(entries);
+        std::vector<Location>().swap(locations);
+        std::vector<uint8_t>().swap(fingerprints);
+        probeCount.store(0, std::memory_order_relaxed);
+        epochs->retire(probeTable.exchange(nullptr, std::memory_order_release));
+        loaded = false;
+    }
+
+    // Check if bucket is full
+    bool isFull() { return !canAddEntry(0); }
+
+    // Drop every entry; only the page headers are rewritten. Overflow pages stay chained
     void clear() {
+        ensureLoaded();
+        ChangeScope change(*this);
+        PageCursor cursor(*this);
+        for (uint32_t page = 0; page < chain.size(); ++page) {
+            SlottedPage slottedPage = cursor.page(page);
+            slottedPage.reset();
+            chain[page].freeSpace = slottedPage.freeSpace();
+        }
+        for (auto &entry : entries) {
+            retireEntry(entry);
+        }
+        retireArenas();
+        dropRecords();
         entries.clear();
-        currentSize = 0;
-        writeToDisk();
+        locations.clear();
+        fingerprints.clear();
+        probeCount.store(0, std::memory_order_relaxed);
     }
 
-    void print() const {
+    void print() {
+        ensureLoaded();
+        parseAll();
         for (const auto &entry : entries) {
             std::cout << "Entry: " << entry->DebugString();
         }
@@ -0,0 +1,118 @@
+#ifndef BUCKETTABLE_HPP
+#define BUCKETTABLE_HPP
+
+#include "BufferPool.hpp"
+#include "MemoryBudget.hpp"
+#include "PageStore.hpp"
+#include "SlottedPage.hpp"
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <stdexcept>
+#include <vector>
+
+namespace ehash {
+
+// Throw if an entry of entrySize bytes would not fit even in an empty bucket page of pageSize bytes
+inline void checkEntrySize(size_t entrySize, size_t pageSize) {
+    if (SlottedPageView::requiredSpace(entrySize) > pageSize - SlottedPageView::HEADER_SIZE) {
+        throw std::runtime_error("Entry size exceeds maximum bucket size");
+    }
+}
+
+// CLOCK hand over a table of bucket slots, which unloads cold buckets to keep the loaded ones within a memory
+// budget. A slot has the bucket, its latch and a referenced flag that every access to the bucket sets
+class BucketClock {
+  private:
+    std::mutex mutex; // Held by the thread that sweeps
+    size_t hand = 0;  // Bucket table index the next sweep starts at
+
+  public:
+    // Unload cold buckets while the loaded ones take more than the budget. Buckets used since the hand last
+    // passed them get a second chance; latched buckets are skipped rather than waited for, so this is only
+    // called while no bucket latch is held. A sweep already running in another thread is not joined.
+    // tableLatch, held shared during the sweep, is the latch that keeps the bucket table from changing
+    template <typename Slot>
+    void sweep(std::shared_mutex &tableLatch, const std::vector<std::unique_ptr<Slot>> &buckets,
+               MemoryBudget &budget) {
+        if (!budget.overBudget()) {
+            return;
+        }
+        std::unique_lock<std::mutex> clockLock(mutex, std::try_to_lock);
+        if (!clockLock) {
+            return;
+        }
+
+        std::shared_lock<std::shared_mutex> tableLock(tableLatch);
+        for (size_t visited = 0; visited < 2 * buckets.size() && budget.overBudget(); ++visited) {
+            const Slot &slot = *buckets[hand++ % buckets.size()];
+            if (slot.referenced.exchange(false, std::memory_order_relaxed)) {
+                continue;
+            }
+            std::unique_lock<std::shared_mutex> latch(slot.latch, std::try_to_lock);
+            if (latch && slot.bucket->isLoaded()) {
+                slot.bucket->unload();
+                budget.countUnload();
+            }
+        }
+    }
+};
+
+// Overflow pages a table chains to its buckets, and pages it stops using. A page released is only given back
+// to the store once the directory file no longer names it, since a crash before that reopens the previous
+// file. Used with the table's latch held exclusively, or shared for overflowPagesAdded()
+class TablePages {
+  private:
+    std::vector<PageId> released; // Pages no bucket uses that directory.meta still names
+    size_t added = 0;             // Overflow pages chained since the table was opened
+    bool changed = false;         // Pages were chained or released since directory.meta was written
+
+  public:
+    // Chain a new overflow page to bucket
+    template <typename BucketType> void addOverflowPage(BufferPool &pool, BucketType &bucket) {
+        bucket.addOverflowPage(pool.allocatePage());
+        added++;
+        changed = true;
+    }
+
+    // Place every entry in bucket, chaining overflow pages while they do not fit
+    template <typename BucketType, typename PendingEntry>
+    void placeWithOverflow(BufferPool &pool, BucketType &bucket, std::vector<PendingEntry> &entries) {
+        while (true) {
+            size_t placed = bucket.addEntries(entries);
+            entries.erase(entries.begin(), entries.begin() + placed);
+            if (entries.empty()) {
+                return;
+            }
+            addOverflowPage(pool, bucket);
+        }
+    }
+
+    // Drop pages no bucket uses anymore from the pool; they are freed by written()
+    void release(BufferPool &pool, const std::vector<PageId> &pageIds) {
+        for (PageId pageId : pageIds) {
+            pool.discardPage(pageId);
+            released.push_back(pageId);
+            changed = true;
+        }
+    }
+
+    // The directory file has been written, so the released pages can go back to the store
+    void written(BufferPool &pool) {
+        for (PageId pageId : released) {
+            pool.freePage(pageId);
+        }
+        released.clear();
+        changed = false;
+    }
+
+    // Pages were chained or released since the directory file was last written
+    bool hasChanged() const { return changed; }
+
+    size_t overflowPagesAdded() const { return added; }
+};
+
+} // namespace ehash
+
+#endif
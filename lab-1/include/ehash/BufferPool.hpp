@@ -0,0 +1,200 @@
+#ifndef BUFFERPOOL_HPP
+#define BUFFERPOOL_HPP
+
+#include "IoQueue.hpp"
+#include "PageCodec.hpp"
+#include "PageStore.hpp"
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+namespace ehash {
+
+// Counters describing how well the buffer pool absorbs page I/O
+struct BufferPoolStats {
+    size_t hits = 0;         // Pins served from a resident frame
+    size_t misses = 0;       // Pins that had to read the page from the store
+    size_t evictions = 0;    // Frames reused for another page
+    size_t pageWrites = 0;   // Dirty pages written back to the store
+    size_t bytesWritten = 0; // Bytes written back; pages with only a few dirty ranges write just those
+};
+
+// What the pool does with the checksum at the start of every page (see Checksum.hpp)
+enum class PageChecksums {
+    Off,    // Pages are written and read as they are
+    Seal,   // Pages are sealed with their checksum when they are written back
+    Verify, // Pages are sealed, and every page read from the store is checked; a mismatch throws
+};
+
+// Fixed-size cache of pages that sits between the buckets and their page store.
+// Pages are modified in memory and only written back when they are evicted or flushed.
+// Victims are chosen with the CLOCK (second chance) policy.
+//
+// In no-steal mode dirty pages are never evicted, so the store only changes on flush(). When every frame
+// holds a dirty or pinned page the pool grows past its capacity and shrinks back on the next flush().
+//
+// The pool may be used from several threads. Its bookkeeping and every call into the page store are
+// serialized by one mutex; the contents of a pinned page are protected by whoever pinned it.
+//
+// With an I/O queue, flush() writes all dirty pages with their writes in flight at once, and pages can be
+// read asynchronously without becoming resident.
+//
+// With page checksums, a page that is written back gets its checksum updated, and the range holding it is
+// written along with the dirty ranges, so that a torn write shows up as a mismatch when the page is read.
+// A store that does not keep pages as they are (see PageStore::pagesStoredAsIs) is only given whole pages
+// and only used synchronously.
+class BufferPool {
+  private:
+    // Past this many disjoint dirty ranges the whole page is written back instead
+    static constexpr size_t MAX_DIRTY_RANGES = 8;
+
+    // Pages a queued write back has in flight at once. Every one may hold a bucket file open until its writes
+    // complete, so a no-steal pool with many dirty pages must not submit them all together
+    static constexpr size_t WRITE_BACK_CHUNK = 128;
+
+    struct Frame {
+        PageId pageId = 0;
+        std::vector<char> data;
+        size_t pinCount = 0;
+        bool dirty = false;
+        bool wholePageDirty = false;
+        std::vector<std::pair<size_t, size_t>> dirtyRanges; // Sorted, non-overlapping [begin, end) ranges
+        bool referenced = false;                             // Second-chance bit for CLOCK
+        bool used = false;                                   // Frame currently holds a page
+    };
+
+    std::shared_ptr<PageStore> store;
+    std::shared_ptr<IoQueue> ioQueue; // nullptr if pages are only read and written synchronously
+    mutable std::mutex mutex;         // Guards everything below and the page store
+    std::vector<Frame> frames;
+    std::unordered_map<PageId, size_t> pageTable; // Resident page -> frame index
+    size_t clockHand = 0;
+    size_t capacityPages; // Frames kept after a flush
+    bool noSteal = false; // Dirty pages stay resident until flush()
+    PageChecksums checksums;
+    BufferPoolStats stats;
+
+    // Merge a modified byte range into the dirty ranges of a frame
+    void addDirtyRange(Frame &frame, size_t offset, size_t size);
+
+    // Update the checksum of a dirty page before it is written back or handed out
+    void seal(Frame &frame);
+
+    // Throw if a page read from the store does not hold its checksum
+    void verify(PageId pageId, const char *data) const;
+
+    // Pick a frame for a new page, writing back its current page if it is dirty
+    size_t findVictim();
+
+    void writeBack(Frame &frame);
+
+    // Write back every dirty page through the I/O queue, WRITE_BACK_CHUNK pages at a time
+    void writeBackQueued();
+
+    // Write back the given dirty frames through the I/O queue, wait for all of their writes and close the files
+    void writeBackChunk(const std::vector<Frame *> &chunk);
+
+    // Release the frame of a page, if it is resident, without writing it back
+    void discardFrame(PageId pageId);
+
+  public:
+    BufferPool(std::shared_ptr<PageStore> store, size_t capacity, std::shared_ptr<IoQueue> ioQueue = nullptr,
+               PageChecksums checksums = PageChecksums::Off);
+
+    BufferPool(const BufferPool &) = delete;
+    BufferPool &operator=(const BufferPool &) = delete;
+
+    // Make the page resident and pin it. The returned pointer stays valid until the page is unpinned
+    char *pinPage(PageId pageId);
+
+    // Release a pin. Pass dirty = true if the whole page may have been modified while pinned
+    void unpinPage(PageId pageId, bool dirty);
+
+    // Record that a byte range of a pinned page was modified
+    void markDirty(PageId pageId, size_t offset, size_t size);
+
+    // Write the page back if it is resident and dirty
+    void flushPage(PageId pageId);
+
+    // Copy the page into data (pageSize() bytes) without making it resident: from its frame if it is resident,
+    // otherwise from the store through the I/O queue. done runs once the copy is complete, on an I/O thread or
+    // before this returns, with nullptr or the error
+    void readPageAsync(PageId pageId, char *data, std::function<void(std::exception_ptr)> done);
+
+    // Write back every dirty page
+    void flush();
+
+    // Keep dirty pages resident until the next flush() instead of writing them back on eviction
+    void setNoSteal(bool enabled);
+
+    // Resident dirty pages and their contents, sealed if the pool checksums pages, valid until the pool is
+    // next used
+    std::vector<std::pair<PageId, const char *>> dirtyPages();
+
+    bool isResident(PageId pageId) const;
+
+    // Read-only mapping of a page that is not resident, so that it can be read without copying it into a frame.
+    // Returns nullptr if the store does not map pages or the pool holds a possibly newer copy
+    const char *mappedPage(PageId pageId);
+
+    // Reserve a page in the store for a new bucket
+    PageId allocatePage();
+
+    // Drop a page from the pool without writing it back, e.g. because its bucket is gone. It must not be pinned
+    void discardPage(PageId pageId);
+
+    // Drop a page like discardPage and give it back to the store
+    void freePage(PageId pageId);
+
+    size_t pageSize() const { return store->pageSize(); }
+
+    size_t capacity() const { return capacityPages; }
+
+    // Frames currently allocated; above capacity() only in no-steal mode
+    size_t frameCount() const;
+
+    // Copy of the counters, taken under the pool mutex so it may be read while other threads use the pool
+    BufferPoolStats getStats() const;
+
+    // Work of the page codec, copied under the pool mutex like getStats(); all zero if the store does not
+    // compress pages
+    CompressionStats compressionStats() const;
+};
+
+// Pins a page for the lifetime of the guard
+class PageGuard {
+  private:
+    BufferPool *pool;
+    PageId pageId;
+    char *pageData;
+    bool dirty = false;
+
+  public:
+    PageGuard(BufferPool &pool, PageId pageId) : pool(&pool), pageId(pageId), pageData(pool.pinPage(pageId)) {}
+
+    PageGuard(const PageGuard &) = delete;
+    PageGuard &operator=(const PageGuard &) = delete;
+
+    ~PageGuard() { pool->unpinPage(pageId, dirty); }
+
+    const char *data() const { return pageData; }
+
+    // Access the page for writing; the whole page is written back when it leaves the pool
+    char *mutableData() {
+        dirty = true;
+        return pageData;
+    }
+
+    // Access size bytes at offset for writing; only the touched ranges are written back
+    char *mutableRange(size_t offset, size_t size) {
+        pool->markDirty(pageId, offset, size);
+        return pageData + offset;
+    }
+};
+
+} // namespace ehash
+
+#endif
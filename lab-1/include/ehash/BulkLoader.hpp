@@ -0,0 +1,115 @@
+#ifndef BULKLOADER_HPP
+#define BULKLOADER_HPP
+
+#include "DirectoryFile.hpp"
+#include "Options.hpp"
+#include "PageStore.hpp"
+#include <cstdint>
+#include <fstream>
+#include <functional>
+#include <iosfwd>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace ehash {
+
+// Read the next length-delimited record (a varint length followed by that many bytes, as protobuf's
+// delimited message format lays them out) into record. Returns false at the end of the input
+bool readDelimitedRecord(std::istream &input, std::string &record);
+
+// Append a length-delimited record
+void writeDelimitedRecord(std::ostream &output, std::string_view record);
+
+// Records gathered by a bulk load and the hash of each one's key, stored back to back
+class RecordBatch {
+  private:
+    std::vector<size_t> hashes;
+    std::vector<size_t> ends; // End of every record in bytes
+    std::string bytes;
+
+  public:
+    void add(size_t hashValue, std::string_view record);
+
+    size_t size() const { return hashes.size(); }
+
+    size_t hash(size_t i) const { return hashes[i]; }
+
+    std::string_view record(size_t i) const;
+
+    // Memory the batch takes
+    size_t memoryBytes() const { return bytes.size() + hashes.size() * (sizeof(size_t) + sizeof(size_t)); }
+};
+
+// Builds the pages and directory file of a new extendible hash table from records in one pass. Records are
+// grouped by hash prefix, and every group that does not fit a page is divided by the next hash bit until it
+// does, so each bucket gets the local depth its keys need and the global depth is the deepest of them.
+// Every bucket page is then written once, in page order, and the directory file last. As in the table,
+// buckets stop dividing at Options::maxLocalDepth or when no division could separate their keys, and chain
+// overflow pages instead.
+//
+// Records are held in memory up to Options::bulkLoadMemoryBytes. Past that, they are spilled to partition
+// files by the low SPILL_BITS bits of their hash, and each partition is built on its own; every bucket then
+// has at least that local depth, which a load of that size needs anyway
+class BulkLoader {
+  public:
+    // Given the records whose keys hash the same, in the order they were added, clears keep for every record
+    // that a later record with the same key replaces
+    using DuplicateFilter =
+        std::function<void(const std::vector<std::string_view> &records, std::vector<bool> &keep)>;
+
+  private:
+    static constexpr size_t SPILL_BITS = 8;
+
+    std::string directoryPath;
+    size_t pageSize;
+    Options options;
+    DuplicateFilter filterDuplicates;
+
+    RecordBatch memory;                    // Records not spilled
+    std::string spillDirectory;            // Holds the partition files once records are spilled
+    size_t spillBits = 0;                  // Hash bits that pick the partition; 0 until records are spilled
+    std::vector<std::ofstream> partitions; // Open partition files while records are added
+
+    std::shared_ptr<PageStore> store;
+    DirectoryMeta meta;
+    std::vector<size_t> bucketPrefixes; // Hash prefix of every bucket in meta
+    std::vector<char> page;             // Image of the page being written
+    size_t entryCount = 0;
+
+    // Move the records held in memory to partition files, where every later record goes as well
+    void spill();
+
+    // Write the partition records with the given hash prefix as buckets
+    void buildPartition(const RecordBatch &batch, size_t prefix, size_t depth);
+
+    // Divide records until each group fits in a bucket, and write the buckets
+    void buildBuckets(const RecordBatch &batch, std::vector<size_t> &records, size_t begin, size_t end, size_t prefix,
+                      size_t depth);
+
+    // Write records as one bucket of the given prefix and depth, chaining overflow pages as needed
+    void writeBucket(const RecordBatch &batch, const std::vector<size_t> &records, size_t begin, size_t end,
+                     size_t prefix, size_t depth);
+
+  public:
+    // Load into directoryPath, which must not hold a table, with bucket pages of pageSize bytes
+    BulkLoader(const std::string &directoryPath, size_t pageSize, const Options &options,
+               DuplicateFilter filterDuplicates);
+
+    BulkLoader(const BulkLoader &) = delete;
+    BulkLoader &operator=(const BulkLoader &) = delete;
+
+    // Removes the partition files
+    ~BulkLoader();
+
+    // Add a record whose key hashes to hashValue. A record with the same key as an earlier one replaces it
+    void add(size_t hashValue, std::string_view record);
+
+    // Write every bucket page, sync them and write the directory file. Returns the number of entries stored
+    size_t finish();
+};
+
+} // namespace ehash
+
+#endif
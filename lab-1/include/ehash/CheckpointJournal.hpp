@@ -0,0 +1,38 @@
+#ifndef CHECKPOINTJOURNAL_HPP
+#define CHECKPOINTJOURNAL_HPP
+
+#include "PageStore.hpp"
+#include <optional>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace ehash {
+
+// Images of everything a checkpoint is about to write in place: the dirty bucket pages and the new
+// directory file. A checkpoint makes the journal durable before it touches any page, so a crash halfway
+// through the in-place writes is repaired by writing the journal again on the next open.
+//
+// File layout: a header, then every page as its id followed by its bytes, then the directory file,
+// then a checksum of everything before it. A journal whose checksum does not match was torn while it
+// was being written, before any page was touched, and is ignored.
+struct CheckpointJournal {
+    size_t pageSize = 0;
+    std::vector<std::pair<PageId, std::string>> pages; // Page id and full page image
+    std::string directory;                             // Encoded directory file
+};
+
+// Path of the checkpoint journal of the table stored in directoryPath
+std::string checkpointJournalPath(const std::string &directoryPath);
+
+// Write and sync a journal holding the given pages (pageSize bytes each) and directory file
+void writeCheckpointJournal(const std::string &path, size_t pageSize,
+                            const std::vector<std::pair<PageId, const char *>> &pages, const std::string &directory);
+
+// Read a complete journal, or return std::nullopt if there is none or it was torn. Throws on a journal
+// of another version
+std::optional<CheckpointJournal> readCheckpointJournal(const std::string &path);
+
+} // namespace ehash
+
+#endif
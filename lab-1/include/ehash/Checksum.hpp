@@ -0,0 +1,31 @@
+#ifndef CHECKSUM_HPP
+#define CHECKSUM_HPP
+
+#include <cstddef>
+#include <cstdint>
+
+namespace ehash {
+
+// CRC32C (Castagnoli) of data, used to detect torn or corrupted log records, journal files and bucket pages.
+// Computed with the SSE4.2 crc32 instruction when the CPU has it, and with a lookup table otherwise.
+// Pass the result of a previous call as seed to checksum data that arrives in pieces
+uint32_t checksum(const void *data, size_t size, uint32_t seed = 0);
+
+// Whether checksum() runs on the CPU's CRC32C instruction
+bool hardwareChecksum();
+
+// Bytes at the start of every checksummed page that hold its checksum
+constexpr size_t PAGE_CHECKSUM_SIZE = sizeof(uint32_t);
+
+// Checksum of a page: everything after the checksum field
+uint32_t pageChecksum(const char *page, size_t pageSize);
+
+// Store the checksum of the page in its first PAGE_CHECKSUM_SIZE bytes
+void sealPage(char *page, size_t pageSize);
+
+// Whether the page holds its own checksum. A page of zeros, which a page never written reads as, is intact too
+bool pageIntact(const char *page, size_t pageSize);
+
+} // namespace ehash
+
+#endif
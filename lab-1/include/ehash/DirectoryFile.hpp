@@ -0,0 +1,53 @@
+#ifndef DIRECTORYFILE_HPP
+#define DIRECTORYFILE_HPP
+
+#include "Options.hpp"
+#include "PageStore.hpp"
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <vector>
+
+namespace ehash {
+
+// Shape of an extendible hash directory as stored in the "directory.meta" file of a table.
+//
+// File layout: a fixed header, the bucket table (page id, local depth and number of overflow pages of every
+// bucket), the directory itself as 2^globalDepth bucket table indexes, one per hash prefix, and finally the
+// overflow page ids of every bucket in bucket table order.
+struct DirectoryMeta {
+    struct BucketInfo {
+        PageId pageId;                     // Primary page of the bucket
+        uint32_t localDepth;               // Hash bits shared by every entry of the bucket
+        std::vector<PageId> overflowPages; // Pages chained to the primary page, in chain order
+    };
+
+    uint64_t pageSize = 0;                                   // Bucket page size the table was created with
+    StorageMode storageMode = StorageMode::BucketFiles;      // Layout of the bucket pages on disk
+    PageCompression pageCompression = PageCompression::None; // Codec of the bucket pages
+    uint32_t globalDepth = 0;                                // Hash bits used to index the directory
+    std::vector<BucketInfo> buckets;                         // Bucket table
+    std::vector<uint32_t> directory;                         // Bucket table index of every hash prefix
+};
+
+// Page id after the highest one the buckets of the directory use, primary or overflow
+PageId pageIdsEnd(const DirectoryMeta &meta);
+
+// Path of the directory file of the table stored in directoryPath
+std::string directoryMetaPath(const std::string &directoryPath);
+
+// Serialized form of a directory, as stored in the directory file
+std::string encodeDirectoryMeta(const DirectoryMeta &meta);
+
+// Parse and validate a serialized directory; source names it in error messages
+DirectoryMeta decodeDirectoryMeta(const std::string &bytes, const std::string &source);
+
+// Read a directory file, or return std::nullopt if it does not exist
+std::optional<DirectoryMeta> readDirectoryMeta(const std::string &path);
+
+// Replace the directory file durably; the old file stays intact until the new one is complete
+void writeDirectoryMeta(const std::string &path, const DirectoryMeta &meta);
+
+} // namespace ehash
+
+#endif
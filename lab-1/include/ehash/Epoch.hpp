@@ -0,0 +1,103 @@
+#ifndef EPOCH_HPP
+#define EPOCH_HPP
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+namespace ehash {
+
+// Epoch-based reclamation for objects that readers use without taking a lock.
+//
+// A reader pins the current epoch with a Guard for as long as it may hold pointers to shared objects.
+// A writer that unlinks such an object retires it instead of deleting it; the object is deleted once
+// every reader that was pinned when it was retired has let go of its guard.
+//
+// Readers take slots from a block of READER_SLOTS; while every slot is taken, pinning chains another block
+// rather than waiting, so one thread may hold any number of guards at once.
+class EpochManager {
+  private:
+    static constexpr size_t READER_SLOTS = 128; // Reader slots per block
+    static constexpr size_t RECLAIM_BATCH = 64; // Retired objects that trigger a reclaim
+
+    // Every pinned reader owns a slot on its own cache line, so readers do not contend with each other
+    struct alignas(64) ReaderSlot {
+        std::atomic<uint64_t> epoch{0}; // Epoch the reader pinned, 0 if the slot is free
+    };
+
+    // Reader slots, and the block chained once they were all taken. Blocks stay until the manager is destroyed
+    struct SlotBlock {
+        ReaderSlot slots[READER_SLOTS];
+        std::atomic<SlotBlock *> next{nullptr};
+    };
+
+    struct Retired {
+        uint64_t epoch; // Epoch in which the object was unlinked
+        void *object;
+        void (*destroy)(void *);
+    };
+
+    std::atomic<uint64_t> globalEpoch{1};
+    SlotBlock readers;
+    std::mutex retiredMutex;
+    std::vector<Retired> retired; // Guarded by retiredMutex
+
+    template <typename U> static void destroyObject(void *object) { delete static_cast<U *>(object); }
+
+    void retireObject(void *object, void (*destroy)(void *));
+
+    // Delete the retired objects no pinned reader can still see. The caller holds retiredMutex
+    void reclaimRetired();
+
+    ReaderSlot *pin();
+
+    void unpin(ReaderSlot *slot);
+
+  public:
+    // Pins the current epoch while alive
+    class Guard {
+      private:
+        EpochManager *manager;
+        ReaderSlot *slot;
+
+      public:
+        explicit Guard(EpochManager &manager) : manager(&manager), slot(manager.pin()) {}
+
+        Guard(const Guard &) = delete;
+        Guard &operator=(const Guard &) = delete;
+
+        // Takes over the pin, so a guard can be handed to the caller with what it protects
+        Guard(Guard &&other) noexcept : manager(other.manager), slot(other.slot) { other.manager = nullptr; }
+        Guard &operator=(Guard &&) = delete;
+
+        ~Guard() {
+            if (manager != nullptr) {
+                manager->unpin(slot);
+            }
+        }
+    };
+
+    EpochManager() = default;
+
+    EpochManager(const EpochManager &) = delete;
+    EpochManager &operator=(const EpochManager &) = delete;
+
+    // Deletes every object still retired; no reader may be pinned anymore
+    ~EpochManager();
+
+    // Delete object once no reader pinned now can still use it. It must already be unreachable for
+    // readers that pin from now on
+    template <typename U> void retire(U *object) { retireObject(object, &destroyObject<U>); }
+
+    // Delete the retired objects no pinned reader can still see
+    void reclaim();
+
+    // Objects retired but not deleted yet
+    size_t retiredCount();
+};
+
+} // namespace ehash
+
+#endif
@@ -2,102 +2,859 @@
 #define EXTENSIBLEHASHING_HPP
 
 #include "Bucket.hpp"
+#include "BucketTable.hpp"
+#include "BufferPool.hpp"
+#include "BulkLoader.hpp"
+#include "CheckpointJournal.hpp"
+#include "DirectoryFile.hpp"
+#include "Epoch.hpp"
+#include "Hasher.hpp"
+#include "KeyExtractor.hpp"
+#include "MemoryBudget.hpp"
+#include "Options.hpp"
+#include "PageStore.hpp"
+#include "PinnedEntry.hpp"
+#include "SegmentFile.hpp"
+#include "TableMetrics.hpp"
+#include "WriteAheadLog.hpp"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <filesystem>
+#include <future>
 #include <google/protobuf/message.h>
 #include <iostream>
+#include <istream>
 #include <memory>
+#include <mutex>
 #include <optional>
+#include <shared_mutex>
+#include <stdexcept>
+#include <thread>
 #include <unordered_map>
+#include <unordered_set>
 #include <vector>
 
 namespace ehash {
 
-// ExtensibleHashing class template
-template <typename T> class ExtensibleHashing {
+// ExtensibleHashing class template. KeyExtractor picks the part of an entry that is hashed and compared;
+// Hasher hashes it (see Hasher.hpp). The directory is indexed by the low bits of the hash, so keys whose
+// std::hash leaves those bits poorly mixed, such as integers sharing their low bits, should use WyHasher or
+// Xxh64Hasher. A table must always be opened with the same hasher.
+//
+// A full bucket is split, unless it has reached Options::maxLocalDepth or no split up to that depth could
+// separate its entries (many keys sharing a long hash prefix, or colliding outright). Such a bucket grows a
+// chain of overflow pages instead, so that skewed keys do not keep doubling the directory. Overflow pages
+// that no longer hold a record are given back.
+//
+// Removing entries merges buckets that have become sparse with their buddy (the bucket that differs only
+// in the last hash bit of the pair's local depth), and the directory halves once no bucket needs its
+// full depth, so a table that churns does not keep the size it had at its peak.
+//
+// The table may be used from several threads. Every bucket has a reader-writer latch that changes take
+// exclusively. The directory latch is held shared only while a bucket is being found, and exclusively only
+// while a split or a merge changes the bucket table and the directory. Point lookups take no latch at all:
+// they find the bucket through an atomic copy of the directory and probe it optimistically, validated by
+// the bucket's seqlock (see getEntry). Lookups return a PinnedEntry, which keeps the entry valid while the
+// caller holds it.
+//
+// Buckets read their page on first use. With Options::memoryBudgetBytes set, every table operation first
+// unloads cold buckets while the loaded ones take more than the budget, choosing them with the CLOCK policy
+// over the bucket table, so tables several times larger than memory can be served. An operation itself may
+// still load the buckets it needs, so the budget is exceeded by at most what one operation touches. Unloading
+// retires a bucket's entries like any other change does, so entries callers still hold stay valid, and their
+// memory is freed once the last handle that may reach them is released. With
+// Options::lazyEntries, loaded buckets keep their records serialized and parse an entry when it is first
+// used, so point lookups on large buckets do not parse every record (see Bucket)
+template <typename T, typename KeyExtractor = SerializedKey<T>, typename Hasher = StdHasher>
+class ExtensibleHashing {
     static_assert(std::is_base_of<google::protobuf::Message, T>::value,
                   "T must be a subclass of google::protobuf::Message");
 
+  public:
+    using Key = typename KeyExtractor::KeyType;
+    using EntryPtr = typename Bucket<T, KeyExtractor, Hasher>::EntryPtr; // Entry owned by a bucket
+
   private:
-    size_t globalDepth; // Tracks the depth of the directory (number of bits used for hashing)
+    using BucketType = Bucket<T, KeyExtractor, Hasher>;
+    using PendingEntry = typename BucketType::PendingEntry;
+
+    size_t globalDepth;      // Tracks the depth of the directory (number of bits used for hashing)
+    KeyExtractor extractKey; // Maps an entry to its key
+    std::shared_ptr<EpochManager> epochs = std::make_shared<EpochManager>(); // Outlives the buckets
+
+    using ReadLatch = std::shared_lock<std::shared_mutex>;
+    using WriteLatch = std::unique_lock<std::shared_mutex>;
+
+    // Bucket table entry; several directory slots may refer to the same bucket
+    struct BucketSlot {
+        std::unique_ptr<BucketType> bucket;
+        size_t localDepth;               // Changed only with the directory latch held exclusively as well;
+                                         // so is the bucket's chain of overflow pages
+        PageId pageId;                   // Page that stores the bucket
+        mutable std::shared_mutex latch; // Guards the bucket and its local depth
+        mutable std::atomic<bool> referenced{false}; // Used since the clock hand last passed it
+    };
+
+    // A bucket found through the directory, with its latch held
+    template <typename Latch> struct LatchedBucket {
+        const BucketSlot *slot;
+        Latch latch;
+
+        BucketType &bucket() const { return *slot->bucket; }
+    };
 
-    // Directory that maps hash prefixes to buckets and tracks their local depth
-    struct DirectoryEntry {
-        std::shared_ptr<Bucket<T>> bucket;
-        size_t localDepth;
-        size_t rootBucketIndex;
+    // The directory and every bucket latched exclusively
+    struct TableLatch {
+        WriteLatch directory;
+        std::vector<WriteLatch> buckets;
     };
 
-    std::unordered_map<size_t, std::shared_ptr<DirectoryEntry>> directories;
-    std::string bucketDirectory; // Path where the bucket files are stored
-    size_t maxBucketSize;        // Maximum size of each bucket (multiple of block size)
+    // Copy of the directory that lookups read without the directory latch. A split updates its entries
+    // in place; doubling the directory publishes a new view and retires the old one
+    struct DirectoryView {
+        explicit DirectoryView(size_t globalDepth)
+            : globalDepth(globalDepth), slots(new std::atomic<const BucketSlot *>[size_t{1} << globalDepth]()) {}
+
+        size_t globalDepth;
+        std::unique_ptr<std::atomic<const BucketSlot *>[]> slots;
+    };
+
+    // Optimistic lookups that keep colliding with writers give up and take the bucket latch
+    static constexpr int OPTIMISTIC_ATTEMPTS = 4;
+
+    // Buckets a scan reads ahead of the one it visits by default, with their overflow pages
+    static constexpr size_t SCAN_READAHEAD = 8;
+
+    // Deepest directory the directory file can store
+    static constexpr size_t MAX_DEPTH = 31;
+
+    std::string bucketDirectory;                         // Path where the bucket files are stored
+    size_t maxBucketSize;                                // Maximum size of each bucket (multiple of block size)
+    StorageMode storageMode;                             // Layout of the bucket pages on disk
+    PageCompression pageCompression;                     // Codec of the bucket pages
+    std::shared_ptr<PageStore> pageStore;                // Bucket files or a single segment file
+    std::shared_ptr<IoQueue> ioQueue;                    // Async reads and flush writes; drains before the store closes
+    std::shared_ptr<BufferPool> bufferPool;              // Caches bucket pages between the buckets and their files
+    std::vector<std::unique_ptr<BucketSlot>> buckets;    // Bucket table; slots stay put while it grows
+    std::vector<uint32_t> directory;                     // Bucket table index of every hash prefix (2^globalDepth)
+    bool directoryChanged = false;                       // The directory differs from directory.meta
+    TablePages tablePages;                               // Overflow pages and pages of merged buckets
+    size_t mergeFillBytes;                               // Buddies using fewer bytes than this together merge
+    size_t maxLocalDepth;                                // Full buckets this deep chain overflow pages
+    bool lazyEntries;                                    // Buckets parse records only when they are used
+    mutable std::shared_mutex directoryLatch;            // Guards globalDepth, the directory and the bucket table
+    std::atomic<DirectoryView *> directoryView{nullptr}; // Directory as seen by lookups
+    std::shared_ptr<MemoryBudget> budget;                // Memory the loaded buckets may take
+    mutable TableMetrics metrics;                        // Splits, merges and operation latencies
+    mutable BucketClock clock;                           // Picks the buckets unloaded to stay within the budget
+
+    std::unique_ptr<WriteAheadLog> wal;           // Changes since the last checkpoint, if logging is enabled
+    size_t checkpointLogBytes = 0;                // Log size that wakes the checkpoint thread
+    std::chrono::milliseconds checkpointInterval; // Longest time between background checkpoints
+    std::mutex checkpointMutex;
+    std::condition_variable checkpointWakeup;
+    bool stopCheckpoints = false;
+    std::thread checkpointThread;
 
     // Get the hash prefix (using given depth)
     size_t getHashPrefix(size_t hashValue, size_t depth) const {
-        return hashValue & ((1 << depth) - 1); // Mask hashValue to use only depth bits
+        return hashValue & ((size_t{1} << depth) - 1); // Mask hashValue to use only depth bits
     }
 
-    // Split the bucket and redistribute entries
-    void splitBucket(size_t bucketIndex) {
-        auto oldBucketEntry = directories[bucketIndex];
-        size_t localDepth = oldBucketEntry->localDepth;
+    // Append a bucket stored in pageId to the bucket table and return its index
+    uint32_t addBucket(PageId pageId, size_t localDepth, const std::vector<PageId> &overflowPages = {}) {
+        buckets.push_back(std::unique_ptr<BucketSlot>(
+            new BucketSlot{std::make_unique<BucketType>(bufferPool, epochs, budget, pageId, overflowPages, lazyEntries),
+                           localDepth, pageId}));
+        return buckets.size() - 1;
+    }
+
+    // Count an access to the bucket in the cache counters and protect it from the next unload sweep
+    void touch(const BucketSlot &slot) const {
+        slot.referenced.store(true, std::memory_order_relaxed);
+        budget->countAccess(slot.bucket->isLoaded());
+    }
+
+    // Unload cold buckets while the loaded ones take more than the memory budget, choosing them with the CLOCK
+    // policy (see BucketClock). Only called while no bucket latch is held
+    void enforceMemoryBudget() const { clock.sweep(directoryLatch, buckets, *budget); }
+
+    // Find the bucket of hashValue and latch it. The directory latch is released as soon as the bucket
+    // latch is held (latch crabbing), so work on the bucket does not keep splits of other buckets waiting
+    template <typename Latch> LatchedBucket<Latch> latchBucket(size_t hashValue) const {
+        ReadLatch directoryLock(directoryLatch);
+        const BucketSlot *slot = buckets[directory[getHashPrefix(hashValue, globalDepth)]].get();
+        return {slot, Latch(slot->latch)};
+    }
+
+    // Latch the bucket of hashValue for a lookup. A bucket that has not read its page yet is loaded under
+    // an exclusive latch first, since loading fills in its entries
+    LatchedBucket<ReadLatch> latchForRead(size_t hashValue) const {
+        auto target = latchBucket<ReadLatch>(hashValue);
+        touch(*target.slot);
+        while (!target.bucket().isLoaded()) {
+            target.latch.unlock();
+            latchBucket<WriteLatch>(hashValue).bucket().load();
+            target = latchBucket<ReadLatch>(hashValue);
+        }
+        return target;
+    }
+
+    // Publish a view of the whole directory, retiring the previous one. The directory latch is held
+    void publishDirectoryView() {
+        auto *view = new DirectoryView(globalDepth);
+        for (size_t i = 0; i < directory.size(); ++i) {
+            view->slots[i].store(buckets[directory[i]].get(), std::memory_order_relaxed);
+        }
+        DirectoryView *previous = directoryView.exchange(view, std::memory_order_acq_rel);
+        if (previous != nullptr) {
+            epochs->retire(previous);
+        }
+    }
+
+    // Find the first entry whose key hashes to hashValue and that match accepts without taking a latch.
+    // The bucket is found through the directory view and probed under its seqlock; the lookup is valid if
+    // the bucket did not change while it was probed and the directory still maps hashValue to it
+    // afterwards. Returns false if the caller has to look it up under the bucket latch instead. The caller has
+    // pinned the epoch and keeps it pinned while it uses the entry
+    template <typename Match> bool findEntryOptimistic(size_t hashValue, Match match, T *&found) const {
+        for (int attempt = 0; attempt < OPTIMISTIC_ATTEMPTS; ++attempt) {
+            const DirectoryView *view = directoryView.load(std::memory_order_acquire);
+            const auto &entry = view->slots[getHashPrefix(hashValue, view->globalDepth)];
+            const BucketSlot *slot = entry.load(std::memory_order_acquire);
+            if (!slot->bucket->hasProbeTable()) {
+                return false; // Loading the page takes the latch anyway
+            }
+            if (!slot->bucket->findEntryOptimistic(hashValue, match, found)) {
+                continue;
+            }
+
+            const DirectoryView *current = directoryView.load(std::memory_order_acquire);
+            if (current->slots[getHashPrefix(hashValue, current->globalDepth)].load(std::memory_order_acquire) ==
+                slot) {
+                slot->referenced.store(true, std::memory_order_relaxed);
+                budget->countAccess(true);
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // Look up with find in the bucket of hashValue without waiting for its page to be read. A bucket that has
+    // not read its page yet reads it through the I/O queue; the bucket is searched, and the page parsed, by the
+    // thread that calls get() on the future, which is also when the result is pinned
+    template <typename Find> std::future<std::optional<PinnedEntry<T>>> findAsync(size_t hashValue, Find find) {
+        const BucketSlot *slot;
+        size_t unloads;
+        {
+            auto target = latchBucket<ReadLatch>(hashValue);
+            touch(*target.slot);
+            unloads = budget->unloadCount();
+            if (target.bucket().isLoaded()) {
+                return std::async(std::launch::deferred, [this, hashValue, find]() {
+                    EpochManager::Guard guard(*epochs);
+                    return pinned(std::move(guard), find(latchForRead(hashValue).bucket()));
+                });
+            }
+            slot = target.slot;
+        }
+
+        auto page = std::make_shared<std::vector<char>>(maxBucketSize);
+        auto read = std::make_shared<std::promise<void>>();
+        std::future<void> readDone = read->get_future();
+        bufferPool->readPageAsync(slot->pageId, page->data(), [read](std::exception_ptr error) {
+            if (error) {
+                read->set_exception(error);
+            } else {
+                read->set_value();
+            }
+        });
+
+        return std::async(std::launch::deferred, [this, hashValue, slot, unloads, page, find,
+                                                  readDone = std::move(readDone)]() mutable {
+            // The read runs without the pool latch, so it can tear against a write-back of a bucket that was
+            // loaded meanwhile. Its error only counts if the copy is used
+            std::exception_ptr readError;
+            try {
+                readDone.get();
+            } catch (...) {
+                readError = std::current_exception();
+            }
+            EpochManager::Guard guard(*epochs);
+            auto target = latchBucket<WriteLatch>(hashValue);
+            // A bucket can only become unloaded again by being unloaded, and the buckets splits create and merges
+            // remove are loaded. So while no bucket has been unloaded since the page was read, a slot that is
+            // still unloaded is the one the page was read for and has not changed since. Otherwise the bucket
+            // reads its page again through the pool
+            if (target.slot == slot && budget->unloadCount() == unloads && !target.bucket().isLoaded()) {
+                if (readError) {
+                    std::rethrow_exception(readError);
+                }
+                target.bucket().loadFrom({page->data()});
+            }
+            return pinned(std::move(guard), find(target.bucket()));
+        });
+    }
+
+    // Hand an entry found with the epoch pinned by guard to the caller, with the pin
+    static std::optional<PinnedEntry<T>> pinned(EpochManager::Guard guard, const T *entry) {
+        if (entry == nullptr) {
+            return std::nullopt;
+        }
+        return PinnedEntry<T>(std::move(guard), entry);
+    }
+
+    // Latch the directory and then every bucket, so that no change is in flight
+    TableLatch latchTable() const {
+        TableLatch latch{WriteLatch(directoryLatch), {}};
+        latch.buckets.reserve(buckets.size());
+        for (const auto &slot : buckets) {
+            latch.buckets.emplace_back(slot->latch);
+        }
+        return latch;
+    }
+
+    // Give back the overflow pages of the bucket of hashValue that no longer hold a record
+    void trimOverflowPages(size_t hashValue) {
+        WriteLatch directoryLock(directoryLatch);
+        const BucketSlot &slot = *buckets[directory[getHashPrefix(hashValue, globalDepth)]];
+        WriteLatch latch(slot.latch);
+        tablePages.release(*bufferPool, slot.bucket->releaseEmptyOverflowPages());
+    }
+
+    // Make room in the bucket of hashValue, found full at the given local depth, for entries with the incoming
+    // hashes. The bucket is split and its entries redistributed, unless it has reached maxLocalDepth or no
+    // split up to that depth could separate its entries and the incoming ones; then an overflow page is chained
+    // to it instead. Nothing happens if another thread has split or merged the bucket since. The directory
+    // latch is held exclusively while the bucket table grows and the directory is updated; the entries of a
+    // bucket without overflow pages are then moved under the latches of the two buckets alone
+    void splitBucket(size_t hashValue, size_t fullDepth, const std::vector<size_t> &incoming) {
+        WriteLatch directoryLock(directoryLatch);
+        BucketSlot &oldBucketSlot = *buckets[directory[getHashPrefix(hashValue, globalDepth)]];
+        WriteLatch oldLatch(oldBucketSlot.latch);
+        if (oldBucketSlot.localDepth != fullDepth) {
+            return;
+        }
+
+        BucketType *oldBucket = oldBucketSlot.bucket.get();
+        size_t limitMask = (size_t{1} << maxLocalDepth) - 1;
+        bool separable =
+            std::any_of(incoming.begin(), incoming.end(),
+                        [&](size_t incomingHash) { return ((incomingHash ^ hashValue) & limitMask) != 0; }) ||
+            !oldBucket->hashesShareBits(hashValue, maxLocalDepth);
+        if (fullDepth >= maxLocalDepth || !separable) {
+            tablePages.addOverflowPage(*bufferPool, *oldBucket);
+            return;
+        }
+
+        size_t bucketIndex = getHashPrefix(hashValue, oldBucketSlot.localDepth);
+        size_t localDepth = ++oldBucketSlot.localDepth;
+
+        // Optimistic lookups of either half retry until both hold their entries again
+        typename BucketType::ChangeScope oldChange(*oldBucket);
+
+        bool doubled = localDepth > globalDepth;
+        if (doubled) {
+            globalDepth++; // Increase global depth
+
+            // Double the directory; the new upper half refers to the same buckets as the lower half
+            size_t oldSize = directory.size();
+            directory.resize(oldSize * 2);
+            std::copy_n(directory.begin(), oldSize, directory.begin() + oldSize);
+        }
+
+        uint32_t newSlot = addBucket(bufferPool->allocatePage(), localDepth);
+        metrics.countSplit(doubled);
+        BucketType *newBucket = buckets[newSlot]->bucket.get();
+        WriteLatch newLatch(buckets[newSlot]->latch);
+        typename BucketType::ChangeScope newChange(*newBucket);
 
-        localDepth++;
-        directories[bucketIndex]->localDepth = localDepth;
+        // Every prefix with the new hash bit set now refers to the new bucket
+        size_t newBucketIndex = bucketIndex + (size_t{1} << (localDepth - 1));
+        DirectoryView *view = directoryView.load(std::memory_order_relaxed);
+        for (size_t i = newBucketIndex; i < directory.size(); i += size_t{1} << localDepth) {
+            directory[i] = newSlot;
+            if (!doubled) {
+                view->slots[i].store(buckets[newSlot].get(), std::memory_order_release);
+            }
+        }
+        if (doubled) {
+            publishDirectoryView();
+        }
+        directoryChanged = true;
 
-        size_t newBucketIndex = bucketIndex + (1 << (localDepth - 1));
-        std::string newBucketPath = bucketDirectory + "/bucket_" + std::to_string(newBucketIndex) + ".dat";
-        auto newBucket = std::make_shared<Bucket<T>>(newBucketPath, maxBucketSize);
+        // The halves of a bucket with overflow pages may need overflow pages of their own, which takes the
+        // directory latch
+        bool chained = oldBucket->overflowPageCount() > 0;
+        if (!chained) {
+            directoryLock.unlock();
+        }
 
-        auto oldBucket = oldBucketEntry->bucket;
-        auto entries = oldBucket->retrieveEntries();
+        typename BucketType::ArenaSet arenas;
+        auto entries = oldBucket->retrieveEntries(arenas);
         oldBucket->clear(); // Clear old bucket after moving its entries
+        oldBucket->adoptArenas(arenas);
+        newBucket->adoptArenas(arenas);
 
+        std::vector<PendingEntry> kept;
+        std::vector<PendingEntry> moved;
         for (auto &entry : entries) {
-            std::string serializedKey;
-            entry->SerializeToString(&serializedKey);
-            size_t hashValue = hashKey(serializedKey);
+            size_t entryHash = hashKey(extractKey(*entry));
+            std::string bytes = entry->SerializeAsString();
 
-            size_t newPrefix = getHashPrefix(hashValue, localDepth);
+            size_t newPrefix = getHashPrefix(entryHash, localDepth);
             if (newPrefix == bucketIndex) {
-                oldBucket->addEntry(std::move(entry)); // Keep entry in the old bucket
+                kept.push_back({std::move(entry), std::move(bytes), entryHash}); // Keep entry in the old bucket
             } else {
-                newBucket->addEntry(std::move(entry)); // Move entry to the new bucket
+                moved.push_back({std::move(entry), std::move(bytes), entryHash}); // Move entry to the new bucket
             }
         }
 
-        if (localDepth > globalDepth) {
-            globalDepth++; // Increase global depth
+        if (!chained) {
+            // Each half held by a single page before, so everything is placed
+            if (oldBucket->addEntries(kept) != kept.size() || newBucket->addEntries(moved) != moved.size()) {
+                throw std::runtime_error("Split bucket lost entries that no longer fit in a page");
+            }
+            return;
+        }
+        tablePages.placeWithOverflow(*bufferPool, *oldBucket, kept);
+        tablePages.placeWithOverflow(*bufferPool, *newBucket, moved);
+        tablePages.release(*bufferPool, oldBucket->releaseEmptyOverflowPages());
+    }
 
-            // Double the directory size, referencing the old DirectoryEntry
-            size_t oldSize = 1 << (globalDepth - 1); // Half the size of the new directory
-            for (size_t i = 0; i < oldSize; ++i) {
-                // Create references to the existing directory entries
-                directories[i + oldSize] = directories[i];
+    // Place a batch of entries. Each bucket takes its share of the batch with its page pinned once. A bucket
+    // its share is predicted to overflow is split before any of the share is placed, and each half is checked
+    // the same way, so the buckets are split to the depth the batch needs up front and no entry is placed only
+    // to be moved by a split. What still does not fit is split off together and placed in the halves. If
+    // lastLsn is given, every entry is logged as it is placed, like insertEntry does, and lastLsn is left at
+    // the last record
+    void insertBatch(std::vector<PendingEntry> batch, WriteAheadLog::Lsn *lastLsn) {
+        std::vector<std::vector<PendingEntry>> work;
+        {
+            ReadLatch directoryLock(directoryLatch);
+            std::unordered_map<uint32_t, std::vector<PendingEntry>> groups;
+            for (auto &pending : batch) {
+                groups[directory[getHashPrefix(pending.hashValue, globalDepth)]].push_back(std::move(pending));
+            }
+            for (auto &[slot, group] : groups) {
+                work.push_back(std::move(group));
             }
         }
-        directories[newBucketIndex] =
-            std::make_shared<DirectoryEntry>(DirectoryEntry{newBucket, localDepth, newBucketIndex});
-        // Update the directory with the new bucket
-        for (size_t i = newBucketIndex + (1 << localDepth); i < ((size_t)1 << globalDepth); i += (1 << localDepth)) {
-            directories[i] = directories[newBucketIndex];
+
+        while (!work.empty()) {
+            std::vector<PendingEntry> group = std::move(work.back());
+            work.pop_back();
+
+            auto target = latchBucket<WriteLatch>(group.front().hashValue);
+            touch(*target.slot);
+            size_t depth = target.slot->localDepth;
+
+            // Other threads may have split the bucket since the group was formed
+            size_t prefix = getHashPrefix(group.front().hashValue, depth);
+            auto elsewhere = std::stable_partition(group.begin(), group.end(), [&](const PendingEntry &pending) {
+                return getHashPrefix(pending.hashValue, depth) == prefix;
+            });
+            if (elsewhere != group.end()) {
+                work.emplace_back(std::make_move_iterator(elsewhere), std::make_move_iterator(group.end()));
+                group.erase(elsewhere, group.end());
+            }
+
+            // Buckets that have chained overflow pages or reached maxLocalDepth could not be split, so they take
+            // what fits
+            bool splittable = depth < maxLocalDepth && target.bucket().overflowPageCount() == 0;
+            size_t placed = splittable && !target.bucket().hasRoomFor(group) ? 0 : target.bucket().addEntries(group);
+            if (lastLsn != nullptr) {
+                for (size_t i = 0; i < placed; ++i) {
+                    *lastLsn = wal->append(WriteAheadLog::RecordType::Put, group[i].bytes);
+                }
+            }
+            group.erase(group.begin(), group.begin() + placed);
+            target.latch.unlock();
+            if (group.empty()) {
+                continue;
+            }
+
+            std::vector<size_t> incoming;
+            for (const auto &pending : group) {
+                incoming.push_back(pending.hashValue);
+            }
+            splitBucket(group.front().hashValue, depth, incoming);
+            work.push_back(std::move(group));
+        }
+    }
+
+    // Rebuild the directory and bucket table saved in directory.meta. Buckets read their pages on first use
+    void restoreDirectory(const DirectoryMeta &meta) {
+        if (meta.pageSize != maxBucketSize) {
+            throw std::runtime_error("Hash table in " + bucketDirectory + " uses bucket page size " +
+                                     std::to_string(meta.pageSize));
+        }
+        if (meta.storageMode != storageMode) {
+            throw std::runtime_error("Hash table in " + bucketDirectory + " uses a different storage mode");
+        }
+        if (meta.pageCompression != pageCompression) {
+            throw std::runtime_error("Hash table in " + bucketDirectory + " uses a different page compression");
+        }
+
+        globalDepth = meta.globalDepth;
+        directory = meta.directory;
+        for (const auto &info : meta.buckets) {
+            addBucket(info.pageId, info.localDepth, info.overflowPages);
         }
     }
 
-    size_t addEntryInternal(std::unique_ptr<T> entry, std::size_t entrySize, std::size_t hashValue) {
-        size_t bucketIndex = getHashPrefix(hashValue, globalDepth);
-        auto &targetBucketEntry = directories[bucketIndex];
-        auto &targetBucket = targetBucketEntry->bucket;
+    DirectoryMeta directoryMeta() const {
+        DirectoryMeta meta;
+        meta.pageSize = maxBucketSize;
+        meta.storageMode = storageMode;
+        meta.pageCompression = pageCompression;
+        meta.globalDepth = globalDepth;
+        meta.directory = directory;
+        for (const auto &slot : buckets) {
+            meta.buckets.push_back(
+                {slot->pageId, static_cast<uint32_t>(slot->localDepth), slot->bucket->overflowPages()});
+        }
+        return meta;
+    }
 
-        // Try to add the entry
-        if (!targetBucket->canAddEntry(entrySize)) {
-            splitBucket(targetBucketEntry->rootBucketIndex);
+    // Save the directory. The pages of buckets merged away are given back to the store only now, since the
+    // previous directory file still refers to them
+    void writeDirectory() {
+        writeDirectoryMeta(directoryMetaPath(bucketDirectory), directoryMeta());
+        directoryChanged = false;
+        tablePages.written(*bufferPool);
+    }
 
-            // Retry adding the entry after the split
-            return addEntryInternal(std::move(entry), entrySize, hashValue);
+    // Finish a checkpoint that a crash interrupted, then read the directory file
+    static std::optional<DirectoryMeta> loadDirectory(const std::string &directoryPath) {
+        std::string journalPath = checkpointJournalPath(directoryPath);
+        std::optional<CheckpointJournal> journal = readCheckpointJournal(journalPath);
+        if (journal) {
+            DirectoryMeta meta = decodeDirectoryMeta(journal->directory, journalPath);
+            Options storeOptions;
+            storeOptions.pageCompression = meta.pageCompression;
+            auto store = makePageStore(directoryPath, journal->pageSize, meta.storageMode, storeOptions, 0);
+            for (const auto &[pageId, data] : journal->pages) {
+                store->writePage(pageId, data.data());
+            }
+            store->sync();
+            writeDirectoryMeta(directoryMetaPath(directoryPath), meta);
         }
+        std::filesystem::remove(journalPath);
+        return readDirectoryMeta(directoryMetaPath(directoryPath));
+    }
 
-        targetBucket->addEntry(std::move(entry));
+    // Make every change durable in the bucket pages and the directory file, then empty the log.
+    // The new page images and directory go to a journal first, so that a crash while they are written
+    // in place is repaired on the next open instead of mixing old and new pages.
+    // The caller holds the table latch, unless no other thread can use the table yet
+    void checkpoint() {
+        auto pages = bufferPool->dirtyPages();
+        if (pages.empty() && !directoryChanged && !tablePages.hasChanged() && (!wal || wal->size() == 0)) {
+            return;
+        }
 
-        return hashValue;
+        std::string journalPath = checkpointJournalPath(bucketDirectory);
+        pageStore->sync(); // Pages allocated since the last checkpoint must exist before the journal names them
+        writeCheckpointJournal(journalPath, maxBucketSize, pages, encodeDirectoryMeta(directoryMeta()));
+        bufferPool->flush();
+        pageStore->sync();
+        writeDirectory();
+        std::filesystem::remove(journalPath);
+        if (wal) {
+            wal->reset();
+        }
+    }
+
+    // Apply the changes recorded in a log on top of the pages of the last checkpoint
+    void replayLog(WriteAheadLog &log) {
+        log.replay([this](WriteAheadLog::RecordType type, const std::string &payload) {
+            auto entry = std::make_unique<T>();
+            if (!entry->ParseFromString(payload)) {
+                throw std::runtime_error("Corrupted entry in the write-ahead log of " + bucketDirectory);
+            }
+            if (type == WriteAheadLog::RecordType::Put) {
+                insertEntry(std::move(entry));
+            } else if (type == WriteAheadLog::RecordType::Erase) {
+                eraseEntry(extractKey(*entry));
+            }
+        });
+    }
+
+    void runCheckpoints() {
+        std::unique_lock<std::mutex> lock(checkpointMutex);
+        while (!stopCheckpoints) {
+            checkpointWakeup.wait_for(lock, checkpointInterval);
+            if (stopCheckpoints) {
+                break;
+            }
+            lock.unlock();
+            try {
+                TableLatch tableLatch = latchTable();
+                checkpoint();
+            } catch (const std::exception &e) {
+                std::cerr << "Background checkpoint failed: " << e.what() << std::endl;
+            }
+            lock.lock();
+        }
+    }
+
+    // Recover the changes logged since the last checkpoint. With logging enabled, dirty pages stay in the
+    // buffer pool until a checkpoint, which a background thread runs periodically and when the log grows
+    void openLog(const Options &options) {
+        std::string logPath = bucketDirectory + "/wal.log";
+        bufferPool->setNoSteal(true);
+
+        if (!options.writeAheadLog) {
+            if (std::filesystem::exists(logPath)) {
+                // The table was last used with a log: apply it and drop it
+                WriteAheadLog log(logPath, std::chrono::microseconds(0));
+                replayLog(log);
+                checkpoint();
+                std::filesystem::remove(logPath);
+            }
+            bufferPool->setNoSteal(false);
+            return;
+        }
+
+        wal = std::make_unique<WriteAheadLog>(logPath, std::chrono::microseconds(options.groupCommitWindowMicros));
+        replayLog(*wal);
+        checkpoint(); // Start from a durable directory file and an empty log
+        checkpointLogBytes = options.checkpointLogBytes;
+        checkpointInterval = std::chrono::milliseconds(options.checkpointIntervalMillis);
+        checkpointThread = std::thread([this] { runCheckpoints(); });
+    }
+
+    void stopCheckpointThread() {
+        if (!checkpointThread.joinable()) {
+            return;
+        }
+        {
+            std::lock_guard<std::mutex> lock(checkpointMutex);
+            stopCheckpoints = true;
+        }
+        checkpointWakeup.notify_one();
+        checkpointThread.join();
+    }
+
+    // Add an entry, or replace the entry with the same key. If lsn is given, the change is appended to the
+    // write-ahead log while its bucket is still latched, so that changes to one key are logged in the order
+    // they are made, and lsn is set to the record
+    size_t insertEntry(std::unique_ptr<T> entry, WriteAheadLog::Lsn *lsn = nullptr) {
+        size_t entrySize = entry->ByteSizeLong();
+        checkEntrySize(entrySize, maxBucketSize);
+        std::string record = lsn != nullptr ? entry->SerializeAsString() : std::string();
+        size_t hashValue = hashKey(extractKey(*entry));
+
+        while (true) {
+            auto target = latchBucket<WriteLatch>(hashValue);
+            touch(*target.slot);
+            BucketType &bucket = target.bucket();
+
+            // An update that no longer fits its page removes the old entry and is inserted like a new one
+            if (bucket.updateEntry(entry, hashValue) ||
+                (bucket.canAddEntry(entrySize) && bucket.addEntry(std::move(entry), hashValue))) {
+                if (lsn != nullptr) {
+                    *lsn = wal->append(WriteAheadLog::RecordType::Put, record);
+                }
+                return hashValue;
+            }
+
+            // Splitting needs the directory latch, which is never waited for while holding a bucket latch
+            size_t fullDepth = target.slot->localDepth;
+            target.latch.unlock();
+            splitBucket(hashValue, fullDepth, {hashValue});
+        }
+    }
+
+    // Remove the entry with the given key, logged like insertEntry does if lsn is given, and merge its
+    // bucket if that leaves it sparse. Returns false if there was no such entry
+    bool eraseEntry(const Key &key, WriteAheadLog::Lsn *lsn = nullptr) {
+        size_t hashValue = hashKey(key);
+        auto target = latchBucket<WriteLatch>(hashValue);
+        touch(*target.slot);
+        BucketType &bucket = target.bucket();
+
+        std::string record;
+        if (lsn != nullptr) {
+            T *entry = bucket.findEntry(key, hashValue);
+            if (entry == nullptr) {
+                return false;
+            }
+            record = entry->SerializeAsString();
+        }
+        if (!bucket.removeEntry(key, hashValue)) {
+            return false;
+        }
+        if (lsn != nullptr) {
+            *lsn = wal->append(WriteAheadLog::RecordType::Erase, record);
+        }
+
+        size_t depth = target.slot->localDepth;
+        size_t used = bucket.usedSpace();
+        bool emptyOverflowPage = bucket.overflowPageCount() > 0 && bucket.hasEmptyOverflowPage();
+        target.latch.unlock();
+        if (emptyOverflowPage) {
+            trimOverflowPages(hashValue);
+        }
+        if (used < mergeFillBytes) {
+            // A merged bucket is sparse as well, so it may merge with its own buddy in turn
+            while (depth > 0 && mergeBucket(hashValue, depth)) {
+                depth--;
+            }
+        }
+        return true;
+    }
+
+    // Merge the bucket of hashValue, found sparse at the given local depth, with its buddy if both still
+    // have that depth and their entries together fill less than mergeFillBytes. The lower half keeps its
+    // bucket, as in a split; the buddy's page is freed with the next directory write. The directory halves
+    // while no bucket uses its full depth. Returns whether the buckets were merged
+    bool mergeBucket(size_t hashValue, size_t depth) {
+        size_t buddyBit = size_t{1} << (depth - 1);
+        {
+            // Most sparse buckets have a full buddy: find out without holding up the whole table
+            auto buddy = latchBucket<WriteLatch>(hashValue ^ buddyBit);
+            if (buddy.slot->localDepth != depth || buddy.bucket().usedSpace() >= mergeFillBytes) {
+                return false;
+            }
+        }
+
+        WriteLatch directoryLock(directoryLatch);
+        if (depth > globalDepth) {
+            return false; // Another merge has halved the directory since
+        }
+        size_t keptPrefix = getHashPrefix(hashValue, depth) & ~buddyBit;
+        size_t gonePrefix = keptPrefix | buddyBit;
+        uint32_t keptIndex = directory[keptPrefix];
+        uint32_t goneIndex = directory[gonePrefix];
+        BucketSlot &keptSlot = *buckets[keptIndex];
+        BucketSlot &goneSlot = *buckets[goneIndex];
+        if (keptSlot.localDepth != depth || goneSlot.localDepth != depth) {
+            return false;
+        }
+
+        // In bucket table order, like latchTable
+        WriteLatch keptLatch(keptSlot.latch, std::defer_lock);
+        WriteLatch goneLatch(goneSlot.latch, std::defer_lock);
+        if (keptIndex < goneIndex) {
+            keptLatch.lock();
+            goneLatch.lock();
+        } else {
+            goneLatch.lock();
+            keptLatch.lock();
+        }
+        BucketType &kept = *keptSlot.bucket;
+        BucketType &gone = *goneSlot.bucket;
+        if (kept.usedSpace() + gone.usedSpace() >= mergeFillBytes) {
+            return false;
+        }
+
+        {
+            // Optimistic lookups of the buddy retry until the directory refers to the kept bucket
+            typename BucketType::ChangeScope keptChange(kept);
+            typename BucketType::ChangeScope goneChange(gone);
+
+            typename BucketType::ArenaSet arenas;
+            std::vector<PendingEntry> moved;
+            for (auto &entry : gone.retrieveEntries(arenas)) {
+                size_t entryHash = hashKey(extractKey(*entry));
+                std::string bytes = entry->SerializeAsString();
+                moved.push_back({std::move(entry), std::move(bytes), entryHash});
+            }
+            // Free space split across the page may not take everything
+            tablePages.placeWithOverflow(*bufferPool, kept, moved);
+            kept.adoptArenas(arenas);
+            keptSlot.localDepth--;
+            tablePages.release(*bufferPool, kept.releaseEmptyOverflowPages());
+
+            DirectoryView *view = directoryView.load(std::memory_order_relaxed);
+            for (size_t i = gonePrefix; i < directory.size(); i += size_t{1} << depth) {
+                directory[i] = keptIndex;
+                view->slots[i].store(&keptSlot, std::memory_order_release);
+            }
+        }
+        std::vector<PageId> gonePages = gone.overflowPages();
+        gonePages.push_back(goneSlot.pageId);
+        tablePages.release(*bufferPool, gonePages);
+
+        // The buckets after the gap move down, so that the table keeps the order the buckets were created in
+        std::unique_ptr<BucketSlot> removed = std::move(buckets[goneIndex]);
+        buckets.erase(buckets.begin() + goneIndex);
+        for (auto &index : directory) {
+            if (index > goneIndex) {
+                index--;
+            }
+        }
+        directoryChanged = true;
+
+        size_t halvings = 0;
+        while (globalDepth > 0 && std::all_of(buckets.begin(), buckets.end(), [&](const auto &slot) {
+                   return slot->localDepth < globalDepth;
+               })) {
+            globalDepth--;
+            directory.resize(directory.size() / 2);
+            halvings++;
+        }
+        if (halvings > 0) {
+            publishDirectoryView();
+        }
+        metrics.countMerge(halvings);
+
+        // Optimistic lookups may still be probing the buddy
+        goneLatch.unlock();
+        epochs->retire(removed.release());
+        return true;
+    }
+
+    // Wait until the log holds everything up to lsn, and wake the checkpoint thread if the log or the
+    // buffer pool has grown too large
+    void commitLog(WriteAheadLog::Lsn lsn) {
+        wal->commit(lsn);
+        if (wal->size() >= checkpointLogBytes || bufferPool->frameCount() > bufferPool->capacity()) {
+            checkpointWakeup.notify_one();
+        }
+    }
+
+    ExtensibleHashing(const std::string &directoryPath, size_t pageSize, size_t initialGlobalDepth,
+                      const Options &options, const std::optional<DirectoryMeta> &meta)
+        : globalDepth(initialGlobalDepth), bucketDirectory(directoryPath), maxBucketSize(pageSize),
+          storageMode(options.storageMode), pageCompression(options.pageCompression),
+          mergeFillBytes(static_cast<size_t>(options.mergeFillFactor * (pageSize - SlottedPageView::HEADER_SIZE))),
+          maxLocalDepth(options.maxLocalDepth), lazyEntries(options.lazyEntries),
+          budget(std::make_shared<MemoryBudget>(options.memoryBudgetBytes)), metrics(options.recordLatencies) {
+        if (maxLocalDepth > MAX_DEPTH) {
+            throw std::runtime_error("Maximum local depth must not exceed " + std::to_string(MAX_DEPTH));
+        }
+        if (!(options.mergeFillFactor >= 0.0 && options.mergeFillFactor <= 1.0)) {
+            throw std::runtime_error("Merge fill factor must be between 0 and 1");
+        }
+        // New bucket files are numbered after the ones the saved table uses
+        PageId nextPageId = meta ? pageIdsEnd(*meta) : 0;
+        pageStore = makePageStore(bucketDirectory, maxBucketSize, storageMode, options, nextPageId);
+        if (options.readMode == ReadMode::Mmap) {
+            pageStore->enableMapping(options.accessPattern);
+        }
+        ioQueue = makeIoQueue(options.ioBackend, options.ioQueueDepth);
+        bufferPool = std::make_shared<BufferPool>(
+            pageStore, options.bufferPoolPages, ioQueue,
+            options.verifyChecksums ? PageChecksums::Verify : PageChecksums::Seal);
+
+        if (meta) {
+            restoreDirectory(*meta);
+        } else {
+            // Initialize the directory with empty buckets
+            for (size_t i = 0; i < (size_t{1} << globalDepth); ++i) {
+                directory.push_back(addBucket(bufferPool->allocatePage(), globalDepth));
+            }
+            directoryChanged = true;
+        }
+        publishDirectoryView();
+
+        openLog(options);
     }
 
   public:
@@ -105,86 +862,539 @@ template <typename T> class ExtensibleHashing {
         : ExtensibleHashing(directoryPath, bucketSize, 1) {}
 
     ExtensibleHashing(const std::string &directoryPath, size_t bucketSize, size_t initialGlobalDepth)
-        : globalDepth(initialGlobalDepth), bucketDirectory(directoryPath), maxBucketSize(bucketSize) {
-        // Initialize the directory with empty buckets
-        for (size_t i = 0; i < ((size_t)1 << globalDepth); ++i) {
-            std::string bucketPath = bucketDirectory + "/bucket_" + std::to_string(i) + ".dat";
-            directories[i] = std::make_shared<DirectoryEntry>(
-                DirectoryEntry{std::make_shared<Bucket<T>>(bucketPath, maxBucketSize), globalDepth, i});
+        : ExtensibleHashing(directoryPath, bucketSize, initialGlobalDepth, Options{}) {}
+
+    // Create a table, or reopen the table saved in directoryPath with its directory and depths
+    // (initialGlobalDepth is then ignored)
+    ExtensibleHashing(const std::string &directoryPath, size_t bucketSize, size_t initialGlobalDepth,
+                      const Options &options)
+        : ExtensibleHashing(directoryPath, bucketPageSize(directoryPath, bucketSize), initialGlobalDepth, options,
+                            loadDirectory(directoryPath)) {}
+
+    // Reopen the table saved in directoryPath. Only directory.meta is read; bucket size and storage mode
+    // come from it, and each bucket reads its page the first time it is used.
+    // The storage mode and page compression in options are ignored
+    static std::unique_ptr<ExtensibleHashing> open(const std::string &directoryPath, Options options = {}) {
+        std::optional<DirectoryMeta> meta = loadDirectory(directoryPath);
+        if (!meta) {
+            throw std::runtime_error("No hash table directory file in " + directoryPath);
+        }
+        options.storageMode = meta->storageMode;
+        options.pageCompression = meta->pageCompression;
+        return std::unique_ptr<ExtensibleHashing>(
+            new ExtensibleHashing(directoryPath, meta->pageSize, meta->globalDepth, options, meta));
+    }
+
+    // Build a new table in directoryPath from length-delimited records (see readDelimitedRecord), such as a
+    // snapshot, and open it. Instead of growing by splits, every bucket is written once at the depth its keys
+    // need (see BulkLoader). A record replaces an earlier one with the same key, as with addEntry. With a key
+    // extractor that finds keys in records, records are stored as they are, so they must be serialized the
+    // way the table would serialize them
+    static std::unique_ptr<ExtensibleHashing> bulkLoad(const std::string &directoryPath, size_t bucketSize,
+                                                       std::istream &records, const Options &options = {}) {
+        std::filesystem::create_directories(directoryPath);
+        if (readDirectoryMeta(directoryMetaPath(directoryPath))) {
+            throw std::runtime_error("Directory " + directoryPath + " already holds a hash table");
+        }
+
+        KeyExtractor extractKey;
+        BulkLoader loader(directoryPath, bucketPageSize(directoryPath, bucketSize), options,
+                          [&extractKey, &directoryPath](const std::vector<std::string_view> &sameHash,
+                                                        std::vector<bool> &keep) {
+                              std::vector<Key> keys;
+                              T entry;
+                              for (std::string_view record : sameHash) {
+                                  if constexpr (HasRecordKeys<KeyExtractor>::value) {
+                                      keys.emplace_back(extractKey.fromRecord(record));
+                                  } else {
+                                      // Records were parsed when they were added, so this one was damaged
+                                      // in a spill file
+                                      if (!entry.ParseFromArray(record.data(), record.size())) {
+                                          throw std::runtime_error("Corrupted spilled record in bulk load of " +
+                                                                   directoryPath);
+                                      }
+                                      keys.push_back(extractKey(entry));
+                                  }
+                              }
+                              for (size_t i = 0; i < keys.size(); ++i) {
+                                  for (size_t j = i + 1; j < keys.size() && keep[i]; ++j) {
+                                      keep[i] = !(keys[i] == keys[j]);
+                                  }
+                              }
+                          });
+
+        std::string record;
+        T entry;
+        while (readDelimitedRecord(records, record)) {
+            if constexpr (HasRecordKeys<KeyExtractor>::value) {
+                loader.add(BucketType::hashOfRecordKey(extractKey, record), record);
+            } else {
+                if (!entry.ParseFromString(record)) {
+                    throw std::runtime_error("Corrupted record in bulk load input for " + directoryPath);
+                }
+                loader.add(BucketType::hashOf(extractKey(entry)), entry.SerializeAsString());
+            }
+        }
+        loader.finish();
+        return open(directoryPath, options);
+    }
+
+    ExtensibleHashing(const ExtensibleHashing &) = delete;
+    ExtensibleHashing &operator=(const ExtensibleHashing &) = delete;
+
+    ~ExtensibleHashing() {
+        stopCheckpointThread();
+        try {
+            flush();
+        } catch (const std::exception &e) {
+            std::cerr << "Failed to flush hash table: " << e.what() << std::endl;
         }
+        delete directoryView.load(std::memory_order_relaxed);
+        epochs->reclaim(); // Buckets merged away hold on to the epoch manager
     }
 
+    // Add an entry, or replace the entry with the same key. With a write-ahead log the change is durable
+    // when this returns; concurrent callers share log syncs
     size_t addEntry(std::unique_ptr<T> entry) {
-        // Serialize the key once
-        std::string serializedKey;
-        entry->SerializeToString(&serializedKey);
+        TableMetrics::Timer timer(metrics, TableMetrics::Operation::Insert);
+        enforceMemoryBudget();
+        if (!wal) {
+            return insertEntry(std::move(entry));
+        }
 
-        size_t hashValue = hashKey(serializedKey);
-        size_t bucketIndex = getHashPrefix(hashValue, globalDepth);
+        WriteAheadLog::Lsn lsn = 0;
+        size_t hashValue = insertEntry(std::move(entry), &lsn);
+        commitLog(lsn);
+        return hashValue;
+    }
 
-        auto &targetBucketEntry = directories[bucketIndex];
-        auto &targetBucket = targetBucketEntry->bucket;
+    // Add or replace a batch of entries, as if by addEntry in order, and return the hash of each.
+    // Entries are serialized and hashed once up front and grouped by bucket, so every touched bucket page
+    // is pinned once per share of the batch rather than once per entry. Buckets the batch would overflow are
+    // split before any of it goes in.
+    // With a write-ahead log the whole batch is committed with a single sync
+    std::vector<size_t> addEntries(std::vector<std::unique_ptr<T>> newEntries) {
+        TableMetrics::Timer timer(metrics, TableMetrics::Operation::BatchInsert);
+        enforceMemoryBudget();
+        std::vector<size_t> hashes;
+        std::vector<PendingEntry> batch;
+        hashes.reserve(newEntries.size());
+        batch.reserve(newEntries.size());
+        for (auto &entry : newEntries) {
+            std::string bytes = entry->SerializeAsString();
+            checkEntrySize(bytes.size(), maxBucketSize);
+            size_t hashValue = hashKey(extractKey(*entry));
+            hashes.push_back(hashValue);
+            batch.push_back({std::move(entry), std::move(bytes), hashValue});
+        }
+        if (batch.empty()) {
+            return hashes;
+        }
 
-        if (targetBucket->hasKey(serializedKey)) {
-            targetBucket->updateEntry(std::move(entry));
-            return hashValue;
+        if (!wal) {
+            insertBatch(std::move(batch), nullptr);
+            return hashes;
         }
 
-        // Try to add the entry
-        if (!targetBucket->canAddEntry(serializedKey.size())) {
+        WriteAheadLog::Lsn lsn = 0;
+        insertBatch(std::move(batch), &lsn);
+        commitLog(lsn);
+        return hashes;
+    }
 
-            splitBucket(targetBucketEntry->rootBucketIndex);
+    // Remove the entry with the given key and return whether there was one. With a write-ahead log the removal
+    // is durable when this returns
+    bool removeEntry(const Key &key) {
+        TableMetrics::Timer timer(metrics, TableMetrics::Operation::Remove);
+        enforceMemoryBudget();
+        if (!wal) {
+            return eraseEntry(key);
+        }
 
-            // Retry adding the entry after the split
-            return addEntryInternal(std::move(entry), serializedKey.size(), hashValue);
+        WriteAheadLog::Lsn lsn = 0;
+        if (!eraseEntry(key, &lsn)) {
+            return false;
         }
+        commitLog(lsn);
+        return true;
+    }
 
-        targetBucket->addEntry(std::move(entry));
+    // Every entry in the bucket of the given entry's key
+    PinnedEntries<T> getEntries(const std::unique_ptr<T> entry) const {
+        return getEntries(hashKey(extractKey(*entry)));
+    }
 
-        return hashValue;
+    // Every entry in the bucket of hash, collected under the bucket latch
+    PinnedEntries<T> getEntries(const size_t &hash) const {
+        enforceMemoryBudget();
+        EpochManager::Guard guard(*epochs);
+        std::vector<const T *> entries;
+        {
+            auto target = latchForRead(hash);
+            for (const auto &entry : target.bucket().getEntries()) {
+                entries.push_back(entry.get());
+            }
+        }
+        return PinnedEntries<T>(std::move(guard), std::move(entries));
     }
 
-    const std::vector<std::unique_ptr<T>> &getEntries(const std::unique_ptr<T> entry) const {
-        std::string serializedKey;
-        entry->SerializeToString(&serializedKey);
+    // First entry whose key hashes to hash. Takes no latch unless writers keep changing the bucket
+    std::optional<PinnedEntry<T>> getEntry(const size_t &hash) const {
+        TableMetrics::Timer timer(metrics, TableMetrics::Operation::Lookup);
+        enforceMemoryBudget();
+        EpochManager::Guard guard(*epochs);
+        T *entry;
+        if (!findEntryOptimistic(hash, [](const T &) { return true; }, entry)) {
+            entry = latchForRead(hash).bucket().findEntryByHash(hash);
+        }
+        return pinned(std::move(guard), entry);
+    }
 
-        size_t hashValue = hashKey(serializedKey);
-        size_t bucketIndex = getHashPrefix(hashValue, globalDepth);
-        return directories.at(bucketIndex)->bucket->getEntries();
+    // Like getEntry, but a bucket that has not read its page yet starts reading it in the background, so that
+    // the reads of many lookups are in flight at once. The page is parsed when get() is called on the future,
+    // on the calling thread; that must happen before the table is destroyed
+    std::future<std::optional<PinnedEntry<T>>> getEntryAsync(size_t hash) {
+        enforceMemoryBudget();
+        return findAsync(hash, [hash](BucketType &bucket) { return bucket.findEntryByHash(hash); });
     }
 
-    const std::vector<std::unique_ptr<T>> &getEntries(const size_t &hash) const {
-        size_t bucketIndex = getHashPrefix(hash, globalDepth);
-        return directories.at(bucketIndex)->bucket->getEntries();
+    // Like get, with the page read in the background as in getEntryAsync
+    std::future<std::optional<PinnedEntry<T>>> getAsync(const Key &key) {
+        enforceMemoryBudget();
+        size_t hashValue = hashKey(key);
+        return findAsync(hashValue, [key, hashValue](BucketType &bucket) { return bucket.findEntry(key, hashValue); });
     }
 
-    std::optional<T *> getEntry(const size_t &hash) const {
-        size_t bucketIndex = getHashPrefix(hash, globalDepth);
-        const auto &entries = directories.at(bucketIndex)->bucket->getEntries();
+    // Look up the entry with the given key. Takes no latch unless writers keep changing the bucket
+    std::optional<PinnedEntry<T>> get(const Key &key) const {
+        TableMetrics::Timer timer(metrics, TableMetrics::Operation::Lookup);
+        enforceMemoryBudget();
+        size_t hashValue = hashKey(key);
+        EpochManager::Guard guard(*epochs);
+        T *entry;
+        if (!findEntryOptimistic(hashValue, [&](const T &candidate) { return extractKey(candidate) == key; },
+                                 entry)) {
+            entry = latchForRead(hashValue).bucket().findEntry(key, hashValue);
+        }
+        return pinned(std::move(guard), entry);
+    }
 
-        for (const auto &entry : entries) {
-            std::string serializedKey;
-            entry->SerializeToString(&serializedKey);
+    size_t hashKey(const Key &key) const { return BucketType::hashOf(key); }
 
-            if (hashKey(serializedKey) == hash) {
-                return entry.get();
+    // Scan over every entry of the table, one bucket at a time, visiting the buckets in the order of their
+    // primary pages in the file. The scan notes the hash range of every bucket when it starts; each step latches
+    // the directory only to find the buckets that hold the next range now, and keeps them latched shared until
+    // the following step. So splits, merges and writers to other buckets go on while a scan is open, and every
+    // entry that stays in the table meanwhile is visited once. The scanning thread must not use the table
+    // between steps. The pages of the next buckets, overflow pages included, are read ahead through the I/O
+    // queue while the caller works on the current one. Buckets the scan loads are unloaded again once visited
+    // while the loaded buckets take more than the memory budget, so scanning a table larger than memory does not
+    // evict its hot buckets
+    class Scan {
+      public:
+        Scan(Scan &&) = default;
+        Scan &operator=(Scan &&) = delete;
+        ~Scan() {
+            latches.clear();
+            if (!loadedByScan.empty()) {
+                ReadLatch directoryLock(table->directoryLatch);
+                unloadVisited();
             }
         }
 
-        return std::nullopt;
-    }
+        // Entries of the next bucket, latched until the next call, or nullptr once every bucket has been visited
+        const std::vector<const T *> *next() {
+            latches.clear();
+            ReadLatch directoryLock(table->directoryLatch);
+            unloadVisited();
+            if (position == order.size()) {
+                return nullptr;
+            }
+            const Range &range = order[position];
+            Readahead read = std::move(pending.front());
+            pending.pop_front();
+            position++;
+            issueReads();
+
+            stepEntries.clear();
+            for (const BucketSlot *slot : slotsOf(range)) {
+                visit(*slot, range, read);
+            }
+            return &stepEntries;
+        }
+
+      private:
+        friend class ExtensibleHashing;
+
+        // Hashes that one bucket held when the scan started, and the page it was stored in
+        struct Range {
+            size_t prefix;
+            size_t depth;
+            PageId pageId;
+        };
+
+        // Pages of a bucket ahead of the scan
+        struct Readahead {
+            std::vector<PageId> pageIds; // Chain of the bucket when the reads were issued; empty if none were
+            std::vector<std::shared_ptr<std::vector<char>>> pages;
+            std::vector<std::future<void>> done;
+            size_t otherUnloads = 0; // Buckets unloaded by others when the reads were issued
+        };
+
+        const ExtensibleHashing *table;
+        std::vector<Range> order;                     // Ranges by primary page
+        size_t position = 0;                          // Index in order of the next range to visit
+        size_t readahead;                             // Ranges read ahead of the one being visited
+        std::deque<Readahead> pending;                // Reads of order[position] onwards
+        std::vector<ReadLatch> latches;               // Buckets of the current step
+        std::vector<const T *> stepEntries;           // Entries of the current step
+        std::vector<const BucketSlot *> loadedByScan; // Buckets of the current step the scan loaded
+        std::unordered_set<PageId> unloadedByScan;    // Primary pages of the buckets the scan unloaded
+        size_t ownUnloads = 0;
+
+        Scan(const ExtensibleHashing *table, size_t readahead)
+            : table(table), readahead(std::max<size_t>(readahead, 1)) {
+            ReadLatch directoryLock(table->directoryLatch);
+            for (size_t i = 0; i < table->directory.size(); ++i) {
+                const BucketSlot &slot = *table->buckets[table->directory[i]];
+                // The first index that refers to a bucket is its hash prefix
+                if (i < (size_t{1} << slot.localDepth)) {
+                    order.push_back({i, slot.localDepth, slot.pageId});
+                }
+            }
+            std::sort(order.begin(), order.end(), [](const Range &a, const Range &b) { return a.pageId < b.pageId; });
+            issueReads();
+        }
 
-    size_t hashKey(const std::string &key) const { return std::hash<std::string>{}(key); }
+        size_t otherUnloads() const { return table->budget->unloadCount() - ownUnloads; }
+
+        // Buckets that hold the hashes of range now: the bucket it was, the halves it has been split into or the
+        // bucket it has been merged into. The directory latch is held
+        std::vector<const BucketSlot *> slotsOf(const Range &range) const {
+            std::vector<const BucketSlot *> slots;
+            size_t size = table->directory.size();
+            for (size_t i = range.prefix & (size - 1); i < size; i += size_t{1} << range.depth) {
+                slots.push_back(table->buckets[table->directory[i]].get());
+            }
+            std::sort(slots.begin(), slots.end());
+            slots.erase(std::unique(slots.begin(), slots.end()), slots.end());
+            return slots;
+        }
+
+        // Latch a bucket of the current step, loading it first if needed, and collect its entries in range. A
+        // bucket merged since the scan started holds other ranges as well. The directory latch is held
+        void visit(const BucketSlot &slot, const Range &range, Readahead &read) {
+            ReadLatch latch(slot.latch);
+            while (!slot.bucket->isLoaded()) {
+                latch.unlock();
+                {
+                    WriteLatch loading(slot.latch);
+                    if (!slot.bucket->isLoaded()) {
+                        slot.bucket->loadFrom(pageCopies(slot, read));
+                        loadedByScan.push_back(&slot);
+                    }
+                }
+                latch = ReadLatch(slot.latch);
+            }
+            bool merged = slot.localDepth < range.depth;
+            for (const auto &entry : slot.bucket->getEntries()) {
+                if (!merged ||
+                    table->getHashPrefix(table->hashKey(table->extractKey(*entry)), range.depth) == range.prefix) {
+                    stepEntries.push_back(entry.get());
+                }
+            }
+            latches.push_back(std::move(latch));
+        }
+
+        // Pages read ahead for the bucket in slot, if they are still its chain and still hold it. Same reasoning
+        // as in findAsync: while no other bucket has been unloaded since the pages were read, a bucket that is
+        // still unloaded has not changed since, unless the scan itself unloaded it
+        std::vector<const char *> pageCopies(const BucketSlot &slot, Readahead &read) {
+            std::vector<const char *> copies;
+            if (read.pageIds.empty() || read.pageIds.front() != slot.pageId ||
+                otherUnloads() != read.otherUnloads || unloadedByScan.count(slot.pageId) != 0) {
+                return copies;
+            }
+            std::vector<PageId> overflow = slot.bucket->overflowPages();
+            if (!std::equal(overflow.begin(), overflow.end(), read.pageIds.begin() + 1, read.pageIds.end())) {
+                return copies;
+            }
+            for (size_t i = 0; i < read.pageIds.size(); ++i) {
+                read.done[i].get();
+                copies.push_back(read.pages[i]->data());
+            }
+            return copies;
+        }
+
+        // Read the pages of the buckets of the ranges up to readahead past position. Buckets that are loaded,
+        // busy or no longer hold their range alone are not read. The directory latch is held
+        void issueReads() {
+            while (pending.size() < readahead && position + pending.size() < order.size()) {
+                const Range &range = order[position + pending.size()];
+                const BucketSlot *slot =
+                    table->buckets[table->directory[range.prefix & (table->directory.size() - 1)]].get();
+                Readahead ahead;
+                ahead.otherUnloads = otherUnloads();
+                ReadLatch latch(slot->latch, std::try_to_lock);
+                if (latch && slot->pageId == range.pageId && !slot->bucket->isLoaded()) {
+                    ahead.pageIds.push_back(slot->pageId);
+                    for (PageId pageId : slot->bucket->overflowPages()) {
+                        ahead.pageIds.push_back(pageId);
+                    }
+                    for (PageId pageId : ahead.pageIds) {
+                        readAhead(pageId, ahead);
+                    }
+                }
+                pending.push_back(std::move(ahead));
+            }
+        }
+
+        void readAhead(PageId pageId, Readahead &ahead) {
+            auto read = std::make_shared<std::promise<void>>();
+            auto page = std::make_shared<std::vector<char>>(table->maxBucketSize);
+            ahead.pages.push_back(page);
+            ahead.done.push_back(read->get_future());
+            table->bufferPool->readPageAsync(pageId, page->data(), [read, page](std::exception_ptr error) {
+                if (error) {
+                    read->set_exception(error);
+                } else {
+                    read->set_value();
+                }
+            });
+        }
+
+        // Unload the buckets the last step loaded, while the loaded buckets take more than the memory budget.
+        // The directory latch is held, so buckets merged away since are no longer found
+        void unloadVisited() {
+            if (loadedByScan.empty()) {
+                return;
+            }
+            for (const BucketSlot *slot : slotsOf(order[position - 1])) {
+                if (std::find(loadedByScan.begin(), loadedByScan.end(), slot) == loadedByScan.end() ||
+                    !table->budget->overBudget()) {
+                    continue;
+                }
+                WriteLatch latch(slot->latch);
+                if (slot->bucket->isLoaded()) {
+                    slot->bucket->unload();
+                    table->budget->countUnload();
+                    ownUnloads++;
+                    unloadedByScan.insert(slot->pageId);
+                }
+            }
+            loadedByScan.clear();
+        }
+    };
+
+    // Start a scan over every bucket, reading the given number of buckets ahead
+    Scan scan(size_t readahead = SCAN_READAHEAD) const { return Scan(this, readahead); }
 
     void print() const {
-        for (const auto &pair : directories) {
-            std::cout << "Bucket Index: " << pair.first << " Depth: " << pair.second->localDepth << " {" << std::endl;
-            pair.second->bucket->print();
+        ReadLatch directoryLock(directoryLatch);
+        for (size_t i = 0; i < directory.size(); ++i) {
+            const auto &slot = *buckets[directory[i]];
+            WriteLatch latch(slot.latch); // Printing loads the bucket
+            std::cout << "Bucket Index: " << i << " Depth: " << slot.localDepth << " {" << std::endl;
+            slot.bucket->print();
             std::cout << "}" << std::endl;
         }
     }
 
-    size_t bucketCount() const { return directories.size(); }
+    // Number of distinct buckets
+    size_t bucketCount() const {
+        ReadLatch directoryLock(directoryLatch);
+        return buckets.size();
+    }
+
+    size_t getGlobalDepth() const {
+        ReadLatch directoryLock(directoryLatch);
+        return globalDepth;
+    }
+
+    // Write every modified bucket page back to its file, then the directory if it changed.
+    // With a write-ahead log this is a checkpoint: the pages are journaled and synced, and the log is emptied
+    void flush() {
+        TableLatch tableLatch = latchTable();
+        if (wal) {
+            checkpoint();
+            return;
+        }
+        bufferPool->flush();
+        if (directoryChanged || tablePages.hasChanged()) {
+            writeDirectory();
+        }
+    }
+
+    // Run flush() on a background thread. The future must be waited for before the table is destroyed
+    std::future<void> flushAsync() {
+        return std::async(std::launch::async, [this] { flush(); });
+    }
+
+    // Name of the backend behind asynchronous reads and flushes
+    const char *ioBackend() const { return ioQueue->backend(); }
+
+    // Counters of the write-ahead log; all zero without one
+    WriteAheadLogStats logStats() const { return wal ? wal->getStats() : WriteAheadLogStats{}; }
+
+    BufferPoolStats bufferPoolStats() const { return bufferPool->getStats(); }
+
+    // Work of the page codec; all zero if the pages are not compressed
+    CompressionStats compressionStats() const { return bufferPool->compressionStats(); }
+
+    // Buckets and pages that have overflowed instead of splitting
+    OverflowStats overflowStats() const {
+        ReadLatch directoryLock(directoryLatch);
+        OverflowStats stats;
+        stats.buckets = buckets.size();
+        stats.overflowPagesAdded = tablePages.overflowPagesAdded();
+        for (const auto &slot : buckets) {
+            size_t pages = slot->bucket->overflowPageCount();
+            stats.overflowBuckets += pages > 0;
+            stats.overflowPages += pages;
+        }
+        return stats;
+    }
+
+    // Hits and misses of bucket accesses and the memory the loaded buckets take
+    BucketCacheStats bucketCacheStats() const { return budget->stats(); }
+
+    // Splits, merges, writes and latencies since the table was opened, and how full the loaded buckets are and
+    // how deep every bucket's overflow chain is now. Buckets that are not loaded are not read to take the fill
+    TableStats stats() const {
+        TableStats stats = metrics.stats();
+        BufferPoolStats pool = bufferPool->getStats();
+        stats.pageWrites = pool.pageWrites;
+        stats.bytesWritten = pool.bytesWritten;
+        stats.filesOpened = pageStore->filesOpened();
+
+        ReadLatch directoryLock(directoryLatch);
+        stats.overflowPagesAdded = tablePages.overflowPagesAdded();
+        size_t pageBytes = maxBucketSize - SlottedPageView::HEADER_SIZE;
+        double fillSum = 0.0;
+        for (const auto &slot : buckets) {
+            // Splits and inserts change the overflow chain under the bucket latch
+            ReadLatch latch(slot->latch);
+            size_t pages = slot->bucket->overflowPageCount();
+            if (stats.overflowDepth.size() <= pages) {
+                stats.overflowDepth.resize(pages + 1);
+            }
+            stats.overflowDepth[pages]++;
+
+            if (!slot->bucket->isLoaded()) {
+                continue;
+            }
+            double fill = static_cast<double>(slot->bucket->usedSpace()) / ((pages + 1) * pageBytes);
+            size_t step = std::min(static_cast<size_t>(fill * TableStats::FILL_STEPS), TableStats::FILL_STEPS - 1);
+            stats.fillFactor[step]++;
+            stats.loadedBuckets++;
+            fillSum += fill;
+        }
+        stats.meanFillFactor = stats.loadedBuckets == 0 ? 0.0 : fillSum / stats.loadedBuckets;
+        return stats;
+    }
+
+    // Tell the kernel how mapped bucket pages will be read next, e.g. before a full scan
+    void adviseAccess(AccessPattern pattern) { pageStore->adviseAccess(pattern); }
 };
 
 } // namespace ehash
@@ -0,0 +1,110 @@
+#ifndef FINGERPRINT_HPP
+#define FINGERPRINT_HPP
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+#if defined(__AVX2__) || defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+namespace ehash {
+
+// One-byte summary of a hash value that buckets keep next to their entries.
+// The directory already consumes the low bits of the hash, so the fingerprint is taken
+// from the high bits after a multiplicative mix that spreads every input bit into them.
+inline uint8_t fingerprintOf(size_t hashValue) {
+    return static_cast<uint8_t>((static_cast<uint64_t>(hashValue) * 0x9E3779B97F4A7C15ULL) >> 56);
+}
+
+// Call visit(i) for every i with fingerprints[i] == fingerprint, in increasing order, until visit returns true.
+// Returns the index visit accepted, or count if there was none.
+// Compares 32 fingerprints per step with AVX2 or 16 with SSE2, falling back to a scalar loop.
+template <typename Visitor>
+size_t probeFingerprints(const uint8_t *fingerprints, size_t count, uint8_t fingerprint, Visitor visit) {
+    size_t i = 0;
+
+#if defined(__AVX2__)
+    const __m256i needle = _mm256_set1_epi8(static_cast<char>(fingerprint));
+    for (; i + 32 <= count; i += 32) {
+        __m256i block = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(fingerprints + i));
+        uint32_t matches = static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(block, needle)));
+        while (matches != 0) {
+            size_t index = i + __builtin_ctz(matches);
+            if (visit(index)) {
+                return index;
+            }
+            matches &= matches - 1;
+        }
+    }
+#endif
+
+#if defined(__SSE2__)
+    const __m128i needle128 = _mm_set1_epi8(static_cast<char>(fingerprint));
+    for (; i + 16 <= count; i += 16) {
+        __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i *>(fingerprints + i));
+        uint32_t matches = static_cast<uint32_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(block, needle128)));
+        while (matches != 0) {
+            size_t index = i + __builtin_ctz(matches);
+            if (visit(index)) {
+                return index;
+            }
+            matches &= matches - 1;
+        }
+    }
+#endif
+
+    for (; i < count; ++i) {
+        if (fingerprints[i] == fingerprint && visit(i)) {
+            return i;
+        }
+    }
+    return count;
+}
+
+// Fingerprint i of an array packed eight to a word, lowest byte first
+inline uint8_t packedFingerprint(const std::atomic<uint64_t> *words, size_t i) {
+    return static_cast<uint8_t>(words[i / 8].load(std::memory_order_relaxed) >> (i % 8 * 8));
+}
+
+// Store fingerprint i of an array packed eight to a word. Only one thread may store into an array at a time
+inline void storePackedFingerprint(std::atomic<uint64_t> *words, size_t i, uint8_t fingerprint) {
+    uint64_t shift = i % 8 * 8;
+    uint64_t word = words[i / 8].load(std::memory_order_relaxed);
+    word = (word & ~(uint64_t{0xFF} << shift)) | (uint64_t{fingerprint} << shift);
+    words[i / 8].store(word, std::memory_order_relaxed);
+}
+
+// probeFingerprints() over fingerprints packed eight to a word, for arrays that a writer changes while
+// readers probe them. Words are read with relaxed atomic loads and compared eight bytes at a time
+// (SWAR), so the caller has to validate what it found, e.g. with a seqlock
+template <typename Visitor>
+size_t probePackedFingerprints(const std::atomic<uint64_t> *words, size_t count, uint8_t fingerprint,
+                               Visitor visit) {
+    constexpr uint64_t LOW_BITS = 0x0101010101010101ULL;
+    constexpr uint64_t HIGH_BITS = 0x8080808080808080ULL;
+    const uint64_t needle = LOW_BITS * fingerprint;
+
+    for (size_t first = 0; first < count; first += 8) {
+        // Bytes equal to the needle become zero and get their high bit set in matches. The borrow out of
+        // a zero byte can also mark the byte above it, so every candidate is checked on its own
+        uint64_t difference = words[first / 8].load(std::memory_order_relaxed) ^ needle;
+        uint64_t matches = (difference - LOW_BITS) & ~difference & HIGH_BITS;
+        while (matches != 0) {
+            size_t index = first + __builtin_ctzll(matches) / 8;
+            matches &= matches - 1;
+            if (index >= count || static_cast<uint8_t>(difference >> (index % 8 * 8)) != 0) {
+                continue;
+            }
+            if (visit(index)) {
+                return index;
+            }
+        }
+    }
+    return count;
+}
+
+} // namespace ehash
+
+#endif
@@ -0,0 +1,91 @@
+#ifndef HASHER_HPP
+#define HASHER_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <string_view>
+#include <type_traits>
+
+namespace ehash {
+
+// Hashers map the key of an entry to the hash that places it. A hasher is a stateless functor; the table
+// picks the directory slot from the lowest bits of the hash, so those must depend on every bit of the key.
+// A table has to be reopened with the hasher it was created with, since entries are stored where their
+// hash put them.
+
+// wyhash (final version 4) of size bytes
+uint64_t wyhash(const void *data, size_t size, uint64_t seed = 0);
+
+// XXH64 of size bytes, as in the reference xxHash implementation
+uint64_t xxh64(const void *data, size_t size, uint64_t seed = 0);
+
+// Mix of two 64-bit values through their 128-bit product, the core of wyhash
+inline uint64_t wymix(uint64_t a, uint64_t b) {
+    __uint128_t product = static_cast<__uint128_t>(a) * b;
+    return static_cast<uint64_t>(product) ^ static_cast<uint64_t>(product >> 64);
+}
+
+// XXH64 of the eight little-endian bytes of value
+inline uint64_t xxh64Word(uint64_t value) {
+    constexpr uint64_t PRIME1 = 0x9E3779B185EBCA87ULL;
+    constexpr uint64_t PRIME2 = 0xC2B2AE3D27D4EB4FULL;
+    constexpr uint64_t PRIME3 = 0x165667B19E3779F9ULL;
+    constexpr uint64_t PRIME4 = 0x85EBCA77C2B2AE63ULL;
+    constexpr uint64_t PRIME5 = 0x27D4EB2F165667C5ULL;
+
+    uint64_t lane = value * PRIME2;
+    lane = ((lane << 31) | (lane >> 33)) * PRIME1;
+    uint64_t hash = (PRIME5 + 8) ^ lane;
+    hash = ((hash << 27) | (hash >> 37)) * PRIME1 + PRIME4;
+    hash ^= hash >> 33;
+    hash *= PRIME2;
+    hash ^= hash >> 29;
+    hash *= PRIME3;
+    hash ^= hash >> 32;
+    return hash;
+}
+
+// std::hash of the key. libstdc++ hashes integers to themselves, so keys that share their low bits share a
+// bucket; this is the default only so that tables created before hashers were pluggable keep their layout
+struct StdHasher {
+    template <typename Key> size_t operator()(const Key &key) const { return std::hash<Key>{}(key); }
+};
+
+// wyhash. Strings are hashed byte by byte; integers as a single word with wyhash's 64-bit mix; other keys
+// have their std::hash mixed the same way
+struct WyHasher {
+    size_t operator()(std::string_view key) const { return wyhash(key.data(), key.size()); }
+
+    size_t operator()(const std::string &key) const { return wyhash(key.data(), key.size()); }
+
+    template <typename Key> size_t operator()(const Key &key) const {
+        uint64_t word;
+        if constexpr (std::is_integral_v<Key> || std::is_enum_v<Key>) {
+            word = static_cast<uint64_t>(key);
+        } else {
+            word = std::hash<Key>{}(key);
+        }
+        return wymix(word ^ 0x2d358dccaa6c78a5ULL, word ^ 0x8bb84b93962eacc9ULL);
+    }
+};
+
+// XXH64. Strings are hashed byte by byte; integers as their 64-bit value; other keys by their std::hash
+struct Xxh64Hasher {
+    size_t operator()(std::string_view key) const { return xxh64(key.data(), key.size()); }
+
+    size_t operator()(const std::string &key) const { return xxh64(key.data(), key.size()); }
+
+    template <typename Key> size_t operator()(const Key &key) const {
+        if constexpr (std::is_integral_v<Key> || std::is_enum_v<Key>) {
+            return xxh64Word(static_cast<uint64_t>(key));
+        } else {
+            return xxh64Word(std::hash<Key>{}(key));
+        }
+    }
+};
+
+} // namespace ehash
+
+#endif
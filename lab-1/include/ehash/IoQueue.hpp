@@ -0,0 +1,64 @@
+#ifndef IOQUEUE_HPP
+#define IOQUEUE_HPP
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <sys/types.h>
+
+namespace ehash {
+
+// How asynchronous page reads and the page writes of a flush are issued
+enum class IoBackend {
+    Auto,       // io_uring if the kernel allows it, otherwise a thread pool
+    IoUring,    // io_uring; creating the queue fails if it is not available
+    ThreadPool, // pread and pwrite on worker threads
+};
+
+// Called once when an operation has finished, with the bytes transferred or -errno, also if the operation
+// could not be submitted. A read returns fewer bytes than asked for only at the end of the file
+using IoCompletion = std::function<void(ssize_t result)>;
+
+// File reads and writes that run asynchronously, many at once. Completions run on an I/O thread; they
+// must be short, must not throw and must never wait for a latch or start I/O on the same queue
+class IoQueue {
+  public:
+    virtual ~IoQueue() = default;
+
+    // Start reading size bytes at offset of fd into data, which stays valid until done has run
+    virtual void read(int fd, char *data, size_t size, uint64_t offset, IoCompletion done) = 0;
+
+    // Start writing size bytes of data at offset of fd
+    virtual void write(int fd, const char *data, size_t size, uint64_t offset, IoCompletion done) = 0;
+
+    // Name of the backend that serves the queue
+    virtual const char *backend() const = 0;
+};
+
+// Create a queue that keeps up to depth operations in flight, at most 8 with a thread pool. The queue waits
+// for the operations still in flight when it is destroyed
+std::unique_ptr<IoQueue> makeIoQueue(IoBackend backend, size_t depth);
+
+// Waits for a group of operations that must transfer all of their bytes
+class IoBatch {
+  private:
+    std::mutex mutex;
+    std::condition_variable finished;
+    size_t pending = 0;
+    int error = 0; // errno of the first failed operation, EIO for a short one
+
+  public:
+    // Completion for one more operation of the batch, which transfers size bytes
+    IoCompletion add(size_t size);
+
+    // Block until every operation added so far has completed. Throws if one of them failed
+    void wait(const std::string &what);
+};
+
+} // namespace ehash
+
+#endif
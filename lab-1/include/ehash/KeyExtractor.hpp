@@ -0,0 +1,41 @@
+#ifndef KEYEXTRACTOR_HPP
+#define KEYEXTRACTOR_HPP
+
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <utility>
+
+namespace ehash {
+
+// Key extractors tell a hash table which part of a message identifies it.
+// An extractor is a functor with a KeyType that maps a message to its key; hashing,
+// equality and lookups by key only look at that key. An extractor may also have a fromRecord member that
+// finds the key in a serialized message, which lets buckets compare and hash keys without parsing records.
+
+// The whole serialized message is the key
+template <typename T> struct SerializedKey {
+    using KeyType = std::string;
+
+    KeyType operator()(const T &entry) const { return entry.SerializeAsString(); }
+
+    std::string_view fromRecord(std::string_view record) const { return record; }
+};
+
+// One field of the message is the key, e.g. FieldKey<Person, &Person::id>
+template <typename T, auto Getter> struct FieldKey {
+    using KeyType = std::decay_t<std::invoke_result_t<decltype(Getter), const T &>>;
+
+    KeyType operator()(const T &entry) const { return (entry.*Getter)(); }
+};
+
+// Whether KeyExtractor can find keys in serialized messages
+template <typename KeyExtractor, typename = void> struct HasRecordKeys : std::false_type {};
+
+template <typename KeyExtractor>
+struct HasRecordKeys<KeyExtractor, std::void_t<decltype(std::declval<const KeyExtractor &>().fromRecord(
+                                       std::declval<std::string_view>()))>> : std::true_type {};
+
+} // namespace ehash
+
+#endif
@@ -0,0 +1,563 @@
+#ifndef LINEARHASHING_HPP
+#define LINEARHASHING_HPP
+
+#include "Bucket.hpp"
+#include "BucketTable.hpp"
+#include "BufferPool.hpp"
+#include "CheckpointJournal.hpp"
+#include "DirectoryFile.hpp"
+#include "Epoch.hpp"
+#include "Hasher.hpp"
+#include "KeyExtractor.hpp"
+#include "MemoryBudget.hpp"
+#include "Options.hpp"
+#include "PageStore.hpp"
+#include "PinnedEntry.hpp"
+#include <atomic>
+#include <filesystem>
+#include <future>
+#include <google/protobuf/message.h>
+#include <iostream>
+#include <iterator>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <shared_mutex>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace ehash {
+
+// LinearHashing class template: a hash table on the same buckets, pages and options as ExtensibleHashing,
+// grown by linear hashing (Litwin) instead of a directory. The buckets are numbered in the order they were
+// created; with 2^level + splitPointer buckets, a hash is placed in bucket hash mod 2^level, or in bucket
+// hash mod 2^(level + 1) if that one has already been split this round. Whenever an entry does not fit in
+// its bucket, the bucket at the split pointer is split, wherever the entry was headed, and the pointer
+// advances; once every bucket of the round has split, the level goes up and the pointer starts over. The
+// entry that found its bucket full is then placed with an overflow page if the split did not make room.
+// Growth therefore costs one bucket split at a time and never doubles a directory, at the price of overflow
+// chains on buckets that fill up before the pointer reaches them.
+//
+// The table is saved in the same directory.meta file as an extendible hash table, written as the directory
+// such a table would have with the same buckets, so ExtensibleHashing can open a linear hash table.
+// LinearHashing in turn opens only tables with that shape.
+//
+// The table may be used from several threads. Every operation holds the table latch shared and the latch of
+// its bucket; splits and the release of overflow pages hold the table latch exclusively. Lookups take their
+// bucket latch shared and return their entries pinned, as in ExtensibleHashing. Memory budgets and lazy entries
+// work as in ExtensibleHashing. Buckets are never merged, and a write-ahead log is not supported
+template <typename T, typename KeyExtractor = SerializedKey<T>, typename Hasher = StdHasher> class LinearHashing {
+    static_assert(std::is_base_of<google::protobuf::Message, T>::value,
+                  "T must be a subclass of google::protobuf::Message");
+
+  public:
+    using Key = typename KeyExtractor::KeyType;
+    using EntryPtr = typename Bucket<T, KeyExtractor, Hasher>::EntryPtr; // Entry owned by a bucket
+
+  private:
+    using BucketType = Bucket<T, KeyExtractor, Hasher>;
+    using PendingEntry = typename BucketType::PendingEntry;
+
+    using ReadLatch = std::shared_lock<std::shared_mutex>;
+    using WriteLatch = std::unique_lock<std::shared_mutex>;
+
+    struct BucketSlot {
+        std::unique_ptr<BucketType> bucket;
+        PageId pageId;                               // Page that stores the bucket
+        mutable std::shared_mutex latch;             // Guards the bucket
+        mutable std::atomic<bool> referenced{false}; // Used since the clock hand last passed it
+    };
+
+    // A bucket found by its address, with the table latch held shared and its own latch held
+    template <typename Latch> struct LatchedBucket {
+        ReadLatch table;
+        const BucketSlot *slot;
+        Latch latch;
+
+        BucketType &bucket() const { return *slot->bucket; }
+    };
+
+    // Deepest directory the directory file can store
+    static constexpr size_t MAX_DEPTH = 31;
+
+    size_t level;                                     // Every bucket address uses at least this many hash bits
+    size_t splitPointer = 0;                          // Next bucket to split; the ones before it use level + 1 bits
+    KeyExtractor extractKey;                          // Maps an entry to its key
+    std::shared_ptr<EpochManager> epochs = std::make_shared<EpochManager>(); // Outlives the buckets
+
+    std::string bucketDirectory;                      // Path where the bucket files are stored
+    size_t maxBucketSize;                             // Maximum size of each bucket (multiple of block size)
+    StorageMode storageMode;                          // Layout of the bucket pages on disk
+    PageCompression pageCompression;                  // Codec of the bucket pages
+    std::shared_ptr<PageStore> pageStore;             // Bucket files or a single segment file
+    std::shared_ptr<IoQueue> ioQueue;                 // Flush writes; drains before the store closes
+    std::shared_ptr<BufferPool> bufferPool;           // Caches bucket pages between the buckets and their files
+    std::vector<std::unique_ptr<BucketSlot>> buckets; // Buckets by address; slots stay put while it grows
+    bool tableChanged = false;                        // The bucket table differs from directory.meta
+    TablePages tablePages;                            // Overflow pages chained and released
+    bool lazyEntries;                                 // Buckets parse records only when they are used
+    mutable std::shared_mutex tableLatch;             // Guards level, splitPointer and the bucket table
+    std::shared_ptr<MemoryBudget> budget;             // Memory the loaded buckets may take
+    mutable BucketClock clock;                        // Picks the buckets unloaded to stay within the budget
+
+    // Bucket a hash is placed in
+    size_t address(size_t hashValue) const {
+        size_t index = hashValue & ((size_t{1} << level) - 1);
+        if (index < splitPointer) {
+            index = hashValue & ((size_t{1} << (level + 1)) - 1);
+        }
+        return index;
+    }
+
+    // Hash bits the directory written to directory.meta uses
+    size_t directoryDepth() const { return splitPointer == 0 ? level : level + 1; }
+
+    // Hash bits the entries of a bucket share: buckets split this round and the ones they split off use one
+    // more than the rest
+    size_t depthOf(size_t index) const {
+        return index < splitPointer || index >= (size_t{1} << level) ? level + 1 : level;
+    }
+
+    // Bucket of every hash prefix of directoryDepth bits, like the directory of an extendible hash table
+    uint32_t directoryEntry(size_t prefix) const {
+        return prefix < buckets.size() ? prefix : prefix - (size_t{1} << level);
+    }
+
+    void addBucket(PageId pageId, const std::vector<PageId> &overflowPages = {}) {
+        buckets.push_back(std::unique_ptr<BucketSlot>(new BucketSlot{
+            std::make_unique<BucketType>(bufferPool, epochs, budget, pageId, overflowPages, lazyEntries), pageId}));
+    }
+
+    // Count an access to the bucket in the cache counters and protect it from the next unload sweep
+    void touch(const BucketSlot &slot) const {
+        slot.referenced.store(true, std::memory_order_relaxed);
+        budget->countAccess(slot.bucket->isLoaded());
+    }
+
+    // Unload cold buckets while the loaded ones take more than the memory budget, choosing them with the CLOCK
+    // policy (see BucketClock). Only called while no latch is held
+    void enforceMemoryBudget() const { clock.sweep(tableLatch, buckets, *budget); }
+
+    // Find the bucket of hashValue and latch it. The table latch stays held, so the bucket is not split
+    // while it is used
+    template <typename Latch> LatchedBucket<Latch> latchBucket(size_t hashValue) const {
+        ReadLatch tableLock(tableLatch);
+        const BucketSlot *slot = buckets[address(hashValue)].get();
+        return {std::move(tableLock), slot, Latch(slot->latch)};
+    }
+
+    // Latch the bucket of hashValue for a lookup. A bucket that has not read its page yet is loaded under
+    // an exclusive latch first, since loading fills in its entries
+    LatchedBucket<ReadLatch> latchForRead(size_t hashValue) const {
+        auto target = latchBucket<ReadLatch>(hashValue);
+        touch(*target.slot);
+        while (!target.bucket().isLoaded()) {
+            target.latch.unlock();
+            {
+                WriteLatch latch(target.slot->latch);
+                target.bucket().load();
+            }
+            target.latch.lock();
+        }
+        return target;
+    }
+
+    // Hand an entry found with the epoch pinned by guard to the caller, with the pin
+    static std::optional<PinnedEntry<T>> pinned(EpochManager::Guard guard, const T *entry) {
+        if (entry == nullptr) {
+            return std::nullopt;
+        }
+        return PinnedEntry<T>(std::move(guard), entry);
+    }
+
+    PendingEntry pendingEntry(std::unique_ptr<T> entry) const {
+        std::string bytes = entry->SerializeAsString();
+        checkEntrySize(bytes.size(), maxBucketSize);
+        size_t hashValue = hashKey(extractKey(*entry));
+        return {std::move(entry), std::move(bytes), hashValue};
+    }
+
+    // Split the bucket at the split pointer into itself and a new bucket at the end of the table, and
+    // advance the pointer. Nothing happens once the directory file could not describe another level.
+    // The table latch is held exclusively
+    void splitNext() {
+        if (level >= MAX_DEPTH) {
+            return;
+        }
+        size_t oldIndex = splitPointer;
+        BucketType &oldBucket = *buckets[oldIndex]->bucket;
+        addBucket(bufferPool->allocatePage());
+        BucketType &newBucket = *buckets.back()->bucket;
+        if (++splitPointer == size_t{1} << level) {
+            level++;
+            splitPointer = 0;
+        }
+        tableChanged = true;
+
+        typename BucketType::ArenaSet arenas;
+        auto entries = oldBucket.retrieveEntries(arenas);
+        oldBucket.clear();
+        oldBucket.adoptArenas(arenas);
+        newBucket.adoptArenas(arenas);
+
+        std::vector<PendingEntry> kept;
+        std::vector<PendingEntry> moved;
+        for (auto &entry : entries) {
+            size_t entryHash = hashKey(extractKey(*entry));
+            std::string bytes = entry->SerializeAsString();
+            auto &half = address(entryHash) == oldIndex ? kept : moved;
+            half.push_back({std::move(entry), std::move(bytes), entryHash});
+        }
+        tablePages.placeWithOverflow(*bufferPool, oldBucket, kept);
+        tablePages.placeWithOverflow(*bufferPool, newBucket, moved);
+        tablePages.release(*bufferPool, oldBucket.releaseEmptyOverflowPages());
+    }
+
+    // Place entries that did not fit in their buckets one at a time, in order: each one splits the next
+    // bucket and is then placed in its bucket, on an overflow page if need be. The table latch is held
+    // exclusively
+    void placeSplitting(std::vector<PendingEntry> &pending) {
+        for (auto &entry : pending) {
+            std::vector<PendingEntry> single;
+            single.push_back(std::move(entry));
+            if (buckets[address(single.front().hashValue)]->bucket->addEntries(single) == 1) {
+                continue; // Another thread made room meanwhile
+            }
+            splitNext();
+            tablePages.placeWithOverflow(*bufferPool, *buckets[address(single.front().hashValue)]->bucket, single);
+        }
+    }
+
+    // Rebuild the bucket table saved in directory.meta. Buckets read their pages on first use
+    void restoreTable(const DirectoryMeta &meta) {
+        if (meta.pageSize != maxBucketSize) {
+            throw std::runtime_error("Hash table in " + bucketDirectory + " uses bucket page size " +
+                                     std::to_string(meta.pageSize));
+        }
+        if (meta.storageMode != storageMode) {
+            throw std::runtime_error("Hash table in " + bucketDirectory + " uses a different storage mode");
+        }
+        if (meta.pageCompression != pageCompression) {
+            throw std::runtime_error("Hash table in " + bucketDirectory + " uses a different page compression");
+        }
+
+        size_t count = meta.buckets.size();
+        size_t directorySize = size_t{1} << meta.globalDepth;
+        if (count == directorySize) {
+            level = meta.globalDepth;
+            splitPointer = 0;
+        } else if (meta.globalDepth > 0 && count > directorySize / 2 && count < directorySize) {
+            level = meta.globalDepth - 1;
+            splitPointer = count - directorySize / 2;
+        } else {
+            throw std::runtime_error("Hash table in " + bucketDirectory + " is not laid out by linear hashing");
+        }
+        for (const auto &info : meta.buckets) {
+            addBucket(info.pageId, info.overflowPages);
+        }
+
+        bool linear = true;
+        for (size_t i = 0; i < count; ++i) {
+            linear = linear && meta.buckets[i].localDepth == depthOf(i);
+        }
+        for (size_t prefix = 0; prefix < directorySize; ++prefix) {
+            linear = linear && meta.directory[prefix] == directoryEntry(prefix);
+        }
+        if (!linear) {
+            throw std::runtime_error("Hash table in " + bucketDirectory + " is not laid out by linear hashing");
+        }
+    }
+
+    DirectoryMeta directoryMeta() const {
+        DirectoryMeta meta;
+        meta.pageSize = maxBucketSize;
+        meta.storageMode = storageMode;
+        meta.pageCompression = pageCompression;
+        meta.globalDepth = directoryDepth();
+        for (size_t prefix = 0; prefix < (size_t{1} << meta.globalDepth); ++prefix) {
+            meta.directory.push_back(directoryEntry(prefix));
+        }
+        for (size_t i = 0; i < buckets.size(); ++i) {
+            meta.buckets.push_back(
+                {buckets[i]->pageId, static_cast<uint32_t>(depthOf(i)), buckets[i]->bucket->overflowPages()});
+        }
+        return meta;
+    }
+
+    // Save the bucket table, then give the released overflow pages back to the store
+    void writeDirectory() {
+        writeDirectoryMeta(directoryMetaPath(bucketDirectory), directoryMeta());
+        tableChanged = false;
+        tablePages.written(*bufferPool);
+    }
+
+    // Read the directory file. A table last used with a write-ahead log has to be recovered by ExtensibleHashing
+    static std::optional<DirectoryMeta> loadDirectory(const std::string &directoryPath) {
+        if (std::filesystem::exists(checkpointJournalPath(directoryPath)) ||
+            std::filesystem::exists(directoryPath + "/wal.log")) {
+            throw std::runtime_error("Hash table in " + directoryPath +
+                                     " has a write-ahead log; open it with ExtensibleHashing to recover it");
+        }
+        return readDirectoryMeta(directoryMetaPath(directoryPath));
+    }
+
+    LinearHashing(const std::string &directoryPath, size_t pageSize, size_t initialLevel, const Options &options,
+                  const std::optional<DirectoryMeta> &meta)
+        : level(initialLevel), bucketDirectory(directoryPath), maxBucketSize(pageSize),
+          storageMode(options.storageMode), pageCompression(options.pageCompression),
+          lazyEntries(options.lazyEntries),
+          budget(std::make_shared<MemoryBudget>(options.memoryBudgetBytes)) {
+        if (options.writeAheadLog) {
+            throw std::runtime_error("Linear hashing does not support a write-ahead log");
+        }
+        if (level > MAX_DEPTH) {
+            throw std::runtime_error("Initial level must not exceed " + std::to_string(MAX_DEPTH));
+        }
+        // New bucket files are numbered after the ones the saved table uses
+        pageStore = makePageStore(bucketDirectory, maxBucketSize, storageMode, options, meta ? pageIdsEnd(*meta) : 0);
+        if (options.readMode == ReadMode::Mmap) {
+            pageStore->enableMapping(options.accessPattern);
+        }
+        ioQueue = makeIoQueue(options.ioBackend, options.ioQueueDepth);
+        bufferPool = std::make_shared<BufferPool>(
+            pageStore, options.bufferPoolPages, ioQueue,
+            options.verifyChecksums ? PageChecksums::Verify : PageChecksums::Seal);
+
+        if (meta) {
+            restoreTable(*meta);
+        } else {
+            for (size_t i = 0; i < (size_t{1} << level); ++i) {
+                addBucket(bufferPool->allocatePage());
+            }
+            tableChanged = true;
+        }
+    }
+
+  public:
+    LinearHashing(const std::string &directoryPath, size_t bucketSize) : LinearHashing(directoryPath, bucketSize, 1) {}
+
+    LinearHashing(const std::string &directoryPath, size_t bucketSize, size_t initialLevel)
+        : LinearHashing(directoryPath, bucketSize, initialLevel, Options{}) {}
+
+    // Create a table of 2^initialLevel buckets, or reopen the table saved in directoryPath (initialLevel is
+    // then ignored)
+    LinearHashing(const std::string &directoryPath, size_t bucketSize, size_t initialLevel, const Options &options)
+        : LinearHashing(directoryPath, bucketPageSize(directoryPath, bucketSize), initialLevel, options,
+                        loadDirectory(directoryPath)) {}
+
+    // Reopen the table saved in directoryPath. Only directory.meta is read; bucket size and storage mode
+    // come from it, and each bucket reads its page the first time it is used.
+    // The storage mode and page compression in options are ignored
+    static std::unique_ptr<LinearHashing> open(const std::string &directoryPath, Options options = {}) {
+        std::optional<DirectoryMeta> meta = loadDirectory(directoryPath);
+        if (!meta) {
+            throw std::runtime_error("No hash table directory file in " + directoryPath);
+        }
+        options.storageMode = meta->storageMode;
+        options.pageCompression = meta->pageCompression;
+        return std::unique_ptr<LinearHashing>(new LinearHashing(directoryPath, meta->pageSize, 0, options, meta));
+    }
+
+    LinearHashing(const LinearHashing &) = delete;
+    LinearHashing &operator=(const LinearHashing &) = delete;
+
+    ~LinearHashing() {
+        try {
+            flush();
+        } catch (const std::exception &e) {
+            std::cerr << "Failed to flush hash table: " << e.what() << std::endl;
+        }
+        epochs->reclaim();
+    }
+
+    // Add an entry, or replace the entry with the same key
+    size_t addEntry(std::unique_ptr<T> entry) {
+        enforceMemoryBudget();
+        std::vector<PendingEntry> single;
+        single.push_back(pendingEntry(std::move(entry)));
+        size_t hashValue = single.front().hashValue;
+        {
+            auto target = latchBucket<WriteLatch>(hashValue);
+            touch(*target.slot);
+            if (target.bucket().addEntries(single) == 1) {
+                return hashValue;
+            }
+        }
+
+        WriteLatch tableLock(tableLatch);
+        placeSplitting(single);
+        return hashValue;
+    }
+
+    // Add or replace a batch of entries, as if by addEntry in order, and return the hash of each. Every
+    // touched bucket takes its share of the batch with its page pinned once; the rest is placed with splits
+    std::vector<size_t> addEntries(std::vector<std::unique_ptr<T>> newEntries) {
+        enforceMemoryBudget();
+        std::vector<size_t> hashes;
+        std::vector<PendingEntry> leftover;
+        hashes.reserve(newEntries.size());
+        {
+            ReadLatch tableLock(tableLatch);
+            std::unordered_map<size_t, std::vector<PendingEntry>> groups;
+            for (auto &entry : newEntries) {
+                PendingEntry pending = pendingEntry(std::move(entry));
+                hashes.push_back(pending.hashValue);
+                groups[address(pending.hashValue)].push_back(std::move(pending));
+            }
+            for (auto &[index, group] : groups) {
+                const BucketSlot &slot = *buckets[index];
+                WriteLatch latch(slot.latch);
+                touch(slot);
+                size_t placed = slot.bucket->addEntries(group);
+                leftover.insert(leftover.end(), std::make_move_iterator(group.begin() + placed),
+                                std::make_move_iterator(group.end()));
+            }
+        }
+        if (!leftover.empty()) {
+            WriteLatch tableLock(tableLatch);
+            placeSplitting(leftover);
+        }
+        return hashes;
+    }
+
+    // Remove the entry with the given key and return whether there was one
+    bool removeEntry(const Key &key) {
+        enforceMemoryBudget();
+        size_t hashValue = hashKey(key);
+        {
+            auto target = latchBucket<WriteLatch>(hashValue);
+            touch(*target.slot);
+            BucketType &bucket = target.bucket();
+            if (!bucket.removeEntry(key, hashValue)) {
+                return false;
+            }
+            if (bucket.overflowPageCount() == 0 || !bucket.hasEmptyOverflowPage()) {
+                return true;
+            }
+        }
+
+        WriteLatch tableLock(tableLatch);
+        tablePages.release(*bufferPool, buckets[address(hashValue)]->bucket->releaseEmptyOverflowPages());
+        return true;
+    }
+
+    // Every entry in the bucket of the given entry's key
+    PinnedEntries<T> getEntries(const std::unique_ptr<T> entry) const {
+        return getEntries(hashKey(extractKey(*entry)));
+    }
+
+    // Every entry in the bucket of hash, collected under the bucket latch
+    PinnedEntries<T> getEntries(const size_t &hash) const {
+        enforceMemoryBudget();
+        EpochManager::Guard guard(*epochs);
+        std::vector<const T *> entries;
+        {
+            auto target = latchForRead(hash);
+            for (const auto &entry : target.bucket().getEntries()) {
+                entries.push_back(entry.get());
+            }
+        }
+        return PinnedEntries<T>(std::move(guard), std::move(entries));
+    }
+
+    // First entry whose key hashes to hash
+    std::optional<PinnedEntry<T>> getEntry(const size_t &hash) const {
+        enforceMemoryBudget();
+        EpochManager::Guard guard(*epochs);
+        T *entry = latchForRead(hash).bucket().findEntryByHash(hash);
+        return pinned(std::move(guard), entry);
+    }
+
+    // Look up the entry with the given key
+    std::optional<PinnedEntry<T>> get(const Key &key) const {
+        enforceMemoryBudget();
+        size_t hashValue = hashKey(key);
+        EpochManager::Guard guard(*epochs);
+        T *entry = latchForRead(hashValue).bucket().findEntry(key, hashValue);
+        return pinned(std::move(guard), entry);
+    }
+
+    size_t hashKey(const Key &key) const { return BucketType::hashOf(key); }
+
+    void print() const {
+        ReadLatch tableLock(tableLatch);
+        for (size_t i = 0; i < buckets.size(); ++i) {
+            const auto &slot = *buckets[i];
+            WriteLatch latch(slot.latch); // Printing loads the bucket
+            std::cout << "Bucket Index: " << i << " Depth: " << depthOf(i) << " {" << std::endl;
+            slot.bucket->print();
+            std::cout << "}" << std::endl;
+        }
+    }
+
+    size_t bucketCount() const {
+        ReadLatch tableLock(tableLatch);
+        return buckets.size();
+    }
+
+    // Hash bits the most recently split buckets use, as the global depth of the equivalent directory
+    size_t getGlobalDepth() const {
+        ReadLatch tableLock(tableLatch);
+        return directoryDepth();
+    }
+
+    // Hash bits every bucket uses at least; the table has 2^level + splitPointer buckets
+    size_t getLevel() const {
+        ReadLatch tableLock(tableLatch);
+        return level;
+    }
+
+    // Bucket that the next split divides
+    size_t getSplitPointer() const {
+        ReadLatch tableLock(tableLatch);
+        return splitPointer;
+    }
+
+    // Write every modified bucket page back to its file, then the bucket table if it changed
+    void flush() {
+        WriteLatch tableLock(tableLatch);
+        bufferPool->flush();
+        if (tableChanged || tablePages.hasChanged()) {
+            writeDirectory();
+        }
+    }
+
+    // Run flush() on a background thread. The future must be waited for before the table is destroyed
+    std::future<void> flushAsync() {
+        return std::async(std::launch::async, [this] { flush(); });
+    }
+
+    // Name of the backend behind the writes of a flush
+    const char *ioBackend() const { return ioQueue->backend(); }
+
+    BufferPoolStats bufferPoolStats() const { return bufferPool->getStats(); }
+
+    // Work of the page codec; all zero if the pages are not compressed
+    CompressionStats compressionStats() const { return bufferPool->compressionStats(); }
+
+    // Buckets and pages that have overflowed before the split pointer reached them
+    OverflowStats overflowStats() const {
+        ReadLatch tableLock(tableLatch);
+        OverflowStats stats;
+        stats.buckets = buckets.size();
+        stats.overflowPagesAdded = tablePages.overflowPagesAdded();
+        for (const auto &slot : buckets) {
+            size_t pages = slot->bucket->overflowPageCount();
+            stats.overflowBuckets += pages > 0;
+            stats.overflowPages += pages;
+        }
+        return stats;
+    }
+
+    // Hits and misses of bucket accesses and the memory the loaded buckets take
+    BucketCacheStats bucketCacheStats() const { return budget->stats(); }
+
+    // Tell the kernel how mapped bucket pages will be read next, e.g. before a full scan
+    void adviseAccess(AccessPattern pattern) { pageStore->adviseAccess(pattern); }
+};
+
+} // namespace ehash
+
+#endif
@@ -0,0 +1,59 @@
+#ifndef MEMORYBUDGET_HPP
+#define MEMORYBUDGET_HPP
+
+#include <atomic>
+#include <cstddef>
+
+namespace ehash {
+
+// Counters describing how often bucket accesses find the bucket's entries in memory
+struct BucketCacheStats {
+    size_t residentBytes = 0; // Estimated memory taken by the loaded buckets
+    size_t hits = 0;          // Accesses to a bucket that was loaded
+    size_t misses = 0;        // Accesses that had to read the bucket's page first
+    size_t unloads = 0;       // Cold buckets dropped from memory to stay within the budget
+    size_t parses = 0;        // Records parsed into entries
+};
+
+// Memory the loaded buckets of a table may take. Buckets charge their estimated size here whenever it
+// changes; the table unloads cold buckets while the total is over the limit
+class MemoryBudget {
+  private:
+    size_t limit; // 0 means no limit
+    std::atomic<size_t> residentBytes{0};
+    std::atomic<size_t> hits{0};
+    std::atomic<size_t> misses{0};
+    std::atomic<size_t> unloads{0};
+    std::atomic<size_t> parses{0};
+
+  public:
+    explicit MemoryBudget(size_t limit) : limit(limit) {}
+
+    // A bucket that was charged before bytes now takes after
+    void recharge(size_t before, size_t after) {
+        residentBytes.fetch_add(after, std::memory_order_relaxed);
+        residentBytes.fetch_sub(before, std::memory_order_relaxed);
+    }
+
+    bool overBudget() const { return limit != 0 && residentBytes.load(std::memory_order_relaxed) > limit; }
+
+    // Count an access to a bucket that was loaded or not
+    void countAccess(bool loaded) { (loaded ? hits : misses).fetch_add(1, std::memory_order_relaxed); }
+
+    void countUnload() { unloads.fetch_add(1, std::memory_order_relaxed); }
+
+    void countParses(size_t records) { parses.fetch_add(records, std::memory_order_relaxed); }
+
+    // Buckets unloaded so far; a bucket that is not loaded has not changed while this stays the same
+    size_t unloadCount() const { return unloads.load(std::memory_order_relaxed); }
+
+    BucketCacheStats stats() const {
+        return {residentBytes.load(std::memory_order_relaxed), hits.load(std::memory_order_relaxed),
+                misses.load(std::memory_order_relaxed), unloads.load(std::memory_order_relaxed),
+                parses.load(std::memory_order_relaxed)};
+    }
+};
+
+} // namespace ehash
+
+#endif
@@ -0,0 +1,57 @@
+#ifndef OPTIONS_HPP
+#define OPTIONS_HPP
+
+#include "IoQueue.hpp"
+#include "PageCodec.hpp"
+#include "PageStore.hpp"
+#include <cstddef>
+#include <memory>
+#include <string>
+
+namespace ehash {
+
+// Where bucket pages are stored
+enum class StorageMode {
+    BucketFiles, // One "bucket_<pageId>.dat" file per bucket
+    Segment,     // All buckets as pages of a single "buckets.seg" file
+};
+
+// How bucket pages are read when a bucket is loaded
+enum class ReadMode {
+    Buffered, // Through the buffer pool
+    Mmap,     // Parsed in place from a read-only mapping of the file; the pool is used for writes only
+};
+
+// Tuning knobs for the storage behind a hash table
+struct Options {
+    size_t bufferPoolPages = 64;                         // Number of bucket pages the buffer pool keeps in memory
+    StorageMode storageMode = StorageMode::BucketFiles;  // Layout of the bucket pages on disk
+    size_t segmentInitialPages = 64;                     // Pages preallocated when a segment file is created
+    ReadMode readMode = ReadMode::Buffered;              // How bucket pages are loaded
+    AccessPattern accessPattern = AccessPattern::Random; // madvise hint for mapped pages
+    bool writeAheadLog = false;                          // Log changes to "wal.log" and sync it before they return
+    size_t groupCommitWindowMicros = 0;                  // Time a committing writer waits for others to share its sync
+    size_t checkpointLogBytes = 16 << 20;                // Log size that wakes the background checkpoint
+    size_t checkpointIntervalMillis = 1000;              // Longest time between background checkpoints
+    double mergeFillFactor = 0.5;                        // Share of a page buddies merge below (0 to 1; 0: never)
+    IoBackend ioBackend = IoBackend::Auto;               // How asynchronous reads and the writes of a flush are issued
+    size_t ioQueueDepth = 32;                            // Reads and writes the I/O queue keeps in flight at once
+    size_t memoryBudgetBytes = 0;                        // Memory for loaded buckets before cold ones unload (0: any)
+    size_t maxLocalDepth = 20;                           // Full buckets this deep chain overflow pages (at most 31)
+    bool lazyEntries = false;                            // Keep loaded records serialized until an entry is used
+    size_t bulkLoadMemoryBytes = 256 << 20;              // Records a bulk load holds before spilling them (0: any)
+    bool verifyChecksums = true;                         // Check the CRC32C of bucket pages read; writes always set it
+    bool recordLatencies = false;                        // Time every operation into the histograms of stats()
+
+    // Codec of the bucket pages of a new table; an opened table keeps the one it was created with
+    PageCompression pageCompression = PageCompression::None;
+};
+
+// Store for the bucket pages of the table in directoryPath, laid out as mode says and compressed as options
+// say. A store of bucket files numbers the pages it allocates from nextPageId
+std::shared_ptr<PageStore> makePageStore(const std::string &directoryPath, size_t pageSize, StorageMode mode,
+                                         const Options &options, PageId nextPageId);
+
+} // namespace ehash
+
+#endif
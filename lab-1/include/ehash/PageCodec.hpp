@@ -0,0 +1,92 @@
+#ifndef PAGECODEC_HPP
+#define PAGECODEC_HPP
+
+#include "Checksum.hpp"
+#include "PageStore.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+namespace ehash {
+
+// How bucket pages are compressed on disk
+enum class PageCompression {
+    None, // Pages are stored as they are
+    Lz,   // Pages are compressed with the in-tree LZ codec (see lzCompress)
+};
+
+// Bytes at the start of every page that the storage layer owns: the checksum, then the size a compressing store
+// marks compressed pages with. In memory the size is always zero
+constexpr size_t PAGE_PREFIX_SIZE = PAGE_CHECKSUM_SIZE + sizeof(uint32_t);
+
+// Compress size bytes of data into output with an LZ77 codec in the style of LZ4: a run of literals and a back
+// reference into the last 64KB per sequence. Returns the compressed size, or 0 if it does not fit in capacity
+size_t lzCompress(const char *data, size_t size, char *output, size_t capacity);
+
+// Decompress into exactly size bytes of output. Returns false if the input is corrupted or does not decompress
+// to that size
+bool lzDecompress(const char *data, size_t compressedSize, char *output, size_t size);
+
+// Work done by a compressing page store
+struct CompressionStats {
+    size_t pagesWritten = 0;      // Whole pages written through the store
+    size_t pagesCompressed = 0;   // Of those, the ones stored compressed; the others did not shrink
+    size_t bytesIn = 0;           // Page bytes handed to the store
+    size_t bytesStored = 0;       // Bytes written for them
+    size_t pagesRead = 0;         // Pages read that had to be decompressed
+    uint64_t compressNanos = 0;   // Time spent compressing
+    uint64_t decompressNanos = 0; // Time spent decompressing
+
+    // Page bytes per byte written
+    double ratio() const { return bytesStored == 0 ? 1.0 : static_cast<double>(bytesIn) / bytesStored; }
+};
+
+// Page store that compresses every page before handing it to another store. A compressed page is stored as its
+// checksum, its compressed size and the LZ-compressed rest of the page, and only those bytes are written; the
+// rest of the page on disk is left as it was and ignored. A page that does not shrink is stored as it is, with
+// a zero size. Pages must keep the size field zero in memory, as slotted pages do.
+//
+// Pages can only be read and written whole: ranges are written by rewriting the page, and pages are neither
+// mapped nor opened for I/O around the store
+class CompressedPageStore : public PageStore {
+  private:
+    std::shared_ptr<PageStore> store;
+    std::vector<char> frame; // Compressed image of the page being read or written
+    CompressionStats stats;
+
+  public:
+    explicit CompressedPageStore(std::shared_ptr<PageStore> store);
+
+    size_t pageSize() const override { return store->pageSize(); }
+
+    bool pagesStoredAsIs() const override { return false; }
+
+    void readPage(PageId pageId, char *data) override;
+
+    void writePage(PageId pageId, const char *data) override;
+
+    void writeRange(PageId pageId, size_t offset, const char *data, size_t size) override;
+
+    PageFile openPage(PageId pageId, bool forWrite) override;
+
+    PageId allocatePage() override { return store->allocatePage(); }
+
+    void freePage(PageId pageId) override { store->freePage(pageId); }
+
+    void sync() override { store->sync(); }
+
+    void enableMapping(AccessPattern) override {}
+
+    void adviseAccess(AccessPattern) override {}
+
+    const char *mapPage(PageId) override { return nullptr; }
+
+    size_t filesOpened() const override { return store->filesOpened(); }
+
+    const CompressionStats &getStats() const { return stats; }
+};
+
+} // namespace ehash
+
+#endif
@@ -0,0 +1,139 @@
+#ifndef PAGESTORE_HPP
+#define PAGESTORE_HPP
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+
+namespace ehash {
+
+// Identifier of a fixed-size page inside a page store
+using PageId = std::uint64_t;
+
+// How mapped bucket pages are expected to be read; passed to madvise
+enum class AccessPattern {
+    Random,     // Point lookups: no readahead
+    Sequential, // Scans in page order: aggressive readahead
+    WillNeed,   // Prefetch the mapped pages now
+};
+
+// File that holds a page, for I/O that goes around readPage and writePage, e.g. through an IoQueue
+struct PageFile {
+    int fd = -1;         // -1 if the page has no file yet; it reads as zeros
+    uint64_t offset = 0; // Position of the page in the file
+    bool owned = false;  // The caller closes fd once its I/O has completed
+};
+
+// Backing storage for bucket pages. Every page has the same size and is read and written as a whole
+class PageStore {
+  public:
+    virtual ~PageStore() = default;
+
+    // Size of every page in bytes
+    virtual size_t pageSize() const = 0;
+
+    // Whether pages are kept on disk byte for byte, so that writing a range or doing I/O on the file of a page
+    // behaves like rewriting the page
+    virtual bool pagesStoredAsIs() const { return true; }
+
+    // Read a page into data (pageSize() bytes). Pages that were never written read back as zeros
+    virtual void readPage(PageId pageId, char *data) = 0;
+
+    // Write pageSize() bytes of data to the page
+    virtual void writePage(PageId pageId, const char *data) = 0;
+
+    // Write only the given byte range of the page; data points at the start of the range
+    virtual void writeRange(PageId pageId, size_t offset, const char *data, size_t size) = 0;
+
+    // Open the file of a page for I/O the caller issues itself. A page opened for writing gets a file of
+    // the full page size and is synced by the next sync()
+    virtual PageFile openPage(PageId pageId, bool forWrite) = 0;
+
+    // Reserve a page for a new bucket
+    virtual PageId allocatePage() = 0;
+
+    // Return a page that no bucket uses anymore
+    virtual void freePage(PageId pageId) = 0;
+
+    // Make every write so far durable
+    virtual void sync() = 0;
+
+    // Serve pages through read-only memory mappings from now on
+    virtual void enableMapping(AccessPattern pattern) = 0;
+
+    // Change the madvise hint of the mappings
+    virtual void adviseAccess(AccessPattern pattern) = 0;
+
+    // Read-only mapping of a page, or nullptr if mapping is disabled or the page is not on disk yet.
+    // The pointer is valid until the page is freed
+    virtual const char *mapPage(PageId pageId) = 0;
+
+    // Files opened so far to read, write, map or sync pages. Safe to call while the store is in use
+    virtual size_t filesOpened() const = 0;
+};
+
+// madvise a mapped range according to the access pattern
+void adviseMapping(const void *address, size_t length, AccessPattern pattern);
+
+// fsync a file or a directory, so that its data or its entries survive a crash
+void syncFile(const std::string &path);
+
+// Page store that keeps every page in its own "bucket_<pageId>.dat" file inside a directory. Bucket files
+// always have the full page size and are only ever overwritten in place, never shrunk, so that mappings handed
+// out by mapPage stay readable until the page is freed
+class BucketFileStore : public PageStore {
+  private:
+    std::string directoryPath;                // Directory that holds the bucket files
+    size_t pageBytes;                         // Size of every bucket file
+    PageId nextPageId = 0;                    // Next bucket file number to hand out
+    std::unordered_set<PageId> unsyncedPages; // Bucket files written since the last sync
+    std::atomic<size_t> openedFiles{0};
+
+    bool mappingEnabled = false;
+    AccessPattern accessPattern = AccessPattern::Random;
+    std::unordered_map<PageId, void *> mappings; // Mapped bucket files
+
+    void unmapPage(PageId pageId);
+
+  public:
+    // nextPageId is the first bucket file number handed out, past the files of an existing table
+    BucketFileStore(const std::string &directoryPath, size_t pageSize, PageId nextPageId = 0);
+
+    BucketFileStore(const BucketFileStore &) = delete;
+    BucketFileStore &operator=(const BucketFileStore &) = delete;
+
+    ~BucketFileStore() override;
+
+    size_t pageSize() const override { return pageBytes; }
+
+    void readPage(PageId pageId, char *data) override;
+
+    void writePage(PageId pageId, const char *data) override;
+
+    void writeRange(PageId pageId, size_t offset, const char *data, size_t size) override;
+
+    PageFile openPage(PageId pageId, bool forWrite) override;
+
+    PageId allocatePage() override { return nextPageId++; }
+
+    void freePage(PageId pageId) override;
+
+    void sync() override;
+
+    void enableMapping(AccessPattern pattern) override;
+
+    void adviseAccess(AccessPattern pattern) override;
+
+    const char *mapPage(PageId pageId) override;
+
+    size_t filesOpened() const override { return openedFiles.load(std::memory_order_relaxed); }
+
+    // Path of the file that stores the given page
+    std::string pagePath(PageId pageId) const;
+};
+
+} // namespace ehash
+
+#endif
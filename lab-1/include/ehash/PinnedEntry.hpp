@@ -0,0 +1,47 @@
+#ifndef PINNEDENTRY_HPP
+#define PINNEDENTRY_HPP
+
+#include "Epoch.hpp"
+#include <utility>
+#include <vector>
+
+namespace ehash {
+
+// Entry returned by a lookup. The handle pins the table's epoch, so the entry stays valid while the handle
+// lives, even if its bucket is changed, split, merged or unloaded meanwhile: those retire entries instead of
+// deleting them. Every handle holds one of the epoch manager's reader slots and keeps what was retired after
+// it from being reclaimed, so handles are meant to be short-lived. A handle must not outlive its table
+template <typename T> class PinnedEntry {
+  private:
+    EpochManager::Guard guard;
+    const T *entry;
+
+  public:
+    PinnedEntry(EpochManager::Guard guard, const T *entry) : guard(std::move(guard)), entry(entry) {}
+
+    const T &operator*() const { return *entry; }
+    const T *operator->() const { return entry; }
+    const T *get() const { return entry; }
+};
+
+// Entries of a bucket, collected under its latch and pinned like a PinnedEntry. The list is a snapshot: changes
+// made to the bucket after it was taken do not show in it
+template <typename T> class PinnedEntries {
+  private:
+    EpochManager::Guard guard;
+    std::vector<const T *> entries;
+
+  public:
+    PinnedEntries(EpochManager::Guard guard, std::vector<const T *> entries)
+        : guard(std::move(guard)), entries(std::move(entries)) {}
+
+    size_t size() const { return entries.size(); }
+    bool empty() const { return entries.empty(); }
+    const T *operator[](size_t i) const { return entries[i]; }
+    typename std::vector<const T *>::const_iterator begin() const { return entries.begin(); }
+    typename std::vector<const T *>::const_iterator end() const { return entries.end(); }
+};
+
+} // namespace ehash
+
+#endif
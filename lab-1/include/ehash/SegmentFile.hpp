@@ -0,0 +1,99 @@
+#ifndef SEGMENTFILE_HPP
+#define SEGMENTFILE_HPP
+
+#include "PageStore.hpp"
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace ehash {
+
+// Page store that keeps every bucket page in one preallocated segment file.
+//
+// Page 0 holds the segment header; bucket pages start at page 1 and live at offset pageId * pageSize,
+// so reading or writing a bucket is a single pread/pwrite on a file descriptor that stays open.
+// Freed pages form a linked free list on disk: the first 8 bytes of a free page hold the id of the
+// next free page and the header holds the head of the list.
+class SegmentFile : public PageStore {
+  private:
+    static constexpr char MAGIC_NUMBER[4] = {'E', 'H', 'S', 'G'};
+    static constexpr uint32_t VERSION = 1;
+
+    // On-disk layout of page 0
+    struct Header {
+        char magic[4];
+        uint32_t version;
+        uint64_t pageSize;
+        uint64_t pageCount;    // Pages handed out so far, including the header page
+        uint64_t freeListHead; // First free page, 0 if the free list is empty
+    };
+
+    std::string filePath;
+    size_t pageBytes;
+    int fd = -1;
+    Header header{};
+    uint64_t capacityPages = 0; // Pages preallocated in the file
+
+    bool mappingEnabled = false;
+    AccessPattern accessPattern = AccessPattern::Random;
+    char *mapping = nullptr; // Read-only mapping of the whole file, created on first use
+    size_t mappedBytes = 0;
+    std::vector<std::pair<char *, size_t>> retiredMappings; // Mappings of smaller file sizes, unmapped on close
+
+    void unmap();
+
+    void writeHeader();
+
+    // Make room for at least the given number of pages, doubling the file to amortize growth
+    void reserve(uint64_t pages);
+
+    void readAt(uint64_t offset, char *data, size_t size) const;
+
+    void writeAt(uint64_t offset, const char *data, size_t size);
+
+  public:
+    // Open the segment file, creating it with room for initialPages bucket pages if it does not exist
+    SegmentFile(const std::string &filePath, size_t pageSize, size_t initialPages);
+
+    SegmentFile(const SegmentFile &) = delete;
+    SegmentFile &operator=(const SegmentFile &) = delete;
+
+    ~SegmentFile() override;
+
+    size_t pageSize() const override { return pageBytes; }
+
+    void readPage(PageId pageId, char *data) override;
+
+    void writePage(PageId pageId, const char *data) override;
+
+    void writeRange(PageId pageId, size_t offset, const char *data, size_t size) override;
+
+    // The segment's own descriptor, which stays open
+    PageFile openPage(PageId pageId, bool forWrite) override;
+
+    PageId allocatePage() override;
+
+    void freePage(PageId pageId) override;
+
+    void sync() override;
+
+    void enableMapping(AccessPattern pattern) override;
+
+    void adviseAccess(AccessPattern pattern) override;
+
+    const char *mapPage(PageId pageId) override;
+
+    // The segment file stays open
+    size_t filesOpened() const override { return 1; }
+
+    // Number of pages handed out so far, including the header page
+    uint64_t pageCount() const { return header.pageCount; }
+
+    // Number of pages the file has room for without growing
+    uint64_t capacity() const { return capacityPages; }
+};
+
+} // namespace ehash
+
+#endif
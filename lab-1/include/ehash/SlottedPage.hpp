@@ -0,0 +1,129 @@
+#ifndef SLOTTEDPAGE_HPP
+#define SLOTTEDPAGE_HPP
+
+#include "BufferPool.hpp"
+#include <cstdint>
+
+namespace ehash {
+
+// Read-only view of a slotted bucket page.
+//
+// Layout: a header, then a slot directory that grows forward, then free space, then a record heap that
+// grows backward from the end of the page:
+//
+//     [Header][Slot 0][Slot 1]...[Slot n-1] -> free space <- [record n-1]...[record 0]
+//
+// Each slot holds the offset and length of one record. A slot with offset FREE_OFFSET is free and may be reused;
+// records always lie past the header, so an empty record (length 0, e.g. a message with only default fields)
+// is still live.
+// Space of removed or shrunk records is counted as fragmented and reclaimed by compaction.
+// The header starts with the bytes the storage layer owns (see PAGE_PREFIX_SIZE); the page operations leave
+// them to whoever writes the page out.
+// An all-zero page is a valid empty page.
+class SlottedPageView {
+  protected:
+    struct Header {
+        uint32_t checksum;        // Of the rest of the page, kept by a buffer pool that seals pages (see Checksum.hpp)
+        uint32_t storedSize;      // Zero; a compressing store marks compressed pages here (see PageCodec.hpp)
+        uint32_t slotCount;       // Slots in the directory, live or free
+        uint32_t heapStart;       // Offset of the lowest record; 0 means the heap is empty
+        uint32_t fragmentedBytes; // Bytes inside the heap that no record uses
+    };
+
+    struct Slot {
+        uint32_t offset; // FREE_OFFSET for a free slot
+        uint32_t length;
+    };
+
+    // Offset that marks a free slot; it lies inside the header, where no record can start
+    static constexpr uint32_t FREE_OFFSET = 0;
+
+    const char *bytes;
+    size_t pageSize;
+
+    Header header() const;
+
+    Slot slot(uint32_t slotId) const;
+
+    // End of the slot directory
+    size_t slotsEnd(uint32_t slotCount) const { return HEADER_SIZE + slotCount * SLOT_SIZE; }
+
+    // Offset of the lowest record, with the empty heap starting at the end of the page
+    size_t heapStart(const Header &pageHeader) const {
+        return pageHeader.heapStart == 0 ? pageSize : pageHeader.heapStart;
+    }
+
+  public:
+    static constexpr size_t HEADER_SIZE = sizeof(Header);
+    static constexpr size_t SLOT_SIZE = sizeof(Slot);
+
+    SlottedPageView(const char *data, size_t pageSize);
+
+    uint32_t slotCount() const { return header().slotCount; }
+
+    bool isLive(uint32_t slotId) const { return slot(slotId).offset != FREE_OFFSET; }
+
+    const char *recordData(uint32_t slotId) const { return bytes + slot(slotId).offset; }
+
+    size_t recordSize(uint32_t slotId) const { return slot(slotId).length; }
+
+    // Bytes available for records and slots once the heap is compacted
+    size_t freeSpace() const;
+
+    // Space a record takes on the page, including its slot
+    static size_t requiredSpace(size_t recordSize) { return recordSize + SLOT_SIZE; }
+
+    bool canInsert(size_t recordSize) const { return requiredSpace(recordSize) <= freeSpace(); }
+};
+
+// Slotted bucket page that is modified in place through a pinned page.
+// Every operation only marks the header, the affected slot and the affected record dirty,
+// except compaction, which rewrites the record heap.
+class SlottedPage : public SlottedPageView {
+  private:
+    PageGuard &page;
+
+    void writeHeader(const Header &pageHeader);
+
+    void writeSlot(uint32_t slotId, const Slot &pageSlot);
+
+    void writeRecord(size_t offset, const char *data, size_t size);
+
+    // Move every live record to the end of the page so the free space is contiguous
+    void compact();
+
+    // Reserve size bytes below the heap for a record, compacting first if the free space is fragmented
+    size_t allocate(Header &pageHeader, size_t size, uint32_t slotCount);
+
+  public:
+    SlottedPage(PageGuard &page, size_t pageSize);
+
+    // Drop every record
+    void reset();
+
+    // Store a record and return its slot. The caller checks canInsert() first
+    uint32_t insert(const char *data, size_t size);
+
+    // Replace the record in a slot. Returns false, leaving the page unchanged, if the new record does not fit
+    bool update(uint32_t slotId, const char *data, size_t size);
+
+    // Remove the record in a slot
+    void erase(uint32_t slotId);
+};
+
+// Slotted bucket page laid out in a plain buffer, for pages that are built whole and then written out at once
+class SlottedPageWriter : public SlottedPageView {
+  private:
+    char *data;
+
+  public:
+    // Start an empty page in data, which holds pageSize bytes
+    SlottedPageWriter(char *data, size_t pageSize);
+
+    // Store a record in the next slot. Returns false, leaving the page unchanged, if it does not fit
+    bool append(const char *record, size_t size);
+};
+
+} // namespace ehash
+
+#endif
@@ -0,0 +1,127 @@
+#ifndef TABLEMETRICS_HPP
+#define TABLEMETRICS_HPP
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace ehash {
+
+// Distribution of the latencies of one kind of operation. Latencies fall into power-of-two buckets: bucket i
+// counts the ones below 2^i nanoseconds that are not counted by bucket i - 1
+struct LatencyHistogram {
+    static constexpr size_t BUCKETS = 64;
+
+    std::array<uint64_t, BUCKETS> counts{};
+    uint64_t count = 0;      // Operations timed
+    uint64_t totalNanos = 0; // Time they took together
+
+    double meanNanos() const { return count == 0 ? 0.0 : static_cast<double>(totalNanos) / count; }
+
+    // Upper bound of the bucket that holds the given quantile (0 to 1) of the latencies; 0 if none were timed
+    uint64_t quantileNanos(double quantile) const;
+};
+
+// What a table has done since it was opened, and the shape of its buckets when the stats were taken
+struct TableStats {
+    static constexpr size_t FILL_STEPS = 10;
+
+    size_t splits = 0;             // Buckets split in two
+    size_t directoryDoublings = 0; // Splits that doubled the directory
+    size_t merges = 0;             // Buddies merged into one bucket
+    size_t directoryHalvings = 0;  // Times the directory halved after a merge
+    size_t overflowPagesAdded = 0; // Pages chained to buckets that could not split
+    size_t pageWrites = 0;         // Bucket pages written back by the buffer pool
+    size_t bytesWritten = 0;       // Bytes those writes took
+    size_t filesOpened = 0;        // Files the page store opened
+
+    // Latencies, if the table records them (see Options::recordLatencies)
+    LatencyHistogram insertLatency;      // addEntry
+    LatencyHistogram batchInsertLatency; // addEntries, one sample per batch
+    LatencyHistogram lookupLatency;      // get and getEntry
+    LatencyHistogram removeLatency;      // removeEntry
+
+    // Loaded buckets by the share of their pages their records and slots take, in tenths; full buckets count in
+    // the last step. Unloaded buckets are not read for this
+    std::array<size_t, FILL_STEPS> fillFactor{};
+    size_t loadedBuckets = 0;
+    double meanFillFactor = 0.0; // Of the loaded buckets
+
+    // Buckets by the number of overflow pages chained to them
+    std::vector<size_t> overflowDepth;
+};
+
+// Counters behind TableStats. Every operation updates them with relaxed atomic increments, so they take no latch
+// and may be read while the table is in use
+class TableMetrics {
+  public:
+    enum class Operation { Insert, BatchInsert, Lookup, Remove };
+
+  private:
+    // Latency buckets of one operation
+    struct Histogram {
+        std::array<std::atomic<uint64_t>, LatencyHistogram::BUCKETS> counts{};
+        std::atomic<uint64_t> totalNanos{0};
+
+        void record(uint64_t nanos);
+        LatencyHistogram snapshot() const;
+    };
+
+    bool timed; // Operations record their latency
+    std::atomic<size_t> splits{0};
+    std::atomic<size_t> directoryDoublings{0};
+    std::atomic<size_t> merges{0};
+    std::atomic<size_t> directoryHalvings{0};
+    std::array<Histogram, 4> latencies;
+
+  public:
+    explicit TableMetrics(bool recordLatencies) : timed(recordLatencies) {}
+
+    // Times an operation from construction to destruction, if the metrics record latencies
+    class Timer {
+      private:
+        Histogram *histogram;
+        std::chrono::steady_clock::time_point start;
+
+      public:
+        Timer(TableMetrics &metrics, Operation operation)
+            : histogram(metrics.timed ? &metrics.latencies[static_cast<size_t>(operation)] : nullptr) {
+            if (histogram != nullptr) {
+                start = std::chrono::steady_clock::now();
+            }
+        }
+
+        Timer(const Timer &) = delete;
+        Timer &operator=(const Timer &) = delete;
+
+        ~Timer() {
+            if (histogram != nullptr) {
+                histogram->record(static_cast<uint64_t>(
+                    std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start)
+                        .count()));
+            }
+        }
+    };
+
+    void countSplit(bool doubled) {
+        splits.fetch_add(1, std::memory_order_relaxed);
+        if (doubled) {
+            directoryDoublings.fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+
+    void countMerge(size_t halvings) {
+        merges.fetch_add(1, std::memory_order_relaxed);
+        directoryHalvings.fetch_add(halvings, std::memory_order_relaxed);
+    }
+
+    // The counters and latencies; the table fills in the rest
+    TableStats stats() const;
+};
+
+} // namespace ehash
+
+#endif
@@ -0,0 +1,26 @@
+#ifndef VERIFYPAGES_HPP
+#define VERIFYPAGES_HPP
+
+#include "PageStore.hpp"
+#include <cstddef>
+#include <string>
+#include <vector>
+
+namespace ehash {
+
+// Page of a table that does not hold its checksum or cannot be read at all
+struct CorruptedPage {
+    PageId pageId;
+    size_t bucket;      // Index of the bucket in the bucket table of the directory file
+    size_t chainIndex;  // 0 for the primary page of the bucket, then its overflow pages in chain order
+    std::string reason; // "checksum mismatch", or the error reading the page (e.g. a corrupted compressed frame)
+};
+
+// Check every bucket page the directory file of the table in directoryPath names, primary and overflow,
+// without opening the table. Pages are checked as they are on disk: a checkpoint journal left by a crash is
+// not applied. A page that fails to read is reported like one that fails its checksum, and the check goes on
+std::vector<CorruptedPage> findCorruptedPages(const std::string &directoryPath);
+
+} // namespace ehash
+
+#endif
@@ -0,0 +1,102 @@
+#ifndef WRITEAHEADLOG_HPP
+#define WRITEAHEADLOG_HPP
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <string>
+
+namespace ehash {
+
+// Counters describing how well group commit batches writers
+struct WriteAheadLogStats {
+    size_t records = 0; // Records appended
+    size_t syncs = 0;   // fdatasync calls made to commit them
+};
+
+// Append-only redo log of the changes made to a hash table.
+//
+// The file starts with a magic number and a format version, then every record is a checksummed header
+// followed by a payload:
+//
+//     [checksum][payload size][record type][payload]
+//
+// Version 2 checksums records with CRC32C. Version 1 logs had no file header and used FNV-1a; they are
+// refused rather than replayed, since every one of their records would fail the check.
+//
+// Records are appended to an in-memory buffer and made durable by commit(). Concurrent committers are
+// batched: one of them becomes the leader, optionally waits a commit window for more writers to join,
+// writes the whole buffer and calls fdatasync once for everybody. The others wait for the leader.
+class WriteAheadLog {
+  public:
+    using Lsn = uint64_t; // Position of a record in the log, starting at 1
+
+    enum class RecordType : uint32_t {
+        Put = 1,   // Payload is a serialized entry that was added or replaced
+        Erase = 2, // Payload is the serialized entry that was removed
+    };
+
+  private:
+    struct FileHeader {
+        char magic[4];
+        uint32_t version;
+    };
+
+    struct RecordHeader {
+        uint32_t checksum; // Covers the type and the payload
+        uint32_t size;     // Payload size
+        uint32_t type;
+    };
+
+    std::string filePath;
+    int fd = -1;
+    std::chrono::microseconds commitWindow; // How long a leader waits for more writers before syncing
+
+    mutable std::mutex mutex;
+    std::condition_variable flushed;
+    std::string buffer;    // Records appended but not yet written
+    Lsn appendedLsn = 0;   // Last record appended
+    Lsn durableLsn = 0;    // Last record known to be durable
+    bool flushing = false; // A leader is writing and syncing the buffer
+    size_t fileBytes = 0;  // Bytes written to the file
+    std::string failure;   // Error of a failed write or sync, empty while the log is healthy
+    WriteAheadLogStats stats;
+
+    void writeAll(const std::string &data);
+    void throwIfFailed() const; // Caller holds mutex
+
+  public:
+    // Open the log, creating it if it does not exist. Throws if the file is a log of another version
+    WriteAheadLog(const std::string &filePath, std::chrono::microseconds commitWindow);
+
+    WriteAheadLog(const WriteAheadLog &) = delete;
+    WriteAheadLog &operator=(const WriteAheadLog &) = delete;
+
+    ~WriteAheadLog();
+
+    // Pass every complete record to apply in log order. A torn or corrupted tail, left by a crash in
+    // the middle of a write, is cut off the file; the file header is never cut
+    void replay(const std::function<void(RecordType, const std::string &)> &apply);
+
+    // Buffer a record and return its position; it is durable once commit() returns for it
+    Lsn append(RecordType type, const std::string &payload);
+
+    // Block until every record up to lsn is durable. Once a write or sync fails, this and append() throw
+    // for every caller until reset(), since the lost batch may have left a torn record in the file
+    void commit(Lsn lsn);
+
+    // Empty the log once everything appended so far has been made durable somewhere else (a checkpoint).
+    // This also clears a write failure
+    void reset();
+
+    // Bytes of records in the log, written or buffered; the file header is not counted
+    size_t size() const;
+
+    WriteAheadLogStats getStats() const;
+};
+
+} // namespace ehash
+
+#endif
@@ -0,0 +1,419 @@
+#include "ehash/BufferPool.hpp"
+#include "ehash/Checksum.hpp"
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+#include <unistd.h>
+
+namespace ehash {
+
+BufferPool::BufferPool(std::shared_ptr<PageStore> store, size_t capacity, std::shared_ptr<IoQueue> ioQueue,
+                       PageChecksums checksums)
+    : store(std::move(store)), ioQueue(std::move(ioQueue)), frames(capacity), capacityPages(capacity),
+      checksums(checksums) {
+    // Pages the store transforms cannot be read or written around it
+    if (!this->store->pagesStoredAsIs()) {
+        this->ioQueue.reset();
+    }
+    if (capacity == 0) {
+        throw std::runtime_error("Buffer pool must hold at least one page");
+    }
+}
+
+void BufferPool::seal(Frame &frame) {
+    if (checksums == PageChecksums::Off) {
+        return;
+    }
+    sealPage(frame.data.data(), frame.data.size());
+    if (!frame.wholePageDirty) {
+        addDirtyRange(frame, 0, PAGE_CHECKSUM_SIZE);
+    }
+}
+
+void BufferPool::verify(PageId pageId, const char *data) const {
+    if (checksums == PageChecksums::Verify && !pageIntact(data, store->pageSize())) {
+        throw std::runtime_error("Checksum mismatch in page " + std::to_string(pageId) +
+                                 ": the page is corrupted or a write to it was torn");
+    }
+}
+
+void BufferPool::writeBack(Frame &frame) {
+    seal(frame);
+    if (frame.wholePageDirty) {
+        store->writePage(frame.pageId, frame.data.data());
+        stats.bytesWritten += frame.data.size();
+    } else {
+        for (const auto &[begin, end] : frame.dirtyRanges) {
+            store->writeRange(frame.pageId, begin, frame.data.data() + begin, end - begin);
+            stats.bytesWritten += end - begin;
+        }
+    }
+
+    frame.dirty = false;
+    frame.wholePageDirty = false;
+    frame.dirtyRanges.clear();
+    stats.pageWrites++;
+}
+
+void BufferPool::writeBackQueued() {
+    std::vector<Frame *> chunk;
+    for (auto &frame : frames) {
+        if (!frame.used || !frame.dirty) {
+            continue;
+        }
+        chunk.push_back(&frame);
+        if (chunk.size() == WRITE_BACK_CHUNK) {
+            writeBackChunk(chunk);
+            chunk.clear();
+        }
+    }
+    if (!chunk.empty()) {
+        writeBackChunk(chunk);
+    }
+}
+
+void BufferPool::writeBackChunk(const std::vector<Frame *> &chunk) {
+    std::vector<Frame *> written;
+    std::vector<PageFile> files;
+    IoBatch batch;
+    std::exception_ptr failure;
+    try {
+        for (Frame *frame : chunk) {
+            seal(*frame);
+            files.push_back(store->openPage(frame->pageId, true));
+            const PageFile &file = files.back();
+            if (frame->wholePageDirty) {
+                size_t size = frame->data.size();
+                ioQueue->write(file.fd, frame->data.data(), size, file.offset, batch.add(size));
+            } else {
+                for (const auto &[begin, end] : frame->dirtyRanges) {
+                    ioQueue->write(file.fd, frame->data.data() + begin, end - begin, file.offset + begin,
+                                   batch.add(end - begin));
+                }
+            }
+            written.push_back(frame);
+        }
+    } catch (...) {
+        failure = std::current_exception();
+    }
+
+    // The writes still in flight use the batch and the files, so they are waited for even after a failure
+    try {
+        batch.wait("write back pages");
+    } catch (...) {
+        if (!failure) {
+            failure = std::current_exception();
+        }
+    }
+    for (const auto &file : files) {
+        if (file.owned) {
+            ::close(file.fd);
+        }
+    }
+    if (failure) {
+        std::rethrow_exception(failure);
+    }
+
+    for (Frame *frame : written) {
+        if (frame->wholePageDirty) {
+            stats.bytesWritten += frame->data.size();
+        } else {
+            for (const auto &[begin, end] : frame->dirtyRanges) {
+                stats.bytesWritten += end - begin;
+            }
+        }
+        frame->dirty = false;
+        frame->wholePageDirty = false;
+        frame->dirtyRanges.clear();
+        stats.pageWrites++;
+    }
+}
+
+size_t BufferPool::findVictim() {
+    // Every frame gets at most two looks: the first clears its reference bit, the second takes it
+    for (size_t step = 0; step < 2 * frames.size(); ++step) {
+        size_t index = clockHand;
+        clockHand = (clockHand + 1) % frames.size();
+
+        Frame &frame = frames[index];
+        if (!frame.used) {
+            return index;
+        }
+        if (frame.pinCount > 0) {
+            continue;
+        }
+        if (frame.referenced) {
+            frame.referenced = false;
+            continue;
+        }
+        if (frame.dirty && noSteal) {
+            continue;
+        }
+
+        if (frame.dirty) {
+            writeBack(frame);
+        }
+        pageTable.erase(frame.pageId);
+        frame.used = false;
+        stats.evictions++;
+        return index;
+    }
+
+    if (noSteal) {
+        // Every page is pinned or waiting for the next flush: grow until then
+        frames.emplace_back();
+        return frames.size() - 1;
+    }
+    throw std::runtime_error("Buffer pool exhausted: all pages are pinned");
+}
+
+char *BufferPool::pinPage(PageId pageId) {
+    std::lock_guard<std::mutex> lock(mutex);
+    auto it = pageTable.find(pageId);
+    if (it != pageTable.end()) {
+        Frame &frame = frames[it->second];
+        frame.pinCount++;
+        frame.referenced = true;
+        stats.hits++;
+        return frame.data.data();
+    }
+
+    size_t index = findVictim();
+    Frame &frame = frames[index];
+    frame.data.resize(store->pageSize());
+    store->readPage(pageId, frame.data.data());
+    verify(pageId, frame.data.data());
+
+    frame.pageId = pageId;
+    frame.pinCount = 1;
+    frame.dirty = false;
+    frame.wholePageDirty = false;
+    frame.dirtyRanges.clear();
+    frame.referenced = true;
+    frame.used = true;
+    pageTable[pageId] = index;
+    stats.misses++;
+    return frame.data.data();
+}
+
+void BufferPool::unpinPage(PageId pageId, bool dirty) {
+    std::lock_guard<std::mutex> lock(mutex);
+    auto it = pageTable.find(pageId);
+    if (it == pageTable.end() || frames[it->second].pinCount == 0) {
+        throw std::runtime_error("Unpinning a page that is not pinned: " + std::to_string(pageId));
+    }
+
+    Frame &frame = frames[it->second];
+    frame.pinCount--;
+    if (dirty) {
+        frame.dirty = true;
+        frame.wholePageDirty = true;
+        frame.dirtyRanges.clear();
+    }
+}
+
+void BufferPool::markDirty(PageId pageId, size_t offset, size_t size) {
+    std::lock_guard<std::mutex> lock(mutex);
+    auto it = pageTable.find(pageId);
+    if (it == pageTable.end() || frames[it->second].pinCount == 0) {
+        throw std::runtime_error("Modifying a page that is not pinned: " + std::to_string(pageId));
+    }
+
+    Frame &frame = frames[it->second];
+    frame.dirty = true;
+    if (!store->pagesStoredAsIs()) {
+        frame.wholePageDirty = true; // Ranges would be written by rewriting the page each time
+    }
+    addDirtyRange(frame, offset, size);
+}
+
+void BufferPool::addDirtyRange(Frame &frame, size_t offset, size_t size) {
+    if (frame.wholePageDirty || size == 0) {
+        return;
+    }
+
+    // Merge the new range with every range it overlaps or touches
+    size_t begin = offset;
+    size_t end = offset + size;
+    auto &ranges = frame.dirtyRanges;
+    auto first = std::lower_bound(ranges.begin(), ranges.end(), begin,
+                                  [](const auto &range, size_t value) { return range.second < value; });
+    auto last = first;
+    while (last != ranges.end() && last->first <= end) {
+        begin = std::min(begin, last->first);
+        end = std::max(end, last->second);
+        ++last;
+    }
+    first = ranges.erase(first, last);
+    ranges.insert(first, {begin, end});
+
+    if (ranges.size() > MAX_DIRTY_RANGES) {
+        frame.wholePageDirty = true;
+        ranges.clear();
+    }
+}
+
+void BufferPool::flushPage(PageId pageId) {
+    std::lock_guard<std::mutex> lock(mutex);
+    auto it = pageTable.find(pageId);
+    if (it != pageTable.end() && frames[it->second].dirty) {
+        writeBack(frames[it->second]);
+    }
+}
+
+void BufferPool::flush() {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (ioQueue) {
+        writeBackQueued();
+    } else {
+        for (auto &frame : frames) {
+            if (frame.used && frame.dirty) {
+                writeBack(frame);
+            }
+        }
+    }
+
+    // Give back the frames a no-steal pool grew by, as far as they are not pinned
+    while (frames.size() > capacityPages && frames.back().pinCount == 0) {
+        if (frames.back().used) {
+            pageTable.erase(frames.back().pageId);
+        }
+        frames.pop_back();
+    }
+    clockHand %= frames.size();
+}
+
+void BufferPool::readPageAsync(PageId pageId, char *data, std::function<void(std::exception_ptr)> done) {
+    std::unique_lock<std::mutex> lock(mutex);
+    size_t size = store->pageSize();
+    auto it = pageTable.find(pageId);
+    if (it != pageTable.end()) {
+        std::memcpy(data, frames[it->second].data.data(), size);
+        lock.unlock();
+        done(nullptr);
+        return;
+    }
+    if (!ioQueue) {
+        std::exception_ptr error;
+        try {
+            store->readPage(pageId, data);
+            verify(pageId, data);
+        } catch (...) {
+            error = std::current_exception();
+        }
+        lock.unlock();
+        done(error);
+        return;
+    }
+
+    PageFile file = store->openPage(pageId, false);
+    lock.unlock();
+    if (file.fd < 0) {
+        std::memset(data, 0, size);
+        done(nullptr);
+        return;
+    }
+    ioQueue->read(file.fd, data, size, file.offset, [this, pageId, file, data, size, done](ssize_t result) {
+        if (file.owned) {
+            ::close(file.fd);
+        }
+        if (result < 0) {
+            done(std::make_exception_ptr(
+                std::runtime_error(std::string("Failed to read page: ") + std::strerror(-result))));
+            return;
+        }
+        std::memset(data + result, 0, size - result); // Past the end of the file
+        try {
+            verify(pageId, data);
+        } catch (...) {
+            done(std::current_exception());
+            return;
+        }
+        done(nullptr);
+    });
+}
+
+std::vector<std::pair<PageId, const char *>> BufferPool::dirtyPages() {
+    std::lock_guard<std::mutex> lock(mutex);
+    std::vector<std::pair<PageId, const char *>> pages;
+    for (auto &frame : frames) {
+        if (frame.used && frame.dirty) {
+            seal(frame);
+            pages.push_back({frame.pageId, frame.data.data()});
+        }
+    }
+    return pages;
+}
+
+void BufferPool::setNoSteal(bool enabled) {
+    std::lock_guard<std::mutex> lock(mutex);
+    noSteal = enabled;
+}
+
+bool BufferPool::isResident(PageId pageId) const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return pageTable.count(pageId) != 0;
+}
+
+const char *BufferPool::mappedPage(PageId pageId) {
+    const char *mapped;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        mapped = pageTable.count(pageId) != 0 ? nullptr : store->mapPage(pageId);
+    }
+    if (mapped != nullptr) {
+        verify(pageId, mapped);
+    }
+    return mapped;
+}
+
+PageId BufferPool::allocatePage() {
+    std::lock_guard<std::mutex> lock(mutex);
+    return store->allocatePage();
+}
+
+void BufferPool::discardFrame(PageId pageId) {
+    auto it = pageTable.find(pageId);
+    if (it == pageTable.end()) {
+        return;
+    }
+
+    Frame &frame = frames[it->second];
+    if (frame.pinCount > 0) {
+        throw std::runtime_error("Discarding a pinned page: " + std::to_string(pageId));
+    }
+    frame.used = false;
+    frame.dirty = false;
+    frame.wholePageDirty = false;
+    frame.dirtyRanges.clear();
+    pageTable.erase(it);
+}
+
+void BufferPool::discardPage(PageId pageId) {
+    std::lock_guard<std::mutex> lock(mutex);
+    discardFrame(pageId);
+}
+
+void BufferPool::freePage(PageId pageId) {
+    std::lock_guard<std::mutex> lock(mutex);
+    discardFrame(pageId);
+    store->freePage(pageId);
+}
+
+size_t BufferPool::frameCount() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return frames.size();
+}
+
+BufferPoolStats BufferPool::getStats() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return stats;
+}
+
+CompressionStats BufferPool::compressionStats() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    auto *compressed = dynamic_cast<const CompressedPageStore *>(store.get());
+    return compressed ? compressed->getStats() : CompressionStats{};
+}
+
+} // namespace ehash
@@ -0,0 +1,286 @@
+#include "ehash/BulkLoader.hpp"
+#include "ehash/Checksum.hpp"
+#include "ehash/SlottedPage.hpp"
+#include <algorithm>
+#include <cstdint>
+#include <filesystem>
+#include <istream>
+#include <numeric>
+#include <ostream>
+#include <stdexcept>
+
+namespace ehash {
+
+namespace {
+
+// Spilled record: its hash, its size, then its bytes
+struct SpillHeader {
+    uint64_t hashValue;
+    uint32_t size;
+};
+
+void writeSpilled(std::ostream &output, size_t hashValue, std::string_view record) {
+    SpillHeader header{hashValue, static_cast<uint32_t>(record.size())};
+    output.write(reinterpret_cast<const char *>(&header), sizeof(SpillHeader));
+    output.write(record.data(), record.size());
+}
+
+RecordBatch readSpilled(const std::string &path) {
+    std::ifstream input(path, std::ios::binary);
+    if (!input) {
+        throw std::runtime_error("Failed to open bulk load partition: " + path);
+    }
+
+    RecordBatch batch;
+    SpillHeader header;
+    std::string record;
+    while (input.read(reinterpret_cast<char *>(&header), sizeof(SpillHeader))) {
+        record.resize(header.size);
+        if (!input.read(record.data(), header.size)) {
+            break;
+        }
+        batch.add(header.hashValue, record);
+    }
+    if (!input.eof() || input.gcount() != 0) {
+        throw std::runtime_error("Failed to read bulk load partition: " + path);
+    }
+    return batch;
+}
+
+} // namespace
+
+bool readDelimitedRecord(std::istream &input, std::string &record) {
+    // The length is a varint of at most 32 bits: seven bits per byte, low bits first, so at most five bytes
+    uint64_t size = 0;
+    for (int shift = 0;; shift += 7) {
+        int byte = input.get();
+        if (byte == std::char_traits<char>::eof()) {
+            if (shift == 0) {
+                return false;
+            }
+            throw std::runtime_error("Truncated record length in bulk load input");
+        }
+        if (shift > 28) {
+            throw std::runtime_error("Corrupted record length in bulk load input");
+        }
+        size |= static_cast<uint64_t>(byte & 0x7f) << shift;
+        if ((byte & 0x80) == 0) {
+            break;
+        }
+    }
+    // A fifth byte carries bits past the 32 the length may have
+    if (size > UINT32_MAX) {
+        throw std::runtime_error("Corrupted record length in bulk load input");
+    }
+
+    record.resize(size);
+    if (!input.read(record.data(), size)) {
+        throw std::runtime_error("Truncated record in bulk load input");
+    }
+    return true;
+}
+
+void writeDelimitedRecord(std::ostream &output, std::string_view record) {
+    char length[5];
+    size_t lengthBytes = 0;
+    uint32_t size = record.size();
+    while (size >= 0x80) {
+        length[lengthBytes++] = static_cast<char>((size & 0x7f) | 0x80);
+        size >>= 7;
+    }
+    length[lengthBytes++] = static_cast<char>(size);
+    output.write(length, lengthBytes);
+    output.write(record.data(), record.size());
+}
+
+void RecordBatch::add(size_t hashValue, std::string_view record) {
+    hashes.push_back(hashValue);
+    bytes.append(record);
+    ends.push_back(bytes.size());
+}
+
+std::string_view RecordBatch::record(size_t i) const {
+    size_t begin = i == 0 ? 0 : ends[i - 1];
+    return std::string_view(bytes).substr(begin, ends[i] - begin);
+}
+
+BulkLoader::BulkLoader(const std::string &directoryPath, size_t pageSize, const Options &options,
+                       DuplicateFilter filterDuplicates)
+    : directoryPath(directoryPath), pageSize(pageSize), options(options),
+      filterDuplicates(std::move(filterDuplicates)), spillDirectory(directoryPath + "/bulk_load"), page(pageSize) {
+    if (options.maxLocalDepth > 31) {
+        throw std::runtime_error("Maximum local depth must not exceed 31");
+    }
+    store = makePageStore(directoryPath, pageSize, options.storageMode, options, 0);
+    meta.pageSize = pageSize;
+    meta.storageMode = options.storageMode;
+    meta.pageCompression = options.pageCompression;
+}
+
+BulkLoader::~BulkLoader() {
+    partitions.clear();
+    std::error_code error;
+    std::filesystem::remove_all(spillDirectory, error);
+}
+
+void BulkLoader::add(size_t hashValue, std::string_view record) {
+    if (SlottedPageView::requiredSpace(record.size()) > pageSize - SlottedPageView::HEADER_SIZE) {
+        throw std::runtime_error("Entry size exceeds maximum bucket size");
+    }
+    if (spillBits != 0) {
+        writeSpilled(partitions[hashValue & ((size_t{1} << spillBits) - 1)], hashValue, record);
+        return;
+    }
+
+    memory.add(hashValue, record);
+    if (options.bulkLoadMemoryBytes != 0 && memory.memoryBytes() > options.bulkLoadMemoryBytes &&
+        options.maxLocalDepth > 0) {
+        spill();
+    }
+}
+
+void BulkLoader::spill() {
+    spillBits = std::min(SPILL_BITS, options.maxLocalDepth);
+    std::filesystem::create_directories(spillDirectory);
+    for (size_t partition = 0; partition < (size_t{1} << spillBits); ++partition) {
+        std::string path = spillDirectory + "/partition_" + std::to_string(partition);
+        partitions.emplace_back(path, std::ios::binary | std::ios::trunc);
+        if (!partitions.back()) {
+            throw std::runtime_error("Failed to open file for writing: " + path);
+        }
+    }
+    for (size_t i = 0; i < memory.size(); ++i) {
+        writeSpilled(partitions[memory.hash(i) & ((size_t{1} << spillBits) - 1)], memory.hash(i), memory.record(i));
+    }
+    memory = RecordBatch();
+}
+
+void BulkLoader::buildPartition(const RecordBatch &batch, size_t prefix, size_t depth) {
+    // Records with equal hashes end up next to each other, in the order they were added
+    std::vector<size_t> order(batch.size());
+    std::iota(order.begin(), order.end(), 0);
+    std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) { return batch.hash(a) < batch.hash(b); });
+
+    std::vector<size_t> live;
+    std::vector<std::string_view> sameHash;
+    std::vector<bool> keep;
+    live.reserve(order.size());
+    for (size_t begin = 0; begin < order.size();) {
+        size_t end = begin + 1;
+        while (end < order.size() && batch.hash(order[end]) == batch.hash(order[begin])) {
+            end++;
+        }
+        if (end - begin == 1) {
+            live.push_back(order[begin]);
+        } else {
+            sameHash.clear();
+            for (size_t i = begin; i < end; ++i) {
+                sameHash.push_back(batch.record(order[i]));
+            }
+            keep.assign(end - begin, true);
+            filterDuplicates(sameHash, keep);
+            for (size_t i = begin; i < end; ++i) {
+                if (keep[i - begin]) {
+                    live.push_back(order[i]);
+                }
+            }
+        }
+        begin = end;
+    }
+
+    buildBuckets(batch, live, 0, live.size(), prefix, depth);
+}
+
+void BulkLoader::buildBuckets(const RecordBatch &batch, std::vector<size_t> &records, size_t begin, size_t end,
+                              size_t prefix, size_t depth) {
+    size_t used = 0;
+    for (size_t i = begin; i < end; ++i) {
+        used += SlottedPageView::requiredSpace(batch.record(records[i]).size());
+    }
+
+    if (used > pageSize - SlottedPageView::HEADER_SIZE && depth < options.maxLocalDepth) {
+        // Dividing only helps if some keys differ within the bits a bucket may use
+        size_t limitMask = (size_t{1} << options.maxLocalDepth) - 1;
+        size_t firstHash = batch.hash(records[begin]);
+        bool separable = std::any_of(records.begin() + begin, records.begin() + end, [&](size_t record) {
+            return ((batch.hash(record) ^ firstHash) & limitMask) != 0;
+        });
+        if (separable) {
+            size_t bit = size_t{1} << depth;
+            auto middle = std::partition(records.begin() + begin, records.begin() + end,
+                                         [&](size_t record) { return (batch.hash(record) & bit) == 0; });
+            size_t split = middle - records.begin();
+            buildBuckets(batch, records, begin, split, prefix, depth + 1);
+            buildBuckets(batch, records, split, end, prefix | bit, depth + 1);
+            return;
+        }
+    }
+    writeBucket(batch, records, begin, end, prefix, depth);
+}
+
+void BulkLoader::writeBucket(const RecordBatch &batch, const std::vector<size_t> &records, size_t begin, size_t end,
+                             size_t prefix, size_t depth) {
+    PageId primaryPage = store->allocatePage();
+    PageId currentPage = primaryPage;
+    std::vector<PageId> overflowPages;
+    SlottedPageWriter writer(page.data(), pageSize);
+    for (size_t i = begin; i < end; ++i) {
+        std::string_view record = batch.record(records[i]);
+        if (writer.append(record.data(), record.size())) {
+            continue;
+        }
+        // Every record fits an empty page, as add() checked
+        sealPage(page.data(), pageSize);
+        store->writePage(currentPage, page.data());
+        currentPage = store->allocatePage();
+        overflowPages.push_back(currentPage);
+        writer = SlottedPageWriter(page.data(), pageSize);
+        writer.append(record.data(), record.size());
+    }
+    sealPage(page.data(), pageSize);
+    store->writePage(currentPage, page.data());
+
+    meta.buckets.push_back({primaryPage, static_cast<uint32_t>(depth), std::move(overflowPages)});
+    bucketPrefixes.push_back(prefix);
+    entryCount += end - begin;
+}
+
+size_t BulkLoader::finish() {
+    if (spillBits == 0) {
+        buildPartition(memory, 0, 0);
+        memory = RecordBatch();
+    } else {
+        for (auto &partition : partitions) {
+            partition.close();
+            if (!partition) {
+                throw std::runtime_error("Failed to write bulk load partition in " + spillDirectory);
+            }
+        }
+        partitions.clear();
+        for (size_t partition = 0; partition < (size_t{1} << spillBits); ++partition) {
+            std::string path = spillDirectory + "/partition_" + std::to_string(partition);
+            buildPartition(readSpilled(path), partition, spillBits);
+            std::filesystem::remove(path);
+        }
+        std::filesystem::remove_all(spillDirectory);
+    }
+
+    for (const auto &bucket : meta.buckets) {
+        meta.globalDepth = std::max(meta.globalDepth, bucket.localDepth);
+    }
+    meta.directory.assign(size_t{1} << meta.globalDepth, 0);
+    for (size_t bucket = 0; bucket < meta.buckets.size(); ++bucket) {
+        for (size_t i = bucketPrefixes[bucket]; i < meta.directory.size();
+             i += size_t{1} << meta.buckets[bucket].localDepth) {
+            meta.directory[i] = bucket;
+        }
+    }
+
+    // The pages must be durable before the directory file names them
+    store->sync();
+    writeDirectoryMeta(directoryMetaPath(directoryPath), meta);
+    store.reset();
+    return entryCount;
+}
+
+} // namespace ehash
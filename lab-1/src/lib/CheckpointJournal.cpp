@@ -0,0 +1,115 @@
+#include "ehash/CheckpointJournal.hpp"
+#include "ehash/Checksum.hpp"
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <stdexcept>
+
+namespace ehash {
+
+namespace {
+
+constexpr char MAGIC_NUMBER[4] = {'E', 'H', 'C', 'J'};
+constexpr uint32_t VERSION = 2; // Version 1 used FNV-1a and pages without a checksum in their header
+
+struct Header {
+    char magic[4];
+    uint32_t version;
+    uint64_t pageSize;
+    uint64_t pageCount;
+    uint64_t directorySize;
+};
+
+} // namespace
+
+std::string checkpointJournalPath(const std::string &directoryPath) {
+    return directoryPath + "/checkpoint.journal";
+}
+
+void writeCheckpointJournal(const std::string &path, size_t pageSize,
+                            const std::vector<std::pair<PageId, const char *>> &pages, const std::string &directory) {
+    Header header{};
+    std::memcpy(header.magic, MAGIC_NUMBER, sizeof(MAGIC_NUMBER));
+    header.version = VERSION;
+    header.pageSize = pageSize;
+    header.pageCount = pages.size();
+    header.directorySize = directory.size();
+
+    std::string bytes;
+    bytes.reserve(sizeof(Header) + pages.size() * (sizeof(PageId) + pageSize) + directory.size() + sizeof(uint32_t));
+    bytes.append(reinterpret_cast<const char *>(&header), sizeof(Header));
+    for (const auto &[pageId, data] : pages) {
+        bytes.append(reinterpret_cast<const char *>(&pageId), sizeof(PageId));
+        bytes.append(data, pageSize);
+    }
+    bytes.append(directory);
+    uint32_t sum = checksum(bytes.data(), bytes.size());
+    bytes.append(reinterpret_cast<const char *>(&sum), sizeof(sum));
+
+    {
+        std::ofstream outFile(path, std::ios::binary | std::ios::trunc);
+        if (!outFile) {
+            throw std::runtime_error("Failed to open file for writing: " + path);
+        }
+        outFile.write(bytes.data(), bytes.size());
+        if (!outFile.flush()) {
+            throw std::runtime_error("Failed to write checkpoint journal: " + path);
+        }
+    }
+    syncFile(path);
+    std::string parentPath = std::filesystem::path(path).parent_path().string();
+    syncFile(parentPath.empty() ? "." : parentPath);
+}
+
+std::optional<CheckpointJournal> readCheckpointJournal(const std::string &path) {
+    std::ifstream inFile(path, std::ios::binary);
+    if (!inFile) {
+        return std::nullopt;
+    }
+    std::string bytes((std::istreambuf_iterator<char>(inFile)), std::istreambuf_iterator<char>());
+    if (inFile.bad()) {
+        throw std::runtime_error("Failed to read checkpoint journal: " + path);
+    }
+
+    // Anything short of a complete, checksummed journal was torn before the checkpoint touched a page
+    Header header;
+    if (bytes.size() < sizeof(Header) + sizeof(uint32_t)) {
+        return std::nullopt;
+    }
+    std::memcpy(&header, bytes.data(), sizeof(Header));
+    if (std::memcmp(header.magic, MAGIC_NUMBER, sizeof(MAGIC_NUMBER)) != 0 || header.pageSize == 0) {
+        return std::nullopt;
+    }
+    // A complete journal of another version may hold a checkpoint that still has to be finished, so it
+    // must not be taken for a torn one
+    if (header.version != VERSION) {
+        throw std::runtime_error("Unsupported checkpoint journal version " + std::to_string(header.version) + ": " +
+                                 path);
+    }
+    size_t payloadSize = bytes.size() - sizeof(Header) - sizeof(uint32_t);
+    if (header.pageCount > payloadSize / (sizeof(PageId) + header.pageSize) ||
+        header.pageCount * (sizeof(PageId) + header.pageSize) + header.directorySize != payloadSize) {
+        return std::nullopt;
+    }
+    uint32_t sum;
+    std::memcpy(&sum, bytes.data() + bytes.size() - sizeof(sum), sizeof(sum));
+    if (sum != checksum(bytes.data(), bytes.size() - sizeof(sum))) {
+        return std::nullopt;
+    }
+
+    CheckpointJournal journal;
+    journal.pageSize = header.pageSize;
+    size_t offset = sizeof(Header);
+    for (uint64_t i = 0; i < header.pageCount; ++i) {
+        PageId pageId;
+        std::memcpy(&pageId, bytes.data() + offset, sizeof(PageId));
+        offset += sizeof(PageId);
+        journal.pages.push_back({pageId, bytes.substr(offset, header.pageSize)});
+        offset += header.pageSize;
+    }
+    journal.directory = bytes.substr(offset, header.directorySize);
+    return journal;
+}
+
+} // namespace ehash
@@ -0,0 +1,98 @@
+#include "ehash/Checksum.hpp"
+#include <array>
+#include <cstring>
+
+#if defined(__x86_64__)
+#include <nmmintrin.h>
+#endif
+
+namespace ehash {
+
+namespace {
+
+// Reflected CRC32C polynomial
+constexpr uint32_t POLYNOMIAL = 0x82f63b78u;
+
+constexpr std::array<uint32_t, 256> makeTable() {
+    std::array<uint32_t, 256> table{};
+    for (uint32_t byte = 0; byte < 256; ++byte) {
+        uint32_t crc = byte;
+        for (int bit = 0; bit < 8; ++bit) {
+            crc = (crc >> 1) ^ ((crc & 1) != 0 ? POLYNOMIAL : 0);
+        }
+        table[byte] = crc;
+    }
+    return table;
+}
+
+constexpr std::array<uint32_t, 256> TABLE = makeTable();
+
+uint32_t crc32cSoftware(uint32_t crc, const unsigned char *bytes, size_t size) {
+    for (size_t i = 0; i < size; ++i) {
+        crc = TABLE[(crc ^ bytes[i]) & 0xff] ^ (crc >> 8);
+    }
+    return crc;
+}
+
+#if defined(__x86_64__)
+__attribute__((target("sse4.2"))) uint32_t crc32cHardware(uint32_t crc, const unsigned char *bytes, size_t size) {
+    uint64_t crc64 = crc;
+    for (; size >= sizeof(uint64_t); size -= sizeof(uint64_t), bytes += sizeof(uint64_t)) {
+        uint64_t word;
+        std::memcpy(&word, bytes, sizeof(word));
+        crc64 = _mm_crc32_u64(crc64, word);
+    }
+    crc = static_cast<uint32_t>(crc64);
+    for (; size > 0; --size, ++bytes) {
+        crc = _mm_crc32_u8(crc, *bytes);
+    }
+    return crc;
+}
+#endif
+
+using Crc32c = uint32_t (*)(uint32_t, const unsigned char *, size_t);
+
+Crc32c pickCrc32c() {
+#if defined(__x86_64__)
+    if (__builtin_cpu_supports("sse4.2")) {
+        return crc32cHardware;
+    }
+#endif
+    return crc32cSoftware;
+}
+
+const Crc32c crc32c = pickCrc32c();
+
+} // namespace
+
+uint32_t checksum(const void *data, size_t size, uint32_t seed) {
+    return ~crc32c(~seed, static_cast<const unsigned char *>(data), size);
+}
+
+bool hardwareChecksum() { return crc32c != crc32cSoftware; }
+
+uint32_t pageChecksum(const char *page, size_t pageSize) {
+    return checksum(page + PAGE_CHECKSUM_SIZE, pageSize - PAGE_CHECKSUM_SIZE);
+}
+
+void sealPage(char *page, size_t pageSize) {
+    uint32_t sum = pageChecksum(page, pageSize);
+    std::memcpy(page, &sum, PAGE_CHECKSUM_SIZE);
+}
+
+bool pageIntact(const char *page, size_t pageSize) {
+    uint32_t stored;
+    std::memcpy(&stored, page, PAGE_CHECKSUM_SIZE);
+    if (stored == pageChecksum(page, pageSize)) {
+        return true;
+    }
+    // Only checked on a mismatch, so intact pages are read once
+    for (size_t i = 0; i < pageSize; ++i) {
+        if (page[i] != 0) {
+            return false;
+        }
+    }
+    return true;
+}
+
+} // namespace ehash
@@ -0,0 +1,179 @@
+#include "ehash/DirectoryFile.hpp"
+#include <algorithm>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <stdexcept>
+
+namespace ehash {
+
+namespace {
+
+constexpr char MAGIC_NUMBER[4] = {'E', 'H', 'D', 'M'};
+constexpr uint32_t VERSION = 4;
+// Tables of earlier versions store their bucket pages without the checksum that now leads the slotted page
+// header, so their pages cannot be read by this version
+constexpr uint32_t OLDEST_VERSION = 4;
+
+struct Header {
+    char magic[4];
+    uint32_t version;
+    uint64_t pageSize;
+    uint32_t storageMode;
+    uint32_t globalDepth;
+    uint32_t bucketCount;
+    uint32_t pageCompression;
+};
+
+struct BucketRecord {
+    uint64_t pageId;
+    uint32_t localDepth;
+    uint32_t overflowPages;
+};
+
+} // namespace
+
+PageId pageIdsEnd(const DirectoryMeta &meta) {
+    PageId end = 0;
+    for (const auto &info : meta.buckets) {
+        end = std::max(end, info.pageId + 1);
+        for (PageId overflowPage : info.overflowPages) {
+            end = std::max(end, overflowPage + 1);
+        }
+    }
+    return end;
+}
+
+std::string directoryMetaPath(const std::string &directoryPath) { return directoryPath + "/directory.meta"; }
+
+std::string encodeDirectoryMeta(const DirectoryMeta &meta) {
+    Header header{};
+    std::memcpy(header.magic, MAGIC_NUMBER, sizeof(MAGIC_NUMBER));
+    header.version = VERSION;
+    header.pageSize = meta.pageSize;
+    header.storageMode = static_cast<uint32_t>(meta.storageMode);
+    header.globalDepth = meta.globalDepth;
+    header.bucketCount = meta.buckets.size();
+    header.pageCompression = static_cast<uint32_t>(meta.pageCompression);
+
+    std::vector<BucketRecord> records;
+    std::vector<uint64_t> overflowPages;
+    records.reserve(meta.buckets.size());
+    for (const auto &bucket : meta.buckets) {
+        records.push_back({bucket.pageId, bucket.localDepth, static_cast<uint32_t>(bucket.overflowPages.size())});
+        overflowPages.insert(overflowPages.end(), bucket.overflowPages.begin(), bucket.overflowPages.end());
+    }
+
+    std::string bytes;
+    bytes.append(reinterpret_cast<const char *>(&header), sizeof(Header));
+    bytes.append(reinterpret_cast<const char *>(records.data()), records.size() * sizeof(BucketRecord));
+    bytes.append(reinterpret_cast<const char *>(meta.directory.data()), meta.directory.size() * sizeof(uint32_t));
+    bytes.append(reinterpret_cast<const char *>(overflowPages.data()), overflowPages.size() * sizeof(uint64_t));
+    return bytes;
+}
+
+DirectoryMeta decodeDirectoryMeta(const std::string &bytes, const std::string &source) {
+    Header header;
+    if (bytes.size() < sizeof(Header)) {
+        throw std::runtime_error("Truncated directory file: " + source);
+    }
+    std::memcpy(&header, bytes.data(), sizeof(Header));
+    if (std::memcmp(header.magic, MAGIC_NUMBER, sizeof(MAGIC_NUMBER)) != 0) {
+        throw std::runtime_error("Invalid magic number in directory file: " + source);
+    }
+    if (header.version < OLDEST_VERSION || header.version > VERSION) {
+        throw std::runtime_error("Unsupported directory file version " + std::to_string(header.version) + ": " +
+                                 source);
+    }
+    if (header.globalDepth >= 32 || header.bucketCount == 0 ||
+        header.storageMode > static_cast<uint32_t>(StorageMode::Segment) ||
+        header.pageCompression > static_cast<uint32_t>(PageCompression::Lz)) {
+        throw std::runtime_error("Corrupted directory file header: " + source);
+    }
+
+    DirectoryMeta meta;
+    meta.pageSize = header.pageSize;
+    meta.storageMode = static_cast<StorageMode>(header.storageMode);
+    meta.pageCompression = static_cast<PageCompression>(header.pageCompression);
+    meta.globalDepth = header.globalDepth;
+
+    std::vector<BucketRecord> records(header.bucketCount);
+    meta.directory.resize(size_t{1} << header.globalDepth);
+    size_t recordBytes = records.size() * sizeof(BucketRecord);
+    size_t directoryBytes = meta.directory.size() * sizeof(uint32_t);
+    if (bytes.size() < sizeof(Header) + recordBytes + directoryBytes) {
+        throw std::runtime_error("Truncated directory file: " + source);
+    }
+    std::memcpy(records.data(), bytes.data() + sizeof(Header), recordBytes);
+    std::memcpy(meta.directory.data(), bytes.data() + sizeof(Header) + recordBytes, directoryBytes);
+
+    size_t overflowCount = 0;
+    for (const auto &record : records) {
+        overflowCount += record.overflowPages;
+    }
+    if (overflowCount > bytes.size() / sizeof(uint64_t)) {
+        throw std::runtime_error("Truncated directory file: " + source);
+    }
+    std::vector<uint64_t> overflowPages(overflowCount);
+    size_t overflowBytes = overflowCount * sizeof(uint64_t);
+    if (bytes.size() != sizeof(Header) + recordBytes + directoryBytes + overflowBytes) {
+        throw std::runtime_error("Truncated directory file: " + source);
+    }
+    if (overflowCount != 0) {
+        std::memcpy(overflowPages.data(), bytes.data() + sizeof(Header) + recordBytes + directoryBytes,
+                    overflowBytes);
+    }
+
+    auto nextOverflowPage = overflowPages.begin();
+    for (const auto &record : records) {
+        if (record.localDepth > header.globalDepth) {
+            throw std::runtime_error("Corrupted bucket depth in directory file: " + source);
+        }
+        meta.buckets.push_back({record.pageId, record.localDepth,
+                                std::vector<PageId>(nextOverflowPage, nextOverflowPage + record.overflowPages)});
+        nextOverflowPage += record.overflowPages;
+    }
+    for (uint32_t bucketIndex : meta.directory) {
+        if (bucketIndex >= meta.buckets.size()) {
+            throw std::runtime_error("Corrupted directory entry in directory file: " + source);
+        }
+    }
+    return meta;
+}
+
+std::optional<DirectoryMeta> readDirectoryMeta(const std::string &path) {
+    std::ifstream inFile(path, std::ios::binary);
+    if (!inFile) {
+        return std::nullopt;
+    }
+
+    std::string bytes((std::istreambuf_iterator<char>(inFile)), std::istreambuf_iterator<char>());
+    if (inFile.bad()) {
+        throw std::runtime_error("Failed to read directory file: " + path);
+    }
+    return decodeDirectoryMeta(bytes, path);
+}
+
+void writeDirectoryMeta(const std::string &path, const DirectoryMeta &meta) {
+    std::string bytes = encodeDirectoryMeta(meta);
+
+    // Write a temporary file and rename it over the old one, so a crash leaves either version
+    std::string tempPath = path + ".tmp";
+    {
+        std::ofstream outFile(tempPath, std::ios::binary | std::ios::trunc);
+        if (!outFile) {
+            throw std::runtime_error("Failed to open file for writing: " + tempPath);
+        }
+        outFile.write(bytes.data(), bytes.size());
+        if (!outFile.flush()) {
+            throw std::runtime_error("Failed to write directory file: " + tempPath);
+        }
+    }
+    syncFile(tempPath);
+    std::filesystem::rename(tempPath, path);
+    std::string parentPath = std::filesystem::path(path).parent_path().string();
+    syncFile(parentPath.empty() ? "." : parentPath);
+}
+
+} // namespace ehash
@@ -0,0 +1,92 @@
+#include "ehash/Epoch.hpp"
+#include <algorithm>
+#include <functional>
+#include <limits>
+#include <thread>
+
+namespace ehash {
+
+EpochManager::~EpochManager() {
+    for (const auto &object : retired) {
+        object.destroy(object.object);
+    }
+    SlotBlock *block = readers.next.load();
+    while (block != nullptr) {
+        SlotBlock *next = block->next.load();
+        delete block;
+        block = next;
+    }
+}
+
+EpochManager::ReaderSlot *EpochManager::pin() {
+    thread_local const size_t home = std::hash<std::thread::id>{}(std::this_thread::get_id());
+
+    uint64_t epoch = globalEpoch.load();
+    for (SlotBlock *block = &readers;;) {
+        for (size_t i = 0; i < READER_SLOTS; ++i) {
+            ReaderSlot &reader = block->slots[(home + i) % READER_SLOTS];
+            uint64_t expected = 0;
+            if (reader.epoch.compare_exchange_strong(expected, epoch)) {
+                // Pairs with the fence in reclaimRetired(): either the reclaiming writer sees this slot,
+                // or everything read from here on sees the writer's unlinks
+                std::atomic_thread_fence(std::memory_order_seq_cst);
+                return &reader;
+            }
+        }
+
+        // Every slot of the block is taken: go on to the next block, chaining one if there is none yet
+        SlotBlock *next = block->next.load();
+        if (next == nullptr) {
+            auto *added = new SlotBlock();
+            if (block->next.compare_exchange_strong(next, added)) {
+                next = added;
+            } else {
+                delete added; // Another reader chained one first
+            }
+        }
+        block = next;
+    }
+}
+
+void EpochManager::unpin(ReaderSlot *slot) { slot->epoch.store(0, std::memory_order_release); }
+
+void EpochManager::retireObject(void *object, void (*destroy)(void *)) {
+    std::lock_guard<std::mutex> lock(retiredMutex);
+    retired.push_back({globalEpoch.fetch_add(1), object, destroy});
+    if (retired.size() >= RECLAIM_BATCH) {
+        reclaimRetired();
+    }
+}
+
+void EpochManager::reclaimRetired() {
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    uint64_t oldestPinned = std::numeric_limits<uint64_t>::max();
+    for (const SlotBlock *block = &readers; block != nullptr; block = block->next.load()) {
+        for (const auto &reader : block->slots) {
+            uint64_t epoch = reader.epoch.load();
+            if (epoch != 0) {
+                oldestPinned = std::min(oldestPinned, epoch);
+            }
+        }
+    }
+
+    // A reader that pinned a later epoch than the one an object was retired in cannot have seen it
+    auto stillVisible = std::partition(retired.begin(), retired.end(),
+                                       [&](const Retired &object) { return object.epoch >= oldestPinned; });
+    for (auto it = stillVisible; it != retired.end(); ++it) {
+        it->destroy(it->object);
+    }
+    retired.erase(stillVisible, retired.end());
+}
+
+void EpochManager::reclaim() {
+    std::lock_guard<std::mutex> lock(retiredMutex);
+    reclaimRetired();
+}
+
+size_t EpochManager::retiredCount() {
+    std::lock_guard<std::mutex> lock(retiredMutex);
+    return retired.size();
+}
+
+} // namespace ehash
@@ -0,0 +1,147 @@
+#include "ehash/Hasher.hpp"
+#include <cstring>
+
+namespace ehash {
+
+namespace {
+
+constexpr uint64_t WY_SECRET[4] = {0x2d358dccaa6c78a5ULL, 0x8bb84b93962eacc9ULL, 0x4b33a62ed433d4a3ULL,
+                                   0x4d5a2da51de1aa47ULL};
+
+constexpr uint64_t XXH_PRIME1 = 0x9E3779B185EBCA87ULL;
+constexpr uint64_t XXH_PRIME2 = 0xC2B2AE3D27D4EB4FULL;
+constexpr uint64_t XXH_PRIME3 = 0x165667B19E3779F9ULL;
+constexpr uint64_t XXH_PRIME4 = 0x85EBCA77C2B2AE63ULL;
+constexpr uint64_t XXH_PRIME5 = 0x27D4EB2F165667C5ULL;
+
+uint64_t read64(const unsigned char *bytes) {
+    uint64_t value;
+    std::memcpy(&value, bytes, sizeof(value));
+    return value;
+}
+
+uint64_t read32(const unsigned char *bytes) {
+    uint32_t value;
+    std::memcpy(&value, bytes, sizeof(value));
+    return value;
+}
+
+uint64_t rotateLeft(uint64_t value, int bits) { return (value << bits) | (value >> (64 - bits)); }
+
+// Multiply a and b to 128 bits, keeping the low half in a and the high half in b
+void wymum(uint64_t &a, uint64_t &b) {
+    __uint128_t product = static_cast<__uint128_t>(a) * b;
+    a = static_cast<uint64_t>(product);
+    b = static_cast<uint64_t>(product >> 64);
+}
+
+uint64_t xxhRound(uint64_t accumulator, uint64_t lane) {
+    accumulator += lane * XXH_PRIME2;
+    return rotateLeft(accumulator, 31) * XXH_PRIME1;
+}
+
+uint64_t xxhMergeRound(uint64_t hash, uint64_t accumulator) {
+    hash ^= xxhRound(0, accumulator);
+    return hash * XXH_PRIME1 + XXH_PRIME4;
+}
+
+} // namespace
+
+uint64_t wyhash(const void *data, size_t size, uint64_t seed) {
+    const auto *bytes = static_cast<const unsigned char *>(data);
+    seed ^= wymix(seed ^ WY_SECRET[0], WY_SECRET[1]);
+
+    uint64_t a;
+    uint64_t b;
+    if (size <= 16) {
+        if (size >= 4) {
+            size_t middle = (size >> 3) << 2;
+            a = (read32(bytes) << 32) | read32(bytes + middle);
+            b = (read32(bytes + size - 4) << 32) | read32(bytes + size - 4 - middle);
+        } else if (size > 0) {
+            a = (uint64_t(bytes[0]) << 16) | (uint64_t(bytes[size >> 1]) << 8) | bytes[size - 1];
+            b = 0;
+        } else {
+            a = b = 0;
+        }
+    } else {
+        size_t left = size;
+        if (left >= 48) {
+            uint64_t seed1 = seed;
+            uint64_t seed2 = seed;
+            do {
+                seed = wymix(read64(bytes) ^ WY_SECRET[1], read64(bytes + 8) ^ seed);
+                seed1 = wymix(read64(bytes + 16) ^ WY_SECRET[2], read64(bytes + 24) ^ seed1);
+                seed2 = wymix(read64(bytes + 32) ^ WY_SECRET[3], read64(bytes + 40) ^ seed2);
+                bytes += 48;
+                left -= 48;
+            } while (left >= 48);
+            seed ^= seed1 ^ seed2;
+        }
+        while (left > 16) {
+            seed = wymix(read64(bytes) ^ WY_SECRET[1], read64(bytes + 8) ^ seed);
+            bytes += 16;
+            left -= 16;
+        }
+        // The last 16 bytes, overlapping the ones already mixed when fewer are left
+        a = read64(bytes + left - 16);
+        b = read64(bytes + left - 8);
+    }
+
+    a ^= WY_SECRET[1];
+    b ^= seed;
+    wymum(a, b);
+    return wymix(a ^ WY_SECRET[0] ^ size, b ^ WY_SECRET[1]);
+}
+
+uint64_t xxh64(const void *data, size_t size, uint64_t seed) {
+    const auto *bytes = static_cast<const unsigned char *>(data);
+    const unsigned char *end = bytes + size;
+
+    uint64_t hash;
+    if (size >= 32) {
+        uint64_t v1 = seed + XXH_PRIME1 + XXH_PRIME2;
+        uint64_t v2 = seed + XXH_PRIME2;
+        uint64_t v3 = seed;
+        uint64_t v4 = seed - XXH_PRIME1;
+        do {
+            v1 = xxhRound(v1, read64(bytes));
+            v2 = xxhRound(v2, read64(bytes + 8));
+            v3 = xxhRound(v3, read64(bytes + 16));
+            v4 = xxhRound(v4, read64(bytes + 24));
+            bytes += 32;
+        } while (end - bytes >= 32);
+
+        hash = rotateLeft(v1, 1) + rotateLeft(v2, 7) + rotateLeft(v3, 12) + rotateLeft(v4, 18);
+        hash = xxhMergeRound(hash, v1);
+        hash = xxhMergeRound(hash, v2);
+        hash = xxhMergeRound(hash, v3);
+        hash = xxhMergeRound(hash, v4);
+    } else {
+        hash = seed + XXH_PRIME5;
+    }
+    hash += size;
+
+    for (; end - bytes >= 8; bytes += 8) {
+        hash ^= xxhRound(0, read64(bytes));
+        hash = rotateLeft(hash, 27) * XXH_PRIME1 + XXH_PRIME4;
+    }
+    if (end - bytes >= 4) {
+        hash ^= read32(bytes) * XXH_PRIME1;
+        hash = rotateLeft(hash, 23) * XXH_PRIME2 + XXH_PRIME3;
+        bytes += 4;
+    }
+    for (; bytes < end; ++bytes) {
+        hash ^= *bytes * XXH_PRIME5;
+        hash = rotateLeft(hash, 11) * XXH_PRIME1;
+    }
+
+    hash ^= hash >> 33;
+    hash *= XXH_PRIME2;
+    hash ^= hash >> 29;
+    hash *= XXH_PRIME3;
+    hash ^= hash >> 32;
+    return hash;
+}
+
+} // namespace ehash
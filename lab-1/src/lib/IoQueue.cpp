@@ -0,0 +1,373 @@
+#include "ehash/IoQueue.hpp"
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <deque>
+#include <linux/io_uring.h>
+#include <stdexcept>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+namespace ehash {
+
+namespace {
+
+// Worker threads of the fallback backend; every worker has one operation in flight
+constexpr size_t MAX_POOL_THREADS = 8;
+
+// A read or write as submitted, with the bytes transferred so far
+struct Operation {
+    int fd;
+    char *data;
+    size_t size;
+    uint64_t offset;
+    bool write;
+    IoCompletion done;
+    size_t transferred = 0;
+};
+
+// Run an operation on the calling thread, retrying short transfers like the page stores do
+ssize_t transfer(Operation &op) {
+    while (op.transferred < op.size) {
+        char *data = op.data + op.transferred;
+        size_t size = op.size - op.transferred;
+        uint64_t offset = op.offset + op.transferred;
+        ssize_t result = op.write ? ::pwrite(op.fd, data, size, offset) : ::pread(op.fd, data, size, offset);
+        if (result < 0) {
+            if (errno == EINTR)
+                continue;
+            return -errno;
+        }
+        if (result == 0) {
+            break; // End of the file
+        }
+        op.transferred += result;
+    }
+    return op.transferred;
+}
+
+// Fallback backend: blocking pread and pwrite on a fixed set of worker threads
+class ThreadPoolQueue : public IoQueue {
+  private:
+    std::mutex mutex;
+    std::condition_variable ready;
+    std::deque<Operation> pending; // Guarded by mutex
+    bool stopping = false;
+    std::vector<std::thread> workers;
+
+    void enqueue(Operation op) {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            pending.push_back(std::move(op));
+        }
+        ready.notify_one();
+    }
+
+    void run() {
+        std::unique_lock<std::mutex> lock(mutex);
+        while (true) {
+            ready.wait(lock, [this] { return stopping || !pending.empty(); });
+            if (pending.empty()) {
+                return; // Stopping, and everything queued has been done
+            }
+            Operation op = std::move(pending.front());
+            pending.pop_front();
+
+            lock.unlock();
+            op.done(transfer(op));
+            lock.lock();
+        }
+    }
+
+  public:
+    explicit ThreadPoolQueue(size_t threads) {
+        for (size_t i = 0; i < threads; ++i) {
+            workers.emplace_back([this] { run(); });
+        }
+    }
+
+    ~ThreadPoolQueue() override {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        ready.notify_all();
+        for (auto &worker : workers) {
+            worker.join();
+        }
+    }
+
+    void read(int fd, char *data, size_t size, uint64_t offset, IoCompletion done) override {
+        enqueue({fd, data, size, offset, false, std::move(done)});
+    }
+
+    void write(int fd, const char *data, size_t size, uint64_t offset, IoCompletion done) override {
+        enqueue({fd, const_cast<char *>(data), size, offset, true, std::move(done)});
+    }
+
+    const char *backend() const override { return "thread pool"; }
+};
+
+// io_uring backend, driven through the raw system calls so that it needs no library.
+//
+// Submitters fill in a submission queue entry and enter the kernel right away, so the kernel consumes
+// every entry before the next one is written. A reaper thread waits for completions and runs them.
+// At most as many operations as the submission queue has entries are in flight, which keeps the twice
+// as large completion queue from overflowing
+class IoUringQueue : public IoQueue {
+  private:
+    int ringFd = -1;
+    unsigned entries = 0;
+
+    void *sqRing = MAP_FAILED;
+    size_t sqRingBytes = 0;
+    unsigned *sqTail = nullptr;
+    unsigned *sqMask = nullptr;
+    unsigned *sqArray = nullptr;
+    io_uring_sqe *sqes = static_cast<io_uring_sqe *>(MAP_FAILED);
+    size_t sqesBytes = 0;
+
+    void *cqRing = MAP_FAILED; // Same mapping as sqRing if the kernel maps both rings at once
+    size_t cqRingBytes = 0;
+    unsigned *cqHead = nullptr;
+    unsigned *cqTail = nullptr;
+    unsigned *cqMask = nullptr;
+    io_uring_cqe *cqes = nullptr;
+
+    std::mutex mutex; // Guards the submission queue and inFlight
+    std::condition_variable slotFreed;
+    size_t inFlight = 0;
+    std::thread reaper;
+
+    static int enter(int fd, unsigned toSubmit, unsigned minComplete, unsigned flags) {
+        return ::syscall(__NR_io_uring_enter, fd, toSubmit, minComplete, flags, nullptr, 0);
+    }
+
+    void release() {
+        if (cqRing != MAP_FAILED && cqRing != sqRing) {
+            ::munmap(cqRing, cqRingBytes);
+        }
+        if (sqRing != MAP_FAILED) {
+            ::munmap(sqRing, sqRingBytes);
+        }
+        if (sqes != MAP_FAILED) {
+            ::munmap(sqes, sqesBytes);
+        }
+        if (ringFd >= 0) {
+            ::close(ringFd);
+        }
+    }
+
+    void *mapRing(size_t bytes, uint64_t offset) {
+        void *ring = ::mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ringFd, offset);
+        if (ring == MAP_FAILED) {
+            throw std::runtime_error(std::string("Failed to map io_uring: ") + std::strerror(errno));
+        }
+        return ring;
+    }
+
+    // Hand the remaining part of op, or a wakeup for the reaper if op is nullptr, to the kernel.
+    // Returns 0 or the errno of the failure. The caller holds mutex
+    int submit(Operation *op) {
+        unsigned tail = *sqTail;
+        unsigned index = tail & *sqMask;
+        io_uring_sqe &sqe = sqes[index];
+        std::memset(&sqe, 0, sizeof(sqe));
+        sqe.opcode = IORING_OP_NOP;
+        if (op != nullptr) {
+            sqe.opcode = op->write ? IORING_OP_WRITE : IORING_OP_READ;
+            sqe.fd = op->fd;
+            sqe.addr = reinterpret_cast<uint64_t>(op->data + op->transferred);
+            sqe.len = op->size - op->transferred;
+            sqe.off = op->offset + op->transferred;
+        }
+        sqe.user_data = reinterpret_cast<uint64_t>(op);
+        sqArray[index] = index;
+        __atomic_store_n(sqTail, tail + 1, __ATOMIC_RELEASE);
+
+        int result;
+        do {
+            result = enter(ringFd, 1, 0, 0);
+        } while (result < 0 && errno == EINTR);
+        if (result < 0) {
+            __atomic_store_n(sqTail, tail, __ATOMIC_RELEASE); // The kernel did not take the entry
+            return errno;
+        }
+        return 0;
+    }
+
+    void enqueue(Operation *op) {
+        std::unique_lock<std::mutex> lock(mutex);
+        slotFreed.wait(lock, [this] { return inFlight < entries; });
+        int error = submit(op);
+        if (error == 0) {
+            inFlight++;
+            return;
+        }
+        lock.unlock();
+        op->done(-error);
+        delete op;
+    }
+
+    // Finish op with the result of its last submission, or submit the rest of a short transfer
+    void complete(Operation *op, int result) {
+        {
+            // Taken even without a resubmission: the kernel hands op over without anything a race
+            // detector can see, the mutex that was held while it was submitted orders the two threads
+            std::lock_guard<std::mutex> lock(mutex);
+            bool retry = result == -EINTR || result == -EAGAIN;
+            if (result > 0 && op->transferred + result < op->size) {
+                op->transferred += result;
+                result = 0;
+                retry = true;
+            }
+            if (retry) {
+                int error = submit(op);
+                if (error == 0) {
+                    return;
+                }
+                result = -error;
+            }
+        }
+
+        op->done(result < 0 ? result : op->transferred + result);
+        delete op;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            inFlight--;
+        }
+        slotFreed.notify_all();
+    }
+
+    void reap() {
+        while (true) {
+            if (enter(ringFd, 0, 1, IORING_ENTER_GETEVENTS) < 0 && errno != EINTR) {
+                std::this_thread::yield(); // Nothing else to do but try again
+            }
+
+            bool stopping = false;
+            unsigned head = *cqHead;
+            unsigned tail = __atomic_load_n(cqTail, __ATOMIC_ACQUIRE);
+            for (; head != tail; ++head) {
+                const io_uring_cqe &cqe = cqes[head & *cqMask];
+                auto *op = reinterpret_cast<Operation *>(cqe.user_data);
+                int result = cqe.res;
+                __atomic_store_n(cqHead, head + 1, __ATOMIC_RELEASE);
+                if (op == nullptr) {
+                    stopping = true;
+                } else {
+                    complete(op, result);
+                }
+            }
+            if (stopping) {
+                return;
+            }
+        }
+    }
+
+  public:
+    explicit IoUringQueue(size_t depth) {
+        io_uring_params params{};
+        ringFd = ::syscall(__NR_io_uring_setup, std::max<size_t>(depth, 1), &params);
+        if (ringFd < 0) {
+            throw std::runtime_error(std::string("io_uring is not available: ") + std::strerror(errno));
+        }
+
+        try {
+            entries = params.sq_entries;
+            sqRingBytes = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+            cqRingBytes = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+            if (params.features & IORING_FEAT_SINGLE_MMAP) {
+                sqRingBytes = cqRingBytes = std::max(sqRingBytes, cqRingBytes);
+            }
+            sqRing = mapRing(sqRingBytes, IORING_OFF_SQ_RING);
+            cqRing = (params.features & IORING_FEAT_SINGLE_MMAP) ? sqRing : mapRing(cqRingBytes, IORING_OFF_CQ_RING);
+            sqesBytes = params.sq_entries * sizeof(io_uring_sqe);
+            sqes = static_cast<io_uring_sqe *>(mapRing(sqesBytes, IORING_OFF_SQES));
+        } catch (...) {
+            release();
+            throw;
+        }
+
+        char *sq = static_cast<char *>(sqRing);
+        sqTail = reinterpret_cast<unsigned *>(sq + params.sq_off.tail);
+        sqMask = reinterpret_cast<unsigned *>(sq + params.sq_off.ring_mask);
+        sqArray = reinterpret_cast<unsigned *>(sq + params.sq_off.array);
+        char *cq = static_cast<char *>(cqRing);
+        cqHead = reinterpret_cast<unsigned *>(cq + params.cq_off.head);
+        cqTail = reinterpret_cast<unsigned *>(cq + params.cq_off.tail);
+        cqMask = reinterpret_cast<unsigned *>(cq + params.cq_off.ring_mask);
+        cqes = reinterpret_cast<io_uring_cqe *>(cq + params.cq_off.cqes);
+
+        reaper = std::thread([this] { reap(); });
+    }
+
+    ~IoUringQueue() override {
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            slotFreed.wait(lock, [this] { return inFlight == 0; });
+            while (submit(nullptr) != 0) {
+                std::this_thread::yield(); // The reaper only stops once the kernel has the wakeup
+            }
+        }
+        reaper.join();
+        release();
+    }
+
+    void read(int fd, char *data, size_t size, uint64_t offset, IoCompletion done) override {
+        enqueue(new Operation{fd, data, size, offset, false, std::move(done)});
+    }
+
+    void write(int fd, const char *data, size_t size, uint64_t offset, IoCompletion done) override {
+        enqueue(new Operation{fd, const_cast<char *>(data), size, offset, true, std::move(done)});
+    }
+
+    const char *backend() const override { return "io_uring"; }
+};
+
+} // namespace
+
+std::unique_ptr<IoQueue> makeIoQueue(IoBackend backend, size_t depth) {
+    if (backend != IoBackend::ThreadPool) {
+        try {
+            return std::make_unique<IoUringQueue>(depth);
+        } catch (const std::exception &) {
+            if (backend == IoBackend::IoUring) {
+                throw;
+            }
+        }
+    }
+    return std::make_unique<ThreadPoolQueue>(std::clamp<size_t>(depth, 1, MAX_POOL_THREADS));
+}
+
+IoCompletion IoBatch::add(size_t size) {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        pending++;
+    }
+    return [this, size](ssize_t result) {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (error == 0 && result != static_cast<ssize_t>(size)) {
+            error = result < 0 ? static_cast<int>(-result) : EIO;
+        }
+        // Notified with the lock held, since the waiter destroys the batch as soon as it sees zero
+        if (--pending == 0) {
+            finished.notify_all();
+        }
+    };
+}
+
+void IoBatch::wait(const std::string &what) {
+    std::unique_lock<std::mutex> lock(mutex);
+    finished.wait(lock, [this] { return pending == 0; });
+    if (error != 0) {
+        int failure = error;
+        error = 0;
+        throw std::runtime_error("Failed to " + what + ": " + std::strerror(failure));
+    }
+}
+
+} // namespace ehash
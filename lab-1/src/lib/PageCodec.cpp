@@ -0,0 +1,249 @@
+#include "ehash/PageCodec.hpp"
+#include <array>
+#include <chrono>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+
+namespace ehash {
+
+namespace {
+
+// Sequence layout: a token byte with the literal count in its high nibble and the match length minus
+// MIN_MATCH in its low nibble, more length bytes for a nibble of 15, the literals, then a 16-bit offset and
+// more match length bytes. The last sequence has literals only
+constexpr size_t MIN_MATCH = 4;
+constexpr size_t MAX_OFFSET = 65535;
+constexpr size_t HASH_BITS = 12;
+constexpr uint32_t NO_POSITION = UINT32_MAX;
+
+uint32_t read32(const char *data) {
+    uint32_t value;
+    std::memcpy(&value, data, sizeof(value));
+    return value;
+}
+
+uint32_t hashOfSequence(uint32_t sequence) { return (sequence * 2654435761u) >> (32 - HASH_BITS); }
+
+// Appends to a bounded output; every call returns false once the output is full
+class Output {
+  private:
+    char *position;
+    char *end;
+
+  public:
+    Output(char *data, size_t capacity) : position(data), end(data + capacity) {}
+
+    bool put(uint8_t byte) {
+        if (position == end) {
+            return false;
+        }
+        *position++ = static_cast<char>(byte);
+        return true;
+    }
+
+    bool put(const char *data, size_t size) {
+        if (static_cast<size_t>(end - position) < size) {
+            return false;
+        }
+        std::memcpy(position, data, size);
+        position += size;
+        return true;
+    }
+
+    // The part of a length past a full nibble, as 255s and a final byte below 255
+    bool putLength(size_t length) {
+        for (; length >= 255; length -= 255) {
+            if (!put(uint8_t{255})) {
+                return false;
+            }
+        }
+        return put(static_cast<uint8_t>(length));
+    }
+
+    char *current() const { return position; }
+};
+
+bool putSequence(Output &output, const char *literals, size_t literalCount, size_t offset, size_t matchLength) {
+    size_t matchCode = matchLength == 0 ? 0 : matchLength - MIN_MATCH;
+    uint8_t token = static_cast<uint8_t>((std::min<size_t>(literalCount, 15) << 4) | std::min<size_t>(matchCode, 15));
+    if (!output.put(token) || (literalCount >= 15 && !output.putLength(literalCount - 15)) ||
+        !output.put(literals, literalCount)) {
+        return false;
+    }
+    if (matchLength == 0) {
+        return true;
+    }
+    return output.put(static_cast<uint8_t>(offset & 0xff)) && output.put(static_cast<uint8_t>(offset >> 8)) &&
+           (matchCode < 15 || output.putLength(matchCode - 15));
+}
+
+// Read the rest of a length whose nibble was 15
+bool readLength(const unsigned char *&input, const unsigned char *end, size_t &length) {
+    uint8_t byte;
+    do {
+        if (input == end) {
+            return false;
+        }
+        byte = *input++;
+        length += byte;
+    } while (byte == 255);
+    return true;
+}
+
+} // namespace
+
+size_t lzCompress(const char *data, size_t size, char *output, size_t capacity) {
+    std::array<uint32_t, size_t{1} << HASH_BITS> positions;
+    positions.fill(NO_POSITION);
+    Output out(output, capacity);
+
+    size_t anchor = 0; // Start of the literals not written yet
+    size_t position = 0;
+    while (position + MIN_MATCH <= size) {
+        uint32_t sequence = read32(data + position);
+        uint32_t &slot = positions[hashOfSequence(sequence)];
+        size_t candidate = slot;
+        slot = static_cast<uint32_t>(position);
+        if (candidate == NO_POSITION || position - candidate > MAX_OFFSET || read32(data + candidate) != sequence) {
+            // Step faster through data that keeps failing to match
+            position += 1 + ((position - anchor) >> 6);
+            continue;
+        }
+
+        size_t length = MIN_MATCH;
+        while (position + length < size && data[candidate + length] == data[position + length]) {
+            length++;
+        }
+        if (!putSequence(out, data + anchor, position - anchor, position - candidate, length)) {
+            return 0;
+        }
+        position += length;
+        anchor = position;
+    }
+    if (!putSequence(out, data + anchor, size - anchor, 0, 0)) {
+        return 0;
+    }
+    return out.current() - output;
+}
+
+bool lzDecompress(const char *data, size_t compressedSize, char *output, size_t size) {
+    const auto *input = reinterpret_cast<const unsigned char *>(data);
+    const auto *inputEnd = input + compressedSize;
+    size_t written = 0;
+    while (true) {
+        if (input == inputEnd) {
+            return false; // Every stream ends with a sequence of literals only
+        }
+        uint8_t token = *input++;
+        size_t literalCount = token >> 4;
+        if (literalCount == 15 && !readLength(input, inputEnd, literalCount)) {
+            return false;
+        }
+        if (literalCount > static_cast<size_t>(inputEnd - input) || literalCount > size - written) {
+            return false;
+        }
+        std::memcpy(output + written, input, literalCount);
+        input += literalCount;
+        written += literalCount;
+        if (input == inputEnd) {
+            return written == size; // Last sequence
+        }
+
+        if (inputEnd - input < 2) {
+            return false;
+        }
+        size_t offset = input[0] | (size_t{input[1]} << 8);
+        input += 2;
+        size_t length = token & 0x0f;
+        if (length == 15 && !readLength(input, inputEnd, length)) {
+            return false;
+        }
+        length += MIN_MATCH;
+        if (offset == 0 || offset > written || length > size - written) {
+            return false;
+        }
+        if (offset >= length) {
+            std::memcpy(output + written, output + written - offset, length);
+            written += length;
+            continue;
+        }
+        // The match overlaps the bytes it produces, so it is copied forward byte by byte
+        for (size_t i = 0; i < length; ++i, ++written) {
+            output[written] = output[written - offset];
+        }
+    }
+}
+
+CompressedPageStore::CompressedPageStore(std::shared_ptr<PageStore> store)
+    : store(std::move(store)), frame(this->store->pageSize()) {
+    if (pageSize() <= PAGE_PREFIX_SIZE) {
+        throw std::runtime_error("Page size is too small for a compressed page");
+    }
+}
+
+void CompressedPageStore::readPage(PageId pageId, char *data) {
+    store->readPage(pageId, data);
+    uint32_t storedSize;
+    std::memcpy(&storedSize, data + PAGE_CHECKSUM_SIZE, sizeof(storedSize));
+    if (storedSize == 0) {
+        return; // Stored as it is
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    size_t size = pageSize();
+    if (storedSize > size - PAGE_PREFIX_SIZE) {
+        throw std::runtime_error("Corrupted compressed page " + std::to_string(pageId));
+    }
+    std::memcpy(frame.data(), data + PAGE_PREFIX_SIZE, storedSize);
+    if (!lzDecompress(frame.data(), storedSize, data + PAGE_PREFIX_SIZE, size - PAGE_PREFIX_SIZE)) {
+        throw std::runtime_error("Corrupted compressed page " + std::to_string(pageId));
+    }
+    std::memset(data + PAGE_CHECKSUM_SIZE, 0, sizeof(storedSize));
+    stats.pagesRead++;
+    stats.decompressNanos +=
+        std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+}
+
+void CompressedPageStore::writePage(PageId pageId, const char *data) {
+    uint32_t storedSize;
+    std::memcpy(&storedSize, data + PAGE_CHECKSUM_SIZE, sizeof(storedSize));
+    if (storedSize != 0) {
+        throw std::runtime_error("Page " + std::to_string(pageId) + " uses the bytes reserved for compression");
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    size_t size = pageSize();
+    // Only pages that end up smaller than they are get compressed
+    size_t compressed = lzCompress(data + PAGE_PREFIX_SIZE, size - PAGE_PREFIX_SIZE, frame.data() + PAGE_PREFIX_SIZE,
+                                   size - PAGE_PREFIX_SIZE - 1);
+    stats.compressNanos +=
+        std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+    stats.pagesWritten++;
+    stats.bytesIn += size;
+    if (compressed == 0) {
+        store->writePage(pageId, data);
+        stats.bytesStored += size;
+        return;
+    }
+
+    storedSize = static_cast<uint32_t>(compressed);
+    std::memcpy(frame.data(), data, PAGE_CHECKSUM_SIZE);
+    std::memcpy(frame.data() + PAGE_CHECKSUM_SIZE, &storedSize, sizeof(storedSize));
+    store->writeRange(pageId, 0, frame.data(), PAGE_PREFIX_SIZE + compressed);
+    stats.pagesCompressed++;
+    stats.bytesStored += PAGE_PREFIX_SIZE + compressed;
+}
+
+void CompressedPageStore::writeRange(PageId pageId, size_t offset, const char *data, size_t size) {
+    std::vector<char> page(pageSize());
+    readPage(pageId, page.data());
+    std::memcpy(page.data() + offset, data, size);
+    writePage(pageId, page.data());
+}
+
+PageFile CompressedPageStore::openPage(PageId pageId, bool) {
+    throw std::runtime_error("Compressed page " + std::to_string(pageId) + " can only be read and written whole");
+}
+
+} // namespace ehash
@@ -0,0 +1,208 @@
+#include "ehash/PageStore.hpp"
+#include "ehash/Options.hpp"
+#include "ehash/SegmentFile.hpp"
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <filesystem>
+#include <fstream>
+#include <stdexcept>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace ehash {
+
+void adviseMapping(const void *address, size_t length, AccessPattern pattern) {
+    int advice = MADV_RANDOM;
+    if (pattern == AccessPattern::Sequential) {
+        advice = MADV_SEQUENTIAL;
+    } else if (pattern == AccessPattern::WillNeed) {
+        advice = MADV_WILLNEED;
+    }
+    // The hint is best effort, a failure only costs readahead
+    ::madvise(const_cast<void *>(address), length, advice);
+}
+
+void syncFile(const std::string &path) {
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        throw std::runtime_error("Failed to open " + path + " for sync: " + std::strerror(errno));
+    }
+    int result = ::fsync(fd);
+    ::close(fd);
+    if (result != 0) {
+        throw std::runtime_error("Failed to sync " + path + ": " + std::strerror(errno));
+    }
+}
+
+BucketFileStore::BucketFileStore(const std::string &directoryPath, size_t pageSize, PageId nextPageId)
+    : directoryPath(directoryPath), pageBytes(pageSize), nextPageId(nextPageId) {
+    if (pageSize == 0) {
+        throw std::runtime_error("Page size must be greater than zero");
+    }
+}
+
+BucketFileStore::~BucketFileStore() {
+    for (const auto &[pageId, address] : mappings) {
+        ::munmap(address, pageBytes);
+    }
+}
+
+std::string BucketFileStore::pagePath(PageId pageId) const {
+    return directoryPath + "/bucket_" + std::to_string(pageId) + ".dat";
+}
+
+void BucketFileStore::readPage(PageId pageId, char *data) {
+    std::memset(data, 0, pageBytes);
+
+    // A bucket that has never been written back has no file yet
+    std::ifstream inFile(pagePath(pageId), std::ios::binary);
+    if (!inFile) {
+        return;
+    }
+    openedFiles.fetch_add(1, std::memory_order_relaxed);
+
+    inFile.read(data, pageBytes);
+    if (inFile.bad()) {
+        throw std::runtime_error("Failed to read bucket file: " + pagePath(pageId));
+    }
+}
+
+void BucketFileStore::writePage(PageId pageId, const char *data) {
+    // Overwritten in place rather than truncated and rewritten: a mapping of the file stays valid, while a
+    // reader touching it past a shrunk end of file would get SIGBUS
+    writeRange(pageId, 0, data, pageBytes);
+}
+
+void BucketFileStore::writeRange(PageId pageId, size_t offset, const char *data, size_t size) {
+    // Open without truncating so the rest of the bucket file stays intact
+    std::fstream file(pagePath(pageId), std::ios::binary | std::ios::in | std::ios::out);
+    if (!file) {
+        // New bucket files get their full size so that they can be mapped
+        std::ofstream(pagePath(pageId), std::ios::binary).close();
+        std::filesystem::resize_file(pagePath(pageId), pageBytes);
+        file.open(pagePath(pageId), std::ios::binary | std::ios::in | std::ios::out);
+        openedFiles.fetch_add(1, std::memory_order_relaxed); // The file created empty
+    }
+    if (!file) {
+        throw std::runtime_error("Failed to open file for writing: " + pagePath(pageId));
+    }
+    openedFiles.fetch_add(1, std::memory_order_relaxed);
+
+    file.seekp(offset);
+    file.write(data, size);
+    if (!file) {
+        throw std::runtime_error("Failed to write bucket file: " + pagePath(pageId));
+    }
+    unsyncedPages.insert(pageId);
+}
+
+PageFile BucketFileStore::openPage(PageId pageId, bool forWrite) {
+    std::string path = pagePath(pageId);
+    int fd = ::open(path.c_str(), forWrite ? O_WRONLY | O_CREAT : O_RDONLY, 0644);
+    if (fd < 0) {
+        if (!forWrite && errno == ENOENT) {
+            return {}; // The bucket was never written back
+        }
+        throw std::runtime_error("Failed to open bucket file: " + path + ": " + std::strerror(errno));
+    }
+    openedFiles.fetch_add(1, std::memory_order_relaxed);
+
+    if (forWrite) {
+        // New bucket files get their full size so that they can be mapped
+        struct stat fileStat;
+        if (::fstat(fd, &fileStat) != 0 ||
+            (static_cast<size_t>(fileStat.st_size) < pageBytes && ::ftruncate(fd, pageBytes) != 0)) {
+            int error = errno;
+            ::close(fd);
+            throw std::runtime_error("Failed to size bucket file: " + path + ": " + std::strerror(error));
+        }
+        unsyncedPages.insert(pageId);
+    }
+    return {fd, 0, true};
+}
+
+void BucketFileStore::freePage(PageId pageId) {
+    unmapPage(pageId);
+    unsyncedPages.erase(pageId);
+    std::filesystem::remove(pagePath(pageId));
+}
+
+void BucketFileStore::sync() {
+    for (PageId pageId : unsyncedPages) {
+        syncFile(pagePath(pageId));
+    }
+    openedFiles.fetch_add(unsyncedPages.size() + 1, std::memory_order_relaxed);
+    unsyncedPages.clear();
+
+    // New and removed bucket files are entries of the directory
+    syncFile(directoryPath);
+}
+
+void BucketFileStore::enableMapping(AccessPattern pattern) {
+    mappingEnabled = true;
+    adviseAccess(pattern);
+}
+
+void BucketFileStore::adviseAccess(AccessPattern pattern) {
+    accessPattern = pattern;
+    for (const auto &[pageId, address] : mappings) {
+        adviseMapping(address, pageBytes, pattern);
+    }
+}
+
+const char *BucketFileStore::mapPage(PageId pageId) {
+    if (!mappingEnabled) {
+        return nullptr;
+    }
+
+    auto it = mappings.find(pageId);
+    if (it != mappings.end()) {
+        return static_cast<const char *>(it->second);
+    }
+
+    int fd = ::open(pagePath(pageId).c_str(), O_RDONLY);
+    if (fd < 0) {
+        return nullptr; // The bucket was never written back
+    }
+    openedFiles.fetch_add(1, std::memory_order_relaxed);
+
+    struct stat fileStat;
+    void *address = MAP_FAILED;
+    if (::fstat(fd, &fileStat) == 0 && static_cast<size_t>(fileStat.st_size) >= pageBytes) {
+        address = ::mmap(nullptr, pageBytes, PROT_READ, MAP_SHARED, fd, 0);
+    }
+    ::close(fd);
+    if (address == MAP_FAILED) {
+        return nullptr;
+    }
+
+    adviseMapping(address, pageBytes, accessPattern);
+    mappings[pageId] = address;
+    return static_cast<const char *>(address);
+}
+
+void BucketFileStore::unmapPage(PageId pageId) {
+    auto it = mappings.find(pageId);
+    if (it != mappings.end()) {
+        ::munmap(it->second, pageBytes);
+        mappings.erase(it);
+    }
+}
+
+std::shared_ptr<PageStore> makePageStore(const std::string &directoryPath, size_t pageSize, StorageMode mode,
+                                         const Options &options, PageId nextPageId) {
+    std::shared_ptr<PageStore> store;
+    if (mode == StorageMode::Segment) {
+        store = std::make_shared<SegmentFile>(directoryPath + "/buckets.seg", pageSize, options.segmentInitialPages);
+    } else {
+        store = std::make_shared<BucketFileStore>(directoryPath, pageSize, nextPageId);
+    }
+    if (options.pageCompression == PageCompression::Lz) {
+        store = std::make_shared<CompressedPageStore>(std::move(store));
+    }
+    return store;
+}
+
+} // namespace ehash
@@ -0,0 +1,228 @@
+#include "ehash/SegmentFile.hpp"
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <stdexcept>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <vector>
+
+namespace ehash {
+
+SegmentFile::SegmentFile(const std::string &filePath, size_t pageSize, size_t initialPages)
+    : filePath(filePath), pageBytes(pageSize) {
+    if (pageSize < sizeof(Header)) {
+        throw std::runtime_error("Page size is too small for the segment header");
+    }
+
+    fd = ::open(filePath.c_str(), O_RDWR | O_CREAT, 0644);
+    if (fd < 0) {
+        throw std::runtime_error("Failed to open segment file: " + filePath + ": " + std::strerror(errno));
+    }
+
+    struct stat fileStat;
+    if (::fstat(fd, &fileStat) != 0) {
+        ::close(fd);
+        throw std::runtime_error("Failed to stat segment file: " + filePath);
+    }
+
+    try {
+        if (fileStat.st_size == 0) {
+            // Fresh segment: only the header page is in use
+            std::memcpy(header.magic, MAGIC_NUMBER, sizeof(MAGIC_NUMBER));
+            header.version = VERSION;
+            header.pageSize = pageSize;
+            header.pageCount = 1;
+            header.freeListHead = 0;
+            reserve(initialPages + 1);
+            writeHeader();
+        } else {
+            readAt(0, reinterpret_cast<char *>(&header), sizeof(Header));
+            if (std::memcmp(header.magic, MAGIC_NUMBER, sizeof(MAGIC_NUMBER)) != 0) {
+                throw std::runtime_error("Invalid magic number in segment file: " + filePath);
+            }
+            if (header.version != VERSION) {
+                throw std::runtime_error("Unsupported segment file version: " + std::to_string(header.version));
+            }
+            if (header.pageSize != pageSize) {
+                throw std::runtime_error("Segment file " + filePath + " uses page size " +
+                                         std::to_string(header.pageSize));
+            }
+            capacityPages = fileStat.st_size / pageSize;
+        }
+    } catch (...) {
+        ::close(fd);
+        throw;
+    }
+}
+
+SegmentFile::~SegmentFile() {
+    unmap();
+    if (fd >= 0) {
+        ::close(fd);
+    }
+}
+
+void SegmentFile::readAt(uint64_t offset, char *data, size_t size) const {
+    size_t done = 0;
+    while (done < size) {
+        ssize_t result = ::pread(fd, data + done, size - done, offset + done);
+        if (result < 0) {
+            if (errno == EINTR)
+                continue;
+            throw std::runtime_error("Failed to read segment file: " + filePath + ": " + std::strerror(errno));
+        }
+        if (result == 0) {
+            // Past the end of the file: the rest of the page was never written
+            std::memset(data + done, 0, size - done);
+            return;
+        }
+        done += result;
+    }
+}
+
+void SegmentFile::writeAt(uint64_t offset, const char *data, size_t size) {
+    size_t done = 0;
+    while (done < size) {
+        ssize_t result = ::pwrite(fd, data + done, size - done, offset + done);
+        if (result < 0) {
+            if (errno == EINTR)
+                continue;
+            throw std::runtime_error("Failed to write segment file: " + filePath + ": " + std::strerror(errno));
+        }
+        done += result;
+    }
+}
+
+void SegmentFile::writeHeader() { writeAt(0, reinterpret_cast<const char *>(&header), sizeof(Header)); }
+
+void SegmentFile::reserve(uint64_t pages) {
+    if (pages <= capacityPages) {
+        return;
+    }
+
+    // The next mapPage() maps the grown file. The old mapping stays valid for readers still parsing
+    // pages from it and is only unmapped when the file is closed
+    if (mapping != nullptr) {
+        retiredMappings.push_back({mapping, mappedBytes});
+        mapping = nullptr;
+        mappedBytes = 0;
+    }
+
+    uint64_t newCapacity = std::max<uint64_t>(pages, capacityPages * 2);
+    off_t newSize = newCapacity * pageBytes;
+    // posix_fallocate returns the error instead of setting errno. Filesystems without fallocate support still
+    // get a sparse file of the right size; any other failure, such as a full disk, is reported
+    int error = ::posix_fallocate(fd, 0, newSize);
+    if (error == EOPNOTSUPP || error == EINVAL) {
+        error = ::ftruncate(fd, newSize) == 0 ? 0 : errno;
+    }
+    if (error != 0) {
+        throw std::runtime_error("Failed to grow segment file: " + filePath + ": " + std::strerror(error));
+    }
+    capacityPages = newCapacity;
+}
+
+void SegmentFile::readPage(PageId pageId, char *data) { readAt(pageId * pageBytes, data, pageBytes); }
+
+void SegmentFile::writePage(PageId pageId, const char *data) {
+    if (pageId == 0 || pageId >= header.pageCount) {
+        throw std::runtime_error("Writing a page outside the segment: " + std::to_string(pageId));
+    }
+    writeAt(pageId * pageBytes, data, pageBytes);
+}
+
+void SegmentFile::writeRange(PageId pageId, size_t offset, const char *data, size_t size) {
+    if (pageId == 0 || pageId >= header.pageCount || offset + size > pageBytes) {
+        throw std::runtime_error("Writing a range outside the segment: " + std::to_string(pageId));
+    }
+    writeAt(pageId * pageBytes + offset, data, size);
+}
+
+PageFile SegmentFile::openPage(PageId pageId, bool forWrite) {
+    if (pageId == 0 || pageId >= header.pageCount) {
+        throw std::runtime_error("Opening a page outside the segment: " + std::to_string(pageId));
+    }
+    return {fd, pageId * pageBytes, false};
+}
+
+PageId SegmentFile::allocatePage() {
+    PageId pageId;
+    if (header.freeListHead != 0) {
+        pageId = header.freeListHead;
+        readAt(pageId * pageBytes, reinterpret_cast<char *>(&header.freeListHead), sizeof(PageId));
+
+        // A recycled page still holds the records of the bucket that freed it
+        std::vector<char> zeros(pageBytes, 0);
+        writeAt(pageId * pageBytes, zeros.data(), pageBytes);
+    } else {
+        reserve(header.pageCount + 1);
+        pageId = header.pageCount++;
+    }
+
+    writeHeader();
+    return pageId;
+}
+
+void SegmentFile::freePage(PageId pageId) {
+    if (pageId == 0 || pageId >= header.pageCount) {
+        throw std::runtime_error("Freeing a page outside the segment: " + std::to_string(pageId));
+    }
+
+    // Link the page in front of the free list
+    writeAt(pageId * pageBytes, reinterpret_cast<const char *>(&header.freeListHead), sizeof(PageId));
+    header.freeListHead = pageId;
+    writeHeader();
+}
+
+void SegmentFile::sync() {
+    if (::fdatasync(fd) != 0) {
+        throw std::runtime_error("Failed to sync segment file: " + filePath + ": " + std::strerror(errno));
+    }
+}
+
+void SegmentFile::enableMapping(AccessPattern pattern) {
+    mappingEnabled = true;
+    accessPattern = pattern;
+}
+
+void SegmentFile::adviseAccess(AccessPattern pattern) {
+    accessPattern = pattern;
+    if (mapping != nullptr) {
+        adviseMapping(mapping, mappedBytes, pattern);
+    }
+}
+
+const char *SegmentFile::mapPage(PageId pageId) {
+    if (!mappingEnabled || pageId == 0 || pageId >= header.pageCount) {
+        return nullptr;
+    }
+
+    if (mapping == nullptr) {
+        size_t length = capacityPages * pageBytes;
+        void *address = ::mmap(nullptr, length, PROT_READ, MAP_SHARED, fd, 0);
+        if (address == MAP_FAILED) {
+            return nullptr;
+        }
+        mapping = static_cast<char *>(address);
+        mappedBytes = length;
+        adviseMapping(mapping, mappedBytes, accessPattern);
+    }
+    return mapping + pageId * pageBytes;
+}
+
+void SegmentFile::unmap() {
+    if (mapping != nullptr) {
+        ::munmap(mapping, mappedBytes);
+        mapping = nullptr;
+        mappedBytes = 0;
+    }
+    for (const auto &[address, length] : retiredMappings) {
+        ::munmap(address, length);
+    }
+    retiredMappings.clear();
+}
+
+} // namespace ehash
@@ -0,0 +1,207 @@
+#include "ehash/SlottedPage.hpp"
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace ehash {
+
+SlottedPageView::SlottedPageView(const char *data, size_t pageSize) : bytes(data), pageSize(pageSize) {
+    if (pageSize < HEADER_SIZE) {
+        throw std::runtime_error("Page size is too small for a slotted page");
+    }
+}
+
+SlottedPageView::Header SlottedPageView::header() const {
+    Header pageHeader;
+    std::memcpy(&pageHeader, bytes, HEADER_SIZE);
+    if (slotsEnd(pageHeader.slotCount) > heapStart(pageHeader) || heapStart(pageHeader) > pageSize) {
+        throw std::runtime_error("Corrupted bucket page header");
+    }
+    return pageHeader;
+}
+
+SlottedPageView::Slot SlottedPageView::slot(uint32_t slotId) const {
+    if (slotsEnd(slotId + 1) > pageSize) {
+        throw std::runtime_error("Slot outside of the bucket page: " + std::to_string(slotId));
+    }
+
+    Slot pageSlot;
+    std::memcpy(&pageSlot, bytes + slotsEnd(slotId), SLOT_SIZE);
+    if (pageSlot.offset != FREE_OFFSET &&
+        (pageSlot.offset < HEADER_SIZE || pageSlot.offset + pageSlot.length > pageSize)) {
+        throw std::runtime_error("Corrupted bucket page slot " + std::to_string(slotId));
+    }
+    return pageSlot;
+}
+
+size_t SlottedPageView::freeSpace() const {
+    Header pageHeader = header();
+    return heapStart(pageHeader) - slotsEnd(pageHeader.slotCount) + pageHeader.fragmentedBytes;
+}
+
+SlottedPage::SlottedPage(PageGuard &page, size_t pageSize) : SlottedPageView(page.data(), pageSize), page(page) {}
+
+void SlottedPage::writeHeader(const Header &pageHeader) {
+    std::memcpy(page.mutableRange(0, HEADER_SIZE), &pageHeader, HEADER_SIZE);
+}
+
+void SlottedPage::writeSlot(uint32_t slotId, const Slot &pageSlot) {
+    std::memcpy(page.mutableRange(slotsEnd(slotId), SLOT_SIZE), &pageSlot, SLOT_SIZE);
+}
+
+void SlottedPage::writeRecord(size_t offset, const char *data, size_t size) {
+    std::memcpy(page.mutableRange(offset, size), data, size);
+}
+
+void SlottedPage::compact() {
+    Header pageHeader = header();
+
+    // Copy the live records aside, then lay them out again from the end of the page
+    std::vector<std::pair<uint32_t, Slot>> liveSlots;
+    std::vector<char> records;
+    for (uint32_t slotId = 0; slotId < pageHeader.slotCount; ++slotId) {
+        Slot pageSlot = slot(slotId);
+        if (pageSlot.offset != FREE_OFFSET) {
+            liveSlots.push_back({slotId, pageSlot});
+            records.insert(records.end(), bytes + pageSlot.offset, bytes + pageSlot.offset + pageSlot.length);
+        }
+    }
+
+    char *data = page.mutableData();
+    size_t top = pageSize;
+    size_t position = 0;
+    for (auto &[slotId, pageSlot] : liveSlots) {
+        top -= pageSlot.length;
+        if (pageSlot.length != 0) { // records has no storage at all when every live record is empty
+            std::memcpy(data + top, records.data() + position, pageSlot.length);
+            position += pageSlot.length;
+        }
+        pageSlot.offset = top;
+        std::memcpy(data + slotsEnd(slotId), &pageSlot, SLOT_SIZE);
+    }
+
+    pageHeader.heapStart = top;
+    pageHeader.fragmentedBytes = 0;
+    std::memcpy(data, &pageHeader, HEADER_SIZE);
+}
+
+size_t SlottedPage::allocate(Header &pageHeader, size_t size, uint32_t slotCount) {
+    if (heapStart(pageHeader) < slotsEnd(slotCount) + size) {
+        compact();
+        pageHeader = header();
+    }
+    if (heapStart(pageHeader) < slotsEnd(slotCount) + size) {
+        throw std::runtime_error("Bucket page overflow: record does not fit");
+    }
+
+    pageHeader.heapStart = heapStart(pageHeader) - size;
+    return pageHeader.heapStart;
+}
+
+void SlottedPage::reset() { writeHeader(Header{}); }
+
+uint32_t SlottedPage::insert(const char *data, size_t size) {
+    if (!canInsert(size)) {
+        throw std::runtime_error("Bucket page overflow: record does not fit");
+    }
+
+    Header pageHeader = header();
+
+    // Reuse the first free slot, or append a new one
+    uint32_t slotId = pageHeader.slotCount;
+    for (uint32_t i = 0; i < pageHeader.slotCount; ++i) {
+        if (slot(i).offset == FREE_OFFSET) {
+            slotId = i;
+            break;
+        }
+    }
+    uint32_t slotCount = std::max(pageHeader.slotCount, slotId + 1);
+
+    size_t offset = allocate(pageHeader, size, slotCount);
+    writeRecord(offset, data, size);
+    writeSlot(slotId, Slot{static_cast<uint32_t>(offset), static_cast<uint32_t>(size)});
+
+    pageHeader.slotCount = slotCount;
+    writeHeader(pageHeader);
+    return slotId;
+}
+
+bool SlottedPage::update(uint32_t slotId, const char *data, size_t size) {
+    Header pageHeader = header();
+    if (slotId >= pageHeader.slotCount || slot(slotId).offset == FREE_OFFSET) {
+        throw std::runtime_error("Updating a free slot: " + std::to_string(slotId));
+    }
+    Slot pageSlot = slot(slotId);
+
+    // A record that does not grow is overwritten where it is
+    if (size <= pageSlot.length) {
+        writeRecord(pageSlot.offset, data, size);
+        if (size < pageSlot.length) {
+            pageHeader.fragmentedBytes += pageSlot.length - size;
+            pageSlot.length = size;
+            writeSlot(slotId, pageSlot);
+            writeHeader(pageHeader);
+        }
+        return true;
+    }
+
+    if (size > freeSpace() + pageSlot.length) {
+        return false;
+    }
+
+    // Release the old record first so that compaction can reuse its space
+    pageHeader.fragmentedBytes += pageSlot.length;
+    writeSlot(slotId, Slot{FREE_OFFSET, 0});
+    writeHeader(pageHeader);
+
+    size_t offset = allocate(pageHeader, size, pageHeader.slotCount);
+    writeRecord(offset, data, size);
+    writeSlot(slotId, Slot{static_cast<uint32_t>(offset), static_cast<uint32_t>(size)});
+    writeHeader(pageHeader);
+    return true;
+}
+
+void SlottedPage::erase(uint32_t slotId) {
+    Header pageHeader = header();
+    if (slotId >= pageHeader.slotCount || slot(slotId).offset == FREE_OFFSET) {
+        throw std::runtime_error("Erasing a free slot: " + std::to_string(slotId));
+    }
+    Slot pageSlot = slot(slotId);
+
+    pageHeader.fragmentedBytes += pageSlot.length;
+    writeSlot(slotId, Slot{FREE_OFFSET, 0});
+
+    // Trailing free slots are dropped from the directory
+    while (pageHeader.slotCount > 0 && slot(pageHeader.slotCount - 1).offset == FREE_OFFSET) {
+        pageHeader.slotCount--;
+    }
+    if (pageHeader.slotCount == 0) {
+        pageHeader = Header{};
+    }
+    writeHeader(pageHeader);
+}
+
+SlottedPageWriter::SlottedPageWriter(char *data, size_t pageSize) : SlottedPageView(data, pageSize), data(data) {
+    std::memset(data, 0, pageSize);
+}
+
+bool SlottedPageWriter::append(const char *record, size_t size) {
+    Header pageHeader = header();
+    size_t top = heapStart(pageHeader);
+    if (top < slotsEnd(pageHeader.slotCount + 1) + size) {
+        return false;
+    }
+
+    top -= size;
+    std::memcpy(data + top, record, size);
+    Slot pageSlot{static_cast<uint32_t>(top), static_cast<uint32_t>(size)};
+    std::memcpy(data + slotsEnd(pageHeader.slotCount), &pageSlot, SLOT_SIZE);
+    pageHeader.slotCount++;
+    pageHeader.heapStart = top;
+    std::memcpy(data, &pageHeader, HEADER_SIZE);
+    return true;
+}
+
+} // namespace ehash
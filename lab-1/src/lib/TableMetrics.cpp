@@ -0,0 +1,55 @@
+#include "ehash/TableMetrics.hpp"
+
+namespace ehash {
+
+uint64_t LatencyHistogram::quantileNanos(double quantile) const {
+    if (count == 0) {
+        return 0;
+    }
+    // Rank of the operation the quantile falls on, counting from 1
+    uint64_t rank = static_cast<uint64_t>(quantile * static_cast<double>(count));
+    rank = rank < 1 ? 1 : (rank > count ? count : rank);
+    uint64_t seen = 0;
+    for (size_t i = 0; i < BUCKETS; ++i) {
+        seen += counts[i];
+        if (seen >= rank) {
+            return i == BUCKETS - 1 ? UINT64_MAX : (uint64_t{1} << i);
+        }
+    }
+    return UINT64_MAX; // The buckets were read while operations were still being counted
+}
+
+void TableMetrics::Histogram::record(uint64_t nanos) {
+    // Bucket i holds the latencies that need i bits
+    size_t bucket = nanos == 0 ? 0 : 64 - __builtin_clzll(nanos);
+    if (bucket >= LatencyHistogram::BUCKETS) {
+        bucket = LatencyHistogram::BUCKETS - 1;
+    }
+    counts[bucket].fetch_add(1, std::memory_order_relaxed);
+    totalNanos.fetch_add(nanos, std::memory_order_relaxed);
+}
+
+LatencyHistogram TableMetrics::Histogram::snapshot() const {
+    LatencyHistogram histogram;
+    for (size_t i = 0; i < LatencyHistogram::BUCKETS; ++i) {
+        histogram.counts[i] = counts[i].load(std::memory_order_relaxed);
+        histogram.count += histogram.counts[i];
+    }
+    histogram.totalNanos = totalNanos.load(std::memory_order_relaxed);
+    return histogram;
+}
+
+TableStats TableMetrics::stats() const {
+    TableStats stats;
+    stats.splits = splits.load(std::memory_order_relaxed);
+    stats.directoryDoublings = directoryDoublings.load(std::memory_order_relaxed);
+    stats.merges = merges.load(std::memory_order_relaxed);
+    stats.directoryHalvings = directoryHalvings.load(std::memory_order_relaxed);
+    stats.insertLatency = latencies[static_cast<size_t>(Operation::Insert)].snapshot();
+    stats.batchInsertLatency = latencies[static_cast<size_t>(Operation::BatchInsert)].snapshot();
+    stats.lookupLatency = latencies[static_cast<size_t>(Operation::Lookup)].snapshot();
+    stats.removeLatency = latencies[static_cast<size_t>(Operation::Remove)].snapshot();
+    return stats;
+}
+
+} // namespace ehash
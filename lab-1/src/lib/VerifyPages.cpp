@@ -0,0 +1,40 @@
+#include "ehash/VerifyPages.hpp"
+#include "ehash/Checksum.hpp"
+#include "ehash/DirectoryFile.hpp"
+#include <stdexcept>
+
+namespace ehash {
+
+std::vector<CorruptedPage> findCorruptedPages(const std::string &directoryPath) {
+    std::optional<DirectoryMeta> meta = readDirectoryMeta(directoryMetaPath(directoryPath));
+    if (!meta) {
+        throw std::runtime_error("No hash table directory file in " + directoryPath);
+    }
+
+    Options storeOptions;
+    storeOptions.pageCompression = meta->pageCompression;
+    auto store = makePageStore(directoryPath, meta->pageSize, meta->storageMode, storeOptions, pageIdsEnd(*meta));
+    std::vector<char> page(meta->pageSize);
+    std::vector<CorruptedPage> corrupted;
+    auto check = [&](PageId pageId, size_t bucket, size_t chainIndex) {
+        try {
+            store->readPage(pageId, page.data());
+        } catch (const std::runtime_error &error) {
+            corrupted.push_back({pageId, bucket, chainIndex, error.what()});
+            return;
+        }
+        if (!pageIntact(page.data(), page.size())) {
+            corrupted.push_back({pageId, bucket, chainIndex, "checksum mismatch"});
+        }
+    };
+    for (size_t bucket = 0; bucket < meta->buckets.size(); ++bucket) {
+        const auto &info = meta->buckets[bucket];
+        check(info.pageId, bucket, 0);
+        for (size_t i = 0; i < info.overflowPages.size(); ++i) {
+            check(info.overflowPages[i], bucket, i + 1);
+        }
+    }
+    return corrupted;
+}
+
+} // namespace ehash
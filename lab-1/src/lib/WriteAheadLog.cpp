@@ -0,0 +1,235 @@
+#include "ehash/WriteAheadLog.hpp"
+#include "ehash/Checksum.hpp"
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <stdexcept>
+#include <sys/stat.h>
+#include <thread>
+#include <unistd.h>
+
+namespace ehash {
+
+namespace {
+
+constexpr char MAGIC_NUMBER[4] = {'E', 'H', 'W', 'L'};
+constexpr uint32_t VERSION = 2;
+
+} // namespace
+
+WriteAheadLog::WriteAheadLog(const std::string &filePath, std::chrono::microseconds commitWindow)
+    : filePath(filePath), commitWindow(commitWindow) {
+    fd = ::open(filePath.c_str(), O_RDWR | O_CREAT | O_APPEND, 0644);
+    if (fd < 0) {
+        throw std::runtime_error("Failed to open log file: " + filePath + ": " + std::strerror(errno));
+    }
+
+    struct stat fileStat;
+    if (::fstat(fd, &fileStat) != 0) {
+        ::close(fd);
+        throw std::runtime_error("Failed to stat log file: " + filePath);
+    }
+    fileBytes = fileStat.st_size;
+
+    try {
+        if (fileBytes >= sizeof(FileHeader)) {
+            FileHeader header;
+            if (::pread(fd, &header, sizeof(FileHeader), 0) != static_cast<ssize_t>(sizeof(FileHeader))) {
+                throw std::runtime_error("Failed to read log file: " + filePath + ": " + std::strerror(errno));
+            }
+            if (std::memcmp(header.magic, MAGIC_NUMBER, sizeof(MAGIC_NUMBER)) != 0) {
+                throw std::runtime_error("Unsupported log file (version 1 or not a log): " + filePath);
+            }
+            if (header.version != VERSION) {
+                throw std::runtime_error("Unsupported log file version " + std::to_string(header.version) + ": " +
+                                         filePath);
+            }
+        } else {
+            // A new log, or one whose header was torn before any record followed it
+            FileHeader header;
+            std::memcpy(header.magic, MAGIC_NUMBER, sizeof(MAGIC_NUMBER));
+            header.version = VERSION;
+            if (::ftruncate(fd, 0) != 0) {
+                throw std::runtime_error("Failed to truncate log file: " + filePath + ": " + std::strerror(errno));
+            }
+            writeAll(std::string(reinterpret_cast<const char *>(&header), sizeof(FileHeader)));
+            if (::fdatasync(fd) != 0) {
+                throw std::runtime_error("Failed to sync log file: " + filePath + ": " + std::strerror(errno));
+            }
+            fileBytes = sizeof(FileHeader);
+        }
+    } catch (...) {
+        ::close(fd);
+        throw;
+    }
+}
+
+WriteAheadLog::~WriteAheadLog() {
+    if (fd >= 0) {
+        ::close(fd);
+    }
+}
+
+void WriteAheadLog::writeAll(const std::string &data) {
+    size_t done = 0;
+    while (done < data.size()) {
+        ssize_t result = ::write(fd, data.data() + done, data.size() - done);
+        if (result < 0) {
+            if (errno == EINTR)
+                continue;
+            throw std::runtime_error("Failed to write log file: " + filePath + ": " + std::strerror(errno));
+        }
+        done += result;
+    }
+}
+
+void WriteAheadLog::replay(const std::function<void(RecordType, const std::string &)> &apply) {
+    std::unique_lock<std::mutex> lock(mutex);
+
+    std::string contents(fileBytes, '\0');
+    size_t done = 0;
+    while (done < contents.size()) {
+        ssize_t result = ::pread(fd, contents.data() + done, contents.size() - done, done);
+        if (result < 0) {
+            if (errno == EINTR)
+                continue;
+            throw std::runtime_error("Failed to read log file: " + filePath + ": " + std::strerror(errno));
+        }
+        if (result == 0) {
+            break;
+        }
+        done += result;
+    }
+    contents.resize(done);
+
+    // Records are applied without the lock held, since applying one may take locks that are held while
+    // appending to the log
+    lock.unlock();
+    size_t offset = sizeof(FileHeader);
+    size_t records = 0;
+    std::string payload;
+    while (offset + sizeof(RecordHeader) <= contents.size()) {
+        RecordHeader header;
+        std::memcpy(&header, contents.data() + offset, sizeof(RecordHeader));
+        if (header.size > contents.size() - offset - sizeof(RecordHeader)) {
+            break; // Torn write: the payload never made it to disk
+        }
+
+        payload.assign(contents.data() + offset + sizeof(RecordHeader), header.size);
+        uint32_t expected = checksum(&header.type, sizeof(header.type));
+        expected = checksum(payload.data(), payload.size(), expected);
+        if (header.checksum != expected) {
+            break;
+        }
+
+        apply(static_cast<RecordType>(header.type), payload);
+        offset += sizeof(RecordHeader) + header.size;
+        records++;
+    }
+    lock.lock();
+    appendedLsn += records;
+    durableLsn = appendedLsn;
+
+    // Later records would follow the garbage, so cut it off
+    if (offset < fileBytes) {
+        if (::ftruncate(fd, offset) != 0 || ::fdatasync(fd) != 0) {
+            throw std::runtime_error("Failed to truncate log file: " + filePath + ": " + std::strerror(errno));
+        }
+        fileBytes = offset;
+    }
+}
+
+void WriteAheadLog::throwIfFailed() const {
+    if (!failure.empty()) {
+        throw std::runtime_error("Log file failed earlier and needs a checkpoint: " + failure);
+    }
+}
+
+WriteAheadLog::Lsn WriteAheadLog::append(RecordType type, const std::string &payload) {
+    RecordHeader header;
+    header.size = payload.size();
+    header.type = static_cast<uint32_t>(type);
+    header.checksum = checksum(&header.type, sizeof(header.type));
+    header.checksum = checksum(payload.data(), payload.size(), header.checksum);
+
+    std::lock_guard<std::mutex> lock(mutex);
+    throwIfFailed();
+    buffer.append(reinterpret_cast<const char *>(&header), sizeof(RecordHeader));
+    buffer.append(payload);
+    stats.records++;
+    return ++appendedLsn;
+}
+
+void WriteAheadLog::commit(Lsn lsn) {
+    std::unique_lock<std::mutex> lock(mutex);
+    while (durableLsn < lsn) {
+        throwIfFailed();
+        if (flushing) {
+            // Another writer is syncing; its batch may already contain this record
+            flushed.wait(lock);
+            continue;
+        }
+
+        // Become the leader and commit everything buffered so far in one write and one sync
+        flushing = true;
+        if (commitWindow.count() > 0) {
+            lock.unlock();
+            std::this_thread::sleep_for(commitWindow);
+            lock.lock();
+        }
+        std::string batch;
+        batch.swap(buffer);
+        Lsn batchLsn = appendedLsn;
+        lock.unlock();
+
+        try {
+            writeAll(batch);
+            if (::fdatasync(fd) != 0) {
+                throw std::runtime_error("Failed to sync log file: " + filePath + ": " + std::strerror(errno));
+            }
+        } catch (const std::exception &error) {
+            // The batch is gone and may be half written, so no later batch can be made durable after it
+            lock.lock();
+            failure = error.what();
+            flushing = false;
+            flushed.notify_all();
+            throw;
+        }
+
+        lock.lock();
+        fileBytes += batch.size();
+        durableLsn = std::max(durableLsn, batchLsn);
+        stats.syncs++;
+        flushing = false;
+        flushed.notify_all();
+    }
+}
+
+void WriteAheadLog::reset() {
+    std::unique_lock<std::mutex> lock(mutex);
+    flushed.wait(lock, [this] { return !flushing; });
+
+    buffer.clear();
+    if (::ftruncate(fd, sizeof(FileHeader)) != 0 || ::fdatasync(fd) != 0) {
+        throw std::runtime_error("Failed to truncate log file: " + filePath + ": " + std::strerror(errno));
+    }
+    fileBytes = sizeof(FileHeader);
+
+    // The checkpoint made every appended record durable, including any a failed write lost
+    durableLsn = appendedLsn;
+    failure.clear();
+    flushed.notify_all();
+}
+
+size_t WriteAheadLog::size() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return fileBytes - sizeof(FileHeader) + buffer.size();
+}
+
+WriteAheadLogStats WriteAheadLog::getStats() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return stats;
+}
+
+} // namespace ehash
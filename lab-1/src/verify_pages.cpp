@@ -0,0 +1,35 @@
+#include "ehash/CheckpointJournal.hpp"
+#include "ehash/Checksum.hpp"
+#include "ehash/VerifyPages.hpp"
+#include <filesystem>
+#include <iostream>
+
+using namespace ehash;
+
+// Check the page checksums of a hash table directory offline. Exits with 1 if any page is corrupted
+int main(int argc, char *argv[]) {
+    if (argc != 2) {
+        std::cerr << "Usage: " << argv[0] << " <table directory>\n";
+        return 2;
+    }
+    std::string directoryPath = argv[1];
+
+    try {
+        if (std::filesystem::exists(checkpointJournalPath(directoryPath))) {
+            std::cout << "Checkpoint journal present: pages it holds are rewritten when the table is opened\n";
+        }
+        std::vector<CorruptedPage> corrupted = findCorruptedPages(directoryPath);
+        for (const auto &page : corrupted) {
+            std::cout << "Page " << page.pageId << " (bucket " << page.bucket << ", "
+                      << (page.chainIndex == 0 ? std::string("primary page")
+                                               : "overflow page " + std::to_string(page.chainIndex))
+                      << "): " << page.reason << "\n";
+        }
+        std::cout << (corrupted.empty() ? "All pages intact" : std::to_string(corrupted.size()) + " corrupted pages")
+                  << " (CRC32C in " << (hardwareChecksum() ? "hardware" : "software") << ")\n";
+        return corrupted.empty() ? 0 : 1;
+    } catch (const std::exception &error) {
+        std::cerr << error.what() << "\n";
+        return 2;
+    }
+}
@@ -0,0 +1,216 @@
+#include "ehash/BufferPool.hpp"
+#include "ehash/Checksum.hpp"
+#include "ehash/PageStore.hpp"
+#include "gtest/gtest.h"
+#include <cstring>
+#include <filesystem>
+#include <memory>
+#include <string>
+#include <sys/resource.h>
+#include <vector>
+
+namespace ehash {
+
+// Temporary test directory for pages
+const std::string POOL_TEST_DIR = "test_pool_pages";
+const size_t PAGE_SIZE = 4096;
+
+class BufferPoolTest : public ::testing::Test {
+  protected:
+    void SetUp() override {
+        std::filesystem::remove_all(POOL_TEST_DIR);
+        std::filesystem::create_directory(POOL_TEST_DIR);
+        store = std::make_shared<BucketFileStore>(POOL_TEST_DIR, PAGE_SIZE);
+    }
+
+    void TearDown() override { std::filesystem::remove_all(POOL_TEST_DIR); }
+
+    // Write a marker byte at the start of the page through the pool
+    void writeMarker(BufferPool &pool, PageId pageId, char marker) {
+        PageGuard page(pool, pageId);
+        page.mutableData()[0] = marker;
+    }
+
+    std::shared_ptr<BucketFileStore> store;
+};
+
+// Test: Rewriting a mapped bucket file keeps its mapping readable and shows the new contents
+TEST_F(BufferPoolTest, RewritingMappedPageKeepsMapping) {
+    std::vector<char> page(PAGE_SIZE, 'a');
+    store->writePage(0, page.data());
+    store->enableMapping(AccessPattern::Random);
+    const char *mapped = store->mapPage(0);
+    ASSERT_NE(mapped, nullptr);
+
+    std::fill(page.begin(), page.end(), 'b');
+    store->writePage(0, page.data());
+    EXPECT_EQ(std::filesystem::file_size(store->pagePath(0)), PAGE_SIZE);
+    EXPECT_EQ(mapped[0], 'b');
+    EXPECT_EQ(mapped[PAGE_SIZE - 1], 'b'); // Past the end of a truncated file this would fault
+    EXPECT_EQ(store->mapPage(0), mapped);
+}
+
+// Test: Repeated writes to a resident page cost a single write back on flush
+TEST_F(BufferPoolTest, DirtyPageWrittenOnceOnFlush) {
+    BufferPool pool(store, 4);
+
+    for (int i = 0; i < 10; ++i) {
+        writeMarker(pool, 0, 'a' + i);
+    }
+    EXPECT_EQ(pool.getStats().pageWrites, 0);
+    EXPECT_EQ(pool.getStats().misses, 1);
+    EXPECT_EQ(pool.getStats().hits, 9);
+
+    pool.flush();
+    EXPECT_EQ(pool.getStats().pageWrites, 1);
+
+    // Flushing a clean pool writes nothing
+    pool.flush();
+    EXPECT_EQ(pool.getStats().pageWrites, 1);
+
+    std::vector<char> data(PAGE_SIZE);
+    store->readPage(0, data.data());
+    EXPECT_EQ(data[0], 'j');
+}
+
+// Test: CLOCK evicts the page whose reference bit was cleared first
+TEST_F(BufferPoolTest, ClockEviction) {
+    BufferPool pool(store, 2);
+
+    writeMarker(pool, 0, 'x');
+    writeMarker(pool, 1, 'y');
+    writeMarker(pool, 2, 'z');
+
+    EXPECT_FALSE(pool.isResident(0));
+    EXPECT_TRUE(pool.isResident(1));
+    EXPECT_TRUE(pool.isResident(2));
+    EXPECT_EQ(pool.getStats().evictions, 1);
+
+    // The evicted page was dirty, so it was written back and reads back intact
+    EXPECT_EQ(pool.getStats().pageWrites, 1);
+    PageGuard page(pool, 0);
+    EXPECT_EQ(page.data()[0], 'x');
+}
+
+// Test: Pinned pages are never evicted
+TEST_F(BufferPoolTest, PinnedPagesAreNotEvicted) {
+    BufferPool pool(store, 2);
+
+    PageGuard first(pool, 0);
+    PageGuard second(pool, 1);
+    EXPECT_THROW(pool.pinPage(2), std::runtime_error);
+
+    EXPECT_TRUE(pool.isResident(0));
+    EXPECT_TRUE(pool.isResident(1));
+}
+
+// Test: Pages that were never written read back as zeros
+TEST_F(BufferPoolTest, NewPageIsZeroed) {
+    BufferPool pool(store, 1);
+
+    PageGuard page(pool, 7);
+    std::vector<char> zeros(PAGE_SIZE, 0);
+    EXPECT_EQ(std::memcmp(page.data(), zeros.data(), PAGE_SIZE), 0);
+}
+
+// Test: Without stealing, dirty pages stay in memory past the capacity until the next flush
+TEST_F(BufferPoolTest, NoStealKeepsDirtyPagesUntilFlush) {
+    BufferPool pool(store, 2);
+    pool.setNoSteal(true);
+
+    for (PageId pageId = 0; pageId < 4; ++pageId) {
+        writeMarker(pool, pageId, 'a' + pageId);
+    }
+    EXPECT_EQ(pool.getStats().pageWrites, 0);
+    EXPECT_EQ(pool.frameCount(), 4);
+    EXPECT_EQ(pool.dirtyPages().size(), 4);
+
+    pool.flush();
+    EXPECT_EQ(pool.getStats().pageWrites, 4);
+    EXPECT_EQ(pool.frameCount(), 2);
+    EXPECT_TRUE(pool.dirtyPages().empty());
+}
+
+// Test: A queued flush of more dirty bucket files than the process may open at once writes them in chunks
+TEST_F(BufferPoolTest, QueuedFlushKeepsFewFilesOpen) {
+    constexpr PageId PAGES = 1000;
+    BufferPool pool(store, 2, makeIoQueue(IoBackend::ThreadPool, 32));
+    pool.setNoSteal(true);
+    for (PageId pageId = 0; pageId < PAGES; ++pageId) {
+        writeMarker(pool, pageId, 'a' + pageId % 26);
+    }
+
+    // Allow the files open now and a few hundred more, far fewer than the dirty pages
+    size_t openFiles = std::distance(std::filesystem::directory_iterator("/proc/self/fd"),
+                                     std::filesystem::directory_iterator());
+    rlimit limit;
+    ASSERT_EQ(::getrlimit(RLIMIT_NOFILE, &limit), 0);
+    rlimit lowered = limit;
+    lowered.rlim_cur = openFiles + 300;
+    ASSERT_EQ(::setrlimit(RLIMIT_NOFILE, &lowered), 0);
+    EXPECT_NO_THROW(pool.flush());
+    ::setrlimit(RLIMIT_NOFILE, &limit);
+
+    EXPECT_EQ(pool.getStats().pageWrites, PAGES);
+    std::vector<char> page(PAGE_SIZE);
+    store->readPage(PAGES - 1, page.data());
+    EXPECT_EQ(page[0], 'a' + (PAGES - 1) % 26);
+}
+
+// Test: A discarded page is never written back, and a freed page loses its file
+TEST_F(BufferPoolTest, DiscardedPagesAreNotWrittenBack) {
+    BufferPool pool(store, 4);
+    writeMarker(pool, 0, 'a');
+    writeMarker(pool, 1, 'b');
+
+    pool.discardPage(0);
+    pool.flush();
+    EXPECT_EQ(pool.getStats().pageWrites, 1);
+    EXPECT_FALSE(pool.isResident(0));
+    EXPECT_FALSE(std::filesystem::exists(store->pagePath(0)));
+
+    pool.freePage(1);
+    EXPECT_FALSE(pool.isResident(1));
+    EXPECT_FALSE(std::filesystem::exists(store->pagePath(1)));
+
+    PageGuard page(pool, 2);
+    EXPECT_THROW(pool.discardPage(2), std::runtime_error);
+}
+
+// Test: A checksumming pool seals the pages it writes back, even when it writes only their dirty ranges,
+// and refuses a page that was changed behind its back
+TEST_F(BufferPoolTest, ChecksumsSealAndVerifyPages) {
+    std::vector<char> data(PAGE_SIZE);
+    {
+        BufferPool pool(store, 4, nullptr, PageChecksums::Verify);
+        {
+            PageGuard page(pool, 0);
+            std::memcpy(page.mutableData() + 100, "whole", 5);
+        }
+        pool.flush();
+        {
+            PageGuard page(pool, 0);
+            std::memcpy(page.mutableRange(200, 5), "range", 5);
+        }
+        pool.flush();
+        EXPECT_EQ(pool.getStats().bytesWritten, PAGE_SIZE + PAGE_CHECKSUM_SIZE + 5);
+    }
+    store->readPage(0, data.data());
+    EXPECT_TRUE(pageIntact(data.data(), PAGE_SIZE));
+    EXPECT_EQ(std::string(data.data() + 200, 5), "range");
+
+    data[300] = 'x';
+    store->writePage(0, data.data());
+    BufferPool pool(store, 4, nullptr, PageChecksums::Verify);
+    EXPECT_THROW(PageGuard(pool, 0), std::runtime_error);
+    EXPECT_FALSE(pool.isResident(0));
+    {
+        PageGuard page(pool, 1); // Never written: zeros
+    }
+
+    BufferPool unchecked(store, 4, nullptr, PageChecksums::Seal);
+    PageGuard page(unchecked, 0);
+    EXPECT_EQ(page.data()[300], 'x');
+}
+
+} // namespace ehash
@@ -0,0 +1,47 @@
+#include "ehash/Checksum.hpp"
+#include "gtest/gtest.h"
+#include <cstring>
+#include <string>
+#include <vector>
+
+namespace ehash {
+
+// Test: The checksum is CRC32C, on every length the word loop and its tail cover
+TEST(ChecksumTest, MatchesCrc32c) {
+    EXPECT_EQ(checksum("", 0), 0u);
+    EXPECT_EQ(checksum("123456789", 9), 0xE3069283u);
+    std::vector<char> zeros(32, 0);
+    EXPECT_EQ(checksum(zeros.data(), zeros.size()), 0x8A9136AAu);
+    std::vector<char> ones(32, '\xff');
+    EXPECT_EQ(checksum(ones.data(), ones.size()), 0x62A8AB43u);
+}
+
+// Test: Checksumming data in pieces, each seeded with the result so far, equals checksumming it whole
+TEST(ChecksumTest, SeedContinuesChecksum) {
+    std::string data = "The quick brown fox jumps over the lazy dog";
+    for (size_t split = 0; split <= data.size(); ++split) {
+        uint32_t first = checksum(data.data(), split);
+        EXPECT_EQ(checksum(data.data() + split, data.size() - split, first), checksum(data.data(), data.size()))
+            << split;
+    }
+}
+
+// Test: A sealed page is intact until any byte changes; a page of zeros counts as intact
+TEST(ChecksumTest, SealedPageDetectsChanges) {
+    constexpr size_t PAGE_SIZE = 4096;
+    std::vector<char> page(PAGE_SIZE, 0);
+    EXPECT_TRUE(pageIntact(page.data(), PAGE_SIZE));
+
+    std::memcpy(page.data() + 100, "record", 6);
+    EXPECT_FALSE(pageIntact(page.data(), PAGE_SIZE));
+    sealPage(page.data(), PAGE_SIZE);
+    EXPECT_TRUE(pageIntact(page.data(), PAGE_SIZE));
+
+    for (size_t offset : {size_t{0}, PAGE_CHECKSUM_SIZE, size_t{100}, PAGE_SIZE - 1}) {
+        page[offset] ^= 0x10;
+        EXPECT_FALSE(pageIntact(page.data(), PAGE_SIZE)) << offset;
+        page[offset] ^= 0x10;
+    }
+}
+
+} // namespace ehash
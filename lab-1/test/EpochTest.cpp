@@ -0,0 +1,103 @@
+#include "ehash/Epoch.hpp"
+#include "gtest/gtest.h"
+#include <memory>
+#include <optional>
+#include <vector>
+
+namespace ehash {
+
+// Counts how many instances have been destroyed
+struct Tracked {
+    int *destroyed;
+
+    explicit Tracked(int *destroyed) : destroyed(destroyed) {}
+
+    ~Tracked() { ++*destroyed; }
+};
+
+// Test: An object retired while a reader is pinned survives until the reader lets go
+TEST(EpochTest, RetiredObjectOutlivesPinnedReader) {
+    int destroyed = 0;
+    EpochManager epochs;
+    {
+        EpochManager::Guard guard(epochs);
+        epochs.retire(new Tracked(&destroyed));
+        epochs.reclaim();
+        EXPECT_EQ(destroyed, 0);
+        EXPECT_EQ(epochs.retiredCount(), 1);
+    }
+
+    epochs.reclaim();
+    EXPECT_EQ(destroyed, 1);
+    EXPECT_EQ(epochs.retiredCount(), 0);
+}
+
+// Test: A moved guard keeps the pin until the guard it was moved into lets go
+TEST(EpochTest, MovedGuardKeepsPin) {
+    int destroyed = 0;
+    EpochManager epochs;
+    {
+        std::optional<EpochManager::Guard> moved;
+        {
+            EpochManager::Guard guard(epochs);
+            moved.emplace(std::move(guard));
+        }
+        epochs.retire(new Tracked(&destroyed));
+        epochs.reclaim();
+        EXPECT_EQ(destroyed, 0);
+    }
+
+    epochs.reclaim();
+    EXPECT_EQ(destroyed, 1);
+}
+
+// Test: One thread can hold more guards than a block has reader slots, and the last of them still keeps
+// retired objects alive
+TEST(EpochTest, ManyGuardsOnOneThread) {
+    constexpr int GUARDS = 300;
+    int destroyed = 0;
+    EpochManager epochs;
+    {
+        std::vector<std::unique_ptr<EpochManager::Guard>> guards;
+        for (int i = 0; i < GUARDS - 1; ++i) {
+            guards.push_back(std::make_unique<EpochManager::Guard>(epochs));
+        }
+        epochs.retire(new Tracked(&destroyed));
+        guards.push_back(std::make_unique<EpochManager::Guard>(epochs));
+        guards.erase(guards.begin(), guards.end() - 1);
+        epochs.retire(new Tracked(&destroyed));
+        epochs.reclaim();
+        EXPECT_EQ(destroyed, 1); // Only the object retired before the last guard pinned
+        EXPECT_EQ(epochs.retiredCount(), 1);
+    }
+
+    epochs.reclaim();
+    EXPECT_EQ(destroyed, 2);
+}
+
+// Test: Readers that pin after an object was retired do not keep it alive
+TEST(EpochTest, LaterReadersDoNotBlockReclaim) {
+    int destroyed = 0;
+    EpochManager epochs;
+    epochs.retire(new Tracked(&destroyed));
+
+    EpochManager::Guard guard(epochs);
+    epochs.reclaim();
+    EXPECT_EQ(destroyed, 1);
+}
+
+// Test: Retiring many objects reclaims them in batches, and the manager deletes the rest
+TEST(EpochTest, ReclaimsInBatchesAndOnDestruction) {
+    int destroyed = 0;
+    {
+        EpochManager epochs;
+        for (int i = 0; i < 100; ++i) {
+            epochs.retire(new Tracked(&destroyed));
+        }
+        EXPECT_GT(destroyed, 0);
+        EXPECT_LT(epochs.retiredCount(), 100);
+    }
+    EXPECT_EQ(destroyed, 100);
+}
+
+} // namespace ehash
@@ -1,8 +1,17 @@
 #include "ehash/ExtensibleHashing.hpp"
+#include "ehash/VerifyPages.hpp"
+#include "AddressBook.pb.h"
 #include "TestMessage.pb.h"
 #include "gtest/gtest.h"
+#include <algorithm>
+#include <cmath>
 #include <filesystem>
+#include <fstream>
+#include <future>
 #include <memory>
+#include <numeric>
+#include <sstream>
+#include <thread>
 
 namespace ehash {
 
@@ -40,6 +49,40 @@ std::unique_ptr<TestMessage> createTestMessage(int id) {
     return message;
 }
 
+// Helper function to create a Person with a specific ID and name
+std::unique_ptr<Person> createPerson(int id, const std::string &name) {
+    auto person = std::make_unique<Person>();
+    person->set_id(id);
+    person->set_name(name);
+    return person;
+}
+
+using PersonTable = ExtensibleHashing<Person, FieldKey<Person, &Person::id>>;
+using WyPersonTable = ExtensibleHashing<Person, FieldKey<Person, &Person::id>, WyHasher>;
+
+// Person id whose hash is 0 below 10000 and keeps only six bits of the id above, so that keys collide
+struct SkewedId {
+    int id;
+
+    bool operator==(const SkewedId &other) const { return id == other.id; }
+};
+
+struct SkewedIdKey {
+    using KeyType = SkewedId;
+
+    KeyType operator()(const Person &entry) const { return {entry.id()}; }
+};
+
+using SkewedTable = ExtensibleHashing<Person, SkewedIdKey>;
+
+} // namespace ehash
+
+template <> struct std::hash<ehash::SkewedId> {
+    size_t operator()(const ehash::SkewedId &key) const { return key.id < 10000 ? 0 : key.id % 64; }
+};
+
+namespace ehash {
+
 // Test: Add a single entry and retrieve it
 TEST_F(ExtensibleHashingTest, AddSingleEntry) {
     ExtensibleHashing<TestMessage> hashTable(TEST_DIR, 4096);
@@ -157,6 +200,1373 @@ TEST_F(ExtensibleHashingTest, UpdateDuplicateKeyAfterSplit) {
     EXPECT_EQ(duplicates, 1);
 }
 
+// Test: Inserts are buffered in memory and written back once on flush
+TEST_F(ExtensibleHashingTest, BufferedWritesAreFlushed) {
+    std::vector<size_t> hashes;
+    {
+        ExtensibleHashing<TestMessage> hashTable(TEST_DIR, 4096);
+        for (int i = 1; i <= 100; ++i) {
+            hashes.push_back(hashTable.addEntry(createTestMessage(i)));
+        }
+        EXPECT_EQ(hashTable.bufferPoolStats().pageWrites, 0);
+
+        hashTable.flush();
+        EXPECT_LE(hashTable.bufferPoolStats().pageWrites, 2); // One write per bucket
+    }
+
+    // The same files read back with every entry present
+    ExtensibleHashing<TestMessage> reopened(TEST_DIR, 4096);
+    for (size_t i = 0; i < hashes.size(); ++i) {
+        const auto entry = reopened.getEntry(hashes[i]);
+        ASSERT_TRUE(entry.has_value());
+        EXPECT_EQ(entry.value()->id(), i + 1);
+    }
+}
+
+// Test: Buckets stored as pages of a single segment file split like bucket files
+TEST_F(ExtensibleHashingTest, SegmentStorage) {
+    Options options;
+    options.storageMode = StorageMode::Segment;
+    options.bufferPoolPages = 4; // Force evictions through the segment file
+    ExtensibleHashing<TestMessage> hashTable(TEST_DIR, 1024, 1, options);
+
+    std::vector<size_t> hashes;
+    for (int i = 1; i <= 2000; ++i) {
+        hashes.push_back(hashTable.addEntry(createTestMessage(i)));
+    }
+    hashTable.flush();
+
+    for (size_t i = 0; i < hashes.size(); ++i) {
+        const auto entry = hashTable.getEntry(hashes[i]);
+        ASSERT_TRUE(entry.has_value());
+        EXPECT_EQ(entry.value()->id(), i + 1);
+    }
+
+    // Only the segment file and the directory file were created
+    size_t files = std::distance(std::filesystem::directory_iterator(TEST_DIR), std::filesystem::directory_iterator{});
+    EXPECT_EQ(files, 2);
+    EXPECT_TRUE(std::filesystem::exists(TEST_DIR + "/buckets.seg"));
+    EXPECT_TRUE(std::filesystem::exists(directoryMetaPath(TEST_DIR)));
+}
+
+// Test: A mapped table parses buckets in place without reading them into the buffer pool
+TEST_F(ExtensibleHashingTest, MappedReads) {
+    std::vector<size_t> hashes;
+    {
+        ExtensibleHashing<TestMessage> hashTable(TEST_DIR, 1024, 2);
+        for (int i = 1; i <= 50; ++i) {
+            hashes.push_back(hashTable.addEntry(createTestMessage(i)));
+        }
+    }
+
+    Options options;
+    options.readMode = ReadMode::Mmap;
+    ExtensibleHashing<TestMessage> hashTable(TEST_DIR, 1024, 2, options);
+    for (size_t i = 0; i < hashes.size(); ++i) {
+        const auto entry = hashTable.getEntry(hashes[i]);
+        ASSERT_TRUE(entry.has_value());
+        EXPECT_EQ(entry.value()->id(), i + 1);
+    }
+    EXPECT_EQ(hashTable.bufferPoolStats().misses, 0);
+
+    // Writes still go through the pool and are visible after a reload
+    size_t hash = hashTable.addEntry(createTestMessage(1000));
+    EXPECT_EQ(hashTable.getEntry(hash).value()->id(), 1000);
+}
+
+// Test: With a key extractor, adding an entry with an existing key replaces it even if other fields differ
+TEST_F(ExtensibleHashingTest, KeyExtractorUpdatesNonKeyFields) {
+    PersonTable hashTable(TEST_DIR, 4096);
+
+    size_t hashValue = hashTable.addEntry(createPerson(1, "Alice"));
+    auto updated = createPerson(1, "Alice Smith");
+    updated->set_email("alice@example.com");
+    EXPECT_EQ(hashTable.addEntry(std::move(updated)), hashValue);
+
+    EXPECT_EQ(hashTable.getEntries(hashValue).size(), 1);
+    const auto entry = hashTable.get(1);
+    ASSERT_TRUE(entry.has_value());
+    EXPECT_EQ(entry.value()->name(), "Alice Smith");
+    EXPECT_EQ(entry.value()->email(), "alice@example.com");
+
+    EXPECT_FALSE(hashTable.get(2).has_value());
+}
+
+// Test: Keys survive splits, and updates that grow an entry past its page still replace it
+TEST_F(ExtensibleHashingTest, KeyExtractorAfterSplit) {
+    PersonTable hashTable(TEST_DIR, 1024, 1);
+
+    for (int i = 1; i <= 2000; ++i) {
+        hashTable.addEntry(createPerson(i, "person"));
+    }
+    for (int i = 1; i <= 2000; i += 3) {
+        hashTable.addEntry(createPerson(i, "person with a much longer name " + std::to_string(i)));
+    }
+
+    for (int i = 1; i <= 2000; ++i) {
+        const auto entry = hashTable.get(i);
+        ASSERT_TRUE(entry.has_value());
+        EXPECT_EQ(entry.value()->id(), i);
+        if (i % 3 == 1) {
+            EXPECT_EQ(entry.value()->name(), "person with a much longer name " + std::to_string(i));
+        } else {
+            EXPECT_EQ(entry.value()->name(), "person");
+        }
+
+        // The old version is gone from the bucket
+        const auto &bucketEntries = hashTable.getEntries(hashTable.hashKey(i));
+        EXPECT_EQ(std::count_if(bucketEntries.begin(), bucketEntries.end(),
+                                [i](const auto &person) { return person->id() == i; }),
+                  1);
+    }
+}
+
+// Test: A reopened table gets back its directory and keeps splitting into new pages
+TEST_F(ExtensibleHashingTest, ReopenRestoresDirectory) {
+    size_t globalDepth;
+    size_t bucketCount;
+    {
+        PersonTable hashTable(TEST_DIR, 1024, 1);
+        for (int i = 1; i <= 2000; ++i) {
+            hashTable.addEntry(createPerson(i, "person"));
+        }
+        globalDepth = hashTable.getGlobalDepth();
+        bucketCount = hashTable.bucketCount();
+    }
+    ASSERT_TRUE(std::filesystem::exists(directoryMetaPath(TEST_DIR)));
+
+    PersonTable reopened(TEST_DIR, 1024, 3);
+    EXPECT_EQ(reopened.getGlobalDepth(), globalDepth);
+    EXPECT_EQ(reopened.bucketCount(), bucketCount);
+
+    for (int i = 2001; i <= 4000; ++i) {
+        reopened.addEntry(createPerson(i, "person"));
+    }
+    for (int i = 1; i <= 4000; ++i) {
+        const auto entry = reopened.get(i);
+        ASSERT_TRUE(entry.has_value());
+        EXPECT_EQ(entry.value()->id(), i);
+    }
+}
+
+// Test: open() reads only the directory file and loads buckets when they are first used
+TEST_F(ExtensibleHashingTest, OpenLoadsBucketsLazily) {
+    Options options;
+    options.storageMode = StorageMode::Segment;
+    size_t bucketCount;
+    {
+        PersonTable hashTable(TEST_DIR, 1024, 1, options);
+        for (int i = 1; i <= 2000; ++i) {
+            hashTable.addEntry(createPerson(i, "person"));
+        }
+        bucketCount = hashTable.bucketCount();
+    }
+
+    auto reopened = PersonTable::open(TEST_DIR);
+    EXPECT_EQ(reopened->bucketCount(), bucketCount);
+    EXPECT_EQ(reopened->bufferPoolStats().misses, 0);
+
+    const auto entry = reopened->get(42);
+    ASSERT_TRUE(entry.has_value());
+    EXPECT_EQ(entry.value()->id(), 42);
+    EXPECT_EQ(reopened->bufferPoolStats().misses, 1);
+}
+
+// Test: open() fails on a directory without a table
+TEST_F(ExtensibleHashingTest, OpenWithoutTableFails) { EXPECT_THROW(PersonTable::open(TEST_DIR), std::runtime_error); }
+
+// Test: open() refuses a table written before bucket pages were checksummed
+TEST_F(ExtensibleHashingTest, OpenRefusesOldDirectoryVersion) {
+    {
+        PersonTable hashTable(TEST_DIR, 1024, 1);
+        hashTable.addEntry(createPerson(1, "person"));
+    }
+    {
+        std::fstream metaFile(directoryMetaPath(TEST_DIR), std::ios::binary | std::ios::in | std::ios::out);
+        uint32_t version = 3;
+        metaFile.seekp(4);
+        metaFile.write(reinterpret_cast<const char *>(&version), sizeof(version));
+    }
+
+    EXPECT_THROW(PersonTable::open(TEST_DIR), std::runtime_error);
+}
+
+// Test: Changes that were logged but never checkpointed survive a crash
+TEST_F(ExtensibleHashingTest, WriteAheadLogRecoversAfterCrash) {
+    const std::string crashDir = TEST_DIR + "/crashed";
+    std::filesystem::create_directory(crashDir);
+    Options options;
+    options.writeAheadLog = true;
+    options.checkpointIntervalMillis = 3600 * 1000; // Only the initial checkpoint runs
+
+    size_t bucketCount;
+    {
+        PersonTable hashTable(TEST_DIR, 1024, 1, options);
+        for (int i = 1; i <= 1000; ++i) {
+            hashTable.addEntry(createPerson(i, "person"));
+        }
+        hashTable.addEntry(createPerson(7, "updated"));
+        bucketCount = hashTable.bucketCount();
+        EXPECT_EQ(hashTable.bufferPoolStats().pageWrites, 0);
+
+        // Files as a crash would leave them: the initial checkpoint plus the log
+        for (const auto &file : std::filesystem::directory_iterator(TEST_DIR)) {
+            if (file.is_regular_file()) {
+                std::filesystem::copy_file(file.path(), crashDir + "/" + file.path().filename().string());
+            }
+        }
+    }
+
+    auto recovered = PersonTable::open(crashDir, options);
+    EXPECT_EQ(recovered->bucketCount(), bucketCount);
+    for (int i = 1; i <= 1000; ++i) {
+        const auto entry = recovered->get(i);
+        ASSERT_TRUE(entry.has_value());
+        EXPECT_EQ(entry.value()->name(), i == 7 ? "updated" : "person");
+    }
+}
+
+// Test: Writers on several threads share log syncs and every change is kept
+TEST_F(ExtensibleHashingTest, WriteAheadLogGroupCommit) {
+    Options options;
+    options.writeAheadLog = true;
+    options.groupCommitWindowMicros = 200;
+    {
+        PersonTable hashTable(TEST_DIR, 1024, 1, options);
+        std::vector<std::thread> writers;
+        for (int thread = 0; thread < 4; ++thread) {
+            writers.emplace_back([&hashTable, thread] {
+                for (int i = 0; i < 100; ++i) {
+                    hashTable.addEntry(createPerson(thread * 1000 + i, "person"));
+                }
+            });
+        }
+        for (auto &writer : writers) {
+            writer.join();
+        }
+        EXPECT_EQ(hashTable.logStats().records, 400);
+        EXPECT_LT(hashTable.logStats().syncs, 400);
+    }
+
+    auto reopened = PersonTable::open(TEST_DIR, options);
+    for (int thread = 0; thread < 4; ++thread) {
+        for (int i = 0; i < 100; ++i) {
+            EXPECT_TRUE(reopened->get(thread * 1000 + i).has_value());
+        }
+    }
+}
+
+// Test: A batch is placed like single inserts in order, with a few page pins per bucket
+TEST_F(ExtensibleHashingTest, AddEntriesBatch) {
+    PersonTable hashTable(TEST_DIR, 1024, 1);
+    hashTable.addEntry(createPerson(1, "before the batch"));
+
+    std::vector<std::unique_ptr<Person>> batch;
+    for (int i = 1; i <= 2000; ++i) {
+        batch.push_back(createPerson(i, "person"));
+    }
+    batch.push_back(createPerson(5, "last write wins"));
+    size_t pinsBefore = hashTable.bufferPoolStats().hits + hashTable.bufferPoolStats().misses;
+
+    auto hashes = hashTable.addEntries(std::move(batch));
+    ASSERT_EQ(hashes.size(), 2001);
+    EXPECT_EQ(hashes[41], hashTable.hashKey(42));
+
+    size_t pins = hashTable.bufferPoolStats().hits + hashTable.bufferPoolStats().misses - pinsBefore;
+    EXPECT_LT(pins, 100); // Single inserts pin a page per entry
+    for (int i = 1; i <= 2000; ++i) {
+        const auto entry = hashTable.get(i);
+        ASSERT_TRUE(entry.has_value());
+        EXPECT_EQ(entry.value()->name(), i == 5 ? "last write wins" : "person");
+    }
+}
+
+// Test: A batch splits the buckets it will overflow before placing entries in them, so a fresh table is filled
+// without moving any of the batch
+TEST_F(ExtensibleHashingTest, AddEntriesSplitsBeforePlacing) {
+    PersonTable hashTable(TEST_DIR, 1024, 1);
+    std::vector<std::unique_ptr<Person>> batch;
+    for (int i = 1; i <= 2000; ++i) {
+        batch.push_back(createPerson(i, "person"));
+    }
+    size_t pinsBefore = hashTable.bufferPoolStats().hits + hashTable.bufferPoolStats().misses;
+
+    hashTable.addEntries(std::move(batch));
+    size_t pins = hashTable.bufferPoolStats().hits + hashTable.bufferPoolStats().misses - pinsBefore;
+    EXPECT_GT(hashTable.stats().splits, 0);
+    EXPECT_LE(pins, 3 * hashTable.bucketCount()); // Moving entries in a split pins both halves again
+    for (int i = 1; i <= 2000; ++i) {
+        ASSERT_TRUE(hashTable.get(i).has_value()) << i;
+    }
+}
+
+// Test: A batch that is too large for any bucket is rejected before anything is added
+TEST_F(ExtensibleHashingTest, AddEntriesRejectsOversizedEntry) {
+    PersonTable hashTable(TEST_DIR, 1024, 1);
+
+    std::vector<std::unique_ptr<Person>> batch;
+    batch.push_back(createPerson(1, "fits"));
+    batch.push_back(createPerson(2, std::string(8192, 'x')));
+    EXPECT_THROW(hashTable.addEntries(std::move(batch)), std::runtime_error);
+    EXPECT_FALSE(hashTable.get(1).has_value());
+}
+
+// Test: Removed entries are gone, and removing a missing key changes nothing
+TEST_F(ExtensibleHashingTest, RemoveEntry) {
+    PersonTable hashTable(TEST_DIR, 1024, 1);
+    for (int i = 0; i < 10; ++i) {
+        hashTable.addEntry(createPerson(i, "person"));
+    }
+
+    EXPECT_TRUE(hashTable.removeEntry(3));
+    EXPECT_FALSE(hashTable.removeEntry(3));
+    EXPECT_FALSE(hashTable.removeEntry(42));
+    for (int i = 0; i < 10; ++i) {
+        EXPECT_EQ(hashTable.get(i).has_value(), i != 3) << i;
+    }
+
+    hashTable.addEntry(createPerson(3, "again"));
+    EXPECT_EQ(hashTable.get(3).value()->name(), "again");
+}
+
+// Test: Emptying a grown table merges its buckets, shrinks the directory and deletes the freed bucket files
+TEST_F(ExtensibleHashingTest, RemoveMergesBucketsAndShrinksDirectory) {
+    size_t bucketCount;
+    {
+        PersonTable hashTable(TEST_DIR, 1024, 1);
+        for (int i = 0; i < 2000; ++i) {
+            hashTable.addEntry(createPerson(i, "person"));
+        }
+        size_t grownDepth = hashTable.getGlobalDepth();
+        size_t grownCount = hashTable.bucketCount();
+        ASSERT_GT(grownDepth, 3);
+
+        for (int i = 10; i < 2000; ++i) {
+            ASSERT_TRUE(hashTable.removeEntry(i)) << i;
+        }
+        EXPECT_LT(hashTable.getGlobalDepth(), grownDepth);
+        EXPECT_LT(hashTable.bucketCount(), grownCount / 8);
+        for (int i = 0; i < 2000; ++i) {
+            ASSERT_EQ(hashTable.get(i).has_value(), i < 10) << i;
+        }
+        bucketCount = hashTable.bucketCount();
+    }
+
+    size_t bucketFiles = 0;
+    for (const auto &file : std::filesystem::directory_iterator(TEST_DIR)) {
+        bucketFiles += file.path().filename().string().rfind("bucket_", 0) == 0;
+    }
+    EXPECT_EQ(bucketFiles, bucketCount);
+
+    auto reopened = PersonTable::open(TEST_DIR);
+    EXPECT_EQ(reopened->bucketCount(), bucketCount);
+    for (int i = 0; i < 10; ++i) {
+        EXPECT_TRUE(reopened->get(i).has_value()) << i;
+    }
+}
+
+// Test: Merge fill factors outside 0 to 1 are rejected, and merging up to a full page keeps every entry
+TEST_F(ExtensibleHashingTest, MergeFillFactorUpToFullPage) {
+    for (double factor : {-0.1, 1.5, std::nan("")}) {
+        Options options;
+        options.mergeFillFactor = factor;
+        EXPECT_THROW(PersonTable(TEST_DIR, 1024, 1, options), std::runtime_error) << factor;
+    }
+
+    Options options;
+    options.mergeFillFactor = 1.0;
+    PersonTable hashTable(TEST_DIR, 1024, 1, options);
+    for (int i = 0; i < 2000; ++i) {
+        hashTable.addEntry(createPerson(i, std::string(i % 40, 'x')));
+    }
+    size_t grownCount = hashTable.bucketCount();
+    for (int i = 0; i < 2000; i += 2) {
+        ASSERT_TRUE(hashTable.removeEntry(i)) << i;
+    }
+    EXPECT_LT(hashTable.bucketCount(), grownCount);
+    for (int i = 0; i < 2000; ++i) {
+        ASSERT_EQ(hashTable.get(i).has_value(), i % 2 == 1) << i;
+    }
+}
+
+// Test: Removals that merged buckets after the last checkpoint are replayed from the log after a crash
+TEST_F(ExtensibleHashingTest, WriteAheadLogRecoversRemovals) {
+    const std::string crashDir = TEST_DIR + "/crashed";
+    std::filesystem::create_directory(crashDir);
+    Options options;
+    options.writeAheadLog = true;
+    options.checkpointIntervalMillis = 3600 * 1000; // Only the checkpoint below runs
+
+    {
+        PersonTable hashTable(TEST_DIR, 1024, 1, options);
+        for (int i = 0; i < 1000; ++i) {
+            hashTable.addEntry(createPerson(i, "person"));
+        }
+        hashTable.flush();
+        for (int i = 100; i < 1000; ++i) {
+            hashTable.removeEntry(i);
+        }
+        EXPECT_EQ(hashTable.logStats().records, 1900);
+
+        for (const auto &file : std::filesystem::directory_iterator(TEST_DIR)) {
+            if (file.is_regular_file()) {
+                std::filesystem::copy_file(file.path(), crashDir + "/" + file.path().filename().string());
+            }
+        }
+    }
+
+    auto recovered = PersonTable::open(crashDir, options);
+    for (int i = 0; i < 1000; ++i) {
+        ASSERT_EQ(recovered->get(i).has_value(), i < 100) << i;
+    }
+}
+
+// Test: Threads adding disjoint keys while others look them up split the table without losing entries
+TEST_F(ExtensibleHashingTest, ConcurrentAddsAndLookups) {
+    constexpr int WRITERS = 4;
+    constexpr int ENTRIES_PER_WRITER = 500;
+    {
+        PersonTable hashTable(TEST_DIR, 1024, 1);
+
+        std::vector<std::thread> threads;
+        for (int writer = 0; writer < WRITERS; ++writer) {
+            threads.emplace_back([&hashTable, writer] {
+                int firstId = writer * ENTRIES_PER_WRITER;
+                for (int i = 0; i < ENTRIES_PER_WRITER / 2; ++i) {
+                    hashTable.addEntry(createPerson(firstId + i, "single"));
+                }
+                // The second half goes in as one batch, which is split around the single inserts of the others
+                std::vector<std::unique_ptr<Person>> batch;
+                for (int i = ENTRIES_PER_WRITER / 2; i < ENTRIES_PER_WRITER; ++i) {
+                    batch.push_back(createPerson(firstId + i, "batch"));
+                }
+                hashTable.addEntries(std::move(batch));
+            });
+        }
+        for (int reader = 0; reader < 2; ++reader) {
+            threads.emplace_back([&hashTable] {
+                for (int round = 0; round < 5; ++round) {
+                    for (int id = 0; id < WRITERS * ENTRIES_PER_WRITER; ++id) {
+                        auto entry = hashTable.get(id);
+                        if (entry.has_value()) {
+                            EXPECT_EQ(entry.value()->id(), id);
+                        }
+                        if (id % 100 == 0) {
+                            // The bucket may split while the list is read; it keeps the entries it collected
+                            for (const Person *other : hashTable.getEntries(hashTable.hashKey(id))) {
+                                EXPECT_FALSE(other->name().empty());
+                            }
+                        }
+                    }
+                }
+            });
+        }
+        for (auto &thread : threads) {
+            thread.join();
+        }
+
+        for (int id = 0; id < WRITERS * ENTRIES_PER_WRITER; ++id) {
+            ASSERT_TRUE(hashTable.get(id).has_value()) << id;
+        }
+    }
+
+    auto reopened = PersonTable::open(TEST_DIR);
+    for (int id = 0; id < WRITERS * ENTRIES_PER_WRITER; ++id) {
+        const auto entry = reopened->get(id);
+        ASSERT_TRUE(entry.has_value()) << id;
+        EXPECT_EQ(entry.value()->name(), id % ENTRIES_PER_WRITER < ENTRIES_PER_WRITER / 2 ? "single" : "batch");
+    }
+}
+
+// Test: Lock-free lookups running through splits find every entry a writer has finished adding
+TEST_F(ExtensibleHashingTest, OptimisticLookupsDuringSplits) {
+    constexpr int WRITERS = 2;
+    constexpr int ENTRIES_PER_WRITER = 1000;
+    PersonTable hashTable(TEST_DIR, 1024, 1);
+
+    std::atomic<int> added[WRITERS] = {};
+    std::vector<std::thread> threads;
+    for (int writer = 0; writer < WRITERS; ++writer) {
+        threads.emplace_back([&, writer] {
+            for (int i = 0; i < ENTRIES_PER_WRITER; ++i) {
+                hashTable.addEntry(createPerson(writer * ENTRIES_PER_WRITER + i, "person"));
+                added[writer].store(i + 1, std::memory_order_release);
+            }
+        });
+    }
+    for (int reader = 0; reader < 2; ++reader) {
+        threads.emplace_back([&] {
+            while (added[0].load() < ENTRIES_PER_WRITER || added[1].load() < ENTRIES_PER_WRITER) {
+                for (int writer = 0; writer < WRITERS; ++writer) {
+                    int done = added[writer].load(std::memory_order_acquire);
+                    for (int i = std::max(0, done - 50); i < done; ++i) {
+                        int id = writer * ENTRIES_PER_WRITER + i;
+                        auto entry = hashTable.get(id);
+                        ASSERT_TRUE(entry.has_value()) << id;
+                        EXPECT_EQ(entry.value()->id(), id);
+                    }
+                }
+            }
+        });
+    }
+    for (auto &thread : threads) {
+        thread.join();
+    }
+
+    for (int id = 0; id < WRITERS * ENTRIES_PER_WRITER; ++id) {
+        ASSERT_TRUE(hashTable.getEntry(hashTable.hashKey(id)).has_value()) << id;
+    }
+}
+
+// Test: A thread can keep more lookup results than the epoch manager has reader slots in a block
+TEST_F(ExtensibleHashingTest, ManyHeldLookups) {
+    constexpr int HELD = 500;
+    PersonTable hashTable(TEST_DIR, 1024, 1);
+    for (int id = 0; id < HELD; ++id) {
+        hashTable.addEntry(createPerson(id, "person " + std::to_string(id)));
+    }
+
+    std::vector<PinnedEntry<Person>> entries;
+    std::vector<PinnedEntries<Person>> buckets;
+    for (int id = 0; id < HELD; ++id) {
+        entries.push_back(hashTable.getEntry(hashTable.hashKey(id)).value());
+        buckets.push_back(hashTable.getEntries(hashTable.hashKey(id)));
+    }
+    for (int id = 0; id < HELD; ++id) {
+        EXPECT_EQ(entries[id]->name(), "person " + std::to_string(id));
+        EXPECT_FALSE(buckets[id].empty());
+    }
+}
+
+// Test: An entry returned by a lookup stays valid and unchanged while other threads replace and remove it
+TEST_F(ExtensibleHashingTest, PinnedEntriesSurviveConcurrentUpdates) {
+    constexpr int KEYS = 8;
+    PersonTable hashTable(TEST_DIR, 1024, 1);
+    for (int id = 0; id < KEYS; ++id) {
+        hashTable.addEntry(createPerson(id, "n"));
+    }
+
+    std::atomic<bool> done{false};
+    std::vector<std::thread> threads;
+    threads.emplace_back([&] {
+        for (int round = 0; round < 5000; ++round) {
+            int id = round % KEYS;
+            if (round % 5 == 0) {
+                hashTable.removeEntry(id);
+            }
+            // Names of changing length make some updates move the record instead of overwriting it
+            hashTable.addEntry(createPerson(id, std::string(1 + round % 60, 'n')));
+        }
+        done.store(true);
+    });
+    for (int reader = 0; reader < 2; ++reader) {
+        threads.emplace_back([&] {
+            while (!done.load()) {
+                for (int id = 0; id < KEYS; ++id) {
+                    auto entry = hashTable.get(id);
+                    if (!entry.has_value()) {
+                        continue; // Removed for the moment
+                    }
+                    std::string name = entry.value()->name();
+                    std::this_thread::yield();
+                    EXPECT_EQ(entry.value()->id(), id);
+                    EXPECT_EQ(entry.value()->name(), name);
+                    EXPECT_EQ(name, std::string(name.size(), 'n'));
+                }
+            }
+        });
+    }
+    for (auto &thread : threads) {
+        thread.join();
+    }
+}
+
+// Test: Asynchronous lookups on a reopened table read the bucket pages in the background and find every entry
+TEST_F(ExtensibleHashingTest, AsyncLookupsReadPagesInBackground) {
+    for (StorageMode mode : {StorageMode::BucketFiles, StorageMode::Segment}) {
+        std::filesystem::remove_all(TEST_DIR);
+        std::filesystem::create_directory(TEST_DIR);
+        Options options;
+        options.storageMode = mode;
+        {
+            PersonTable hashTable(TEST_DIR, 1024, 1, options);
+            for (int i = 1; i <= 2000; ++i) {
+                hashTable.addEntry(createPerson(i, "person"));
+            }
+        }
+
+        auto reopened = PersonTable::open(TEST_DIR, options);
+        std::vector<std::future<std::optional<PinnedEntry<Person>>>> lookups;
+        for (int i = 1; i <= 2000; i += 7) {
+            lookups.push_back(reopened->getAsync(i));
+        }
+        lookups.push_back(reopened->getEntryAsync(reopened->hashKey(2000)));
+        lookups.push_back(reopened->getAsync(5000));
+
+        for (size_t i = 0; i + 2 < lookups.size(); ++i) {
+            const auto entry = lookups[i].get();
+            ASSERT_TRUE(entry.has_value()) << i;
+            EXPECT_EQ(entry.value()->id(), static_cast<int>(i * 7 + 1));
+        }
+        const auto byHash = lookups[lookups.size() - 2].get();
+        ASSERT_TRUE(byHash.has_value());
+        EXPECT_EQ(byHash.value()->id(), 2000);
+        EXPECT_FALSE(lookups.back().get().has_value());
+    }
+}
+
+// Test: flushAsync writes the dirty pages in the background, and a reopened table finds the entries
+TEST_F(ExtensibleHashingTest, FlushAsyncPersistsEntries) {
+    Options options;
+    options.storageMode = StorageMode::Segment;
+    {
+        PersonTable hashTable(TEST_DIR, 1024, 1, options);
+        for (int i = 1; i <= 1000; ++i) {
+            hashTable.addEntry(createPerson(i, "person"));
+        }
+        hashTable.flushAsync().get();
+        EXPECT_GT(hashTable.bufferPoolStats().pageWrites, 0);
+    }
+
+    auto reopened = PersonTable::open(TEST_DIR, options);
+    for (int i = 1; i <= 1000; ++i) {
+        EXPECT_TRUE(reopened->get(i).has_value()) << i;
+    }
+}
+
+// Test: Lookups count a miss when they load a bucket and a hit when it is already loaded
+TEST_F(ExtensibleHashingTest, BucketCacheCountsHitsAndMisses) {
+    {
+        PersonTable hashTable(TEST_DIR, 1024, 1);
+        for (int i = 1; i <= 500; ++i) {
+            hashTable.addEntry(createPerson(i, "person"));
+        }
+        EXPECT_GT(hashTable.bucketCacheStats().residentBytes, 0);
+        EXPECT_EQ(hashTable.bucketCacheStats().unloads, 0);
+    }
+
+    auto reopened = PersonTable::open(TEST_DIR);
+    EXPECT_EQ(reopened->bucketCacheStats().residentBytes, 0);
+    ASSERT_TRUE(reopened->get(42).has_value());
+    EXPECT_EQ(reopened->bucketCacheStats().misses, 1);
+    EXPECT_EQ(reopened->bucketCacheStats().hits, 0);
+    ASSERT_TRUE(reopened->get(42).has_value());
+    EXPECT_EQ(reopened->bucketCacheStats().misses, 1);
+    EXPECT_EQ(reopened->bucketCacheStats().hits, 1);
+}
+
+// Test: A table larger than its memory budget unloads cold buckets and reloads them when they are used again
+TEST_F(ExtensibleHashingTest, MemoryBudgetUnloadsColdBuckets) {
+    constexpr size_t BUDGET = 32 << 10;
+    Options options;
+    options.memoryBudgetBytes = BUDGET;
+    PersonTable hashTable(TEST_DIR, 1024, 1, options);
+    for (int i = 1; i <= 5000; ++i) {
+        hashTable.addEntry(createPerson(i, "person " + std::to_string(i)));
+    }
+    EXPECT_GT(hashTable.bucketCacheStats().unloads, 0);
+    EXPECT_LT(hashTable.bucketCacheStats().residentBytes, 2 * BUDGET);
+
+    size_t misses = hashTable.bucketCacheStats().misses;
+    for (int i = 1; i <= 5000; ++i) {
+        const auto entry = hashTable.get(i);
+        ASSERT_TRUE(entry.has_value()) << i;
+        EXPECT_EQ(entry.value()->name(), "person " + std::to_string(i));
+    }
+    EXPECT_GT(hashTable.bucketCacheStats().misses, misses);
+    EXPECT_LT(hashTable.bucketCacheStats().residentBytes, 2 * BUDGET);
+
+    // Changes made before a bucket is unloaded are read back from its page
+    for (int i = 1; i <= 5000; i += 2) {
+        ASSERT_TRUE(hashTable.removeEntry(i));
+    }
+    for (int i = 1; i <= 5000; ++i) {
+        EXPECT_EQ(hashTable.get(i).has_value(), i % 2 == 0) << i;
+    }
+}
+
+// Test: Entries held by the caller stay valid while their buckets are unloaded to keep within the memory budget
+TEST_F(ExtensibleHashingTest, HeldEntriesOutliveUnloads) {
+    for (bool lazy : {false, true}) {
+        std::filesystem::remove_all(TEST_DIR);
+        std::filesystem::create_directory(TEST_DIR);
+        Options options;
+        options.memoryBudgetBytes = 16 << 10;
+        options.lazyEntries = lazy;
+        PersonTable hashTable(TEST_DIR, 1024, 1, options);
+        for (int i = 1; i <= 3000; ++i) {
+            hashTable.addEntry(createPerson(i, "person " + std::to_string(i)));
+        }
+
+        auto held = hashTable.get(42);
+        ASSERT_TRUE(held.has_value());
+        auto bucket = hashTable.getEntries(hashTable.hashKey(42));
+        size_t unloads = hashTable.bucketCacheStats().unloads;
+        for (int round = 0; round < 2; ++round) {
+            for (int i = 1; i <= 3000; ++i) {
+                ASSERT_TRUE(hashTable.get(i).has_value()) << i;
+            }
+        }
+        EXPECT_GT(hashTable.bucketCacheStats().unloads, unloads);
+
+        EXPECT_EQ(held.value()->name(), "person 42");
+        bool found = false;
+        for (const Person *entry : bucket) {
+            EXPECT_EQ(entry->name(), "person " + std::to_string(entry->id()));
+            found = found || entry->id() == 42;
+        }
+        EXPECT_TRUE(found);
+    }
+}
+
+// Test: Threads adding and looking up entries keep working while other threads unload their buckets
+TEST_F(ExtensibleHashingTest, ConcurrentAccessWithinMemoryBudget) {
+    constexpr int THREADS = 4;
+    constexpr int ENTRIES_PER_THREAD = 500;
+    Options options;
+    options.memoryBudgetBytes = 8 << 10;
+    PersonTable hashTable(TEST_DIR, 1024, 1, options);
+
+    std::vector<std::thread> threads;
+    for (int thread = 0; thread < THREADS; ++thread) {
+        threads.emplace_back([&, thread] {
+            for (int i = 0; i < ENTRIES_PER_THREAD; ++i) {
+                int id = thread * ENTRIES_PER_THREAD + i;
+                hashTable.addEntry(createPerson(id, "person"));
+                EXPECT_TRUE(hashTable.get(id).has_value()) << id;
+            }
+        });
+    }
+    for (auto &thread : threads) {
+        thread.join();
+    }
+
+    EXPECT_GT(hashTable.bucketCacheStats().unloads, 0);
+    for (int id = 0; id < THREADS * ENTRIES_PER_THREAD; ++id) {
+        ASSERT_TRUE(hashTable.get(id).has_value()) << id;
+    }
+}
+
+// Test: Keys with one hash grow an overflow chain instead of doubling the directory, and the chain is given
+// back as they are removed
+TEST_F(ExtensibleHashingTest, CollidingKeysGrowOverflowPages) {
+    {
+        SkewedTable hashTable(TEST_DIR, 1024, 1);
+        for (int i = 0; i < 200; ++i) {
+            hashTable.addEntry(createPerson(i, "person"));
+        }
+        std::vector<std::unique_ptr<Person>> batch;
+        for (int i = 200; i < 400; ++i) {
+            batch.push_back(createPerson(i, "person"));
+        }
+        hashTable.addEntries(std::move(batch));
+
+        EXPECT_EQ(hashTable.getGlobalDepth(), 1);
+        const OverflowStats stats = hashTable.overflowStats();
+        EXPECT_EQ(stats.buckets, 2);
+        EXPECT_EQ(stats.overflowBuckets, 1);
+        EXPECT_GT(stats.overflowPages, 0);
+        EXPECT_EQ(stats.overflowPagesAdded, stats.overflowPages);
+        EXPECT_DOUBLE_EQ(stats.overflowRate(), 0.5);
+    }
+
+    auto reopened = SkewedTable::open(TEST_DIR);
+    EXPECT_GT(reopened->overflowStats().overflowPages, 0);
+    for (int i = 0; i < 400; ++i) {
+        const auto entry = reopened->get({i});
+        ASSERT_TRUE(entry.has_value()) << i;
+        EXPECT_EQ(entry.value()->id(), i);
+    }
+
+    for (int i = 0; i < 400; ++i) {
+        ASSERT_TRUE(reopened->removeEntry({i}));
+    }
+    EXPECT_EQ(reopened->overflowStats().overflowPages, 0);
+    EXPECT_FALSE(reopened->get({0}).has_value());
+}
+
+// Test: Buckets stop splitting at the maximum local depth and chain overflow pages instead
+TEST_F(ExtensibleHashingTest, MaxLocalDepthCapsDirectory) {
+    Options options;
+    options.maxLocalDepth = 3;
+    options.storageMode = StorageMode::Segment;
+    {
+        SkewedTable hashTable(TEST_DIR, 1024, 1, options);
+        for (int i = 10000; i < 12000; ++i) {
+            hashTable.addEntry(createPerson(i, "person"));
+        }
+        EXPECT_EQ(hashTable.getGlobalDepth(), 3);
+        EXPECT_EQ(hashTable.overflowStats().overflowBuckets, 8);
+    }
+
+    auto reopened = SkewedTable::open(TEST_DIR, options);
+    for (int i = 10000; i < 12000; ++i) {
+        ASSERT_TRUE(reopened->get({i}).has_value()) << i;
+    }
+}
+
+// Test: A bucket with overflow pages still splits once keys it can separate arrive, and both halves keep
+// every entry
+TEST_F(ExtensibleHashingTest, SplitsBucketWithOverflowPages) {
+    {
+        SkewedTable hashTable(TEST_DIR, 1024, 1);
+        for (int i = 0; i < 300; ++i) {
+            hashTable.addEntry(createPerson(i, "colliding"));
+        }
+        size_t chained = hashTable.overflowStats().overflowPages;
+        ASSERT_GT(chained, 0);
+        for (int i = 10000; i < 13000; ++i) {
+            hashTable.addEntry(createPerson(i, "spread"));
+        }
+        EXPECT_LE(hashTable.getGlobalDepth(), 6);
+        EXPECT_GT(hashTable.bucketCount(), 2);
+    }
+
+    auto reopened = SkewedTable::open(TEST_DIR);
+    for (int i = 0; i < 300; ++i) {
+        ASSERT_TRUE(reopened->get({i}).has_value()) << i;
+    }
+    for (int i = 10000; i < 13000; ++i) {
+        ASSERT_TRUE(reopened->get({i}).has_value()) << i;
+    }
+}
+
+// Test: A table hashing with WyHasher spreads ids that share their low bits over few directory bits, and
+// finds them again when reopened
+TEST_F(ExtensibleHashingTest, PluggableHasherSpreadsStridedIds) {
+    size_t wyDepth;
+    {
+        WyPersonTable hashTable(TEST_DIR, 1024, 1);
+        for (int i = 0; i < 2000; ++i) {
+            hashTable.addEntry(createPerson(i * 1024, "person"));
+        }
+        wyDepth = hashTable.getGlobalDepth();
+    }
+    auto reopened = WyPersonTable::open(TEST_DIR);
+    for (int i = 0; i < 2000; ++i) {
+        ASSERT_TRUE(reopened->get(i * 1024).has_value()) << i;
+    }
+    reopened.reset();
+
+    std::filesystem::remove_all(TEST_DIR);
+    std::filesystem::create_directory(TEST_DIR);
+    PersonTable stdTable(TEST_DIR, 1024, 1);
+    for (int i = 0; i < 2000; ++i) {
+        stdTable.addEntry(createPerson(i * 1024, "person"));
+    }
+    // std::hash leaves the low ten bits of every id zero, so each split has to look past them
+    EXPECT_GE(stdTable.getGlobalDepth(), 10u);
+    EXPECT_LT(wyDepth, stdTable.getGlobalDepth());
+}
+
+// Test: Entries read back from the pages live in an arena that stays alive while splits move them to other
+// buckets, updates replace them and removals merge their buckets
+TEST_F(ExtensibleHashingTest, LoadedEntriesLiveInArena) {
+    {
+        PersonTable hashTable(TEST_DIR, 1024, 1);
+        for (int i = 0; i < 200; ++i) {
+            hashTable.addEntry(createPerson(i, "person " + std::to_string(i)));
+        }
+    }
+
+    auto reopened = PersonTable::open(TEST_DIR);
+    ASSERT_TRUE(reopened->get(0).has_value());
+    EXPECT_NE(reopened->get(0).value()->GetArena(), nullptr);
+
+    for (int i = 200; i < 2000; ++i) {
+        reopened->addEntry(createPerson(i, "person " + std::to_string(i)));
+    }
+    EXPECT_EQ(reopened->get(1999).value()->GetArena(), nullptr); // Added entries stay on the heap
+    for (int i = 0; i < 200; i += 2) {
+        reopened->addEntry(createPerson(i, "updated " + std::to_string(i)));
+    }
+    for (int i = 1000; i < 2000; ++i) {
+        reopened->removeEntry(i);
+    }
+
+    for (int i = 0; i < 1000; ++i) {
+        auto entry = reopened->get(i);
+        ASSERT_TRUE(entry.has_value()) << i;
+        EXPECT_EQ(entry.value()->name(), (i < 200 && i % 2 == 0 ? "updated " : "person ") + std::to_string(i));
+    }
+}
+
+// Test: A lazy table parses only the records lookups use, while an eager one parses the whole bucket
+TEST_F(ExtensibleHashingTest, LazyEntriesParseOnlyWhatIsUsed) {
+    std::vector<size_t> hashes;
+    {
+        ExtensibleHashing<TestMessage> hashTable(TEST_DIR, 4096);
+        for (int i = 1; i <= 100; ++i) {
+            hashes.push_back(hashTable.addEntry(createTestMessage(i)));
+        }
+    }
+
+    Options lazy;
+    lazy.lazyEntries = true;
+    {
+        auto reopened = ExtensibleHashing<TestMessage>::open(TEST_DIR, lazy);
+        auto entry = reopened->get(createTestMessage(42)->SerializeAsString());
+        ASSERT_TRUE(entry.has_value());
+        EXPECT_EQ(entry.value()->id(), 42);
+        EXPECT_EQ(reopened->bucketCacheStats().parses, 1u); // Keys are compared and hashed in the records
+
+        ASSERT_TRUE(reopened->getEntry(hashes[6]).has_value());
+        EXPECT_EQ(reopened->getEntry(hashes[6]).value()->id(), 7);
+        EXPECT_EQ(reopened->bucketCacheStats().parses, 2u);
+
+        // Changed and added entries are found like parsed ones
+        reopened->addEntry(createTestMessage(101));
+        EXPECT_TRUE(reopened->removeEntry(createTestMessage(7)->SerializeAsString()));
+        EXPECT_FALSE(reopened->get(createTestMessage(7)->SerializeAsString()).has_value());
+        EXPECT_TRUE(reopened->get(createTestMessage(101)->SerializeAsString()).has_value());
+    }
+
+    auto eager = ExtensibleHashing<TestMessage>::open(TEST_DIR);
+    ASSERT_TRUE(eager->get(createTestMessage(42)->SerializeAsString()).has_value());
+    EXPECT_GT(eager->bucketCacheStats().parses, 1u);
+}
+
+// Test: A lazy table whose keys are fields parses every record once to hash its key, keeps only the records,
+// and stays consistent through updates, splits and merges
+TEST_F(ExtensibleHashingTest, LazyEntriesWithFieldKeys) {
+    {
+        PersonTable hashTable(TEST_DIR, 1024, 1);
+        for (int i = 0; i < 300; ++i) {
+            hashTable.addEntry(createPerson(i, "person " + std::to_string(i)));
+        }
+    }
+
+    Options options;
+    options.lazyEntries = true;
+    auto reopened = PersonTable::open(TEST_DIR, options);
+    for (int i = 0; i < 300; i += 3) {
+        reopened->addEntry(createPerson(i, "updated " + std::to_string(i)));
+    }
+    for (int i = 300; i < 1500; ++i) {
+        reopened->addEntry(createPerson(i, "person " + std::to_string(i)));
+    }
+    for (int i = 600; i < 1500; ++i) {
+        ASSERT_TRUE(reopened->removeEntry(i)) << i;
+    }
+    for (int i = 0; i < 600; ++i) {
+        auto entry = reopened->get(i);
+        ASSERT_TRUE(entry.has_value()) << i;
+        EXPECT_EQ(entry.value()->name(), (i < 300 && i % 3 == 0 ? "updated " : "person ") + std::to_string(i));
+    }
+    EXPECT_FALSE(reopened->get(600).has_value());
+}
+
+// Test: Readers sharing the latch of a lazy bucket parse its entries concurrently
+TEST_F(ExtensibleHashingTest, ConcurrentLazyLookups) {
+    constexpr int ENTRIES = 2000;
+    {
+        PersonTable hashTable(TEST_DIR, 4096, 1);
+        for (int i = 0; i < ENTRIES; ++i) {
+            hashTable.addEntry(createPerson(i, "person"));
+        }
+    }
+
+    Options options;
+    options.lazyEntries = true;
+    auto reopened = PersonTable::open(TEST_DIR, options);
+    std::vector<std::thread> readers;
+    for (int reader = 0; reader < 4; ++reader) {
+        readers.emplace_back([&reopened, reader] {
+            for (int i = 0; i < ENTRIES; ++i) {
+                int id = (i + reader * ENTRIES / 4) % ENTRIES;
+                auto entry = reopened->get(id);
+                ASSERT_TRUE(entry.has_value()) << id;
+                EXPECT_EQ(entry.value()->id(), id);
+            }
+        });
+    }
+    for (auto &reader : readers) {
+        reader.join();
+    }
+}
+
+// Test: A bulk load builds a table holding every record, later records replacing earlier ones with the same
+// key, in no more buckets than adding the records one by one takes
+TEST_F(ExtensibleHashingTest, BulkLoadBuildsTableAtFinalDepth) {
+    constexpr int ENTRIES = 20000;
+    std::stringstream records;
+    for (int i = 0; i < ENTRIES; ++i) {
+        writeDelimitedRecord(records, createPerson(i, "person")->SerializeAsString());
+    }
+    writeDelimitedRecord(records, createPerson(5, "replaced")->SerializeAsString());
+
+    size_t grownBuckets;
+    std::filesystem::create_directory(TEST_DIR + "/grown");
+    {
+        PersonTable grown(TEST_DIR + "/grown", 4096, 1);
+        for (int i = 0; i < ENTRIES; ++i) {
+            grown.addEntry(createPerson(i, "person"));
+        }
+        grownBuckets = grown.bucketCount();
+    }
+
+    {
+        auto loaded = PersonTable::bulkLoad(TEST_DIR + "/loaded", 4096, records);
+        EXPECT_LE(loaded->bucketCount(), grownBuckets);
+        EXPECT_EQ(loaded->overflowStats().overflowPages, 0);
+        for (int i = 0; i < ENTRIES; ++i) {
+            const auto entry = loaded->get(i);
+            ASSERT_TRUE(entry.has_value()) << i;
+            EXPECT_EQ(entry.value()->name(), i == 5 ? "replaced" : "person");
+        }
+        const auto &entries = loaded->getEntries(loaded->hashKey(5));
+        EXPECT_EQ(std::count_if(entries.begin(), entries.end(), [](const auto &entry) { return entry->id() == 5; }),
+                  1);
+
+        // The loaded buckets split as usual
+        for (int i = ENTRIES; i < 2 * ENTRIES; ++i) {
+            loaded->addEntry(createPerson(i, "added"));
+        }
+    }
+
+    auto reopened = PersonTable::open(TEST_DIR + "/loaded");
+    for (int i = 0; i < 2 * ENTRIES; ++i) {
+        ASSERT_TRUE(reopened->get(i).has_value()) << i;
+    }
+    std::stringstream more;
+    EXPECT_THROW(PersonTable::bulkLoad(TEST_DIR + "/loaded", 4096, more), std::runtime_error);
+}
+
+// Test: A bulk load larger than its memory spills records to partition files, which are gone afterwards
+TEST_F(ExtensibleHashingTest, BulkLoadSpillsToPartitions) {
+    constexpr int ENTRIES = 20000;
+    std::stringstream records;
+    for (int i = 0; i < ENTRIES; ++i) {
+        writeDelimitedRecord(records, createTestMessage(i)->SerializeAsString());
+    }
+    writeDelimitedRecord(records, createTestMessage(7)->SerializeAsString());
+
+    Options options;
+    options.bulkLoadMemoryBytes = 64 << 10;
+    options.storageMode = StorageMode::Segment;
+    auto loaded = ExtensibleHashing<TestMessage>::bulkLoad(TEST_DIR, 4096, records, options);
+    EXPECT_FALSE(std::filesystem::exists(TEST_DIR + "/bulk_load"));
+    EXPECT_GE(loaded->getGlobalDepth(), 8);
+    for (int i = 0; i < ENTRIES; ++i) {
+        ASSERT_TRUE(loaded->get(createTestMessage(i)->SerializeAsString()).has_value()) << i;
+    }
+    const auto &entries = loaded->getEntries(loaded->hashKey(createTestMessage(7)->SerializeAsString()));
+    EXPECT_EQ(std::count_if(entries.begin(), entries.end(), [](const auto &entry) { return entry->id() == 7; }), 1);
+}
+
+// Test: Records whose keys collide are loaded into one bucket with overflow pages; truncated input is refused
+TEST_F(ExtensibleHashingTest, BulkLoadCollidingKeys) {
+    std::stringstream records;
+    for (int i = 0; i < 400; ++i) {
+        writeDelimitedRecord(records, createPerson(i, "person")->SerializeAsString());
+    }
+
+    {
+        auto loaded = SkewedTable::bulkLoad(TEST_DIR, 1024, records);
+        EXPECT_EQ(loaded->getGlobalDepth(), 0);
+        EXPECT_EQ(loaded->bucketCount(), 1);
+        EXPECT_GT(loaded->overflowStats().overflowPages, 0);
+        for (int i = 0; i < 400; ++i) {
+            ASSERT_TRUE(loaded->get({i}).has_value()) << i;
+        }
+    }
+
+    std::filesystem::remove_all(TEST_DIR);
+    std::stringstream truncated;
+    writeDelimitedRecord(truncated, createPerson(1, "person")->SerializeAsString());
+    truncated << '\x20' << "short";
+    EXPECT_THROW(SkewedTable::bulkLoad(TEST_DIR, 1024, truncated), std::runtime_error);
+
+    // A five-byte length may only carry 32 bits
+    std::string record;
+    std::stringstream wide("\xff\xff\xff\xff\x1f");
+    EXPECT_THROW(readDelimitedRecord(wide, record), std::runtime_error);
+    std::stringstream empty;
+    writeDelimitedRecord(empty, std::string());
+    EXPECT_TRUE(readDelimitedRecord(empty, record));
+    EXPECT_TRUE(record.empty());
+}
+
+// Test: A page changed on disk is reported by its checksum, both when a lookup reads it and offline
+TEST_F(ExtensibleHashingTest, CorruptedPageFailsChecksum) {
+    PageId corruptedPage;
+    {
+        PersonTable hashTable(TEST_DIR, 1024, 1);
+        for (int i = 1; i <= 2000; ++i) {
+            hashTable.addEntry(createPerson(i, "person"));
+        }
+        size_t mask = (size_t{1} << hashTable.getGlobalDepth()) - 1;
+        hashTable.flush();
+        DirectoryMeta meta = readDirectoryMeta(directoryMetaPath(TEST_DIR)).value();
+        corruptedPage = meta.buckets[meta.directory[hashTable.hashKey(42) & mask]].pageId;
+    }
+    EXPECT_TRUE(findCorruptedPages(TEST_DIR).empty());
+
+    // Flip a bit of the record at the end of the page
+    std::string path = BucketFileStore(TEST_DIR, 1).pagePath(corruptedPage);
+    std::fstream file(path, std::ios::in | std::ios::out | std::ios::binary);
+    file.seekg(-1, std::ios::end);
+    char last = file.get();
+    file.seekp(-1, std::ios::end);
+    file.put(last ^ 0x01);
+    file.close();
+
+    auto corrupted = findCorruptedPages(TEST_DIR);
+    ASSERT_EQ(corrupted.size(), 1);
+    EXPECT_EQ(corrupted[0].pageId, corruptedPage);
+    EXPECT_EQ(corrupted[0].chainIndex, 0);
+
+    for (ReadMode readMode : {ReadMode::Buffered, ReadMode::Mmap}) {
+        Options options;
+        options.readMode = readMode;
+        auto reopened = PersonTable::open(TEST_DIR, options);
+        try {
+            reopened->get(42);
+            ADD_FAILURE() << "Corrupted page was read";
+        } catch (const std::runtime_error &error) {
+            EXPECT_NE(std::string(error.what()).find("Checksum mismatch"), std::string::npos) << error.what();
+        }
+    }
+}
+
+// Test: A table with compressed pages writes fewer bytes than its pages hold, and keeps its codec when reopened
+TEST_F(ExtensibleHashingTest, CompressedPages) {
+    for (StorageMode storageMode : {StorageMode::BucketFiles, StorageMode::Segment}) {
+        std::filesystem::remove_all(TEST_DIR);
+        std::filesystem::create_directory(TEST_DIR);
+        Options options;
+        options.storageMode = storageMode;
+        options.pageCompression = PageCompression::Lz;
+        {
+            PersonTable hashTable(TEST_DIR, 4096, 1, options);
+            for (int i = 1; i <= 2000; ++i) {
+                hashTable.addEntry(createPerson(i, "person@example.com"));
+            }
+            hashTable.removeEntry(7);
+            hashTable.flush();
+            EXPECT_GT(hashTable.compressionStats().ratio(), 1.5);
+        }
+
+        auto reopened = PersonTable::open(TEST_DIR);
+        for (int i = 1; i <= 2000; ++i) {
+            EXPECT_EQ(reopened->get(i).has_value(), i != 7) << i;
+        }
+        EXPECT_GT(reopened->compressionStats().pagesRead, 0);
+        EXPECT_TRUE(findCorruptedPages(TEST_DIR).empty());
+        reopened.reset();
+
+        options.pageCompression = PageCompression::None;
+        EXPECT_THROW(PersonTable(TEST_DIR, 4096, 1, options), std::runtime_error);
+    }
+}
+
+// Test: A compressed frame that cannot be decompressed is reported by the verifier, which checks the other pages
+TEST_F(ExtensibleHashingTest, VerifierReportsCorruptedCompressedFrame) {
+    Options options;
+    options.pageCompression = PageCompression::Lz;
+    {
+        PersonTable hashTable(TEST_DIR, 4096, 1, options);
+        for (int i = 1; i <= 2000; ++i) {
+            hashTable.addEntry(createPerson(i, "person@example.com"));
+        }
+    }
+    DirectoryMeta meta = readDirectoryMeta(directoryMetaPath(TEST_DIR)).value();
+    ASSERT_GT(meta.buckets.size(), 1);
+    PageId corruptedPage = meta.buckets[0].pageId;
+
+    // Claim a frame longer than the page after the checksum
+    std::fstream file(BucketFileStore(TEST_DIR, 1).pagePath(corruptedPage),
+                      std::ios::in | std::ios::out | std::ios::binary);
+    uint32_t storedSize = UINT32_MAX;
+    file.seekp(PAGE_CHECKSUM_SIZE);
+    file.write(reinterpret_cast<const char *>(&storedSize), sizeof(storedSize));
+    file.close();
+
+    auto corrupted = findCorruptedPages(TEST_DIR);
+    ASSERT_EQ(corrupted.size(), 1);
+    EXPECT_EQ(corrupted[0].pageId, corruptedPage);
+    EXPECT_NE(corrupted[0].reason.find("Corrupted compressed page"), std::string::npos) << corrupted[0].reason;
+}
+
+// Test: A scan visits every bucket once in page order, reading reopened buckets ahead within the memory budget
+TEST_F(ExtensibleHashingTest, ScanVisitsEveryEntryOnce) {
+    constexpr size_t BUDGET = 32 << 10;
+    constexpr int COUNT = 5000;
+    Options options;
+    options.storageMode = StorageMode::Segment;
+    {
+        PersonTable hashTable(TEST_DIR, 1024, 1, options);
+        for (int i = 1; i <= COUNT; ++i) {
+            hashTable.addEntry(createPerson(i, "person " + std::to_string(i)));
+        }
+    }
+
+    options.memoryBudgetBytes = BUDGET;
+    auto reopened = PersonTable::open(TEST_DIR, options);
+    reopened->get(1); // Loaded before the scan, so it stays loaded
+    std::vector<int> seen(COUNT + 1);
+    size_t buckets = 0;
+    {
+        auto scan = reopened->scan(4);
+        while (const auto *entries = scan.next()) {
+            buckets++;
+            for (const auto &entry : *entries) {
+                seen[entry->id()]++;
+            }
+        }
+        EXPECT_EQ(scan.next(), nullptr);
+    }
+    EXPECT_EQ(buckets, reopened->bucketCount());
+    for (int i = 1; i <= COUNT; ++i) {
+        EXPECT_EQ(seen[i], 1) << i;
+    }
+    EXPECT_LT(reopened->bucketCacheStats().residentBytes, 2 * BUDGET);
+    EXPECT_TRUE(reopened->get(1).has_value());
+
+    // Overflow pages are visited with their bucket
+    std::filesystem::remove_all(TEST_DIR);
+    std::filesystem::create_directory(TEST_DIR);
+    SkewedTable skewed(TEST_DIR, 1024, 1);
+    for (int i = 0; i < 400; ++i) {
+        skewed.addEntry(createPerson(i, "person"));
+    }
+    ASSERT_GT(skewed.overflowStats().overflowPages, 0);
+    size_t entries = 0;
+    auto scan = skewed.scan();
+    while (const auto *bucket = scan.next()) {
+        entries += bucket->size();
+    }
+    EXPECT_EQ(entries, 400);
+}
+
+// Test: Splits and merges go on while a scan is open, and the scan still visits every entry that stays once
+TEST_F(ExtensibleHashingTest, ScanRunsAlongsideSplitsAndMerges) {
+    constexpr int KEPT = 500;
+    constexpr int CHURN = 5000;
+    PersonTable hashTable(TEST_DIR, 1024, 1);
+    for (int i = 1; i <= KEPT; ++i) {
+        hashTable.addEntry(createPerson(i, "person " + std::to_string(i)));
+    }
+
+    // Fill the table with other entries and empty it again until the scan is done, counting the splits and
+    // merges the writer sees. Going through the entries by their hash bits from the lowest up fills and empties
+    // one bucket after the other, so the table splits and merges all along
+    auto reversedBits = [&](int id) {
+        size_t hash = hashTable.hashKey(id);
+        size_t reversed = 0;
+        for (int bit = 0; bit < 16; ++bit) {
+            reversed = (reversed << 1) | ((hash >> bit) & 1);
+        }
+        return reversed;
+    };
+    std::vector<int> churn(CHURN);
+    std::iota(churn.begin(), churn.end(), KEPT + 1);
+    std::sort(churn.begin(), churn.end(), [&](int a, int b) { return reversedBits(a) < reversedBits(b); });
+    std::atomic<bool> filled{false};
+    std::atomic<bool> scanned{false};
+    std::atomic<size_t> changes{0};
+    std::thread writer([&] {
+        size_t buckets = hashTable.bucketCount();
+        auto countChange = [&] {
+            size_t now = hashTable.bucketCount();
+            if (now != buckets) {
+                changes++;
+                buckets = now;
+            }
+        };
+        while (!scanned.load()) {
+            for (int id : churn) {
+                hashTable.addEntry(createPerson(id, "churn"));
+                countChange();
+            }
+            filled = true;
+            for (int id : churn) {
+                hashTable.removeEntry(id);
+                countChange();
+            }
+        }
+    });
+
+    while (!filled.load()) {
+        std::this_thread::yield();
+    }
+
+    // Give the writer time to change the table at every step, unless it waits for the buckets the step holds
+    std::vector<int> seen(KEPT + 1);
+    size_t changesDuring = 0;
+    {
+        auto scan = hashTable.scan(2);
+        while (const auto *entries = scan.next()) {
+            for (const Person *entry : *entries) {
+                if (entry->id() <= KEPT) {
+                    seen[entry->id()]++;
+                }
+            }
+            size_t before = changes.load();
+            for (int wait = 0; wait < 100 && changes.load() == before; ++wait) {
+                std::this_thread::sleep_for(std::chrono::microseconds(100));
+            }
+            changesDuring += changes.load() - before;
+        }
+    }
+    scanned = true;
+    writer.join();
+
+    EXPECT_GT(changesDuring, 0);
+    for (int i = 1; i <= KEPT; ++i) {
+        EXPECT_EQ(seen[i], 1) << i;
+    }
+}
+
+// Test: Stats count splits, doublings, merges and writes, time operations and describe the buckets
+TEST_F(ExtensibleHashingTest, StatsDescribeTableActivity) {
+    Options options;
+    options.recordLatencies = true;
+    PersonTable hashTable(TEST_DIR, 1024, 1, options);
+    for (int i = 1; i <= 2000; ++i) {
+        hashTable.addEntry(createPerson(i, "person " + std::to_string(i)));
+    }
+    for (int i = 1; i <= 2000; ++i) {
+        ASSERT_TRUE(hashTable.get(i).has_value());
+    }
+    hashTable.flush();
+
+    TableStats stats = hashTable.stats();
+    EXPECT_EQ(stats.splits, hashTable.bucketCount() - 2);
+    EXPECT_EQ(stats.directoryDoublings, hashTable.getGlobalDepth() - 1);
+    EXPECT_EQ(stats.merges, 0);
+    EXPECT_GT(stats.bytesWritten, 0);
+    EXPECT_GT(stats.filesOpened, 0);
+    EXPECT_EQ(stats.insertLatency.count, 2000);
+    EXPECT_EQ(stats.lookupLatency.count, 2000);
+    EXPECT_LE(stats.insertLatency.quantileNanos(0.5), stats.insertLatency.quantileNanos(0.99));
+    EXPECT_EQ(stats.loadedBuckets, hashTable.bucketCount());
+    EXPECT_GT(stats.meanFillFactor, 0.3);
+    EXPECT_LT(stats.meanFillFactor, 1.0);
+    size_t filled = 0;
+    for (size_t buckets : stats.fillFactor) {
+        filled += buckets;
+    }
+    EXPECT_EQ(filled, stats.loadedBuckets);
+    ASSERT_EQ(stats.overflowDepth.size(), 1);
+    EXPECT_EQ(stats.overflowDepth[0], hashTable.bucketCount());
+
+    for (int i = 1; i <= 2000; ++i) {
+        ASSERT_TRUE(hashTable.removeEntry(i));
+    }
+    stats = hashTable.stats();
+    EXPECT_GT(stats.merges, 0);
+    EXPECT_GT(stats.directoryHalvings, 0);
+    EXPECT_EQ(stats.removeLatency.count, 2000);
+
+    // Without recordLatencies nothing is timed
+    std::filesystem::remove_all(TEST_DIR);
+    std::filesystem::create_directory(TEST_DIR);
+    PersonTable untimed(TEST_DIR, 1024, 1);
+    untimed.addEntry(createPerson(1, "person"));
+    EXPECT_EQ(untimed.stats().insertLatency.count, 0);
+}
+
 int main(int argc, char **argv) {
     testing::InitGoogleTest(&argc, argv);
     return RUN_ALL_TESTS();
@@ -0,0 +1,85 @@
+#include "ehash/Fingerprint.hpp"
+#include "gtest/gtest.h"
+#include <atomic>
+#include <set>
+#include <vector>
+
+namespace ehash {
+
+// Indexes of all matching fingerprints, found one by one
+std::vector<size_t> scalarMatches(const std::vector<uint8_t> &fingerprints, uint8_t fingerprint) {
+    std::vector<size_t> matches;
+    for (size_t i = 0; i < fingerprints.size(); ++i) {
+        if (fingerprints[i] == fingerprint) {
+            matches.push_back(i);
+        }
+    }
+    return matches;
+}
+
+// Test: Probing visits the same positions as a scalar scan for every vector width and tail length
+TEST(FingerprintTest, ProbeMatchesScalarScan) {
+    for (size_t count : {0, 1, 15, 16, 17, 31, 32, 33, 100}) {
+        std::vector<uint8_t> fingerprints(count);
+        for (size_t i = 0; i < count; ++i) {
+            fingerprints[i] = static_cast<uint8_t>(i % 7 == 0 ? 0xAB : i);
+        }
+
+        std::vector<size_t> visited;
+        size_t result = probeFingerprints(fingerprints.data(), count, 0xAB, [&](size_t i) {
+            visited.push_back(i);
+            return false;
+        });
+
+        EXPECT_EQ(result, count);
+        EXPECT_EQ(visited, scalarMatches(fingerprints, 0xAB)) << "count " << count;
+    }
+}
+
+// Test: Probing stops at the first position the visitor accepts
+TEST(FingerprintTest, ProbeStopsWhenAccepted) {
+    std::vector<uint8_t> fingerprints(70, 0x11);
+
+    size_t visits = 0;
+    size_t result = probeFingerprints(fingerprints.data(), fingerprints.size(), 0x11, [&](size_t i) {
+        ++visits;
+        return i == 40;
+    });
+
+    EXPECT_EQ(result, 40);
+    EXPECT_EQ(visits, 41);
+}
+
+// Test: Hashes that differ only in their low bits still get different fingerprints
+TEST(FingerprintTest, FingerprintUsesLowBits) {
+    std::set<uint8_t> fingerprints;
+    for (size_t hash = 0; hash < 256; ++hash) {
+        fingerprints.insert(fingerprintOf(hash));
+    }
+    EXPECT_GT(fingerprints.size(), 128);
+}
+
+// Test: Probing packed fingerprints visits the same positions as a scalar scan, including tails within a word
+TEST(FingerprintTest, PackedProbeMatchesScalarScan) {
+    for (size_t count : {0, 1, 7, 8, 9, 33, 100}) {
+        std::vector<uint8_t> fingerprints(count);
+        std::vector<std::atomic<uint64_t>> words((count + 7) / 8);
+        for (size_t i = 0; i < count; ++i) {
+            // Neighbours of a match differ from it by one bit, which a sloppy zero-byte test reports too
+            fingerprints[i] = static_cast<uint8_t>(i % 5 == 0 ? 0xAB : 0xAA ^ (i % 2));
+            storePackedFingerprint(words.data(), i, fingerprints[i]);
+        }
+
+        std::vector<size_t> visited;
+        size_t result = probePackedFingerprints(words.data(), count, 0xAB, [&](size_t i) {
+            EXPECT_EQ(packedFingerprint(words.data(), i), 0xAB);
+            visited.push_back(i);
+            return false;
+        });
+
+        EXPECT_EQ(result, count);
+        EXPECT_EQ(visited, scalarMatches(fingerprints, 0xAB)) << "count " << count;
+    }
+}
+
+} // namespace ehash
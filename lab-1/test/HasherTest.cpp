@@ -0,0 +1,80 @@
+#include "ehash/Hasher.hpp"
+#include "gtest/gtest.h"
+#include <algorithm>
+#include <cstring>
+#include <string>
+#include <vector>
+
+namespace ehash {
+
+// Largest number of keys that fall into one of 256 slots picked by the low eight bits of their hash
+template <typename Hasher, typename Key> size_t fullestLowByteSlot(const std::vector<Key> &keys) {
+    std::vector<size_t> slots(256);
+    for (const auto &key : keys) {
+        slots[Hasher{}(key) & 0xFF]++;
+    }
+    return *std::max_element(slots.begin(), slots.end());
+}
+
+// Test: XXH64 matches the reference implementation, across the stripe loop and every tail length
+TEST(HasherTest, Xxh64MatchesReference) {
+    EXPECT_EQ(xxh64("", 0), 0xEF46DB3751D8E999ULL);
+    EXPECT_EQ(xxh64("a", 1), 0xD24EC4F1A98C6E5BULL);
+    EXPECT_EQ(xxh64("abc", 3), 0x44BC2CF5AD770999ULL);
+    const char *sentence = "Nobody inspects the spammish repetition";
+    EXPECT_EQ(xxh64(sentence, std::strlen(sentence)), 0xFBCEA83C8A378BF1ULL);
+}
+
+// Test: wyhash matches the test vectors of its reference implementation, which seed each one with its index
+TEST(HasherTest, WyhashMatchesReference) {
+    EXPECT_EQ(wyhash("", 0, 0), 0x93228A4DE0EEC5A2ULL);
+    EXPECT_EQ(wyhash("a", 1, 1), 0xC5BAC3DB178713C4ULL);
+    EXPECT_EQ(wyhash("abc", 3, 2), 0xA97F2F7B1D9B3314ULL);
+}
+
+// Test: Hashing a word inline gives the same hash as hashing its bytes
+TEST(HasherTest, Xxh64WordMatchesBytes) {
+    for (uint64_t value : {0ULL, 1ULL, 12345ULL, ~0ULL}) {
+        EXPECT_EQ(xxh64Word(value), xxh64(&value, sizeof(value))) << value;
+        EXPECT_EQ(Xxh64Hasher{}(value), xxh64(&value, sizeof(value))) << value;
+    }
+}
+
+// Test: Strings hash the same whether passed as std::string or std::string_view, for every length up to
+// past wyhash's 48-byte loop
+TEST(HasherTest, StringAndViewHashAlike) {
+    std::string key;
+    for (size_t length = 0; length <= 100; ++length) {
+        EXPECT_EQ(WyHasher{}(key), WyHasher{}(std::string_view(key))) << length;
+        EXPECT_EQ(Xxh64Hasher{}(key), Xxh64Hasher{}(std::string_view(key))) << length;
+        EXPECT_EQ(WyHasher{}(key), wyhash(key.data(), key.size())) << length;
+        key.push_back(static_cast<char>('a' + length % 26));
+    }
+}
+
+// Test: Integer keys that share their low bits still spread over the low bits of their hash, which std::hash
+// leaves unmixed
+TEST(HasherTest, IntegersSharingLowBitsSpread) {
+    std::vector<int> keys;
+    for (int i = 0; i < 25600; ++i) {
+        keys.push_back(i * 1024);
+    }
+
+    EXPECT_EQ(fullestLowByteSlot<StdHasher>(keys), keys.size());
+    // 100 keys per slot on average
+    EXPECT_LT(fullestLowByteSlot<WyHasher>(keys), 150u);
+    EXPECT_LT(fullestLowByteSlot<Xxh64Hasher>(keys), 150u);
+}
+
+// Test: Strings that differ only in their last byte spread over the low bits of their hash
+TEST(HasherTest, StringsDifferingInOneByteSpread) {
+    std::vector<std::string> keys;
+    for (int i = 0; i < 25600; ++i) {
+        keys.push_back("key-prefix-shared-by-every-entry-" + std::to_string(i));
+    }
+
+    EXPECT_LT(fullestLowByteSlot<WyHasher>(keys), 150u);
+    EXPECT_LT(fullestLowByteSlot<Xxh64Hasher>(keys), 150u);
+}
+
+} // namespace ehash
@@ -0,0 +1,116 @@
+#include "ehash/IoQueue.hpp"
+#include "gtest/gtest.h"
+#include <cerrno>
+#include <cstdio>
+#include <fcntl.h>
+#include <future>
+#include <stdexcept>
+#include <string>
+#include <unistd.h>
+#include <vector>
+
+namespace ehash {
+
+// Opens a scratch file for reading and writing and removes it again
+class ScratchFile {
+  public:
+    int fd;
+
+    ScratchFile() {
+        char path[] = "/tmp/ioqueue_test_XXXXXX";
+        fd = ::mkstemp(path);
+        ::unlink(path);
+    }
+
+    ~ScratchFile() { ::close(fd); }
+};
+
+class IoQueueTest : public ::testing::TestWithParam<IoBackend> {
+  protected:
+    std::unique_ptr<IoQueue> makeQueue() {
+        try {
+            return makeIoQueue(GetParam(), 4);
+        } catch (const std::runtime_error &) {
+            return nullptr;
+        }
+    }
+};
+
+// Test: Many writes in flight at once land at their offsets and read back unchanged
+TEST_P(IoQueueTest, WritesReadBack) {
+    auto queue = makeQueue();
+    if (!queue) {
+        GTEST_SKIP() << "io_uring is not available";
+    }
+    ScratchFile file;
+    ASSERT_GE(file.fd, 0);
+
+    constexpr size_t PAGE = 4096;
+    constexpr size_t PAGES = 32;
+    std::vector<std::vector<char>> pages;
+    IoBatch writes;
+    for (size_t i = 0; i < PAGES; i++) {
+        pages.emplace_back(PAGE, static_cast<char>('a' + i % 26));
+    }
+    for (size_t i = 0; i < PAGES; i++) {
+        queue->write(file.fd, pages[i].data(), PAGE, i * PAGE, writes.add(PAGE));
+    }
+    writes.wait("write pages");
+
+    std::vector<std::vector<char>> read(PAGES, std::vector<char>(PAGE));
+    IoBatch reads;
+    for (size_t i = 0; i < PAGES; i++) {
+        queue->read(file.fd, read[i].data(), PAGE, i * PAGE, reads.add(PAGE));
+    }
+    reads.wait("read pages");
+    EXPECT_EQ(read, pages);
+}
+
+// Test: A read past the end of the file returns the bytes up to the end
+TEST_P(IoQueueTest, ShortReadAtEndOfFile) {
+    auto queue = makeQueue();
+    if (!queue) {
+        GTEST_SKIP() << "io_uring is not available";
+    }
+    ScratchFile file;
+    ASSERT_EQ(::write(file.fd, "hello", 5), 5);
+
+    std::vector<char> data(4096);
+    std::promise<ssize_t> result;
+    queue->read(file.fd, data.data(), data.size(), 0,
+                [&result](ssize_t transferred) { result.set_value(transferred); });
+    EXPECT_EQ(result.get_future().get(), 5);
+    EXPECT_EQ(std::string(data.data(), 5), "hello");
+}
+
+// Test: A failed operation reports -errno, and a batch containing it throws
+TEST_P(IoQueueTest, FailuresReachTheBatch) {
+    auto queue = makeQueue();
+    if (!queue) {
+        GTEST_SKIP() << "io_uring is not available";
+    }
+    std::vector<char> data(512);
+    std::promise<ssize_t> result;
+    queue->read(-1, data.data(), data.size(), 0, [&result](ssize_t transferred) { result.set_value(transferred); });
+    EXPECT_EQ(result.get_future().get(), -EBADF);
+
+    ScratchFile file;
+    IoBatch batch;
+    queue->write(file.fd, data.data(), data.size(), 0, batch.add(data.size()));
+    queue->read(file.fd, data.data(), data.size(), 4096, batch.add(data.size())); // Past the end: short
+    EXPECT_THROW(batch.wait("read pages"), std::runtime_error);
+}
+
+INSTANTIATE_TEST_SUITE_P(Backends, IoQueueTest, ::testing::Values(IoBackend::IoUring, IoBackend::ThreadPool),
+                         [](const auto &info) {
+                             return std::string(info.param == IoBackend::IoUring ? "IoUring" : "ThreadPool");
+                         });
+
+// Test: Auto picks a backend that works
+TEST(IoQueueBackendTest, AutoPicksAWorkingBackend) {
+    auto queue = makeIoQueue(IoBackend::Auto, 8);
+    ASSERT_NE(queue, nullptr);
+    EXPECT_TRUE(std::string(queue->backend()) == "io_uring" || std::string(queue->backend()) == "thread pool");
+}
+
+} // namespace ehash
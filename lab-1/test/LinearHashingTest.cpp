@@ -0,0 +1,320 @@
+#include "ehash/LinearHashing.hpp"
+#include "ehash/ExtensibleHashing.hpp"
+#include "AddressBook.pb.h"
+#include "TestMessage.pb.h"
+#include "gtest/gtest.h"
+#include <algorithm>
+#include <filesystem>
+#include <memory>
+#include <thread>
+
+namespace ehash {
+
+using namespace ehash::proto;
+
+// Temporary test directory for buckets
+const std::string TEST_DIR = "linear_test_buckets";
+
+class LinearHashingTest : public ::testing::Test {
+  protected:
+    void SetUp() override {
+        std::filesystem::remove_all(TEST_DIR);
+        std::filesystem::create_directory(TEST_DIR);
+    }
+
+    void TearDown() override { std::filesystem::remove_all(TEST_DIR); }
+};
+
+std::unique_ptr<TestMessage> createTestMessage(int id) {
+    auto message = std::make_unique<TestMessage>();
+    message->set_id(id);
+    return message;
+}
+
+std::unique_ptr<Person> createPerson(int id, const std::string &name) {
+    auto person = std::make_unique<Person>();
+    person->set_id(id);
+    person->set_name(name);
+    return person;
+}
+
+using PersonTable = LinearHashing<Person, FieldKey<Person, &Person::id>, WyHasher>;
+
+// Person id that hashes to 0, so that every key collides
+struct CollidingId {
+    int id;
+
+    bool operator==(const CollidingId &other) const { return id == other.id; }
+};
+
+struct CollidingIdKey {
+    using KeyType = CollidingId;
+
+    KeyType operator()(const Person &entry) const { return {entry.id()}; }
+};
+
+struct ZeroHasher {
+    size_t operator()(const CollidingId &) const { return 0; }
+};
+
+using CollidingTable = LinearHashing<Person, CollidingIdKey, ZeroHasher>;
+
+// Test: Entries added one at a time are found by hash and by key
+TEST_F(LinearHashingTest, AddAndRetrieveEntries) {
+    LinearHashing<TestMessage> hashTable(TEST_DIR, 1024, 2);
+    EXPECT_EQ(hashTable.bucketCount(), 4);
+
+    size_t hashValue = hashTable.addEntry(createTestMessage(1));
+    hashTable.addEntry(createTestMessage(2));
+
+    const auto &entries = hashTable.getEntries(hashValue);
+    EXPECT_EQ(std::count_if(entries.begin(), entries.end(), [](const auto &entry) { return entry->id() == 1; }), 1);
+    EXPECT_EQ(hashTable.getEntry(hashValue).value()->id(), 1);
+    EXPECT_EQ(hashTable.get(createTestMessage(2)->SerializeAsString()).value()->id(), 2);
+    EXPECT_FALSE(hashTable.get(createTestMessage(3)->SerializeAsString()).has_value());
+}
+
+// Test: The table grows one bucket per split, in address order, and raises the level after a full round
+TEST_F(LinearHashingTest, SplitsRoundRobin) {
+    PersonTable hashTable(TEST_DIR, 1024, 1);
+    EXPECT_EQ(hashTable.getLevel(), 1);
+    EXPECT_EQ(hashTable.getSplitPointer(), 0);
+
+    size_t buckets = hashTable.bucketCount();
+    int id = 0;
+    while (hashTable.bucketCount() == buckets) {
+        hashTable.addEntry(createPerson(id++, "person"));
+    }
+    EXPECT_EQ(hashTable.bucketCount(), 3);
+    EXPECT_EQ(hashTable.getSplitPointer(), 1);
+    EXPECT_EQ(hashTable.getGlobalDepth(), 2);
+
+    for (; id < 5000; ++id) {
+        hashTable.addEntry(createPerson(id, "person"));
+    }
+    size_t level = hashTable.getLevel();
+    EXPECT_EQ(hashTable.bucketCount(), (size_t{1} << level) + hashTable.getSplitPointer());
+    EXPECT_GT(level, 2);
+    for (int i = 0; i < 5000; ++i) {
+        const auto entry = hashTable.get(i);
+        ASSERT_TRUE(entry.has_value()) << i;
+        EXPECT_EQ(entry.value()->id(), i);
+    }
+}
+
+// Test: Adding an entry with a key that is already present replaces it, before and after splits
+TEST_F(LinearHashingTest, UpdateDuplicateKey) {
+    PersonTable hashTable(TEST_DIR, 1024, 1);
+    for (int i = 0; i < 500; ++i) {
+        hashTable.addEntry(createPerson(i, "old"));
+    }
+    for (int i = 0; i < 500; ++i) {
+        hashTable.addEntry(createPerson(i, "a much longer name than before"));
+    }
+    for (int i = 0; i < 500; ++i) {
+        const auto entry = hashTable.get(i);
+        ASSERT_TRUE(entry.has_value()) << i;
+        EXPECT_EQ(entry.value()->name(), "a much longer name than before");
+        const auto &entries = hashTable.getEntries(hashTable.hashKey(i));
+        EXPECT_EQ(std::count_if(entries.begin(), entries.end(), [i](const auto &entry) { return entry->id() == i; }),
+                  1);
+    }
+}
+
+// Test: A batch places the same entries as single adds, the last one winning for a repeated key
+TEST_F(LinearHashingTest, AddEntriesBatch) {
+    PersonTable hashTable(TEST_DIR, 1024, 1);
+    std::vector<std::unique_ptr<Person>> batch;
+    for (int i = 0; i < 2000; ++i) {
+        batch.push_back(createPerson(i, "first"));
+    }
+    batch.push_back(createPerson(7, "second"));
+    std::vector<size_t> hashes = hashTable.addEntries(std::move(batch));
+
+    ASSERT_EQ(hashes.size(), 2001);
+    EXPECT_EQ(hashes[7], hashTable.hashKey(7));
+    EXPECT_GT(hashTable.bucketCount(), 2);
+    for (int i = 0; i < 2000; ++i) {
+        ASSERT_TRUE(hashTable.get(i).has_value()) << i;
+    }
+    EXPECT_EQ(hashTable.get(7).value()->name(), "second");
+
+    std::vector<std::unique_ptr<Person>> oversized;
+    oversized.push_back(createPerson(1, std::string(2 * 4096, 'x')));
+    EXPECT_THROW(hashTable.addEntries(std::move(oversized)), std::runtime_error);
+}
+
+// Test: Removed entries are gone and the others stay
+TEST_F(LinearHashingTest, RemoveEntry) {
+    PersonTable hashTable(TEST_DIR, 1024, 1);
+    for (int i = 0; i < 1000; ++i) {
+        hashTable.addEntry(createPerson(i, "person"));
+    }
+    for (int i = 0; i < 1000; i += 2) {
+        EXPECT_TRUE(hashTable.removeEntry(i));
+    }
+    EXPECT_FALSE(hashTable.removeEntry(0));
+    for (int i = 0; i < 1000; ++i) {
+        EXPECT_EQ(hashTable.get(i).has_value(), i % 2 == 1) << i;
+    }
+}
+
+// Test: Reopening a table restores its level, split pointer and entries, in either storage mode
+TEST_F(LinearHashingTest, ReopenRestoresTable) {
+    for (StorageMode mode : {StorageMode::BucketFiles, StorageMode::Segment}) {
+        std::filesystem::remove_all(TEST_DIR);
+        std::filesystem::create_directory(TEST_DIR);
+        Options options;
+        options.storageMode = mode;
+
+        size_t buckets;
+        size_t splitPointer;
+        {
+            PersonTable hashTable(TEST_DIR, 1024, 1, options);
+            for (int i = 0; i < 3000; ++i) {
+                hashTable.addEntry(createPerson(i, "person"));
+            }
+            buckets = hashTable.bucketCount();
+            splitPointer = hashTable.getSplitPointer();
+        }
+
+        auto reopened = PersonTable::open(TEST_DIR);
+        EXPECT_EQ(reopened->bucketCount(), buckets);
+        EXPECT_EQ(reopened->getSplitPointer(), splitPointer);
+        for (int i = 0; i < 3000; ++i) {
+            ASSERT_TRUE(reopened->get(i).has_value()) << i;
+        }
+        reopened->addEntry(createPerson(3000, "person"));
+        EXPECT_TRUE(reopened->get(3000).has_value());
+    }
+    EXPECT_THROW(PersonTable::open("missing_linear_table"), std::runtime_error);
+}
+
+// Test: A linear hash table is saved as an extendible hash directory, which ExtensibleHashing opens; an
+// extendible hash table whose buckets split unevenly is not opened as a linear one
+TEST_F(LinearHashingTest, SharesDirectoryFormatWithExtensibleHashing) {
+    using ExtensiblePersonTable = ExtensibleHashing<Person, FieldKey<Person, &Person::id>, WyHasher>;
+    {
+        PersonTable hashTable(TEST_DIR, 1024, 1);
+        for (int i = 0; i < 2000; ++i) {
+            hashTable.addEntry(createPerson(i, "linear"));
+        }
+        ASSERT_NE(hashTable.getSplitPointer(), 0);
+    }
+    {
+        auto extensible = ExtensiblePersonTable::open(TEST_DIR);
+        for (int i = 0; i < 2000; ++i) {
+            const auto entry = extensible->get(i);
+            ASSERT_TRUE(entry.has_value()) << i;
+            EXPECT_EQ(entry.value()->name(), "linear");
+        }
+    }
+
+    std::filesystem::remove_all(TEST_DIR);
+    std::filesystem::create_directory(TEST_DIR);
+    {
+        ExtensiblePersonTable extensible(TEST_DIR, 1024, 2);
+        for (int i = 0; i < 1500; ++i) {
+            extensible.addEntry(createPerson(i, "extensible"));
+        }
+        ASSERT_GT(extensible.bucketCount(), 4);
+    }
+    EXPECT_THROW(PersonTable::open(TEST_DIR), std::runtime_error);
+}
+
+// Test: Keys that all collide stay in one bucket on overflow pages, which removing them gives back
+TEST_F(LinearHashingTest, CollidingKeysGrowOverflowPages) {
+    CollidingTable hashTable(TEST_DIR, 1024, 1);
+    for (int i = 0; i < 1000; ++i) {
+        hashTable.addEntry(createPerson(i, "person"));
+    }
+
+    OverflowStats stats = hashTable.overflowStats();
+    EXPECT_EQ(stats.overflowBuckets, 1);
+    EXPECT_GT(stats.overflowPages, 0);
+    EXPECT_EQ(stats.buckets, hashTable.bucketCount());
+    for (int i = 0; i < 1000; ++i) {
+        ASSERT_TRUE(hashTable.get({i}).has_value()) << i;
+    }
+
+    for (int i = 0; i < 1000; ++i) {
+        ASSERT_TRUE(hashTable.removeEntry({i}));
+    }
+    EXPECT_EQ(hashTable.overflowStats().overflowPages, 0);
+}
+
+// Test: Writers adding single entries and batches while readers look them up
+TEST_F(LinearHashingTest, ConcurrentAddsAndLookups) {
+    constexpr int WRITERS = 4;
+    constexpr int ENTRIES_PER_WRITER = 500;
+    {
+        PersonTable hashTable(TEST_DIR, 1024, 1);
+
+        std::vector<std::thread> threads;
+        for (int writer = 0; writer < WRITERS; ++writer) {
+            threads.emplace_back([&hashTable, writer] {
+                int firstId = writer * ENTRIES_PER_WRITER;
+                for (int i = 0; i < ENTRIES_PER_WRITER / 2; ++i) {
+                    hashTable.addEntry(createPerson(firstId + i, "single"));
+                }
+                std::vector<std::unique_ptr<Person>> batch;
+                for (int i = ENTRIES_PER_WRITER / 2; i < ENTRIES_PER_WRITER; ++i) {
+                    batch.push_back(createPerson(firstId + i, "batch"));
+                }
+                hashTable.addEntries(std::move(batch));
+            });
+        }
+        for (int reader = 0; reader < 2; ++reader) {
+            threads.emplace_back([&hashTable] {
+                for (int round = 0; round < 5; ++round) {
+                    for (int id = 0; id < WRITERS * ENTRIES_PER_WRITER; ++id) {
+                        auto entry = hashTable.get(id);
+                        if (entry.has_value()) {
+                            EXPECT_EQ(entry.value()->id(), id);
+                        }
+                        if (id % 100 == 0) {
+                            // The bucket may split while the list is read; it keeps the entries it collected
+                            for (const Person *other : hashTable.getEntries(hashTable.hashKey(id))) {
+                                EXPECT_FALSE(other->name().empty());
+                            }
+                        }
+                    }
+                }
+            });
+        }
+        for (auto &thread : threads) {
+            thread.join();
+        }
+    }
+
+    auto reopened = PersonTable::open(TEST_DIR);
+    for (int id = 0; id < WRITERS * ENTRIES_PER_WRITER; ++id) {
+        const auto entry = reopened->get(id);
+        ASSERT_TRUE(entry.has_value()) << id;
+        EXPECT_EQ(entry.value()->name(), id % ENTRIES_PER_WRITER < ENTRIES_PER_WRITER / 2 ? "single" : "batch");
+    }
+}
+
+// Test: With a memory budget, cold buckets are unloaded and read again when used
+TEST_F(LinearHashingTest, MemoryBudgetUnloadsColdBuckets) {
+    Options options;
+    options.memoryBudgetBytes = 16 << 10;
+    options.lazyEntries = true;
+    PersonTable hashTable(TEST_DIR, 1024, 1, options);
+    for (int i = 0; i < 5000; ++i) {
+        hashTable.addEntry(createPerson(i, "person"));
+    }
+    for (int i = 0; i < 5000; ++i) {
+        ASSERT_TRUE(hashTable.get(i).has_value()) << i;
+    }
+    EXPECT_GT(hashTable.bucketCacheStats().unloads, 0);
+}
+
+// Test: A write-ahead log is refused
+TEST_F(LinearHashingTest, RejectsWriteAheadLog) {
+    Options options;
+    options.writeAheadLog = true;
+    EXPECT_THROW(PersonTable(TEST_DIR, 1024, 1, options), std::runtime_error);
+}
+
+} // namespace ehash
@@ -0,0 +1,131 @@
+#include "ehash/PageCodec.hpp"
+#include "ehash/PageStore.hpp"
+#include "gtest/gtest.h"
+#include <cstring>
+#include <filesystem>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace ehash {
+
+// Temporary test directory for compressed pages
+const std::string CODEC_TEST_DIR = "test_codec_pages";
+const size_t CODEC_PAGE_SIZE = 4096;
+
+// Compress data and check that it decompresses to the same bytes; returns the compressed size
+size_t roundTrip(const std::string &data) {
+    std::vector<char> compressed(data.size() * 2 + 16);
+    size_t size = lzCompress(data.data(), data.size(), compressed.data(), compressed.size());
+    EXPECT_GT(size, 0);
+    std::string decompressed(data.size(), '\0');
+    EXPECT_TRUE(lzDecompress(compressed.data(), size, decompressed.data(), decompressed.size()));
+    EXPECT_EQ(decompressed, data);
+    return size;
+}
+
+// Test: Data of every shape survives compression, and repetitive data shrinks
+TEST(PageCodecTest, CompressRoundTrip) {
+    roundTrip("");
+    roundTrip("abc");
+    EXPECT_LT(roundTrip(std::string(4000, '\0')), 40);
+    EXPECT_LT(roundTrip(std::string(300, 'x') + std::string(300, 'y')), 40);
+
+    std::string records;
+    for (int i = 0; i < 100; ++i) {
+        records += "person" + std::to_string(i) + "@example.com;MOBILE;WORK;";
+    }
+    EXPECT_LT(roundTrip(records), records.size() / 2);
+
+    std::mt19937 random(42);
+    std::string noise(5000, '\0');
+    for (auto &byte : noise) {
+        byte = static_cast<char>(random());
+    }
+    roundTrip(noise);
+    roundTrip(noise.substr(0, 17) + std::string(1000, 'z') + noise);
+}
+
+// Test: Output that does not fit is refused, and damaged input is detected instead of overrunning the output
+TEST(PageCodecTest, RejectsShortOutputAndCorruptedInput) {
+    std::string data(1000, 'a');
+    std::vector<char> compressed(64);
+    size_t size = lzCompress(data.data(), data.size(), compressed.data(), compressed.size());
+    ASSERT_GT(size, 0);
+    EXPECT_EQ(lzCompress(data.data(), data.size(), compressed.data(), 2), 0);
+
+    std::string output(data.size(), '\0');
+    EXPECT_FALSE(lzDecompress(compressed.data(), size - 1, output.data(), output.size()));
+    EXPECT_FALSE(lzDecompress(compressed.data(), size, output.data(), output.size() - 1));
+    compressed[2] = 0x7f; // Offset past the start of the output
+    EXPECT_FALSE(lzDecompress(compressed.data(), size, output.data(), output.size()));
+}
+
+class CompressedPageStoreTest : public ::testing::Test {
+  protected:
+    void SetUp() override {
+        std::filesystem::remove_all(CODEC_TEST_DIR);
+        std::filesystem::create_directory(CODEC_TEST_DIR);
+        files = std::make_shared<BucketFileStore>(CODEC_TEST_DIR, CODEC_PAGE_SIZE);
+        store = std::make_unique<CompressedPageStore>(files);
+    }
+
+    void TearDown() override { std::filesystem::remove_all(CODEC_TEST_DIR); }
+
+    std::shared_ptr<BucketFileStore> files;
+    std::unique_ptr<CompressedPageStore> store;
+};
+
+// Test: A compressible page is stored as a short frame and reads back whole; one that does not shrink is stored
+// as it is
+TEST_F(CompressedPageStoreTest, StoresPagesCompressedWhenTheyShrink) {
+    std::vector<char> page(CODEC_PAGE_SIZE, 0);
+    std::memcpy(page.data() + 3000, "record", 6);
+    store->writePage(0, page.data());
+
+    std::mt19937 random(7);
+    std::vector<char> noise(CODEC_PAGE_SIZE);
+    for (size_t i = PAGE_PREFIX_SIZE; i < noise.size(); ++i) {
+        noise[i] = static_cast<char>(random());
+    }
+    store->writePage(1, noise.data());
+
+    const CompressionStats &stats = store->getStats();
+    EXPECT_EQ(stats.pagesWritten, 2);
+    EXPECT_EQ(stats.pagesCompressed, 1);
+    EXPECT_LT(stats.bytesStored, 2 * CODEC_PAGE_SIZE);
+    EXPECT_GT(stats.ratio(), 1.0);
+
+    std::vector<char> raw(CODEC_PAGE_SIZE);
+    files->readPage(0, raw.data());
+    EXPECT_NE(raw, page);
+
+    std::vector<char> data(CODEC_PAGE_SIZE);
+    store->readPage(0, data.data());
+    EXPECT_EQ(data, page);
+    store->readPage(1, data.data());
+    EXPECT_EQ(data, noise);
+    store->readPage(2, data.data()); // Never written
+    EXPECT_EQ(data, std::vector<char>(CODEC_PAGE_SIZE, 0));
+    EXPECT_EQ(store->getStats().pagesRead, 1);
+}
+
+// Test: Writing a range rewrites the whole page, and the reserved size field must stay clear
+TEST_F(CompressedPageStoreTest, WriteRangeAndReservedPrefix) {
+    std::vector<char> page(CODEC_PAGE_SIZE, 0);
+    store->writePage(0, page.data());
+    store->writeRange(0, 100, "abc", 3);
+
+    std::vector<char> data(CODEC_PAGE_SIZE);
+    store->readPage(0, data.data());
+    EXPECT_EQ(std::string(data.data() + 100, 3), "abc");
+    EXPECT_EQ(store->getStats().pagesWritten, 2);
+    EXPECT_FALSE(store->pagesStoredAsIs());
+    EXPECT_EQ(store->mapPage(0), nullptr);
+
+    page[PAGE_CHECKSUM_SIZE] = 1;
+    EXPECT_THROW(store->writePage(0, page.data()), std::runtime_error);
+}
+
+} // namespace ehash
@@ -0,0 +1,126 @@
+#include "ehash/SegmentFile.hpp"
+#include "gtest/gtest.h"
+#include <filesystem>
+#include <vector>
+
+namespace ehash {
+
+// Temporary segment file
+const std::string SEGMENT_TEST_FILE = "test_segment.seg";
+const size_t SEGMENT_PAGE_SIZE = 4096;
+
+class SegmentFileTest : public ::testing::Test {
+  protected:
+    void SetUp() override { std::filesystem::remove(SEGMENT_TEST_FILE); }
+
+    void TearDown() override { std::filesystem::remove(SEGMENT_TEST_FILE); }
+
+    std::vector<char> pageFilledWith(char value) { return std::vector<char>(SEGMENT_PAGE_SIZE, value); }
+};
+
+// Test: A new segment is preallocated and hands out pages after the header
+TEST_F(SegmentFileTest, AllocatesAfterHeader) {
+    SegmentFile segment(SEGMENT_TEST_FILE, SEGMENT_PAGE_SIZE, 8);
+
+    EXPECT_EQ(segment.capacity(), 9);
+    EXPECT_EQ(std::filesystem::file_size(SEGMENT_TEST_FILE), 9 * SEGMENT_PAGE_SIZE);
+
+    EXPECT_EQ(segment.allocatePage(), 1);
+    EXPECT_EQ(segment.allocatePage(), 2);
+    EXPECT_EQ(segment.pageCount(), 3);
+}
+
+// Test: Pages are written and read at their own offsets
+TEST_F(SegmentFileTest, ReadWritePages) {
+    SegmentFile segment(SEGMENT_TEST_FILE, SEGMENT_PAGE_SIZE, 4);
+    PageId first = segment.allocatePage();
+    PageId second = segment.allocatePage();
+
+    segment.writePage(first, pageFilledWith('a').data());
+    segment.writePage(second, pageFilledWith('b').data());
+
+    std::vector<char> data(SEGMENT_PAGE_SIZE);
+    segment.readPage(first, data.data());
+    EXPECT_EQ(data, pageFilledWith('a'));
+    segment.readPage(second, data.data());
+    EXPECT_EQ(data, pageFilledWith('b'));
+}
+
+// Test: The file grows when the preallocated pages run out
+TEST_F(SegmentFileTest, GrowsWhenFull) {
+    SegmentFile segment(SEGMENT_TEST_FILE, SEGMENT_PAGE_SIZE, 2);
+    for (int i = 0; i < 10; ++i) {
+        segment.allocatePage();
+    }
+
+    EXPECT_EQ(segment.pageCount(), 11);
+    EXPECT_GE(segment.capacity(), 11);
+    EXPECT_GE(std::filesystem::file_size(SEGMENT_TEST_FILE), 11 * SEGMENT_PAGE_SIZE);
+}
+
+// Test: Freed pages are reused in LIFO order and come back zeroed
+TEST_F(SegmentFileTest, FreeListReuse) {
+    SegmentFile segment(SEGMENT_TEST_FILE, SEGMENT_PAGE_SIZE, 4);
+    PageId first = segment.allocatePage();
+    PageId second = segment.allocatePage();
+    segment.writePage(first, pageFilledWith('x').data());
+
+    segment.freePage(first);
+    segment.freePage(second);
+
+    EXPECT_EQ(segment.allocatePage(), second);
+    EXPECT_EQ(segment.allocatePage(), first);
+    EXPECT_EQ(segment.pageCount(), 3);
+
+    std::vector<char> data(SEGMENT_PAGE_SIZE);
+    segment.readPage(first, data.data());
+    EXPECT_EQ(data, pageFilledWith(0));
+}
+
+// Test: The header and free list survive reopening the file
+TEST_F(SegmentFileTest, ReopenKeepsFreeList) {
+    PageId freed;
+    {
+        SegmentFile segment(SEGMENT_TEST_FILE, SEGMENT_PAGE_SIZE, 4);
+        segment.allocatePage();
+        freed = segment.allocatePage();
+        segment.allocatePage();
+        segment.freePage(freed);
+    }
+
+    SegmentFile segment(SEGMENT_TEST_FILE, SEGMENT_PAGE_SIZE, 4);
+    EXPECT_EQ(segment.pageCount(), 4);
+    EXPECT_EQ(segment.allocatePage(), freed);
+    EXPECT_EQ(segment.allocatePage(), 4);
+}
+
+// Test: Opening a segment with a different page size is rejected
+TEST_F(SegmentFileTest, RejectsPageSizeMismatch) {
+    { SegmentFile segment(SEGMENT_TEST_FILE, SEGMENT_PAGE_SIZE, 1); }
+
+    EXPECT_THROW(SegmentFile(SEGMENT_TEST_FILE, 2 * SEGMENT_PAGE_SIZE, 1), std::runtime_error);
+}
+
+// Test: Mapped pages show the data written through the file, also after the file grows
+TEST_F(SegmentFileTest, MappedPages) {
+    SegmentFile segment(SEGMENT_TEST_FILE, SEGMENT_PAGE_SIZE, 1);
+    PageId pageId = segment.allocatePage();
+    segment.writePage(pageId, pageFilledWith('m').data());
+
+    EXPECT_EQ(segment.mapPage(pageId), nullptr); // Mapping is off by default
+    segment.enableMapping(AccessPattern::Random);
+    EXPECT_EQ(segment.mapPage(0), nullptr); // The header is never handed out
+
+    const char *mapped = segment.mapPage(pageId);
+    ASSERT_NE(mapped, nullptr);
+    EXPECT_EQ(std::vector<char>(mapped, mapped + SEGMENT_PAGE_SIZE), pageFilledWith('m'));
+
+    PageId grown = segment.allocatePage();
+    segment.writePage(grown, pageFilledWith('g').data());
+    mapped = segment.mapPage(grown);
+    ASSERT_NE(mapped, nullptr);
+    EXPECT_EQ(mapped[0], 'g');
+    EXPECT_EQ(segment.mapPage(pageId)[0], 'm');
+}
+
+} // namespace ehash
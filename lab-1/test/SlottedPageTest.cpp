@@ -0,0 +1,200 @@
+#include "ehash/SlottedPage.hpp"
+#include "gtest/gtest.h"
+#include <cstring>
+#include <filesystem>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace ehash {
+
+// Temporary test directory for pages
+const std::string SLOTTED_TEST_DIR = "test_slotted_pages";
+const size_t SLOTTED_PAGE_SIZE = 4096;
+
+class SlottedPageTest : public ::testing::Test {
+  protected:
+    void SetUp() override {
+        std::filesystem::remove_all(SLOTTED_TEST_DIR);
+        std::filesystem::create_directory(SLOTTED_TEST_DIR);
+        pool = std::make_unique<BufferPool>(std::make_shared<BucketFileStore>(SLOTTED_TEST_DIR, SLOTTED_PAGE_SIZE),
+                                            4);
+    }
+
+    void TearDown() override {
+        pool.reset();
+        std::filesystem::remove_all(SLOTTED_TEST_DIR);
+    }
+
+    std::string record(const SlottedPageView &view, uint32_t slot) {
+        return std::string(view.recordData(slot), view.recordSize(slot));
+    }
+
+    std::unique_ptr<BufferPool> pool;
+};
+
+// Test: A zeroed page is an empty slotted page
+TEST_F(SlottedPageTest, ZeroPageIsEmpty) {
+    PageGuard page(*pool, 0);
+    SlottedPageView view(page.data(), SLOTTED_PAGE_SIZE);
+
+    EXPECT_EQ(view.slotCount(), 0);
+    EXPECT_EQ(view.freeSpace(), SLOTTED_PAGE_SIZE - SlottedPageView::HEADER_SIZE);
+}
+
+// Test: Records are stored in slots and read back
+TEST_F(SlottedPageTest, InsertAndRead) {
+    PageGuard page(*pool, 0);
+    SlottedPage slottedPage(page, SLOTTED_PAGE_SIZE);
+
+    uint32_t first = slottedPage.insert("alpha", 5);
+    uint32_t second = slottedPage.insert("beta", 4);
+
+    EXPECT_EQ(slottedPage.slotCount(), 2);
+    EXPECT_EQ(record(slottedPage, first), "alpha");
+    EXPECT_EQ(record(slottedPage, second), "beta");
+    EXPECT_EQ(slottedPage.freeSpace(), SLOTTED_PAGE_SIZE - SlottedPageView::HEADER_SIZE -
+                                           SlottedPageView::requiredSpace(5) - SlottedPageView::requiredSpace(4));
+}
+
+// Test: Updating a record of the same size writes back only that record
+TEST_F(SlottedPageTest, UpdateInPlaceWritesOnlyRecord) {
+    uint32_t slot;
+    {
+        PageGuard page(*pool, 0);
+        SlottedPage slottedPage(page, SLOTTED_PAGE_SIZE);
+        slottedPage.insert("first", 5);
+        slot = slottedPage.insert("second", 6);
+    }
+    pool->flush();
+    size_t bytesBefore = pool->getStats().bytesWritten;
+
+    {
+        PageGuard page(*pool, 0);
+        SlottedPage slottedPage(page, SLOTTED_PAGE_SIZE);
+        ASSERT_TRUE(slottedPage.update(slot, "SECOND", 6));
+        EXPECT_EQ(record(slottedPage, slot), "SECOND");
+    }
+    pool->flush();
+    EXPECT_EQ(pool->getStats().bytesWritten - bytesBefore, 6);
+}
+
+// Test: A record that grows moves to new space in the heap and keeps its slot
+TEST_F(SlottedPageTest, UpdateGrowsRecord) {
+    PageGuard page(*pool, 0);
+    SlottedPage slottedPage(page, SLOTTED_PAGE_SIZE);
+    uint32_t slot = slottedPage.insert("ab", 2);
+    uint32_t other = slottedPage.insert("other", 5);
+
+    ASSERT_TRUE(slottedPage.update(slot, "abcdefgh", 8));
+    EXPECT_EQ(record(slottedPage, slot), "abcdefgh");
+    EXPECT_EQ(record(slottedPage, other), "other");
+    EXPECT_EQ(slottedPage.slotCount(), 2);
+}
+
+// Test: An update that cannot fit leaves the page unchanged
+TEST_F(SlottedPageTest, UpdateTooLargeFails) {
+    PageGuard page(*pool, 0);
+    SlottedPage slottedPage(page, SLOTTED_PAGE_SIZE);
+    uint32_t slot = slottedPage.insert("small", 5);
+
+    std::string huge(SLOTTED_PAGE_SIZE, 'x');
+    EXPECT_FALSE(slottedPage.update(slot, huge.data(), huge.size()));
+    EXPECT_EQ(record(slottedPage, slot), "small");
+}
+
+// Test: Erased slots are reused and fragmented space is reclaimed by compaction
+TEST_F(SlottedPageTest, EraseAndCompact) {
+    PageGuard page(*pool, 0);
+    SlottedPage slottedPage(page, SLOTTED_PAGE_SIZE);
+
+    // Fill the page with 100-byte records
+    std::vector<uint32_t> slots;
+    std::string value(100, 'a');
+    while (slottedPage.canInsert(value.size())) {
+        slots.push_back(slottedPage.insert(value.data(), value.size()));
+    }
+
+    // Free two records in the middle; a 150-byte record only fits after compaction
+    slottedPage.erase(slots[3]);
+    slottedPage.erase(slots[5]);
+    std::string larger(150, 'b');
+    ASSERT_TRUE(slottedPage.canInsert(larger.size()));
+
+    uint32_t slot = slottedPage.insert(larger.data(), larger.size());
+    EXPECT_EQ(slot, slots[3]);
+    EXPECT_EQ(record(slottedPage, slot), larger);
+    EXPECT_EQ(record(slottedPage, slots[4]), value);
+    EXPECT_FALSE(slottedPage.isLive(slots[5]));
+}
+
+// Test: Empty records are live records, told apart from free slots, and survive compaction and erasure around them
+TEST_F(SlottedPageTest, EmptyRecordsStayLive) {
+    PageGuard page(*pool, 0);
+    SlottedPage slottedPage(page, SLOTTED_PAGE_SIZE);
+    uint32_t first = slottedPage.insert("", 0);
+    uint32_t second = slottedPage.insert("value", 5);
+    uint32_t third = slottedPage.insert("", 0);
+    EXPECT_TRUE(slottedPage.isLive(first));
+    EXPECT_TRUE(slottedPage.isLive(third));
+    EXPECT_EQ(slottedPage.recordSize(first), 0);
+
+    // Shrinking a record to nothing keeps it, and compaction moves empty records like any other
+    EXPECT_TRUE(slottedPage.update(second, "", 0));
+    std::string large(SLOTTED_PAGE_SIZE - SlottedPageView::HEADER_SIZE - 4 * SlottedPageView::SLOT_SIZE, 'x');
+    ASSERT_TRUE(slottedPage.canInsert(large.size()));
+    uint32_t fourth = slottedPage.insert(large.data(), large.size());
+    for (uint32_t slot : {first, second, third}) {
+        EXPECT_TRUE(slottedPage.isLive(slot)) << slot;
+        EXPECT_EQ(slottedPage.recordSize(slot), 0) << slot;
+    }
+    EXPECT_EQ(record(slottedPage, fourth), large);
+
+    slottedPage.erase(first);
+    EXPECT_FALSE(slottedPage.isLive(first));
+    EXPECT_TRUE(slottedPage.isLive(third));
+    slottedPage.erase(fourth);
+    slottedPage.erase(third);
+    slottedPage.erase(second);
+    EXPECT_EQ(slottedPage.slotCount(), 0);
+
+    std::vector<char> buffer(SLOTTED_PAGE_SIZE);
+    SlottedPageWriter writer(buffer.data(), SLOTTED_PAGE_SIZE);
+    ASSERT_TRUE(writer.append("", 0));
+    EXPECT_TRUE(writer.isLive(0));
+}
+
+// Test: Erasing the last record leaves an empty page
+TEST_F(SlottedPageTest, EraseLastRecord) {
+    PageGuard page(*pool, 0);
+    SlottedPage slottedPage(page, SLOTTED_PAGE_SIZE);
+    uint32_t slot = slottedPage.insert("only", 4);
+
+    slottedPage.erase(slot);
+    EXPECT_EQ(slottedPage.slotCount(), 0);
+    EXPECT_EQ(slottedPage.freeSpace(), SLOTTED_PAGE_SIZE - SlottedPageView::HEADER_SIZE);
+}
+
+// Test: A page built in a buffer reads back like one filled by inserts, and can be modified in place afterwards
+TEST_F(SlottedPageTest, WriterBuildsPage) {
+    std::vector<char> buffer(SLOTTED_PAGE_SIZE, 'x');
+    SlottedPageWriter writer(buffer.data(), SLOTTED_PAGE_SIZE);
+    std::string value(100, 'a');
+    size_t records = 0;
+    while (writer.append(value.data(), value.size())) {
+        records++;
+    }
+    EXPECT_EQ(records, (SLOTTED_PAGE_SIZE - SlottedPageView::HEADER_SIZE) / SlottedPageView::requiredSpace(100));
+    EXPECT_FALSE(writer.canInsert(value.size()));
+
+    PageGuard page(*pool, 0);
+    std::memcpy(page.mutableData(), buffer.data(), SLOTTED_PAGE_SIZE);
+    SlottedPage slottedPage(page, SLOTTED_PAGE_SIZE);
+    EXPECT_EQ(record(slottedPage, 0), value);
+    EXPECT_EQ(record(slottedPage, records - 1), value);
+    slottedPage.erase(0);
+    EXPECT_EQ(slottedPage.insert("beta", 4), 0);
+    EXPECT_EQ(record(slottedPage, 0), "beta");
+}
+
+} // namespace ehash
@@ -0,0 +1,62 @@
+#include "ehash/TableMetrics.hpp"
+#include "gtest/gtest.h"
+#include <numeric>
+#include <thread>
+#include <vector>
+
+namespace ehash {
+
+// Test: Latency quantiles come from power-of-two buckets
+TEST(TableMetricsTest, LatencyQuantiles) {
+    LatencyHistogram histogram;
+    EXPECT_EQ(histogram.quantileNanos(0.5), 0u);
+    EXPECT_DOUBLE_EQ(histogram.meanNanos(), 0.0);
+
+    histogram.counts[7] = 90;  // 64 to 127 ns
+    histogram.counts[12] = 10; // 2048 to 4095 ns
+    histogram.count = 100;
+    histogram.totalNanos = 100 * 500;
+    EXPECT_EQ(histogram.quantileNanos(0.0), 128u);
+    EXPECT_EQ(histogram.quantileNanos(0.5), 128u);
+    EXPECT_EQ(histogram.quantileNanos(0.9), 128u);
+    EXPECT_EQ(histogram.quantileNanos(0.99), 4096u);
+    EXPECT_EQ(histogram.quantileNanos(1.0), 4096u);
+    EXPECT_DOUBLE_EQ(histogram.meanNanos(), 500.0);
+}
+
+// Test: Counters and timers update from several threads without losing counts; untimed metrics time nothing
+TEST(TableMetricsTest, CountsFromSeveralThreads) {
+    constexpr int THREADS = 4;
+    constexpr int OPERATIONS = 1000;
+    TableMetrics metrics(true);
+    std::vector<std::thread> threads;
+    for (int t = 0; t < THREADS; ++t) {
+        threads.emplace_back([&metrics] {
+            for (int i = 0; i < OPERATIONS; ++i) {
+                TableMetrics::Timer timer(metrics, TableMetrics::Operation::Insert);
+                metrics.countSplit(i % 10 == 0);
+            }
+            metrics.countMerge(1);
+        });
+    }
+    for (auto &thread : threads) {
+        thread.join();
+    }
+
+    TableStats stats = metrics.stats();
+    EXPECT_EQ(stats.splits, THREADS * OPERATIONS);
+    EXPECT_EQ(stats.directoryDoublings, THREADS * OPERATIONS / 10);
+    EXPECT_EQ(stats.merges, THREADS);
+    EXPECT_EQ(stats.directoryHalvings, THREADS);
+    EXPECT_EQ(stats.insertLatency.count, THREADS * OPERATIONS);
+    EXPECT_EQ(std::accumulate(stats.insertLatency.counts.begin(), stats.insertLatency.counts.end(), uint64_t{0}),
+              THREADS * OPERATIONS);
+    EXPECT_GT(stats.insertLatency.totalNanos, 0u);
+    EXPECT_EQ(stats.lookupLatency.count, 0u);
+
+    TableMetrics untimed(false);
+    { TableMetrics::Timer timer(untimed, TableMetrics::Operation::Lookup); }
+    EXPECT_EQ(untimed.stats().lookupLatency.count, 0u);
+}
+
+} // namespace ehash
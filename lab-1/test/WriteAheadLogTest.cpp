@@ -0,0 +1,201 @@
+#include "ehash/CheckpointJournal.hpp"
+#include "ehash/WriteAheadLog.hpp"
+#include "gtest/gtest.h"
+#include <atomic>
+#include <fcntl.h>
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+namespace ehash {
+
+// Temporary test directory for the log
+const std::string LOG_TEST_DIR = "test_wal";
+const std::string LOG_PATH = LOG_TEST_DIR + "/wal.log";
+
+class WriteAheadLogTest : public ::testing::Test {
+  protected:
+    void SetUp() override {
+        std::filesystem::remove_all(LOG_TEST_DIR);
+        std::filesystem::create_directory(LOG_TEST_DIR);
+    }
+
+    void TearDown() override { std::filesystem::remove_all(LOG_TEST_DIR); }
+
+    // Payloads of every record in the log
+    std::vector<std::string> replayed() {
+        WriteAheadLog log(LOG_PATH, std::chrono::microseconds(0));
+        std::vector<std::string> payloads;
+        log.replay([&](WriteAheadLog::RecordType, const std::string &payload) { payloads.push_back(payload); });
+        return payloads;
+    }
+
+    // Point the descriptor this process holds for the log at a new open of it with the given flags,
+    // so that the log's next write fails or succeeds
+    static void reopenLogDescriptor(int flags) {
+        auto logPath = std::filesystem::canonical(LOG_PATH);
+        int replacement = ::open(LOG_PATH.c_str(), flags);
+        ASSERT_GE(replacement, 0);
+        int replaced = 0;
+        for (const auto &link : std::filesystem::directory_iterator("/proc/self/fd")) {
+            std::error_code error;
+            int fd = std::stoi(link.path().filename().string());
+            if (fd != replacement && std::filesystem::read_symlink(link.path(), error) == logPath) {
+                ASSERT_GE(::dup2(replacement, fd), 0);
+                replaced++;
+            }
+        }
+        ::close(replacement);
+        ASSERT_EQ(replaced, 1);
+    }
+};
+
+// Test: Committed records are replayed in order after reopening
+TEST_F(WriteAheadLogTest, CommittedRecordsAreReplayed) {
+    {
+        WriteAheadLog log(LOG_PATH, std::chrono::microseconds(0));
+        log.append(WriteAheadLog::RecordType::Put, "first");
+        log.append(WriteAheadLog::RecordType::Put, "second");
+        log.commit(log.append(WriteAheadLog::RecordType::Put, "third"));
+        log.append(WriteAheadLog::RecordType::Put, "never committed");
+    }
+
+    EXPECT_EQ(replayed(), (std::vector<std::string>{"first", "second", "third"}));
+}
+
+// Test: A torn record at the end of the log is cut off and the log stays usable
+TEST_F(WriteAheadLogTest, TornTailIsCutOff) {
+    {
+        WriteAheadLog log(LOG_PATH, std::chrono::microseconds(0));
+        log.commit(log.append(WriteAheadLog::RecordType::Put, "complete"));
+    }
+    size_t completeSize = std::filesystem::file_size(LOG_PATH);
+    {
+        std::ofstream logFile(LOG_PATH, std::ios::binary | std::ios::app);
+        logFile << "half a record";
+    }
+
+    EXPECT_EQ(replayed(), std::vector<std::string>{"complete"});
+    EXPECT_EQ(std::filesystem::file_size(LOG_PATH), completeSize);
+
+    {
+        WriteAheadLog log(LOG_PATH, std::chrono::microseconds(0));
+        log.replay([](WriteAheadLog::RecordType, const std::string &) {});
+        log.commit(log.append(WriteAheadLog::RecordType::Put, "after recovery"));
+    }
+    EXPECT_EQ(replayed(), (std::vector<std::string>{"complete", "after recovery"}));
+}
+
+// Test: A log without a version 2 file header is refused and left as it was
+TEST_F(WriteAheadLogTest, OldLogIsRefused) {
+    std::string oldLog(40, '\x01');
+    {
+        std::ofstream logFile(LOG_PATH, std::ios::binary);
+        logFile << oldLog;
+    }
+
+    EXPECT_THROW(WriteAheadLog(LOG_PATH, std::chrono::microseconds(0)), std::runtime_error);
+    EXPECT_EQ(std::filesystem::file_size(LOG_PATH), oldLog.size());
+}
+
+// Test: Concurrent committers share syncs
+TEST_F(WriteAheadLogTest, GroupCommitBatchesWriters) {
+    WriteAheadLog log(LOG_PATH, std::chrono::microseconds(200));
+
+    std::vector<std::thread> writers;
+    for (int thread = 0; thread < 8; ++thread) {
+        writers.emplace_back([&log, thread] {
+            for (int i = 0; i < 20; ++i) {
+                log.commit(log.append(WriteAheadLog::RecordType::Put, std::to_string(thread * 100 + i)));
+            }
+        });
+    }
+    for (auto &writer : writers) {
+        writer.join();
+    }
+
+    EXPECT_EQ(log.getStats().records, 160);
+    EXPECT_LT(log.getStats().syncs, 160);
+    EXPECT_EQ(replayed().size(), 160);
+}
+
+// Test: Resetting after a checkpoint empties the log
+TEST_F(WriteAheadLogTest, ResetEmptiesLog) {
+    WriteAheadLog log(LOG_PATH, std::chrono::microseconds(0));
+    log.commit(log.append(WriteAheadLog::RecordType::Put, "checkpointed"));
+    log.append(WriteAheadLog::RecordType::Put, "buffered");
+
+    log.reset();
+    EXPECT_EQ(log.size(), 0);
+    EXPECT_TRUE(replayed().empty());
+}
+
+// Test: After a failed write no committer returns success, even once writes work again, until a reset
+TEST_F(WriteAheadLogTest, FailedWriteFailsEveryLaterCommit) {
+    WriteAheadLog log(LOG_PATH, std::chrono::microseconds(200));
+    log.commit(log.append(WriteAheadLog::RecordType::Put, "durable"));
+
+    reopenLogDescriptor(O_RDONLY);
+    std::atomic<int> succeeded = 0;
+    std::atomic<int> failed = 0;
+    std::vector<std::thread> writers;
+    for (int thread = 0; thread < 8; ++thread) {
+        writers.emplace_back([&log, &succeeded, &failed, thread] {
+            try {
+                log.commit(log.append(WriteAheadLog::RecordType::Put, std::to_string(thread)));
+                succeeded++;
+            } catch (const std::runtime_error &) {
+                failed++;
+            }
+        });
+    }
+    for (auto &writer : writers) {
+        writer.join();
+    }
+    EXPECT_EQ(succeeded, 0);
+    EXPECT_EQ(failed, 8);
+
+    reopenLogDescriptor(O_RDWR | O_APPEND);
+    EXPECT_THROW(log.append(WriteAheadLog::RecordType::Put, "after the failure"), std::runtime_error);
+
+    log.reset();
+    log.commit(log.append(WriteAheadLog::RecordType::Put, "after the reset"));
+    EXPECT_EQ(replayed(), std::vector<std::string>{"after the reset"});
+}
+
+// Test: A checkpoint journal reads back as written, and a torn one is ignored
+TEST_F(WriteAheadLogTest, CheckpointJournalRoundTrip) {
+    std::string journalPath = checkpointJournalPath(LOG_TEST_DIR);
+    std::string page(64, 'p');
+    writeCheckpointJournal(journalPath, page.size(), {{7, page.data()}}, "directory");
+
+    auto journal = readCheckpointJournal(journalPath);
+    ASSERT_TRUE(journal.has_value());
+    ASSERT_EQ(journal->pages.size(), 1);
+    EXPECT_EQ(journal->pages[0].first, 7);
+    EXPECT_EQ(journal->pages[0].second, page);
+    EXPECT_EQ(journal->directory, "directory");
+
+    std::filesystem::resize_file(journalPath, std::filesystem::file_size(journalPath) - 1);
+    EXPECT_FALSE(readCheckpointJournal(journalPath).has_value());
+}
+
+// Test: A journal of another version is refused instead of being ignored as torn
+TEST_F(WriteAheadLogTest, OldCheckpointJournalIsRefused) {
+    std::string journalPath = checkpointJournalPath(LOG_TEST_DIR);
+    std::string page(64, 'p');
+    writeCheckpointJournal(journalPath, page.size(), {{7, page.data()}}, "directory");
+    {
+        std::fstream journalFile(journalPath, std::ios::binary | std::ios::in | std::ios::out);
+        uint32_t version = 1;
+        journalFile.seekp(4);
+        journalFile.write(reinterpret_cast<const char *>(&version), sizeof(version));
+    }
+
+    EXPECT_THROW(readCheckpointJournal(journalPath), std::runtime_error);
+}
+
+} // namespace ehash